@@ -74,6 +74,21 @@
    #define DBG_DUMP(_zone_, _x_)
 #endif
 
+   /* The following MACROs write a message with zero to three arguments */
+   /* to the binary log (see BTPS_LogMessage()).  The arguments are not */
+   /* evaluated if the log is left out (BTPS_LOG_BUFFER_SIZE is zero).  */
+#if BTPS_LOG_BUFFER_SIZE
+   #define BTPS_LOG0(_ID)                 BTPS_LogMessage((_ID), 0, 0, 0, 0)
+   #define BTPS_LOG1(_ID, _a)             BTPS_LogMessage((_ID), 1, (DWord_t)(_a), 0, 0)
+   #define BTPS_LOG2(_ID, _a, _b)         BTPS_LogMessage((_ID), 2, (DWord_t)(_a), (DWord_t)(_b), 0)
+   #define BTPS_LOG3(_ID, _a, _b, _c)     BTPS_LogMessage((_ID), 3, (DWord_t)(_a), (DWord_t)(_b), (DWord_t)(_c))
+#else
+   #define BTPS_LOG0(_ID)
+   #define BTPS_LOG1(_ID, _a)
+   #define BTPS_LOG2(_ID, _a, _b)
+   #define BTPS_LOG3(_ID, _a, _b, _c)
+#endif
+
    /* The following defines the maximum number of bytes that a debug    */
    /* message can be.  All debug strings are truncated to this value    */
    /* minus one to allow for a NULL terminator.                         */
@@ -90,6 +105,25 @@
    /* Handle.                                                           */
 typedef void *Mailbox_t;
 
+   /* The following type declaration represents the state of a          */
+   /* single-producer/single-consumer Queue of pointers (see            */
+   /* BTPS_InitializeQueue()).  The Queue is lock-free: Head is only    */
+   /* written by the producer and Tail only by the consumer (both are   */
+   /* free-running and the number of queued entries is Head - Tail), so */
+   /* one side may be an interrupt service routine, or another thread   */
+   /* on a host port (the port orders the indexes with release/acquire  */
+   /* atomics, see posix/BTPSKRNL.c).  The Queue (and its entries) is   */
+   /* provided by the caller so that it can be static.                  */
+typedef struct _tagBTPS_Queue_t
+{
+   volatile unsigned int   Head;
+   volatile unsigned int   Tail;
+   unsigned int            Mask;
+   void         *volatile *Entries;
+} BTPS_Queue_t;
+
+#define BTPS_QUEUE_SIZE                                  (sizeof(BTPS_Queue_t))
+
    /* The following MACRO is a utility MACRO that exists to calculate   */
    /* the offset position of a particular structure member from the     */
    /* start of the structure.  This MACRO accepts as the first          */
@@ -169,10 +203,6 @@ BTPSAPI_DECLARATION unsigned long BTPSAPI BTPS_GetTickCount(void);
    /*          ONCE (AND ONLY ONCE) to begin the Scheduler Executing    */
    /*          periodic Scheduled functions.                            */
 BTPSAPI_DECLARATION Boolean_t BTPSAPI BTPS_AddFunctionToScheduler(BTPS_SchedulerFunction_t SchedulerFunction, void *SchedulerParameter, unsigned int Period);
-static unsigned int           NumberScheduledFunctions; /* Variable which     */
-                                                /* holds the total number of  */
-                                                /* Functions that have been   */
-                                                /* added to the Scheduler.    */
 
 #ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
    typedef Boolean_t (BTPSAPI *PFN_BTPS_AddFunctionToScheduler_t)(BTPS_SchedulerFunction_t SchedulerFunction, void *SchedulerParameter, unsigned int Period);
@@ -216,6 +246,24 @@ BTPSAPI_DECLARATION void BTPSAPI BTPS_ProcessScheduler(void);
    typedef void (BTPSAPI *PFN_BTPS_ProcessScheduler_t)(void);
 #endif
 
+   /* The following function is provided to allow a mechanism to query  */
+   /* the time until the next Scheduled Function is due.  This function */
+   /* accepts as input a pointer to a buffer that will receive the time */
+   /* (in ticks of BTPS_GetTickCount(), 0 if a function is already      */
+   /* due).  This function returns TRUE if a function is due at a known */
+   /* time or FALSE if there is no such function (the caller may then   */
+   /* wait for an interrupt).  A platform idle function may sleep for   */
+   /* this time between calls to BTPS_ProcessScheduler().               */
+   /* * NOTE * A function with a period of zero runs on every pass and  */
+   /*          is polled for work that interrupts flag, so it does not  */
+   /*          set a time (unless it has not run yet in the current     */
+   /*          pass, in which case it is due now).                      */
+BTPSAPI_DECLARATION Boolean_t BTPSAPI BTPS_QueryScheduleTimeout(unsigned long *Timeout);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef Boolean_t (BTPSAPI *PFN_BTPS_QueryScheduleTimeout_t)(unsigned long *Timeout);
+#endif
+
    /* The following function is provided to allow a mechanism to        */
    /* actually allocate a Block of Memory (of at least the specified    */
    /* size).  This function accepts as input the size (in Bytes) of the */
@@ -240,6 +288,183 @@ BTPSAPI_DECLARATION void BTPSAPI BTPS_FreeMemory(void *MemoryPointer);
    typedef void (BTPSAPI *PFN_BTPS_FreeMemory_t)(void *MemoryPointer);
 #endif
 
+   /* The following structure represents the usage of a fixed-block     */
+   /* memory pool (see BTPS_QueryMemoryPoolUsage()).  MaxBlocksUsed is  */
+   /* the high-water mark of BlocksUsed, and HeapFallbacks counts the   */
+   /* requests for the pool that were allocated from the heap because   */
+   /* the pool was empty.                                               */
+typedef struct _tagBTPS_MemoryPoolUsage_t
+{
+   unsigned int BlockSize;
+   unsigned int NumberBlocks;
+   unsigned int BlocksUsed;
+   unsigned int MaxBlocksUsed;
+   unsigned int HeapFallbacks;
+} BTPS_MemoryPoolUsage_t;
+
+#define BTPS_MEMORY_POOL_USAGE_SIZE                      (sizeof(BTPS_MemoryPoolUsage_t))
+
+   /* The following function is responsible for the usage information   */
+   /* of a fixed-block memory pool.  This function accepts as input the */
+   /* index of the pool (the pools are ordered by increasing BlockSize) */
+   /* and a pointer to a buffer that will receive the usage.  This      */
+   /* function returns TRUE if the usage was returned or FALSE if there */
+   /* is no such pool.                                                  */
+BTPSAPI_DECLARATION Boolean_t BTPSAPI BTPS_QueryMemoryPoolUsage(unsigned int PoolIndex, BTPS_MemoryPoolUsage_t *Usage);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef Boolean_t (BTPSAPI *PFN_BTPS_QueryMemoryPoolUsage_t)(unsigned int PoolIndex, BTPS_MemoryPoolUsage_t *Usage);
+#endif
+
+   /* The following structure represents the memory statistics that are */
+   /* kept as memory is allocated and freed (see                        */
+   /* BTPS_QueryMemoryStatistics()).  The sizes are in bytes and include*/
+   /* the fragment headers (the fixed-block pools are used heap         */
+   /* memory).  MaxUsed is the high-water mark of Used.  The            */
+   /* FragmentationIndex is the percentage of the free memory that is   */
+   /* not in the largest free fragment (0 when all the free memory is   */
+   /* one fragment).  The counters count the calls to                   */
+   /* BTPS_AllocateMemory() that succeeded (Allocations) or failed      */
+   /* (Failures) and the calls to BTPS_FreeMemory() (Frees).            */
+typedef struct _tagBTPS_MemoryStatistics_t
+{
+   unsigned int  HeapSize;
+   unsigned int  Used;
+   unsigned int  MaxUsed;
+   unsigned int  Free;
+   unsigned int  MaxFree;
+   unsigned int  FragmentationIndex;
+   unsigned long Allocations;
+   unsigned long Frees;
+   unsigned long Failures;
+} BTPS_MemoryStatistics_t;
+
+#define BTPS_MEMORY_STATISTICS_SIZE                      (sizeof(BTPS_MemoryStatistics_t))
+
+   /* The following function is responsible for the memory statistics.  */
+   /* This function accepts as input a pointer to a buffer that will    */
+   /* receive the statistics.  Unlike BTPS_QueryMemoryUsage(), this     */
+   /* function does not walk the heap.  This function returns zero if   */
+   /* successful, or a negative value if there was an error.            */
+BTPSAPI_DECLARATION int BTPSAPI BTPS_QueryMemoryStatistics(BTPS_MemoryStatistics_t *Statistics);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef int (BTPSAPI *PFN_BTPS_QueryMemoryStatistics_t)(BTPS_MemoryStatistics_t *Statistics);
+#endif
+
+   /* The following structure represents an entry of the memory         */
+   /* allocation trace.  Tag is the trace tag that was set when the     */
+   /* operation took place (see BTPS_SetMemoryTraceTag()).  Size is the */
+   /* requested size in bytes (0 for a free).  Offset identifies the    */
+   /* memory (the offset in alignment units of the memory from the      */
+   /* start of the heap), so a free can be matched with its allocation. */
+typedef struct _tagBTPS_MemoryTraceEntry_t
+{
+   Byte_t Operation;
+   Byte_t Tag;
+   Word_t Size;
+   Word_t Offset;
+} BTPS_MemoryTraceEntry_t;
+
+#define BTPS_MEMORY_TRACE_ENTRY_SIZE                     (sizeof(BTPS_MemoryTraceEntry_t))
+
+   /* The following constants represent the values of the Operation     */
+   /* member of a memory allocation trace entry.                        */
+#define BTPS_MEMORY_TRACE_OPERATION_ALLOCATE             (0x01)
+#define BTPS_MEMORY_TRACE_OPERATION_FREE                 (0x02)
+#define BTPS_MEMORY_TRACE_OPERATION_POOL_ALLOCATE        (0x03)
+#define BTPS_MEMORY_TRACE_OPERATION_POOL_FREE            (0x04)
+#define BTPS_MEMORY_TRACE_OPERATION_FAILURE              (0x05)
+
+   /* The following function is provided to allow a mechanism to set    */
+   /* the tag of the memory allocation trace entries that follow.  This */
+   /* function accepts as input the new tag and returns the previous    */
+   /* tag (so a caller can restore it).  The tag is 0 after BTPS_Init().*/
+BTPSAPI_DECLARATION Byte_t BTPSAPI BTPS_SetMemoryTraceTag(Byte_t Tag);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef Byte_t (BTPSAPI *PFN_BTPS_SetMemoryTraceTag_t)(Byte_t Tag);
+#endif
+
+   /* The following function is provided to allow a mechanism to read   */
+   /* the memory allocation trace.  This function accepts as input the  */
+   /* maximum number of entries to read, a pointer to a buffer that     */
+   /* will receive the entries (oldest first) and a pointer to a        */
+   /* variable that will receive the number of entries that were lost   */
+   /* (overwritten before they were read) since the last read.  This    */
+   /* function returns the number of entries that were read.  The       */
+   /* entries that are read are removed from the trace.                 */
+   /* * NOTE * The trace is only present if BTPS_MEMORY_TRACE_SIZE is   */
+   /*          not zero, otherwise this function always returns zero.   */
+   /* * NOTE * Entries are added and read in a critical section, so     */
+   /*          this function may be called from an interrupt.           */
+BTPSAPI_DECLARATION unsigned int BTPSAPI BTPS_ReadMemoryTrace(unsigned int MaximumEntries, BTPS_MemoryTraceEntry_t *Entries, unsigned long *Lost);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef unsigned int (BTPSAPI *PFN_BTPS_ReadMemoryTrace_t)(unsigned int MaximumEntries, BTPS_MemoryTraceEntry_t *Entries, unsigned long *Lost);
+#endif
+
+   /* The following function is provided to allow a mechanism to write  */
+   /* the memory allocation trace to the debug output (see              */
+   /* BTPS_OutputMessage()).  Every entry is written as a line          */
+   /* "HT Operation Tag Size Offset" and lost entries as a line         */
+   /* "HL Lost".  The entries that are written are removed from the     */
+   /* trace.                                                            */
+BTPSAPI_DECLARATION void BTPSAPI BTPS_DumpMemoryTrace(void);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef void (BTPSAPI *PFN_BTPS_DumpMemoryTrace_t)(void);
+#endif
+
+   /* The following constants represent the format of an entry of the   */
+   /* binary log (as read by BTPS_ReadLog()), all values MSB first :    */
+   /*    Header (2 Bytes)     : Message ID << 2 | number of arguments   */
+   /*    Tick Count (4 Bytes) : BTPS_GetTickCount() when the message    */
+   /*                           was written                             */
+   /*    Arguments (4 Bytes each)                                       */
+#define BTPS_LOG_ENTRY_HEADER_SIZE                       (6)
+#define BTPS_LOG_ARGUMENT_SIZE                           (4)
+#define BTPS_LOG_MAXIMUM_ARGUMENTS                       (3)
+#define BTPS_LOG_MAXIMUM_MESSAGE_ID                      (0x3FFF)
+
+#define BTPS_LOG_ENTRY_SIZE(_x)                          (BTPS_LOG_ENTRY_HEADER_SIZE + ((_x) * BTPS_LOG_ARGUMENT_SIZE))
+
+   /* The following function is provided to allow a mechanism to write  */
+   /* a message to the binary log without formatting it.  This function */
+   /* accepts as input the Message ID (a compile-time constant of the   */
+   /* caller, at most BTPS_LOG_MAXIMUM_MESSAGE_ID, that the host maps to*/
+   /* a format string), the number of arguments (at most                */
+   /* BTPS_LOG_MAXIMUM_ARGUMENTS) and the arguments.  The message is    */
+   /* read with BTPS_ReadLog() and decoded on the host.  When the log is*/
+   /* full the oldest entries are overwritten.                          */
+   /* * NOTE * This function may be called from an interrupt service    */
+   /*          routine.  The BTPS_LOGx() MACROs should be used instead  */
+   /*          of calling this function directly.                       */
+   /* * NOTE * The log is only present if BTPS_LOG_BUFFER_SIZE is not   */
+   /*          zero, otherwise this function does nothing.              */
+BTPSAPI_DECLARATION void BTPSAPI BTPS_LogMessage(Word_t MessageID, unsigned int NumberArguments, DWord_t Argument1, DWord_t Argument2, DWord_t Argument3);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef void (BTPSAPI *PFN_BTPS_LogMessage_t)(Word_t MessageID, unsigned int NumberArguments, DWord_t Argument1, DWord_t Argument2, DWord_t Argument3);
+#endif
+
+   /* The following function is provided to allow a mechanism to read   */
+   /* the binary log.  This function accepts as input the size of a     */
+   /* buffer, a pointer to the buffer that will receive the entries     */
+   /* (whole entries only, oldest first, see BTPS_LOG_ENTRY_SIZE()) and */
+   /* a pointer to a variable that will receive the number of entries   */
+   /* that were lost (overwritten before they were read) since the last */
+   /* read.  This function returns the number of bytes that were read.  */
+   /* The entries that are read are removed from the log.               */
+   /* * NOTE * This function may be called from an interrupt service    */
+   /*          routine (so that the log can be drained as the data is   */
+   /*          sent).                                                   */
+BTPSAPI_DECLARATION unsigned int BTPSAPI BTPS_ReadLog(unsigned int BufferSize, Byte_t *Buffer, unsigned long *Lost);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef unsigned int (BTPSAPI *PFN_BTPS_ReadLog_t)(unsigned int BufferSize, Byte_t *Buffer, unsigned long *Lost);
+#endif
+
    /* The following function is responsible for copying a block of      */
    /* memory of the specified size from the specified source pointer    */
    /* to the specified destination memory pointer.  This function       */
@@ -443,6 +668,88 @@ BTPSAPI_DECLARATION void BTPSAPI BTPS_DeleteMailbox(Mailbox_t Mailbox, BTPS_Mail
    typedef void (BTPSAPI *PFN_BTPS_DeleteMailbox_t)(Mailbox_t Mailbox, BTPS_MailboxDeleteCallback_t MailboxDeleteCallback);
 #endif
 
+   /* The following function is provided to allow a means to pass a     */
+   /* buffer to a Mailbox by pointer (where it can be retrieved via the */
+   /* BTPS_WaitMailboxPointer() function).  This function accepts as    */
+   /* input the Mailbox Handle of the Mailbox and a pointer to the      */
+   /* buffer (which CANNOT be NULL).  Only the pointer is placed into   */
+   /* the Mailbox, so the Mailbox must have been created with a         */
+   /* SlotSize of sizeof(void *).  This function returns TRUE if the    */
+   /* pointer was added, or FALSE if the Mailbox is full or invalid.    */
+   /* * NOTE * Ownership of the buffer passes to the Mailbox when this  */
+   /*          function returns TRUE.  The buffer is normally allocated */
+   /*          with BTPS_AllocateMemory() (so that it is taken from a   */
+   /*          fixed-block pool when one fits) and freed by the         */
+   /*          receiver with BTPS_FreeMemory().                         */
+   /* * NOTE * The BTPS_DeleteMailbox() callback is passed the address  */
+   /*          of the Slot, i.e. a pointer to the buffer pointer.       */
+BTPSAPI_DECLARATION Boolean_t BTPSAPI BTPS_AddMailboxPointer(Mailbox_t Mailbox, void *Buffer);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef Boolean_t (BTPSAPI *PFN_BTPS_AddMailboxPointer_t)(Mailbox_t Mailbox, void *Buffer);
+#endif
+
+   /* The following function is provided to allow a means to retrieve   */
+   /* a buffer that was passed to a Mailbox by the                      */
+   /* BTPS_AddMailboxPointer() function.  This function accepts as its  */
+   /* first parameter the Mailbox Handle and as its second parameter a  */
+   /* pointer to a variable that will receive the pointer to the        */
+   /* buffer.  This function returns TRUE if a buffer was retrieved     */
+   /* (ownership passes to the caller), or FALSE if the Mailbox is      */
+   /* empty or invalid.                                                 */
+BTPSAPI_DECLARATION Boolean_t BTPSAPI BTPS_WaitMailboxPointer(Mailbox_t Mailbox, void **Buffer);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef Boolean_t (BTPSAPI *PFN_BTPS_WaitMailboxPointer_t)(Mailbox_t Mailbox, void **Buffer);
+#endif
+
+   /* The following function is provided to allow a mechanism to        */
+   /* initialize a single-producer/single-consumer Queue of pointers.   */
+   /* This function accepts as input a pointer to the Queue, the number */
+   /* of entries (a power of two, no more than 32768) and a pointer to  */
+   /* the array that will hold the entries.  This function returns TRUE */
+   /* if the Queue was initialized, or FALSE if a parameter is invalid. */
+   /* * NOTE * Exactly one context may add to the Queue and exactly one */
+   /*          context may remove from it.  Either may be an interrupt  */
+   /*          service routine, no other serialization is needed.       */
+BTPSAPI_DECLARATION Boolean_t BTPSAPI BTPS_InitializeQueue(BTPS_Queue_t *Queue, unsigned int NumberEntries, void **Entries);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef Boolean_t (BTPSAPI *PFN_BTPS_InitializeQueue_t)(BTPS_Queue_t *Queue, unsigned int NumberEntries, void **Entries);
+#endif
+
+   /* The following function is provided to allow the producer to add a */
+   /* pointer to a Queue.  This function accepts as input a pointer to  */
+   /* the Queue and the pointer to add.  This function returns TRUE if  */
+   /* the pointer was added, or FALSE if the Queue is full.             */
+BTPSAPI_DECLARATION Boolean_t BTPSAPI BTPS_AddQueue(BTPS_Queue_t *Queue, void *Entry);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef Boolean_t (BTPSAPI *PFN_BTPS_AddQueue_t)(BTPS_Queue_t *Queue, void *Entry);
+#endif
+
+   /* The following function is provided to allow the consumer to remove*/
+   /* the oldest pointer from a Queue.  This function accepts as input a*/
+   /* pointer to the Queue and a pointer to a variable that will receive*/
+   /* the pointer.  This function returns TRUE if a pointer was removed,*/
+   /* or FALSE if the Queue is empty.                                   */
+BTPSAPI_DECLARATION Boolean_t BTPSAPI BTPS_RemoveQueue(BTPS_Queue_t *Queue, void **Entry);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef Boolean_t (BTPSAPI *PFN_BTPS_RemoveQueue_t)(BTPS_Queue_t *Queue, void **Entry);
+#endif
+
+   /* The following function is a utility function that exists to       */
+   /* determine the number of pointers queued in the specified Queue.   */
+   /* The value may be stale by the time it is used if the other side   */
+   /* is running in an interrupt: the producer can only see it too high */
+   /* and the consumer can only see it too low.                         */
+BTPSAPI_DECLARATION unsigned int BTPSAPI BTPS_QueryQueue(BTPS_Queue_t *Queue);
+
+#ifdef INCLUDE_BLUETOOTH_API_PROTOTYPES
+   typedef unsigned int (BTPSAPI *PFN_BTPS_QueryQueue_t)(BTPS_Queue_t *Queue);
+#endif
+
    /* The following function is used to initialize the Platform module. */
    /* The Platform module relies on some static variables that are used */
    /* to coordinate the abstraction.  When the module is initially      */
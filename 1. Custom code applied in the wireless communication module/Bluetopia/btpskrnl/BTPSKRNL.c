@@ -18,8 +18,35 @@
 #include <string.h>
 #include <stdarg.h>
 #include "BTPSKRNL.h"             /* BTPS Kernel Prototypes/Constants.        */
+
+   /* A port of the kernel to another platform (see posix/BTPSKRNL.c)   */
+   /* defines BTPS_KERNEL_PORT, supplies MSP430_TICK_RATE_MS, the       */
+   /* critical section MACROs, InterruptState_t and the Queue index     */
+   /* MACROs itself and includes this module.                           */
+#ifndef BTPS_KERNEL_PORT
+
 #include "HRDWCFG.h"              /* SS1 MSP430 Hardware Configuration Consts.*/
 
+   /* The following MACROs protect the data that is shared with the     */
+   /* interrupt service routines (the binary log and the memory         */
+   /* allocation trace), restoring the interrupt state of the caller on */
+   /* exit.                                                             */
+#define ENTER_CRITICAL_SECTION(_State)                 { (_State) = __get_interrupt_state(); __disable_interrupt(); }
+
+#define EXIT_CRITICAL_SECTION(_State)                  __set_interrupt_state(_State)
+
+typedef __istate_t InterruptState_t;
+
+   /* The following MACROs read and write the Head and Tail of a Queue  */
+   /* (see BTPS_AddQueue()).  The MSP430 has one core and the other     */
+   /* side of a Queue is an interrupt service routine, so the volatile  */
+   /* accesses are enough to keep the entry and the index in order.     */
+#define QUEUE_LOAD_ACQUIRE(_x)                         (_x)
+
+#define QUEUE_STORE_RELEASE(_x, _y)                    ((_x) = (_y))
+
+#endif
+
    /* The following constant represents the number of bytes that are    */
    /* displayed on an individual line when using the DumpData()         */
    /* function.                                                         */
@@ -33,14 +60,32 @@
    /* The following MACRO maps System Ticks to Milliseconds.            */
 #define TICKS_TO_MILLISECONDS(_x)                      ((_x) *  (MSP430_TICK_RATE_MS))
 
+   /* The following MACROs are used by the memory functions to determine*/
+   /* if a pointer is word aligned and if two pointers have the same    */
+   /* word alignment (so that a block between them can be transferred a */
+   /* word at a time once a leading odd byte is handled).  The MSP430   */
+   /* cannot access a word at an odd address.                           */
+#define WORD_ALIGNED(_x)                               (!(((unsigned long)(_x)) & (sizeof(Word_t) - 1)))
+#define SAME_WORD_ALIGNMENT(_x, _y)                    (!((((unsigned long)(_x)) ^ ((unsigned long)(_y))) & (sizeof(Word_t) - 1)))
+
+   /* The following constant represents the smallest block (in bytes)   */
+   /* that the memory functions transfer a word at a time.  Smaller     */
+   /* blocks are not worth the alignment checks.                        */
+#define MINIMUM_WORD_TRANSFER_SIZE                     (8)
+
    /* The following type declaration represents an individual Scheduler */
    /* Function Entry.  This Entry contains all information needed to    */
    /* Schedule and Execute a Function that has been added to the        */
-   /* Scheduler.                                                        */
+   /* Scheduler.  The entries are kept as a binary min-heap ordered by  */
+   /* ScheduleDeadline (Tick Count the function is due at), so the next */
+   /* function to run is always the first entry.  Entries that are due  */
+   /* at the same time are ordered by the scheduler pass they last ran  */
+   /* in, which keeps a function from running twice in one pass.        */
 typedef struct _tagSchedulerInformation_t
 {
-   unsigned long             ScheduleCount;
+   unsigned long             ScheduleDeadline;
    unsigned long             ScheduleExpireCount;
+   unsigned int              SchedulePass;
    BTPS_SchedulerFunction_t  ScheduleFunction;
    void                     *ScheduleParameter;
 } SchedulerInformation_t;
@@ -59,8 +104,17 @@ typedef struct _tagMailboxHeader_t
 } MailboxHeader_t;
 
    /* The following defines a type that is the size in bytes of the     */
-   /* desired alignment of each datra fragment.                         */
-typedef unsigned int Alignment_t;
+   /* desired alignment of each datra fragment.  A port whose pointers  */
+   /* are wider than an unsigned int defines BTPS_ALIGNMENT_TYPE, so    */
+   /* that the fragments (and the pool and Mailbox storage taken from   */
+   /* them) are aligned for the pointers that are stored in them.       */
+#ifndef BTPS_ALIGNMENT_TYPE
+
+   #define BTPS_ALIGNMENT_TYPE  unsigned int
+
+#endif
+
+typedef BTPS_ALIGNMENT_TYPE Alignment_t;
 
    /* The following defines the byte boundary size that has been        */
    /* specified size if the alignment data.                             */
@@ -85,13 +139,38 @@ typedef struct _tagHeapInfo_t
 
 #define HEAP_INFO_DATA_SIZE(_x) ((BTPS_STRUCTURE_OFFSET(HeapInfo_t, Data) / ALIGNMENT_SIZE) + (_x))
 
+   /* The following defines the structure that describes a free memory  */
+   /* fragment.  The header is the same as for any fragment, it is      */
+   /* followed by the links (offsets in alignment units from the start  */
+   /* of the heap) to the next and previous fragments in the free list  */
+   /* of its size class.                                                */
+typedef struct _tagFreeInfo_t
+{
+   Word_t PrevSize;
+   Word_t Size;
+   Word_t NextFree;
+   Word_t PrevFree;
+} FreeInfo_t;
+
+   /* The following defines the size (in alignment units) of the free   */
+   /* fragment structure, which is the smallest fragment size.          */
+#define FREE_INFO_SIZE          ((sizeof(FreeInfo_t) + ALIGNMENT_SIZE - 1) / ALIGNMENT_SIZE)
+
+   /* The following defines the free list link that ends a list.        */
+#define FREE_LIST_END           (0xFFFF)
+
+   /* The following MACROs convert between a free list link and a       */
+   /* pointer to the free fragment.                                     */
+#define HEAP_FRAGMENT(_x)       ((FreeInfo_t *)(MemoryBuffer + (_x)))
+#define HEAP_OFFSET(_x)         ((Word_t)(((Alignment_t *)(_x)) - MemoryBuffer))
+
 #define SEGMENT_ALLOCATED_BITMASK (0x8000)
 #define SEGMENT_SIZE_BITMASK      (0x7FFF)
 
    /* The following defines the size in bytes of a data fragment that is*/
    /* considered a large value.  Allocations that are equal to and      */
    /* larger than this value will be allocated from the end of the      */
-   /* buffer.                                                           */
+   /* free fragment.                                                    */
 #define LARGE_SIZE              (256/ALIGNMENT_SIZE)
 
    /* The following defines the minimum size (in alignment units) of a  */
@@ -102,6 +181,22 @@ typedef struct _tagHeapInfo_t
    /* MINIMUM_MEMORY_SIZE.                                              */
 #define MINIMUM_MEMORY_SIZE     1
 
+   /* The following defines the minimum size (in alignment units) of a  */
+   /* fragment, header included, that is split off a larger fragment.   */
+   /* The fragment must also be able to hold the free list links.       */
+#define MINIMUM_FRAGMENT_SIZE   ((HEAP_INFO_DATA_SIZE(MINIMUM_MEMORY_SIZE) > FREE_INFO_SIZE)?HEAP_INFO_DATA_SIZE(MINIMUM_MEMORY_SIZE):FREE_INFO_SIZE)
+
+   /* The following define the size classes of the free lists (sizes in */
+   /* alignment units, header included).  Fragments smaller than        */
+   /* HEAP_CLASS_SMALL_LIMIT are kept in classes HEAP_CLASS_SMALL_STEP  */
+   /* units wide, the larger fragments in one class per power of two    */
+   /* (the last class holds all the larger sizes).  There must be no    */
+   /* more classes than bits in a Word_t (see HeapFreeMap).             */
+#define HEAP_CLASS_SMALL_STEP   4
+#define HEAP_CLASS_SMALL_LIMIT  32
+#define HEAP_CLASS_SMALL_NO     (HEAP_CLASS_SMALL_LIMIT / HEAP_CLASS_SMALL_STEP)
+#define HEAP_CLASS_NO           (HEAP_CLASS_SMALL_NO + 7)
+
    /* Declare a buffer to use for the Heap.  Note that we declare this  */
    /* as an unsigned long buffer so that we can force alignment to be   */
    /* correct.                                                          */
@@ -110,6 +205,83 @@ static Alignment_t MemoryBuffer[(BTPS_MEMORY_BUFFER_SIZE/ALIGNMENT_SIZE) + 1];
 static HeapInfo_t *HeapHead = NULL;
 static HeapInfo_t *HeapTail = NULL;
 
+static Word_t HeapFreeList[HEAP_CLASS_NO];      /* First free fragment of     */
+                                                /* every size class.          */
+
+static Word_t HeapFreeMap;                      /* Bit mask of the size       */
+                                                /* classes that have free     */
+                                                /* fragments.                 */
+
+   /* The following structure holds the state of a fixed-block memory   */
+   /* pool.  The free blocks are linked through their first bytes.      */
+typedef struct _tagMemoryPool_t
+{
+   unsigned int   BlockSize;
+   unsigned int   NumberBlocks;
+   unsigned int   BlocksUsed;
+   unsigned int   MaxBlocksUsed;
+   unsigned int   HeapFallbacks;
+   void          *FreeList;
+   unsigned char *PoolStart;
+   unsigned char *PoolEnd;
+} MemoryPool_t;
+
+static MemoryPool_t MemoryPool[BTPS_MAX_NUMBER_MEMORY_POOLS];
+                                                /* Fixed-block pools, ordered */
+                                                /* by increasing BlockSize.   */
+
+static unsigned int NumberMemoryPools;          /* Number of pools that were  */
+                                                /* created by BTPS_Init().    */
+
+static Word_t HeapFreeUnits;                    /* Free memory of the heap    */
+                                                /* (alignment units).         */
+
+static Word_t HeapMaxUsedUnits;                 /* High-water mark of the     */
+                                                /* used memory of the heap    */
+                                                /* (alignment units).         */
+
+static unsigned long MemoryAllocations;         /* Counters of the successful */
+static unsigned long MemoryFrees;               /* and failed allocations and */
+static unsigned long MemoryFailures;            /* of the frees.              */
+
+#if BTPS_MEMORY_TRACE_SIZE
+
+static BTPS_MemoryTraceEntry_t MemoryTrace[BTPS_MEMORY_TRACE_SIZE];
+                                                /* Memory allocation trace    */
+                                                /* (ring buffer).             */
+
+static unsigned int MemoryTraceHead;            /* Next entry to write.       */
+
+static unsigned int MemoryTraceCount;           /* Entries not read yet.      */
+
+static unsigned long MemoryTraceLost;           /* Entries overwritten before */
+                                                /* they were read.            */
+
+static Byte_t MemoryTraceTag;                   /* Tag of the next entries.   */
+
+   /* The following MACRO adds an entry to the memory allocation trace. */
+#define MEMORY_TRACE(_Operation, _Size, _Pointer) MemoryTraceAdd((_Operation), (_Size), (_Pointer))
+
+#else
+
+#define MEMORY_TRACE(_Operation, _Size, _Pointer)
+
+#endif
+
+#if BTPS_LOG_BUFFER_SIZE
+
+static Byte_t LogBuffer[BTPS_LOG_BUFFER_SIZE];  /* Binary log (ring buffer of */
+                                                /* whole entries).            */
+
+static unsigned int LogHead;                    /* Oldest entry (read next).  */
+
+static unsigned int LogCount;                   /* Bytes not read yet.        */
+
+static unsigned long LogLost;                   /* Entries overwritten before */
+                                                /* they were read.            */
+
+#endif
+
    /* Internal Variables to this Module (Remember that all variables    */
    /* declared static are initialized to 0 automatically by the compiler*/
    /* as part of standard C/C++).                                       */
@@ -118,7 +290,7 @@ static Boolean_t              SchedulerInitialized; /* Flag which flags       */
                                                 /* Scheduler has been         */
                                                 /* successfully Intitalized.  */
 
-//static unsigned int           NumberScheduledFunctions; /* Variable which     */
+static unsigned int           NumberScheduledFunctions; /* Variable which     */
                                                 /* holds the total number of  */
                                                 /* Functions that have been   */
                                                 /* added to the Scheduler.    */
@@ -126,7 +298,18 @@ static Boolean_t              SchedulerInitialized; /* Flag which flags       */
 static SchedulerInformation_t SchedulerInformation[MAX_NUMBER_SCHEDULE_FUNCTIONS];
                                                 /* Variable which holds ALL   */
                                                 /* Information regarding ALL  */
-                                                /* Scheduled Functions.       */
+                                                /* Scheduled Functions (min-  */
+                                                /* heap by deadline).         */
+
+static unsigned int           SchedulerPass;    /* Variable which holds the   */
+                                                /* number of the current pass */
+                                                /* through the scheduler.     */
+
+static unsigned long PreviousTickCount;         /* Variable which holds the   */
+                                                /* previous Tick Count that   */
+                                                /* was present through the    */
+                                                /* last pass through the      */
+                                                /* scheduler.                 */
 
 static unsigned long          DebugZoneMask = DEBUG_ZONES; /* Variable which  */
                                                 /* holds the current Debug    */
@@ -153,17 +336,29 @@ static BTPS_MessageOutputCallback_t MessageOutputCallback; /* Variable which  */
                                                 /* set via a call to the      */
                                                 /* BTPS_Init() function.      */
 
-static unsigned long PreviousTickCount;         /* Variable which holds the   */
-                                                /* previous Tick Count that   */
-                                                /* was present through the    */
-                                                /* last pass through the      */
-                                                /* scheduler.                 */
       /* Internal Function Prototypes.                                  */
 static Byte_t ConsoleWrite(char *Message, int Length);
 static void CalcTotals(unsigned int *Used, unsigned int *Free, unsigned int *MaxFree);
+static unsigned int HeapClass(Word_t Size);
+static void HeapListInsert(FreeInfo_t *FreeInfoPtr);
+static void HeapListRemove(FreeInfo_t *FreeInfoPtr);
+static Word_t HeapListFit(Word_t Offset, Word_t Size);
 static void  HeapInit(void);
 static void *_Malloc(unsigned long Size);
 static void _MemFree(void *MemoryPtr);
+static void PoolInit(unsigned int NumberPools, BTPS_MemoryPool_t *PoolConfig);
+static void *PoolAlloc(unsigned long Size);
+static Boolean_t PoolFree(void *MemoryPtr);
+static Word_t HeapLargestFree(void);
+
+#if BTPS_MEMORY_TRACE_SIZE
+
+static void MemoryTraceAdd(Byte_t Operation, unsigned long Size, void *MemoryPtr);
+
+#endif
+static Boolean_t ScheduleBefore(SchedulerInformation_t *First, SchedulerInformation_t *Second);
+static unsigned int ScheduleSiftUp(unsigned int Index);
+static void ScheduleSiftDown(unsigned int Index);
 
    /* The following function is used to send a string of characters to  */
    /* the Console or Output device.  The function takes as its first    */
@@ -248,11 +443,97 @@ static void CalcTotals(unsigned int *Used, unsigned int *Free, unsigned int *Max
    }
 }
 
+   /* The following function is a utility function that is used to      */
+   /* determine the size class (free list) of a fragment of the         */
+   /* specified size (in alignment units).                              */
+static unsigned int HeapClass(Word_t Size)
+{
+   unsigned int Class;
+
+   if(Size < HEAP_CLASS_SMALL_LIMIT)
+      Class = Size / HEAP_CLASS_SMALL_STEP;
+   else
+   {
+      /* One class per power of two above the small classes, the last   */
+      /* class holds all the remaining sizes.                           */
+      for(Class=HEAP_CLASS_SMALL_NO, Size /= (HEAP_CLASS_SMALL_LIMIT * 2); (Size) && (Class < (HEAP_CLASS_NO - 1)); Size >>= 1)
+         Class++;
+   }
+
+   return(Class);
+}
+
+   /* The following function is a utility function that is used to add  */
+   /* a free fragment to the head of the free list of its size class.   */
+static void HeapListInsert(FreeInfo_t *FreeInfoPtr)
+{
+   unsigned int Class;
+
+   Class = HeapClass(FreeInfoPtr->Size);
+
+   FreeInfoPtr->PrevFree = FREE_LIST_END;
+   FreeInfoPtr->NextFree = HeapFreeList[Class];
+
+   if(FreeInfoPtr->NextFree != FREE_LIST_END)
+      HEAP_FRAGMENT(FreeInfoPtr->NextFree)->PrevFree = HEAP_OFFSET(FreeInfoPtr);
+
+   HeapFreeList[Class]  = HEAP_OFFSET(FreeInfoPtr);
+   HeapFreeMap         |= (Word_t)(1U << Class);
+}
+
+   /* The following function is a utility function that is used to      */
+   /* remove a free fragment from the free list of its size class.      */
+   /* * NOTE * The Size of the fragment must not have been changed since*/
+   /*          it was added to the list.                                */
+static void HeapListRemove(FreeInfo_t *FreeInfoPtr)
+{
+   unsigned int Class;
+
+   if(FreeInfoPtr->PrevFree != FREE_LIST_END)
+      HEAP_FRAGMENT(FreeInfoPtr->PrevFree)->NextFree = FreeInfoPtr->NextFree;
+   else
+   {
+      /* The fragment is the head of its list.                          */
+      Class               = HeapClass(FreeInfoPtr->Size);
+      HeapFreeList[Class] = FreeInfoPtr->NextFree;
+
+      if(FreeInfoPtr->NextFree == FREE_LIST_END)
+         HeapFreeMap &= (Word_t)~(1U << Class);
+   }
+
+   if(FreeInfoPtr->NextFree != FREE_LIST_END)
+      HEAP_FRAGMENT(FreeInfoPtr->NextFree)->PrevFree = FreeInfoPtr->PrevFree;
+}
+
+   /* The following function is a utility function that is used to find */
+   /* the free fragment of a list that a request of the specified size  */
+   /* (in alignment units) is taken from.  The function takes as its    */
+   /* first parameter the first fragment of the list.  Of the fragments */
+   /* that are large enough, the one with the lowest address is         */
+   /* returned (the highest address for a request of LARGE_SIZE or      */
+   /* more), as the first-fit walk of the heap would find it, so that   */
+   /* the small fragments stay packed at the start of the heap and the  */
+   /* large ones at its end.  This function returns FREE_LIST_END if no */
+   /* fragment of the list is large enough.                             */
+static Word_t HeapListFit(Word_t Offset, Word_t Size)
+{
+   Word_t ret_val;
+
+   for(ret_val=FREE_LIST_END;Offset!=FREE_LIST_END;Offset=HEAP_FRAGMENT(Offset)->NextFree)
+   {
+      if((HEAP_FRAGMENT(Offset)->Size >= Size) && ((ret_val == FREE_LIST_END) || ((Size < LARGE_SIZE)?(Offset < ret_val):(Offset > ret_val))))
+         ret_val = Offset;
+   }
+
+   return(ret_val);
+}
+
    /* The following function is used to initialize the heap structure.  */
    /* The function takes no parameters and returns no status.           */
 static void HeapInit(void)
 {
-   DWord_t HeapSize;
+   DWord_t      HeapSize;
+   unsigned int Index;
 
    /* Verify that the heap info structure is properly aligned.          */
    if((BTPS_STRUCTURE_OFFSET(HeapInfo_t, Data) % ALIGNMENT_SIZE) == 0)
@@ -270,22 +551,42 @@ static void HeapInit(void)
          HeapHead->Size     = HeapSize;
 
          HeapTail           = (HeapInfo_t *)(MemoryBuffer + HeapSize);
+
+         /* Empty the free lists and add the whole heap as one free     */
+         /* fragment.                                                   */
+         for(Index=0;Index<HEAP_CLASS_NO;Index++)
+            HeapFreeList[Index] = FREE_LIST_END;
+
+         HeapFreeMap = 0;
+
+         HeapListInsert((FreeInfo_t *)HeapHead);
+
+         /* The whole heap is free.                                     */
+         HeapFreeUnits    = HeapSize;
+         HeapMaxUsedUnits = 0;
       }
    }
 }
 
    /* The following function is used to allocate a fragment of memory   */
    /* from a large buffer.  The function takes as its parameter the size*/
-   /* in bytes of the fragment to be allocated.  The function tries to  */
-   /* avoid fragmentation by obtaining memory requests larger than      */
-   /* LARGE_SIZE from the end of the buffer, while small fragments are  */
-   /* taken from the start of the buffer.                               */
+   /* in bytes of the fragment to be allocated.  The free fragments are */
+   /* kept in lists by size class, so only the class of the request is  */
+   /* searched and, if none of its fragments is large enough, the next  */
+   /* class that has any (all of them are large enough).  Within the    */
+   /* class the fragment is chosen by address (see HeapListFit()).      */
+   /* The function tries to avoid fragmentation by obtaining memory     */
+   /* requests larger than LARGE_SIZE from the end of the fragment,     */
+   /* while small requests are taken from the start of the fragment.    */
 static void *_Malloc(unsigned long Size)
 {
-   HeapInfo_t *HeapInfoPtr;
-   HeapInfo_t *TmpInfoPtr;
-   Word_t      TmpSize;
-   void       *ret_val;
+   HeapInfo_t   *HeapInfoPtr;
+   HeapInfo_t   *TmpInfoPtr;
+   Word_t        TmpSize;
+   Word_t        Offset;
+   Word_t        ClassMap;
+   unsigned int  Class;
+   void         *ret_val;
 
    /* Convert the requested memory allocation in bytes to alignment     */
    /* size.                                                             */
@@ -300,6 +601,11 @@ static void *_Malloc(unsigned long Size)
    /* Verify that the requested size is valid                           */
    if((Size >= HEAP_INFO_DATA_SIZE(1)) && (!(Size & SEGMENT_ALLOCATED_BITMASK)))
    {
+      /* A fragment must be able to hold the free list links once it is */
+      /* freed.                                                         */
+      if(Size < FREE_INFO_SIZE)
+         Size = FREE_INFO_SIZE;
+
       /* Verify that the heap has been initialized.                     */
       if(!HeapHead)
          HeapInit();
@@ -307,44 +613,38 @@ static void *_Malloc(unsigned long Size)
       /* Verify that the heap is valid.                                 */
       if(HeapHead)
       {
-         /* If we are allocating a large segment, then start at the end */
-         /* of the heap.  Otherwise, start at the beginning of the heap.*/
-         /* If there is only one segment in the heap, then HeapHead will*/
-         /* be used either way.                                         */
-         if(Size >= LARGE_SIZE)
-            HeapInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapTail) - HeapHead->PrevSize);
-         else
-            HeapInfoPtr = HeapHead;
+         /* Search the class of the request.                            */
+         Class  = HeapClass((Word_t)Size);
+         Offset = HeapListFit(HeapFreeList[Class], (Word_t)Size);
 
-         /* Loop until we have walked the entire list.                  */
-         while(((Size < LARGE_SIZE) || (HeapInfoPtr != HeapHead)) && (HeapInfoPtr != HeapTail))
+         if(Offset == FREE_LIST_END)
          {
-            /* Check to see if the current entry is free and is large   */
-            /* enough to hold the data being requested.                 */
-            if((HeapInfoPtr->Size & SEGMENT_ALLOCATED_BITMASK) || (HeapInfoPtr->Size < Size))
+            /* Any fragment of a larger class is large enough, so search*/
+            /* the next class that has any.                             */
+            ClassMap = HeapFreeMap & (Word_t)~((2U << Class) - 1);
+            if(ClassMap)
             {
-               /* If the requested size is larger than the limit then   */
-               /* search backwards for an available buffer, else go     */
-               /* forward.  This will hopefully help to reduce          */
-               /* fragmentataion problems.                              */
-               if(Size >= LARGE_SIZE)
-                  HeapInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) - (HeapInfoPtr->PrevSize));
-               else
-                  HeapInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) + (HeapInfoPtr->Size & SEGMENT_SIZE_BITMASK));
+               for(Class++;!(ClassMap & (1U << Class));Class++)
+                  ;
+
+               Offset = HeapListFit(HeapFreeList[Class], (Word_t)Size);
             }
-            else
-               break;
          }
 
          /* Check to see if we found a segment large enough for the     */
          /* request.                                                    */
-         if((HeapInfoPtr != HeapTail) && (!(HeapInfoPtr->Size & SEGMENT_ALLOCATED_BITMASK)) && (HeapInfoPtr->Size >= Size))
+         if(Offset != FREE_LIST_END)
          {
+            HeapInfoPtr = (HeapInfo_t *)HEAP_FRAGMENT(Offset);
+
+            /* The fragment is no longer free.                          */
+            HeapListRemove((FreeInfo_t *)HeapInfoPtr);
+
             /* Check to see if we need to split this into two entries.  */
             /* * NOTE * If there is not enough room to make another     */
             /*          entry then we will not adjust the size of this  */
             /*          entry to match the amount requested.            */
-            if(HeapInfoPtr->Size >= (Size + HEAP_INFO_DATA_SIZE(MINIMUM_MEMORY_SIZE)))
+            if(HeapInfoPtr->Size >= (Size + MINIMUM_FRAGMENT_SIZE))
             {
                /* Calculate the size for the free segment.              */
                TmpSize = HeapInfoPtr->Size - Size;
@@ -361,9 +661,12 @@ static void *_Malloc(unsigned long Size)
                   TmpInfoPtr->PrevSize = TmpSize;
                   TmpInfoPtr->Size     = Size | SEGMENT_ALLOCATED_BITMASK;
 
-                  /* Set the new size of the free segment.              */
+                  /* Set the new size of the free segment and return it */
+                  /* to the free lists.                                 */
                   HeapInfoPtr->Size = TmpSize;
 
+                  HeapListInsert((FreeInfo_t *)HeapInfoPtr);
+
                   /* Set the pointer to the beginning of the newly      */
                   /* allocated segment                                  */
                   HeapInfoPtr = TmpInfoPtr;
@@ -378,10 +681,12 @@ static void *_Malloc(unsigned long Size)
                   TmpInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) + Size);
 
                   /* Set the previous size and size values for the free */
-                  /* segment.                                           */
+                  /* segment and return it to the free lists.           */
                   TmpInfoPtr->PrevSize = Size;
                   TmpInfoPtr->Size     = TmpSize;
 
+                  HeapListInsert((FreeInfo_t *)TmpInfoPtr);
+
                   /* Set the new size of the allocated segment and      */
                   /* indicate that it is no longer free.                */
                   HeapInfoPtr->Size = Size | SEGMENT_ALLOCATED_BITMASK;
@@ -407,6 +712,13 @@ static void *_Malloc(unsigned long Size)
                HeapInfoPtr->Size |= SEGMENT_ALLOCATED_BITMASK;
             }
 
+            /* Update the free memory and the high-water mark of the    */
+            /* used memory.                                             */
+            HeapFreeUnits -= (HeapInfoPtr->Size & SEGMENT_SIZE_BITMASK);
+
+            if((Word_t)(((Alignment_t *)HeapTail) - ((Alignment_t *)HeapHead) - HeapFreeUnits) > HeapMaxUsedUnits)
+               HeapMaxUsedUnits = (Word_t)(((Alignment_t *)HeapTail) - ((Alignment_t *)HeapHead) - HeapFreeUnits);
+
             /* Get the address of the start of RAM.                     */
             ret_val = (void *)&HeapInfoPtr->Data;
          }
@@ -445,7 +757,8 @@ static void *_Malloc(unsigned long Size)
    /* fragment.  The function tries to a verify that the structure is a */
    /* valid fragment structure before the memory is freed.  When a      */
    /* fragment is freed, it may be combined with adjacent fragments to  */
-   /* produce a larger free fragment.                                   */
+   /* produce a larger free fragment, which is then added to the free   */
+   /* list of its size class.                                           */
 static void _MemFree(void *MemoryPtr)
 {
    HeapInfo_t *HeapInfoPtr;
@@ -464,6 +777,8 @@ static void _MemFree(void *MemoryPtr)
          /* This will make calculations in this block easier.           */
          HeapInfoPtr->Size &= SEGMENT_SIZE_BITMASK;
 
+         HeapFreeUnits     += HeapInfoPtr->Size;
+
          /* If the segment to be freed is at the head of the heap, then */
          /* we do not have to merge or update any sizes of the previous */
          /* segment.  This will also handle the case where the entire   */
@@ -476,6 +791,10 @@ static void _MemFree(void *MemoryPtr)
             /* Check to see if the previous segment can be combined.    */
             if(!(TmpInfoPtr->Size & SEGMENT_ALLOCATED_BITMASK))
             {
+               /* Take the previous segment out of its free list, its   */
+               /* size class changes.                                   */
+               HeapListRemove((FreeInfo_t *)TmpInfoPtr);
+
                /* Add the segment to be freed to the new header.        */
                TmpInfoPtr->Size += HeapInfoPtr->Size;
 
@@ -506,8 +825,10 @@ static void _MemFree(void *MemoryPtr)
             }
             else
             {
-               /* The next segment is free, so merge it with the current*/
-               /* segment.                                              */
+               /* The next segment is free, so take it out of its free  */
+               /* list and merge it with the current segment.           */
+               HeapListRemove((FreeInfo_t *)TmpInfoPtr);
+
                HeapInfoPtr->Size += TmpInfoPtr->Size;
 
                /* Since we merged the next segment, we have to update   */
@@ -526,6 +847,9 @@ static void _MemFree(void *MemoryPtr)
                }
             }
          }
+
+         /* Add the (combined) free segment to its free list.           */
+         HeapListInsert((FreeInfo_t *)HeapInfoPtr);
       }
       else
       {
@@ -538,18 +862,520 @@ static void _MemFree(void *MemoryPtr)
    }
 }
 
-   /* The following function is responsible for the Memory Usage        */
-   /* Information.  This function accepts as input the Memory Pool Usage*/
-   /* Length and a pointer to an Buffer of Memory Pool Usage structures.*/
-   /* The third parameter to this function is a pointer to a unsigned   */
-   /* int which will passed the Total Buffer Size.  The fourth parameter*/
-   /* to this function is a pointer to a unsigned int which will be     */
-   /* passed the Memory Buffer Usage.                                   */
-int BTPSAPI BTPS_QueryMemoryUsage(unsigned int *Used, unsigned int *Free, unsigned int *MaxFree)
+   /* The following function is used to create the fixed-block memory   */
+   /* pools.  The function takes as its parameters the number of pools  */
+   /* and a pointer to the pool configurations.  The memory of every    */
+   /* pool is allocated from the heap, and its blocks are linked into   */
+   /* the free list of the pool.  A pool that cannot be allocated is    */
+   /* skipped (its requests are served by the heap).                    */
+static void PoolInit(unsigned int NumberPools, BTPS_MemoryPool_t *PoolConfig)
+{
+   unsigned int   Index;
+   unsigned int   Block;
+   unsigned int   BlockSize;
+   unsigned char *BlockPtr;
+   MemoryPool_t   Pool;
+
+   NumberMemoryPools = 0;
+
+   for(Index=0;(PoolConfig) && (Index<NumberPools) && (NumberMemoryPools<BTPS_MAX_NUMBER_MEMORY_POOLS);Index++)
+   {
+      /* The blocks are aligned, and a free block must be able to hold  */
+      /* the free list link.                                            */
+      BlockSize = PoolConfig[Index].BlockSize;
+      if(BlockSize < sizeof(void *))
+         BlockSize = sizeof(void *);
+
+      if(BlockSize % ALIGNMENT_SIZE)
+         BlockSize += ALIGNMENT_SIZE - (BlockSize % ALIGNMENT_SIZE);
+
+      if((PoolConfig[Index].NumberBlocks) && ((BlockPtr = (unsigned char *)_Malloc((unsigned long)BlockSize * PoolConfig[Index].NumberBlocks)) != NULL))
+      {
+         MEMORY_TRACE(BTPS_MEMORY_TRACE_OPERATION_ALLOCATE, (unsigned long)BlockSize * PoolConfig[Index].NumberBlocks, BlockPtr);
+
+         BTPS_MemInitialize(&Pool, 0, sizeof(Pool));
+
+         Pool.BlockSize    = BlockSize;
+         Pool.NumberBlocks = PoolConfig[Index].NumberBlocks;
+         Pool.PoolStart    = BlockPtr;
+         Pool.PoolEnd      = BlockPtr + ((unsigned long)BlockSize * Pool.NumberBlocks);
+
+         /* Link all the blocks into the free list.                     */
+         for(Block=0;Block<Pool.NumberBlocks;Block++,BlockPtr+=BlockSize)
+         {
+            *((void **)BlockPtr) = Pool.FreeList;
+            Pool.FreeList        = BlockPtr;
+         }
+
+         /* Insert the pool so that the pools stay ordered by           */
+         /* increasing BlockSize.                                       */
+         for(Block=NumberMemoryPools;(Block) && (MemoryPool[Block - 1].BlockSize > BlockSize);Block--)
+            MemoryPool[Block] = MemoryPool[Block - 1];
+
+         MemoryPool[Block] = Pool;
+
+         NumberMemoryPools++;
+      }
+      else
+      {
+         DBG_MSG(DBG_ZONE_BTPSKRNL, ("POOL %u NOT CREATED.\r\n", Index));
+      }
+   }
+}
+
+   /* The following function is used to allocate a block from the       */
+   /* fixed-block memory pools.  The function takes as its parameter    */
+   /* the size in bytes of the memory to be allocated.  The block is    */
+   /* taken from the pool with the smallest BlockSize that holds the    */
+   /* request, if the request is more than three quarters of that       */
+   /* BlockSize (so that other objects do not use up the blocks).  The  */
+   /* function returns NULL if no pool is selected or the pool is       */
+   /* empty, in which case the memory is to be allocated from the heap. */
+static void *PoolAlloc(unsigned long Size)
+{
+   unsigned int  Index;
+   MemoryPool_t *PoolPtr;
+   void         *ret_val;
+
+   ret_val = NULL;
+
+   for(Index=0;Index<NumberMemoryPools;Index++)
+   {
+      PoolPtr = &MemoryPool[Index];
+
+      if(Size <= PoolPtr->BlockSize)
+      {
+         if(Size > (PoolPtr->BlockSize - (PoolPtr->BlockSize >> 2)))
+         {
+            if(PoolPtr->FreeList)
+            {
+               /* Take the first block of the free list.                */
+               ret_val           = PoolPtr->FreeList;
+               PoolPtr->FreeList = *((void **)ret_val);
+
+               if(++(PoolPtr->BlocksUsed) > PoolPtr->MaxBlocksUsed)
+                  PoolPtr->MaxBlocksUsed = PoolPtr->BlocksUsed;
+            }
+            else
+               PoolPtr->HeapFallbacks++;
+         }
+
+         break;
+      }
+   }
+
+   return(ret_val);
+}
+
+   /* The following function is used to free memory that may have been  */
+   /* allocated from a fixed-block memory pool.  The function takes as  */
+   /* its parameter a pointer to the memory.  This function returns     */
+   /* TRUE if the memory was a block of a pool (and was returned to it) */
+   /* or FALSE if it was not (and is to be freed to the heap).          */
+static Boolean_t PoolFree(void *MemoryPtr)
+{
+   unsigned int  Index;
+   MemoryPool_t *PoolPtr;
+   Boolean_t     ret_val;
+
+   ret_val = FALSE;
+
+   for(Index=0;Index<NumberMemoryPools;Index++)
+   {
+      PoolPtr = &MemoryPool[Index];
+
+      if((((unsigned char *)MemoryPtr) >= PoolPtr->PoolStart) && (((unsigned char *)MemoryPtr) < PoolPtr->PoolEnd))
+      {
+         /* Add the block to the head of the free list.                 */
+         *((void **)MemoryPtr) = PoolPtr->FreeList;
+         PoolPtr->FreeList     = MemoryPtr;
+
+         PoolPtr->BlocksUsed--;
+
+         ret_val = TRUE;
+         break;
+      }
+   }
+
+   return(ret_val);
+}
+
+   /* The following function is used to find the size (in alignment     */
+   /* units) of the largest free fragment of the heap.  The largest     */
+   /* fragment is in the highest size class that has free fragments,    */
+   /* so only that class is searched.                                   */
+static Word_t HeapLargestFree(void)
+{
+   Word_t       Offset;
+   Word_t       ret_val;
+   unsigned int Class;
+
+   ret_val = 0;
+
+   if(HeapFreeMap)
+   {
+      for(Class=HEAP_CLASS_NO-1;!(HeapFreeMap & (1U << Class));Class--)
+         ;
+
+      for(Offset=HeapFreeList[Class];Offset!=FREE_LIST_END;Offset=HEAP_FRAGMENT(Offset)->NextFree)
+      {
+         if(HEAP_FRAGMENT(Offset)->Size > ret_val)
+            ret_val = HEAP_FRAGMENT(Offset)->Size;
+      }
+   }
+
+   return(ret_val);
+}
+
+#if BTPS_MEMORY_TRACE_SIZE
+
+   /* The following function is used to add an entry to the memory      */
+   /* allocation trace.  The function takes as its parameters the       */
+   /* operation, the requested size in bytes (0 for a free) and a       */
+   /* pointer to the memory (NULL for a failure).  When the trace is    */
+   /* full, the oldest entry is overwritten (and counted as lost).      */
+static void MemoryTraceAdd(Byte_t Operation, unsigned long Size, void *MemoryPtr)
+{
+   BTPS_MemoryTraceEntry_t *EntryPtr;
+   InterruptState_t         State;
+
+   ENTER_CRITICAL_SECTION(State);
+
+   EntryPtr            = &MemoryTrace[MemoryTraceHead];
+   EntryPtr->Operation = Operation;
+   EntryPtr->Tag       = MemoryTraceTag;
+   EntryPtr->Size      = (Size > 0xFFFF)?0xFFFF:(Word_t)Size;
+   EntryPtr->Offset    = (MemoryPtr)?(Word_t)(((Alignment_t *)MemoryPtr) - MemoryBuffer):0;
+
+   if(++MemoryTraceHead == BTPS_MEMORY_TRACE_SIZE)
+      MemoryTraceHead = 0;
+
+   if(MemoryTraceCount < BTPS_MEMORY_TRACE_SIZE)
+      MemoryTraceCount++;
+   else
+      MemoryTraceLost++;
+
+   EXIT_CRITICAL_SECTION(State);
+}
+
+#endif
+
+   /* The following function is responsible for the Memory Usage        */
+   /* Information.  This function accepts as input the Memory Pool Usage*/
+   /* Length and a pointer to an Buffer of Memory Pool Usage structures.*/
+   /* The third parameter to this function is a pointer to a unsigned   */
+   /* int which will passed the Total Buffer Size.  The fourth parameter*/
+   /* to this function is a pointer to a unsigned int which will be     */
+   /* passed the Memory Buffer Usage.                                   */
+int BTPSAPI BTPS_QueryMemoryUsage(unsigned int *Used, unsigned int *Free, unsigned int *MaxFree)
+{
+   CalcTotals(Used, Free, MaxFree);
+
+   return(0);
+}
+
+   /* The following function is responsible for the memory statistics.  */
+   /* This function accepts as input a pointer to a buffer that will    */
+   /* receive the statistics.  Unlike BTPS_QueryMemoryUsage(), this     */
+   /* function does not walk the heap.  This function returns zero if   */
+   /* successful, or a negative value if there was an error.            */
+int BTPSAPI BTPS_QueryMemoryStatistics(BTPS_MemoryStatistics_t *Statistics)
+{
+   Word_t HeapSize;
+   int    ret_val;
+
+   /* Verify that the heap has been initialized.                        */
+   if(!HeapHead)
+      HeapInit();
+
+   if((Statistics) && (HeapHead))
+   {
+      HeapSize                       = (Word_t)(((Alignment_t *)HeapTail) - ((Alignment_t *)HeapHead));
+
+      Statistics->HeapSize           = HeapSize * ALIGNMENT_SIZE;
+      Statistics->Used               = (HeapSize - HeapFreeUnits) * ALIGNMENT_SIZE;
+      Statistics->MaxUsed            = HeapMaxUsedUnits * ALIGNMENT_SIZE;
+      Statistics->Free               = HeapFreeUnits * ALIGNMENT_SIZE;
+      Statistics->MaxFree            = HeapLargestFree() * ALIGNMENT_SIZE;
+      Statistics->FragmentationIndex = (HeapFreeUnits)?(unsigned int)(100 - (((DWord_t)(Statistics->MaxFree / ALIGNMENT_SIZE) * 100) / HeapFreeUnits)):0;
+      Statistics->Allocations        = MemoryAllocations;
+      Statistics->Frees              = MemoryFrees;
+      Statistics->Failures           = MemoryFailures;
+
+      ret_val                        = 0;
+   }
+   else
+      ret_val = -1;
+
+   return(ret_val);
+}
+
+   /* The following function is provided to allow a mechanism to set    */
+   /* the tag of the memory allocation trace entries that follow.  This */
+   /* function accepts as input the new tag and returns the previous    */
+   /* tag (so a caller can restore it).  The tag is 0 after BTPS_Init().*/
+Byte_t BTPSAPI BTPS_SetMemoryTraceTag(Byte_t Tag)
+{
+#if BTPS_MEMORY_TRACE_SIZE
+
+   Byte_t ret_val;
+
+   ret_val        = MemoryTraceTag;
+   MemoryTraceTag = Tag;
+
+   return(ret_val);
+
+#else
+
+   (void)Tag;
+
+   return(0);
+
+#endif
+}
+
+   /* The following function is provided to allow a mechanism to read   */
+   /* the memory allocation trace.  This function accepts as input the  */
+   /* maximum number of entries to read, a pointer to a buffer that     */
+   /* will receive the entries (oldest first) and a pointer to a        */
+   /* variable that will receive the number of entries that were lost   */
+   /* (overwritten before they were read) since the last read.  This    */
+   /* function returns the number of entries that were read.  The       */
+   /* entries that are read are removed from the trace.                 */
+unsigned int BTPSAPI BTPS_ReadMemoryTrace(unsigned int MaximumEntries, BTPS_MemoryTraceEntry_t *Entries, unsigned long *Lost)
+{
+   unsigned int ret_val;
+
+   ret_val = 0;
+
+#if BTPS_MEMORY_TRACE_SIZE
+
+   unsigned int     Index;
+   InterruptState_t State;
+
+   if((Entries) && (Lost))
+   {
+      ENTER_CRITICAL_SECTION(State);
+
+      *Lost           = MemoryTraceLost;
+      MemoryTraceLost = 0;
+
+      /* The oldest entry is MemoryTraceCount entries behind the next   */
+      /* entry to write.                                                */
+      Index = (MemoryTraceHead + BTPS_MEMORY_TRACE_SIZE - MemoryTraceCount) % BTPS_MEMORY_TRACE_SIZE;
+
+      while((ret_val < MaximumEntries) && (MemoryTraceCount))
+      {
+         Entries[ret_val++] = MemoryTrace[Index];
+
+         if(++Index == BTPS_MEMORY_TRACE_SIZE)
+            Index = 0;
+
+         MemoryTraceCount--;
+      }
+
+      EXIT_CRITICAL_SECTION(State);
+   }
+
+#else
+
+   (void)MaximumEntries;
+   (void)Entries;
+
+   if(Lost)
+      *Lost = 0;
+
+#endif
+
+   return(ret_val);
+}
+
+   /* The following function is provided to allow a mechanism to write  */
+   /* the memory allocation trace to the debug output (see              */
+   /* BTPS_OutputMessage()).  Every entry is written as a line          */
+   /* "HT Operation Tag Size Offset" and lost entries as a line         */
+   /* "HL Lost".  The entries that are written are removed from the     */
+   /* trace.                                                            */
+void BTPSAPI BTPS_DumpMemoryTrace(void)
+{
+   unsigned long           Lost;
+   BTPS_MemoryTraceEntry_t Entry;
+
+   while(BTPS_ReadMemoryTrace(1, &Entry, &Lost))
+   {
+      if(Lost)
+         BTPS_OutputMessage("HL %lu\r\n", Lost);
+
+      BTPS_OutputMessage("HT %u %u %u %u\r\n", (unsigned int)Entry.Operation, (unsigned int)Entry.Tag, (unsigned int)Entry.Size, (unsigned int)Entry.Offset);
+   }
+}
+
+   /* The following function is provided to allow a mechanism to write  */
+   /* a message to the binary log without formatting it.  This function */
+   /* accepts as input the Message ID, the number of arguments and the  */
+   /* arguments.  The entry is written MSB first (see                   */
+   /* BTPS_LOG_ENTRY_SIZE()).  When there is no room the oldest entries */
+   /* are dropped (and counted as lost).                                */
+void BTPSAPI BTPS_LogMessage(Word_t MessageID, unsigned int NumberArguments, DWord_t Argument1, DWord_t Argument2, DWord_t Argument3)
+{
+#if BTPS_LOG_BUFFER_SIZE
+
+   unsigned int     Index;
+   unsigned int     Length;
+   unsigned int     EntryLength;
+   DWord_t          Value[BTPS_LOG_MAXIMUM_ARGUMENTS + 1];
+   Byte_t           Entry[BTPS_LOG_ENTRY_SIZE(BTPS_LOG_MAXIMUM_ARGUMENTS)];
+   InterruptState_t State;
+
+   if(NumberArguments > BTPS_LOG_MAXIMUM_ARGUMENTS)
+      NumberArguments = BTPS_LOG_MAXIMUM_ARGUMENTS;
+
+   Length = BTPS_LOG_ENTRY_SIZE(NumberArguments);
+
+   if(Length <= BTPS_LOG_BUFFER_SIZE)
+   {
+      /* Build the entry before entering the critical section.          */
+      MessageID  = (Word_t)((MessageID & BTPS_LOG_MAXIMUM_MESSAGE_ID) << 2) | (Word_t)NumberArguments;
+      Entry[0]   = (Byte_t)(MessageID >> 8);
+      Entry[1]   = (Byte_t)MessageID;
+
+      Value[0]   = (DWord_t)BTPS_GetTickCount();
+      Value[1]   = Argument1;
+      Value[2]   = Argument2;
+      Value[3]   = Argument3;
+
+      for(Index=0;Index<=NumberArguments;Index++)
+      {
+         Entry[2 + (Index * 4)] = (Byte_t)(Value[Index] >> 24);
+         Entry[3 + (Index * 4)] = (Byte_t)(Value[Index] >> 16);
+         Entry[4 + (Index * 4)] = (Byte_t)(Value[Index] >> 8);
+         Entry[5 + (Index * 4)] = (Byte_t)Value[Index];
+      }
+
+      ENTER_CRITICAL_SECTION(State);
+
+      /* Drop the oldest entries until the new entry fits.  The length  */
+      /* of an entry is given by the number of arguments in the low     */
+      /* bits of its header.                                            */
+      while((LogCount + Length) > BTPS_LOG_BUFFER_SIZE)
+      {
+         EntryLength  = BTPS_LOG_ENTRY_SIZE(LogBuffer[(LogHead + 1) % BTPS_LOG_BUFFER_SIZE] & 0x03);
+
+         LogHead      = (LogHead + EntryLength) % BTPS_LOG_BUFFER_SIZE;
+         LogCount    -= EntryLength;
+
+         LogLost++;
+      }
+
+      Index = (LogHead + LogCount) % BTPS_LOG_BUFFER_SIZE;
+
+      for(EntryLength=0;EntryLength<Length;EntryLength++)
+      {
+         LogBuffer[Index] = Entry[EntryLength];
+
+         if(++Index == BTPS_LOG_BUFFER_SIZE)
+            Index = 0;
+      }
+
+      LogCount += Length;
+
+      EXIT_CRITICAL_SECTION(State);
+   }
+
+#else
+
+   (void)MessageID;
+   (void)NumberArguments;
+   (void)Argument1;
+   (void)Argument2;
+   (void)Argument3;
+
+#endif
+}
+
+   /* The following function is provided to allow a mechanism to read   */
+   /* the binary log.  This function accepts as input the size of a     */
+   /* buffer, a pointer to the buffer that will receive the entries     */
+   /* (whole entries only, oldest first) and a pointer to a variable    */
+   /* that will receive the number of entries that were lost since the  */
+   /* last read.  This function returns the number of bytes that were   */
+   /* read.  The entries that are read are removed from the log.        */
+unsigned int BTPSAPI BTPS_ReadLog(unsigned int BufferSize, Byte_t *Buffer, unsigned long *Lost)
+{
+   unsigned int ret_val;
+
+   ret_val = 0;
+
+#if BTPS_LOG_BUFFER_SIZE
+
+   unsigned int     EntryLength;
+   InterruptState_t State;
+
+   if((Buffer) && (Lost))
+   {
+      ENTER_CRITICAL_SECTION(State);
+
+      *Lost   = LogLost;
+      LogLost = 0;
+
+      while(LogCount)
+      {
+         EntryLength = BTPS_LOG_ENTRY_SIZE(LogBuffer[(LogHead + 1) % BTPS_LOG_BUFFER_SIZE] & 0x03);
+
+         if((ret_val + EntryLength) > BufferSize)
+            break;
+
+         LogCount -= EntryLength;
+
+         while(EntryLength--)
+         {
+            Buffer[ret_val++] = LogBuffer[LogHead];
+
+            if(++LogHead == BTPS_LOG_BUFFER_SIZE)
+               LogHead = 0;
+         }
+      }
+
+      EXIT_CRITICAL_SECTION(State);
+   }
+
+#else
+
+   (void)BufferSize;
+   (void)Buffer;
+
+   if(Lost)
+      *Lost = 0;
+
+#endif
+
+   return(ret_val);
+}
+
+   /* The following function is responsible for the usage information   */
+   /* of a fixed-block memory pool.  This function accepts as input the */
+   /* index of the pool (the pools are ordered by increasing BlockSize) */
+   /* and a pointer to a buffer that will receive the usage.  This      */
+   /* function returns TRUE if the usage was returned or FALSE if there */
+   /* is no such pool.                                                  */
+Boolean_t BTPSAPI BTPS_QueryMemoryPoolUsage(unsigned int PoolIndex, BTPS_MemoryPoolUsage_t *Usage)
 {
-   CalcTotals(Used, Free, MaxFree);
+   Boolean_t ret_val;
 
-   return(0);
+   if((PoolIndex < NumberMemoryPools) && (Usage))
+   {
+      Usage->BlockSize     = MemoryPool[PoolIndex].BlockSize;
+      Usage->NumberBlocks  = MemoryPool[PoolIndex].NumberBlocks;
+      Usage->BlocksUsed    = MemoryPool[PoolIndex].BlocksUsed;
+      Usage->MaxBlocksUsed = MemoryPool[PoolIndex].MaxBlocksUsed;
+      Usage->HeapFallbacks = MemoryPool[PoolIndex].HeapFallbacks;
+
+      ret_val = TRUE;
+   }
+   else
+      ret_val = FALSE;
+
+   return(ret_val);
 }
 
    /* The following function is responsible for delaying the current    */
@@ -563,7 +1389,7 @@ void BTPSAPI BTPS_Delay(unsigned long MilliSeconds)
 
    msTickCount = BTPS_GetTickCount();
 
-   DelayCount = msTickCount + (MILLISECONDS_TO_TICKS(MilliSeconds))*8;
+   DelayCount = msTickCount + MILLISECONDS_TO_TICKS(MilliSeconds);
 
    while(msTickCount < DelayCount)
       msTickCount = BTPS_GetTickCount();
@@ -584,6 +1410,74 @@ unsigned long BTPSAPI BTPS_GetTickCount(void)
       return(0);
 }
 
+   /* The following function is a utility function that is used to      */
+   /* compare two Scheduler entries.  This function returns TRUE if the */
+   /* First entry is due before the Second entry (earlier deadline, or  */
+   /* the same deadline and an earlier pass).  The comparisons are done */
+   /* on the differences so that the Tick Count may wrap.               */
+static Boolean_t ScheduleBefore(SchedulerInformation_t *First, SchedulerInformation_t *Second)
+{
+   long Difference;
+
+   Difference = (long)(First->ScheduleDeadline - Second->ScheduleDeadline);
+   if(Difference)
+      return((Boolean_t)(Difference < 0));
+
+   return((Boolean_t)((int)(First->SchedulePass - Second->SchedulePass) < 0));
+}
+
+   /* The following function is a utility function that is used to move */
+   /* the Scheduler entry at the specified index towards the top of the */
+   /* heap until its parent is due before it.  This function returns    */
+   /* the final index of the entry.                                     */
+static unsigned int ScheduleSiftUp(unsigned int Index)
+{
+   unsigned int           Parent;
+   SchedulerInformation_t Entry;
+
+   Entry = SchedulerInformation[Index];
+
+   while(Index)
+   {
+      Parent = (Index - 1) >> 1;
+
+      if(!ScheduleBefore(&Entry, &SchedulerInformation[Parent]))
+         break;
+
+      SchedulerInformation[Index] = SchedulerInformation[Parent];
+      Index                       = Parent;
+   }
+
+   SchedulerInformation[Index] = Entry;
+
+   return(Index);
+}
+
+   /* The following function is a utility function that is used to move */
+   /* the Scheduler entry at the specified index towards the bottom of  */
+   /* the heap until it is due before both of its children.             */
+static void ScheduleSiftDown(unsigned int Index)
+{
+   unsigned int           Child;
+   SchedulerInformation_t Entry;
+
+   Entry = SchedulerInformation[Index];
+
+   while((Child = (Index << 1) + 1) < NumberScheduledFunctions)
+   {
+      if(((Child + 1) < NumberScheduledFunctions) && (ScheduleBefore(&SchedulerInformation[Child + 1], &SchedulerInformation[Child])))
+         Child++;
+
+      if(!ScheduleBefore(&SchedulerInformation[Child], &Entry))
+         break;
+
+      SchedulerInformation[Index] = SchedulerInformation[Child];
+      Index                       = Child;
+   }
+
+   SchedulerInformation[Index] = Entry;
+}
+
    /* The following function is provided to allow a mechanism for       */
    /* adding Scheduler Functions to the Scheduler.  These functions are */
    /* called periodically by the Scheduler (based upon the requested    */
@@ -612,9 +1506,10 @@ Boolean_t BTPSAPI BTPS_AddFunctionToScheduler(BTPS_SchedulerFunction_t Scheduler
       /* appears to be semi-valid.                                      */
       if(SchedulerFunction)
       {
-         /* Simply add the Scheduled Function into the Next available   */
-         /* Schedule Slot.                                              */
-         SchedulerInformation[NumberScheduledFunctions].ScheduleCount     = 0;
+         /* Add the Scheduled Function at the end of the heap.  It is   */
+         /* due one period from now, and does not run in a pass that is */
+         /* already in progress.                                        */
+         SchedulerInformation[NumberScheduledFunctions].SchedulePass      = SchedulerPass;
          SchedulerInformation[NumberScheduledFunctions].ScheduleFunction  = SchedulerFunction;
          SchedulerInformation[NumberScheduledFunctions].ScheduleParameter = SchedulerParameter;
 
@@ -629,10 +1524,15 @@ Boolean_t BTPSAPI BTPS_AddFunctionToScheduler(BTPS_SchedulerFunction_t Scheduler
 
 #endif
 
+         SchedulerInformation[NumberScheduledFunctions].ScheduleDeadline = BTPS_GetTickCount() + SchedulerInformation[NumberScheduledFunctions].ScheduleExpireCount;
+
          /* Update the total number of Functions that have been added to*/
-         /* the Scheduler.                                              */
+         /* the Scheduler and move the new entry to its place in the    */
+         /* heap.                                                       */
          NumberScheduledFunctions++;
 
+         ScheduleSiftUp(NumberScheduledFunctions - 1);
+
          /* Finally return success to the caller.                       */
          ret_val = TRUE;
       }
@@ -652,6 +1552,10 @@ Boolean_t BTPSAPI BTPS_AddFunctionToScheduler(BTPS_SchedulerFunction_t Scheduler
    /* input the Scheduler Function to that was added to the Scheduler,  */
    /* as well as the Scheduler Parameter that was registered.  Both of  */
    /* these values *must* match to remove a specific Scheduler Entry.   */
+   /* * NOTE * The entry is found by comparing the (at most             */
+   /*          MAX_NUMBER_SCHEDULE_FUNCTIONS) entries.  It is replaced  */
+   /*          by the last entry of the heap, which is then moved to    */
+   /*          its place, so nothing is shifted.                        */
 void BTPSAPI BTPS_DeleteFunctionFromScheduler(BTPS_SchedulerFunction_t SchedulerFunction, void *SchedulerParameter)
 {
    unsigned int Index;
@@ -672,25 +1576,21 @@ void BTPSAPI BTPS_DeleteFunctionFromScheduler(BTPS_SchedulerFunction_t Scheduler
                break;
          }
 
-         /* Check to see if we have found the scheduled function.  Also,*/
-         /* if we have we need to copy all the functions in the         */
-         /* scheduler that exist AFTER the current index into the       */
-         /* Scheduler array starting at the index that was found above. */
+         /* Check to see if we have found the scheduled function.  If   */
+         /* we have, move the last entry of the heap into its place and */
+         /* restore the heap order from there.                          */
          if(Index < NumberScheduledFunctions)
          {
-            /* Simply start copying from the next location back one in  */
-            /* the array.                                               */
-            for(Index++;Index<NumberScheduledFunctions;Index++)
-            {
-               SchedulerInformation[Index - 1].ScheduleCount       = SchedulerInformation[Index].ScheduleCount;
-               SchedulerInformation[Index - 1].ScheduleFunction    = SchedulerInformation[Index].ScheduleFunction;
-               SchedulerInformation[Index - 1].ScheduleParameter   = SchedulerInformation[Index].ScheduleParameter;
-               SchedulerInformation[Index - 1].ScheduleExpireCount = SchedulerInformation[Index].ScheduleExpireCount;
-            }
-
             /* Update the total number of Functions that have been added*/
             /* to the Scheduler.                                        */
             NumberScheduledFunctions--;
+
+            if(Index < NumberScheduledFunctions)
+            {
+               SchedulerInformation[Index] = SchedulerInformation[NumberScheduledFunctions];
+
+               ScheduleSiftDown(ScheduleSiftUp(Index));
+            }
          }
       }
    }
@@ -732,53 +1632,102 @@ void BTPSAPI BTPS_ExecuteScheduler(void)
    /*          loop will occur.                                         */
 void BTPSAPI BTPS_ProcessScheduler(void)
 {
-   unsigned int  SchedulerPointer;
-   unsigned long ElapsedTicks;
-   unsigned long CurrentTickCount;
+   unsigned int              Index;
+   unsigned long             CurrentTickCount;
+   unsigned long             Difference;
+   BTPS_SchedulerFunction_t  ScheduleFunction;
+   void                     *ScheduleParameter;
 
-   /* First, let's calculate the Elapsed Number of Ticks that have      */
-   /* occurred since the last time through the scheduler (taking into   */
-   /* account the possibility that the Tick Counter could have wrapped).*/
+   /* Start a new pass through the scheduler.                           */
    CurrentTickCount = BTPS_GetTickCount();
 
-   ElapsedTicks = CurrentTickCount - PreviousTickCount;
+   SchedulerPass++;
 
-   if(ElapsedTicks & 0x80000000)
-      ElapsedTicks = CurrentTickCount + (0xFFFFFFFF - PreviousTickCount) + 1;
+   /* If the Tick Count was set back since the last pass, move every    */
+   /* deadline back by the same amount so that the remaining time of    */
+   /* each function is kept (the heap order does not change).           */
+   Difference = CurrentTickCount - PreviousTickCount;
+   if((long)Difference < 0)
+   {
+      for(Index=0;Index<NumberScheduledFunctions;Index++)
+         SchedulerInformation[Index].ScheduleDeadline += Difference;
+   }
 
-#if BTPS_MINIMUM_SCHEDULER_RESOLUTION
+   PreviousTickCount = CurrentTickCount;
 
-   if(ElapsedTicks)
+   /* Run the functions that are due, earliest deadline first.  Every   */
+   /* function is rescheduled one period from now before it is called   */
+   /* (so it may delete itself or add other functions), and runs at     */
+   /* most once per pass.                                               */
+   while((NumberScheduledFunctions) && ((long)(CurrentTickCount - SchedulerInformation[0].ScheduleDeadline) >= 0) && (SchedulerInformation[0].SchedulePass != SchedulerPass))
+   {
+      ScheduleFunction  = SchedulerInformation[0].ScheduleFunction;
+      ScheduleParameter = SchedulerInformation[0].ScheduleParameter;
 
-#else
+      SchedulerInformation[0].ScheduleDeadline = CurrentTickCount + SchedulerInformation[0].ScheduleExpireCount;
+      SchedulerInformation[0].SchedulePass     = SchedulerPass;
 
-   if(1)
+      ScheduleSiftDown(0);
 
-#endif
+      /* Simply call the Scheduled function.                            */
+      (*ScheduleFunction)(ScheduleParameter);
+   }
+}
+
+   /* The following function is provided to allow a mechanism to query  */
+   /* the time until the next Scheduled Function is due.  This function */
+   /* accepts as input a pointer to a buffer that will receive the time */
+   /* (in ticks of BTPS_GetTickCount(), 0 if a function is already      */
+   /* due).  This function returns TRUE if a function is due at a known */
+   /* time or FALSE if there is no such function (the caller may then   */
+   /* wait for an interrupt).                                           */
+   /* * NOTE * A function with a period of zero runs on every pass and  */
+   /*          is polled for work that interrupts flag, so it does not  */
+   /*          set a time (unless it has not run yet in the current     */
+   /*          pass, in which case it is due now).                      */
+   /* * NOTE * Mailboxes of this (No-OS) kernel are never waited on, so */
+   /*          they do not set a time either.                           */
+Boolean_t BTPSAPI BTPS_QueryScheduleTimeout(unsigned long *Timeout)
+{
+   long          Remaining;
+   unsigned int  Index;
+   unsigned long CurrentTickCount;
+   Boolean_t     ret_val;
+
+   ret_val = FALSE;
+
+   if((SchedulerInitialized) && (Timeout))
    {
-      /* Now that we have calculated the Elapsed Time, let's increment  */
-      /* the the Scheduler Count for each Scheduled Function by the     */
-      /* Elapsed Tick Amount.                                           */
-      SchedulerPointer = 0;
-      while(SchedulerPointer < NumberScheduledFunctions)
-      {
-         SchedulerInformation[SchedulerPointer].ScheduleCount += ElapsedTicks;
+      CurrentTickCount = BTPS_GetTickCount();
 
-         if(SchedulerInformation[SchedulerPointer].ScheduleCount >= SchedulerInformation[SchedulerPointer].ScheduleExpireCount)
+      /* Functions with a period of zero are spread through the heap,   */
+      /* so all (at most MAX_NUMBER_SCHEDULE_FUNCTIONS) entries are     */
+      /* checked.                                                       */
+      for(Index=0;Index<NumberScheduledFunctions;Index++)
+      {
+         if(SchedulerInformation[Index].ScheduleExpireCount)
+         {
+            Remaining = (long)(SchedulerInformation[Index].ScheduleDeadline - CurrentTickCount);
+            if(Remaining < 0)
+               Remaining = 0;
+         }
+         else
          {
-            /* Simply call the Scheduled function.                      */
-            (*(BTPS_SchedulerFunction_t)(SchedulerInformation[SchedulerPointer].ScheduleFunction))(SchedulerInformation[SchedulerPointer].ScheduleParameter);
+            if(SchedulerInformation[Index].SchedulePass == SchedulerPass)
+               continue;
 
-            /* Reset the current Schedule Count back to zero.           */
-            SchedulerInformation[SchedulerPointer].ScheduleCount = 0;
+            Remaining = 0;
          }
 
-         SchedulerPointer++;
+         if((!ret_val) || ((unsigned long)Remaining < *Timeout))
+         {
+            *Timeout = (unsigned long)Remaining;
+            ret_val  = TRUE;
+         }
       }
-
-      /* Note the last time that we processed the scheduler.            */
-      PreviousTickCount = CurrentTickCount;
    }
+
+   return(ret_val);
 }
 
    /* The following function is provided to allow a mechanism to        */
@@ -795,10 +1744,31 @@ void BTPSAPI *BTPS_AllocateMemory(unsigned long MemorySize)
    /* allocated.                                                        */
    if(MemorySize)
    {
-      ret_val = _Malloc(MemorySize);
+      /* Objects of the sizes of the fixed-block pools are taken from   */
+      /* the pools, everything else (and the overflow of an empty pool) */
+      /* from the heap.                                                 */
+      if((ret_val = PoolAlloc(MemorySize)) != NULL)
+      {
+         MEMORY_TRACE(BTPS_MEMORY_TRACE_OPERATION_POOL_ALLOCATE, MemorySize, ret_val);
+      }
+      else
+      {
+         if((ret_val = _Malloc(MemorySize)) != NULL)
+         {
+            MEMORY_TRACE(BTPS_MEMORY_TRACE_OPERATION_ALLOCATE, MemorySize, ret_val);
+         }
+      }
+
+      if(ret_val)
+         MemoryAllocations++;
+      else
+      {
+         MemoryFailures++;
+
+         MEMORY_TRACE(BTPS_MEMORY_TRACE_OPERATION_FAILURE, MemorySize, NULL);
 
-      if(!ret_val)
          BTPS_OutputMessage("Alloc Failed: %d\r\n", MemorySize);
+      }
    }
    else
    {
@@ -820,7 +1790,20 @@ void BTPSAPI BTPS_FreeMemory(void *MemoryPointer)
 {
    /* First make sure that the memory being returned is semi-valid.     */
    if(MemoryPointer)
-      _MemFree(MemoryPointer);
+   {
+      MemoryFrees++;
+
+      if(PoolFree(MemoryPointer))
+      {
+         MEMORY_TRACE(BTPS_MEMORY_TRACE_OPERATION_POOL_FREE, 0, MemoryPointer);
+      }
+      else
+      {
+         MEMORY_TRACE(BTPS_MEMORY_TRACE_OPERATION_FREE, 0, MemoryPointer);
+
+         _MemFree(MemoryPointer);
+      }
+   }
    else
       DBG_MSG(DBG_ZONE_BTPSKRNL,("Invalid Pointer\r\n"));
 }
@@ -838,8 +1821,38 @@ void BTPSAPI BTPS_FreeMemory(void *MemoryPointer)
    /*          Source and Destination Buffers !!!!                      */
 void BTPSAPI BTPS_MemCopy(void *Destination, BTPSCONST void *Source, unsigned long Size)
 {
-   /* Simply wrap the C Run-Time memcpy() function.                     */
-   memcpy(Destination, Source, Size);
+   unsigned char           *DestinationPtr;
+   unsigned char           *End;
+   BTPSCONST unsigned char *SourcePtr;
+   Word_t                  *DestinationWord;
+   Word_t                  *WordEnd;
+   BTPSCONST Word_t        *SourceWord;
+
+   DestinationPtr = (unsigned char *)Destination;
+   SourcePtr      = (BTPSCONST unsigned char *)Source;
+   End            = DestinationPtr + Size;
+
+   /* Blocks with the same word alignment are copied a word at a time   */
+   /* (after the first byte if they start at an odd address).           */
+   if((Size >= MINIMUM_WORD_TRANSFER_SIZE) && (SAME_WORD_ALIGNMENT(DestinationPtr, SourcePtr)))
+   {
+      if(!WORD_ALIGNED(DestinationPtr))
+         *DestinationPtr++ = *SourcePtr++;
+
+      DestinationWord = (Word_t *)DestinationPtr;
+      SourceWord      = (BTPSCONST Word_t *)SourcePtr;
+      WordEnd         = DestinationWord + ((unsigned long)(End - DestinationPtr) / sizeof(Word_t));
+
+      while(DestinationWord != WordEnd)
+         *DestinationWord++ = *SourceWord++;
+
+      DestinationPtr  = (unsigned char *)DestinationWord;
+      SourcePtr       = (BTPSCONST unsigned char *)SourceWord;
+   }
+
+   /* Copy the remaining bytes (all of them if the alignments differ).  */
+   while(DestinationPtr != End)
+      *DestinationPtr++ = *SourcePtr++;
 }
 
    /* The following function is responsible for moving a block of       */
@@ -855,8 +1868,44 @@ void BTPSAPI BTPS_MemCopy(void *Destination, BTPSCONST void *Source, unsigned lo
    /*          Source and Destination Buffers.                          */
 void BTPSAPI BTPS_MemMove(void *Destination, BTPSCONST void *Source, unsigned long Size)
 {
-   /* Simply wrap the C Run-Time memmove() function.                    */
-   memmove(Destination, Source, Size);
+   unsigned char           *DestinationPtr;
+   BTPSCONST unsigned char *SourcePtr;
+   Word_t                  *DestinationWord;
+   BTPSCONST Word_t        *SourceWord;
+
+   DestinationPtr = (unsigned char *)Destination;
+   SourcePtr      = (BTPSCONST unsigned char *)Source;
+
+   /* A forward copy is safe unless the Destination starts inside the   */
+   /* Source.                                                           */
+   if((DestinationPtr <= SourcePtr) || (DestinationPtr >= (SourcePtr + Size)))
+      BTPS_MemCopy(Destination, Source, Size);
+   else
+   {
+      /* Copy backwards from the end of the blocks, a word at a time if */
+      /* the alignments are the same (after the last byte if the blocks */
+      /* end at an odd address).                                        */
+      DestinationPtr += Size;
+      SourcePtr      += Size;
+
+      if((Size >= MINIMUM_WORD_TRANSFER_SIZE) && (SAME_WORD_ALIGNMENT(DestinationPtr, SourcePtr)))
+      {
+         if(!WORD_ALIGNED(DestinationPtr))
+            *--DestinationPtr = *--SourcePtr;
+
+         DestinationWord = (Word_t *)DestinationPtr;
+         SourceWord      = (BTPSCONST Word_t *)SourcePtr;
+
+         while((unsigned long)(((unsigned char *)DestinationWord) - ((unsigned char *)Destination)) >= sizeof(Word_t))
+            *--DestinationWord = *--SourceWord;
+
+         DestinationPtr  = (unsigned char *)DestinationWord;
+         SourcePtr       = (BTPSCONST unsigned char *)SourceWord;
+      }
+
+      while(DestinationPtr != (unsigned char *)Destination)
+         *--DestinationPtr = *--SourcePtr;
+   }
 }
 
    /* The following function is provided to allow a mechanism to fill   */
@@ -869,8 +1918,35 @@ void BTPSAPI BTPS_MemMove(void *Destination, BTPSCONST void *Source, unsigned lo
    /* the Size parameter.                                               */
 void BTPSAPI BTPS_MemInitialize(void *Destination, unsigned char Value, unsigned long Size)
 {
-   /* Simply wrap the C Run-Time memset() function.                     */
-   memset(Destination, Value, Size);
+   unsigned char *DestinationPtr;
+   unsigned char *End;
+   Word_t        *DestinationWord;
+   Word_t        *WordEnd;
+   Word_t         WordValue;
+
+   DestinationPtr = (unsigned char *)Destination;
+   End            = DestinationPtr + Size;
+
+   /* Fill a word at a time (after the first byte if the block starts   */
+   /* at an odd address).                                               */
+   if(Size >= MINIMUM_WORD_TRANSFER_SIZE)
+   {
+      if(!WORD_ALIGNED(DestinationPtr))
+         *DestinationPtr++ = Value;
+
+      WordValue       = (Word_t)((((Word_t)Value) << 8) | Value);
+      DestinationWord = (Word_t *)DestinationPtr;
+      WordEnd         = DestinationWord + ((unsigned long)(End - DestinationPtr) / sizeof(Word_t));
+
+      while(DestinationWord != WordEnd)
+         *DestinationWord++ = WordValue;
+
+      DestinationPtr  = (unsigned char *)DestinationWord;
+   }
+
+   /* Fill the remaining bytes.                                         */
+   while(DestinationPtr != End)
+      *DestinationPtr++ = Value;
 }
 
    /* The following function is provided to allow a mechanism to        */
@@ -881,8 +1957,55 @@ void BTPSAPI BTPS_MemInitialize(void *Destination, unsigned char Value, unsigned
    /* a positive value if Source1 is greater than Source2.              */
 int BTPSAPI BTPS_MemCompare(BTPSCONST void *Source1, BTPSCONST void *Source2, unsigned long Size)
 {
-   /* Simply wrap the C Run-Time memcmp() function.                     */
-   return(memcmp(Source1, Source2, Size));
+   BTPSCONST unsigned char *Source1Ptr;
+   BTPSCONST unsigned char *Source2Ptr;
+   BTPSCONST unsigned char *End;
+   BTPSCONST Word_t        *Source1Word;
+   BTPSCONST Word_t        *Source2Word;
+   BTPSCONST Word_t        *WordEnd;
+   int                      ret_val;
+
+   Source1Ptr = (BTPSCONST unsigned char *)Source1;
+   Source2Ptr = (BTPSCONST unsigned char *)Source2;
+   End        = Source1Ptr + Size;
+   ret_val    = 0;
+
+   /* Blocks with the same word alignment are compared a word at a time */
+   /* up to the first word that differs, the bytes of that word (and    */
+   /* the remaining bytes) are compared below so that the result is the */
+   /* same as a byte by byte compare.                                   */
+   if((Size >= MINIMUM_WORD_TRANSFER_SIZE) && (SAME_WORD_ALIGNMENT(Source1Ptr, Source2Ptr)))
+   {
+      if(!WORD_ALIGNED(Source1Ptr))
+      {
+         if(*Source1Ptr != *Source2Ptr)
+            ret_val = (int)*Source1Ptr - (int)*Source2Ptr;
+
+         Source1Ptr++;
+         Source2Ptr++;
+      }
+
+      if(!ret_val)
+      {
+         Source1Word = (BTPSCONST Word_t *)Source1Ptr;
+         Source2Word = (BTPSCONST Word_t *)Source2Ptr;
+         WordEnd     = Source1Word + ((unsigned long)(End - Source1Ptr) / sizeof(Word_t));
+
+         while((Source1Word != WordEnd) && (*Source1Word == *Source2Word))
+         {
+            Source1Word++;
+            Source2Word++;
+         }
+
+         Source1Ptr  = (BTPSCONST unsigned char *)Source1Word;
+         Source2Ptr  = (BTPSCONST unsigned char *)Source2Word;
+      }
+   }
+
+   while((!ret_val) && (Source1Ptr != End))
+      ret_val = (int)*Source1Ptr++ - (int)*Source2Ptr++;
+
+   return(ret_val);
 }
 
    /* The following function is provided to allow a mechanism to Compare*/
@@ -1191,6 +2314,183 @@ void BTPSAPI BTPS_DeleteMailbox(Mailbox_t Mailbox, BTPS_MailboxDeleteCallback_t
    }
 }
 
+   /* The following function is provided to allow a means to pass a     */
+   /* buffer to a Mailbox by pointer (where it can be retrieved via the */
+   /* BTPS_WaitMailboxPointer() function).  This function accepts as    */
+   /* input the Mailbox Handle of the Mailbox and a pointer to the      */
+   /* buffer (which CANNOT be NULL).  Only the pointer is placed into   */
+   /* the Mailbox, so the Mailbox must have been created with a         */
+   /* SlotSize of sizeof(void *).  This function returns TRUE if the    */
+   /* pointer was added, or FALSE if the Mailbox is full or invalid.    */
+   /* * NOTE * Ownership of the buffer passes to the Mailbox when this  */
+   /*          function returns TRUE.                                   */
+Boolean_t BTPSAPI BTPS_AddMailboxPointer(Mailbox_t Mailbox, void *Buffer)
+{
+   Boolean_t ret_val;
+
+   /* Before proceeding any further make sure that the Mailbox Handle   */
+   /* and the Buffer pointer that was specified appears semi-valid and  */
+   /* that the Mailbox holds pointers.                                  */
+   if((Mailbox) && (Buffer) && (((MailboxHeader_t *)Mailbox)->SlotSize == sizeof(void *)))
+   {
+      /* Before adding the pointer to the Mailbox, make sure that the   */
+      /* Mailbox is not already full.                                   */
+      if(((MailboxHeader_t *)Mailbox)->OccupiedSlots < ((MailboxHeader_t *)Mailbox)->NumberSlots)
+      {
+         /* Mailbox is NOT full, so store the pointer in the next       */
+         /* available free Mailbox Slot (no data is copied).            */
+         ((void **)(((MailboxHeader_t *)Mailbox)->Slots))[((MailboxHeader_t *)Mailbox)->HeadSlot] = Buffer;
+
+         /* Update the Next available Free Mailbox Slot (taking into    */
+         /* account wrapping the pointer).                              */
+         if(++(((MailboxHeader_t *)Mailbox)->HeadSlot) == ((MailboxHeader_t *)Mailbox)->NumberSlots)
+            ((MailboxHeader_t *)Mailbox)->HeadSlot = 0;
+
+         ((MailboxHeader_t *)Mailbox)->OccupiedSlots++;
+
+         ret_val = TRUE;
+      }
+      else
+         ret_val = FALSE;
+   }
+   else
+      ret_val = FALSE;
+
+   /* Return the result to the caller.                                  */
+   return(ret_val);
+}
+
+   /* The following function is provided to allow a means to retrieve   */
+   /* a buffer that was passed to a Mailbox by the                      */
+   /* BTPS_AddMailboxPointer() function.  This function accepts as its  */
+   /* first parameter the Mailbox Handle and as its second parameter a  */
+   /* pointer to a variable that will receive the pointer to the        */
+   /* buffer.  This function returns TRUE if a buffer was retrieved     */
+   /* (ownership passes to the caller), or FALSE if the Mailbox is      */
+   /* empty or invalid.                                                 */
+Boolean_t BTPSAPI BTPS_WaitMailboxPointer(Mailbox_t Mailbox, void **Buffer)
+{
+   Boolean_t ret_val;
+
+   /* Before proceeding any further make sure that the Mailbox Handle   */
+   /* and the Buffer pointer that was specified appears semi-valid and  */
+   /* that the Mailbox holds pointers.                                  */
+   if((Mailbox) && (Buffer) && (((MailboxHeader_t *)Mailbox)->SlotSize == sizeof(void *)))
+   {
+      /* Let's check to see if there exists at least one slot with a    */
+      /* pointer present in it.                                         */
+      if(((MailboxHeader_t *)Mailbox)->OccupiedSlots)
+      {
+         *Buffer = ((void **)(((MailboxHeader_t *)Mailbox)->Slots))[((MailboxHeader_t *)Mailbox)->TailSlot];
+
+         /* Mark the Mailbox Slot as free.                              */
+         if(++(((MailboxHeader_t *)Mailbox)->TailSlot) == ((MailboxHeader_t *)Mailbox)->NumberSlots)
+            ((MailboxHeader_t *)Mailbox)->TailSlot = 0;
+
+         ((MailboxHeader_t *)Mailbox)->OccupiedSlots--;
+
+         ret_val = TRUE;
+      }
+      else
+         ret_val = FALSE;
+   }
+   else
+      ret_val = FALSE;
+
+   /* Return the result to the caller.                                  */
+   return(ret_val);
+}
+
+   /* The following function is provided to allow a mechanism to        */
+   /* initialize a single-producer/single-consumer Queue of pointers.   */
+   /* This function accepts as input a pointer to the Queue, the number */
+   /* of entries (a power of two, no more than 32768) and a pointer to  */
+   /* the array that will hold the entries.  This function returns TRUE */
+   /* if the Queue was initialized, or FALSE if a parameter is invalid. */
+Boolean_t BTPSAPI BTPS_InitializeQueue(BTPS_Queue_t *Queue, unsigned int NumberEntries, void **Entries)
+{
+   Boolean_t ret_val;
+
+   /* The number of entries must be a power of two so that the          */
+   /* free-running indexes can be masked (and wrap around with the      */
+   /* unsigned arithmetic).                                             */
+   if((Queue) && (Entries) && (NumberEntries) && (NumberEntries <= 32768U) && (!(NumberEntries & (NumberEntries - 1))))
+   {
+      Queue->Head    = 0;
+      Queue->Tail    = 0;
+      Queue->Mask    = NumberEntries - 1;
+      Queue->Entries = Entries;
+
+      ret_val        = TRUE;
+   }
+   else
+      ret_val = FALSE;
+
+   return(ret_val);
+}
+
+   /* The following function is provided to allow the producer to add a */
+   /* pointer to a Queue.  This function accepts as input a pointer to  */
+   /* the Queue and the pointer to add.  This function returns TRUE if  */
+   /* the pointer was added, or FALSE if the Queue is full.             */
+   /* * NOTE * The entry is written before Head is advanced (a release  */
+   /*          store, see QUEUE_STORE_RELEASE()), so the consumer never */
+   /*          sees an entry that is not written yet.                   */
+Boolean_t BTPSAPI BTPS_AddQueue(BTPS_Queue_t *Queue, void *Entry)
+{
+   unsigned int Head;
+   Boolean_t    ret_val;
+
+   Head = Queue->Head;
+
+   if((unsigned int)(Head - QUEUE_LOAD_ACQUIRE(Queue->Tail)) <= Queue->Mask)
+   {
+      Queue->Entries[Head & Queue->Mask] = Entry;
+      QUEUE_STORE_RELEASE(Queue->Head, Head + 1);
+
+      ret_val                            = TRUE;
+   }
+   else
+      ret_val = FALSE;
+
+   return(ret_val);
+}
+
+   /* The following function is provided to allow the consumer to remove*/
+   /* the oldest pointer from a Queue.  This function accepts as input a*/
+   /* pointer to the Queue and a pointer to a variable that will receive*/
+   /* the pointer.  This function returns TRUE if a pointer was removed,*/
+   /* or FALSE if the Queue is empty.                                   */
+   /* * NOTE * The entry is read before Tail is advanced (a release     */
+   /*          store), so the producer never overwrites an entry that   */
+   /*          is not read yet.                                         */
+Boolean_t BTPSAPI BTPS_RemoveQueue(BTPS_Queue_t *Queue, void **Entry)
+{
+   unsigned int Tail;
+   Boolean_t    ret_val;
+
+   Tail = Queue->Tail;
+
+   if(QUEUE_LOAD_ACQUIRE(Queue->Head) != Tail)
+   {
+      *Entry      = Queue->Entries[Tail & Queue->Mask];
+      QUEUE_STORE_RELEASE(Queue->Tail, Tail + 1);
+
+      ret_val     = TRUE;
+   }
+   else
+      ret_val = FALSE;
+
+   return(ret_val);
+}
+
+   /* The following function is a utility function that exists to       */
+   /* determine the number of pointers queued in the specified Queue.   */
+unsigned int BTPSAPI BTPS_QueryQueue(BTPS_Queue_t *Queue)
+{
+   return((unsigned int)(QUEUE_LOAD_ACQUIRE(Queue->Head) - QUEUE_LOAD_ACQUIRE(Queue->Tail)));
+}
+
    /* The following function is used to initialize the Platform module. */
    /* The Platform module relies on some static variables that are used */
    /* to coordinate the abstraction.  When the module is initially      */
@@ -1218,6 +2518,7 @@ void BTPSAPI BTPS_Init(void *UserParam)
 
    /* Initialize Scheduler parameters.                                  */
    NumberScheduledFunctions = 0;
+   SchedulerPass            = 0;
    PreviousTickCount        = 0;
 
    /* Finally flag that the Scheduler has been initialized successfully.*/
@@ -1225,6 +2526,34 @@ void BTPSAPI BTPS_Init(void *UserParam)
 
    /* Initialize the static variables for this module.                  */
    HeapHead                 = NULL;
+
+   MemoryAllocations        = 0;
+   MemoryFrees              = 0;
+   MemoryFailures           = 0;
+
+#if BTPS_MEMORY_TRACE_SIZE
+
+   MemoryTraceHead          = 0;
+   MemoryTraceCount         = 0;
+   MemoryTraceLost          = 0;
+   MemoryTraceTag           = 0;
+
+#endif
+
+#if BTPS_LOG_BUFFER_SIZE
+
+   LogHead                  = 0;
+   LogCount                 = 0;
+   LogLost                  = 0;
+
+#endif
+
+   /* Create the fixed-block memory pools (first, so that they are      */
+   /* allocated at the start of the heap).                              */
+   if(UserParam)
+      PoolInit(((BTPS_Initialization_t *)UserParam)->NumberMemoryPools, ((BTPS_Initialization_t *)UserParam)->MemoryPools);
+   else
+      NumberMemoryPools = 0;
 }
 
    /* The following function is used to cleanup the Platform module.    */
@@ -41,6 +41,35 @@
 
    #define BTPS_MEMORY_BUFFER_SIZE                       (2900)
 
+#endif
+
+   /* The following constant represents the number of entries of the    */
+   /* memory allocation trace (see BTPS_ReadMemoryTrace()).  The trace  */
+   /* is a ring buffer of BTPS_MEMORY_TRACE_ENTRY_SIZE bytes per entry, */
+   /* 0 leaves the trace out.                                           */
+#ifndef BTPS_MEMORY_TRACE_SIZE
+
+   #define BTPS_MEMORY_TRACE_SIZE                        (0)
+
+#endif
+
+   /* The following constant represents the size (in bytes) of the      */
+   /* binary log (see BTPS_LogMessage()), a ring buffer of entries of   */
+   /* BTPS_LOG_ENTRY_SIZE() bytes.  0 leaves the log out (and the       */
+   /* BTPS_LOGx() MACROs compile to nothing).                           */
+#ifndef BTPS_LOG_BUFFER_SIZE
+
+   #define BTPS_LOG_BUFFER_SIZE                          (0)
+
+#endif
+
+   /* The following constant represents the maximum number of fixed-    */
+   /* block memory pools that can be configured (see the MemoryPools    */
+   /* member of the BTPS_Initialization_t structure).                   */
+#ifndef BTPS_MAX_NUMBER_MEMORY_POOLS
+
+   #define BTPS_MAX_NUMBER_MEMORY_POOLS                  (4)
+
 #endif
 
    /* The following constant represents the maximum number of functions */
@@ -81,6 +110,23 @@ typedef unsigned long (BTPSAPI *BTPS_GetTickCountCallback_t)(void);
    /*          there will be no output (i.e. it will simply be ignored).*/
 typedef void (BTPSAPI *BTPS_MessageOutputCallback_t)(char DebugCharacter);
 
+   /* The following structure represents the configuration of a fixed-  */
+   /* block memory pool.  The memory of the pool (BlockSize times       */
+   /* NumberBlocks bytes) is taken from the kernel heap by BTPS_Init(). */
+   /* BTPS_AllocateMemory() takes a block from the pool with the        */
+   /* smallest BlockSize that holds the request if the request is more  */
+   /* than three quarters of that BlockSize, so the pools should be     */
+   /* configured for the object sizes that are allocated and freed most */
+   /* often.  When the pool is empty (or no pool is selected) the       */
+   /* memory is allocated from the heap.                                */
+typedef struct _tagBTPS_MemoryPool_t
+{
+   unsigned int BlockSize;
+   unsigned int NumberBlocks;
+} BTPS_MemoryPool_t;
+
+#define BTPS_MEMORY_POOL_SIZE                            (sizeof(BTPS_MemoryPool_t))
+
    /* The following structure represents the structure that is passed   */
    /* to the BTPS_Init() function to notify the Bluetooth abstraction   */
    /* layer of the function(s) that are required for proper device      */
@@ -91,10 +137,15 @@ typedef void (BTPSAPI *BTPS_MessageOutputCallback_t)(char DebugCharacter);
    /*          the Bluetooth sub-system to not function because the     */
    /*          scheduler will not function (as the Tick Count will      */
    /*          never change).                                           */
+   /* * NOTE * MemoryPools points to NumberMemoryPools (at most         */
+   /*          BTPS_MAX_NUMBER_MEMORY_POOLS) pool configurations, or is */
+   /*          NULL (with NumberMemoryPools 0) for no pools.            */
 typedef struct _tagBTPS_Initialization_t
 {
    BTPS_GetTickCountCallback_t  GetTickCountCallback;
    BTPS_MessageOutputCallback_t MessageOutputCallback;
+   unsigned int                 NumberMemoryPools;
+   BTPS_MemoryPool_t           *MemoryPools;
 } BTPS_Initialization_t;
 
 #define BTPS_INITIALIZATION_SIZE                         (sizeof(BTPS_Initialization_t))
@@ -0,0 +1,720 @@
+/*****< btpskrnl.c >***********************************************************/
+/*                                                                            */
+/*  BTPSKRNL - Bluetooth Stack Kernel Implementation for POSIX hosts.         */
+/*                                                                            */
+/*  This module builds the No-OS kernel (../BTPSKRNL.c, included below) on a  */
+/*  POSIX host (Linux) so that application code written against the BTPS      */
+/*  kernel (buffer management, acquisition logic, ...) can be run and         */
+/*  measured natively.  The heap, the memory pools, the scheduler heap and    */
+/*  the mailbox storage are the code of the No-OS kernel (same semantics,     */
+/*  same BTPS_MEMORY_BUFFER_SIZE).  This module replaces :                    */
+/*     - the Tick Count (CLOCK_MONOTONIC Milliseconds if no                   */
+/*       GetTickCountCallback is given) and BTPS_Delay() (sleeps),            */
+/*     - BTPS_ExecuteScheduler() (sleeps until the next function is due),     */
+/*     - BTPS_WaitMailbox() (blocks until data is added or the Mailbox is     */
+/*       deleted, as documented),                                             */
+/*  and serializes the kernel with one lock so that other threads (e.g. a     */
+/*  thread standing in for an interrupt) may call the kernel functions.       */
+/*  Scheduled functions run with the lock held, so they never run             */
+/*  concurrently with each other (as on the MSP430).                          */
+/*                                                                            */
+/*  Build (with the application and the host transport, hcitrans/posix) :     */
+/*     gcc -I<btpskrnl> -I<include> -I<hcitrans> posix/BTPSKRNL.c sprintf.c   */
+/*         <application> -lpthread                                            */
+/*  and '-D__INTADDR__(_x)=((unsigned long)(_x))' for modules that use        */
+/*  BTPS_STRUCTURE_OFFSET().  Do not compile ../BTPSKRNL.c as well.           */
+/******************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+   /* The kernel is built without the MSP430 hardware configuration.    */
+   /* The Tick Count of this port is in Milliseconds.                   */
+#define BTPS_KERNEL_PORT
+#define MSP430_TICK_RATE_MS                            (1)
+
+   /* IAR intrinsic (address of an object as an integer) used by        */
+   /* BTPS_STRUCTURE_OFFSET().                                          */
+#ifndef __INTADDR__
+
+   #define __INTADDR__(_x)                             ((unsigned long)(_x))
+
+#endif
+
+   /* There are no interrupt service routines on this port : the data   */
+   /* that the No-OS kernel protects with a critical section is         */
+   /* protected by the kernel lock (see below).                         */
+#define ENTER_CRITICAL_SECTION(_State)                 ((_State) = 0)
+#define EXIT_CRITICAL_SECTION(_State)                  ((void)(_State))
+
+typedef int InterruptState_t;
+
+   /* The heap fragments are aligned to a pointer (an unsigned int is    */
+   /* only half of one on LP64 hosts), since the memory pools and the   */
+   /* Mailboxes store pointers in memory taken from the heap.           */
+#ifndef BTPS_ALIGNMENT_TYPE
+
+   #define BTPS_ALIGNMENT_TYPE                         unsigned long
+
+#endif
+
+   /* The two sides of a Queue (see BTPS_AddQueue()) may be threads on  */
+   /* different cores, which volatile does not order.  Head and Tail    */
+   /* are therefore published with a release store and read with an     */
+   /* acquire load, so the entry is seen before the index that covers   */
+   /* it (the Queue functions do not take the kernel lock).             */
+#define QUEUE_LOAD_ACQUIRE(_x)                         __atomic_load_n(&(_x), __ATOMIC_ACQUIRE)
+
+#define QUEUE_STORE_RELEASE(_x, _y)                    __atomic_store_n(&(_x), (_y), __ATOMIC_RELEASE)
+
+   /* The following functions of the No-OS kernel are renamed (to       */
+   /* NoOS_xxx) and called by the functions of the same name in this    */
+   /* module with the kernel lock held.  The calls between functions of */
+   /* the No-OS kernel (e.g. BTPS_CreateMailbox() allocating memory) go */
+   /* to the renamed functions, so the lock is taken once per call of   */
+   /* the application.                                                  */
+#define BTPS_Init                                      NoOS_BTPS_Init
+#define BTPS_DeInit                                    NoOS_BTPS_DeInit
+#define BTPS_Delay                                     NoOS_BTPS_Delay
+#define BTPS_AddFunctionToScheduler                    NoOS_BTPS_AddFunctionToScheduler
+#define BTPS_DeleteFunctionFromScheduler               NoOS_BTPS_DeleteFunctionFromScheduler
+#define BTPS_ExecuteScheduler                          NoOS_BTPS_ExecuteScheduler
+#define BTPS_ProcessScheduler                          NoOS_BTPS_ProcessScheduler
+#define BTPS_QueryScheduleTimeout                      NoOS_BTPS_QueryScheduleTimeout
+#define BTPS_AllocateMemory                            NoOS_BTPS_AllocateMemory
+#define BTPS_FreeMemory                                NoOS_BTPS_FreeMemory
+#define BTPS_QueryMemoryUsage                          NoOS_BTPS_QueryMemoryUsage
+#define BTPS_QueryMemoryStatistics                     NoOS_BTPS_QueryMemoryStatistics
+#define BTPS_SetMemoryTraceTag                         NoOS_BTPS_SetMemoryTraceTag
+#define BTPS_ReadMemoryTrace                           NoOS_BTPS_ReadMemoryTrace
+#define BTPS_DumpMemoryTrace                           NoOS_BTPS_DumpMemoryTrace
+#define BTPS_QueryMemoryPoolUsage                      NoOS_BTPS_QueryMemoryPoolUsage
+#define BTPS_LogMessage                                NoOS_BTPS_LogMessage
+#define BTPS_ReadLog                                   NoOS_BTPS_ReadLog
+#define BTPS_CreateMailbox                             NoOS_BTPS_CreateMailbox
+#define BTPS_AddMailbox                                NoOS_BTPS_AddMailbox
+#define BTPS_WaitMailbox                               NoOS_BTPS_WaitMailbox
+#define BTPS_QueryMailbox                              NoOS_BTPS_QueryMailbox
+#define BTPS_DeleteMailbox                             NoOS_BTPS_DeleteMailbox
+#define BTPS_AddMailboxPointer                         NoOS_BTPS_AddMailboxPointer
+#define BTPS_WaitMailboxPointer                        NoOS_BTPS_WaitMailboxPointer
+#define BTPS_OutputMessage                             NoOS_BTPS_OutputMessage
+#define BTPS_DumpData                                  NoOS_BTPS_DumpData
+
+#include "../BTPSKRNL.c"          /* No-OS Kernel (Heap, Scheduler, Mailbox). */
+
+#undef BTPS_Init
+#undef BTPS_DeInit
+#undef BTPS_Delay
+#undef BTPS_AddFunctionToScheduler
+#undef BTPS_DeleteFunctionFromScheduler
+#undef BTPS_ExecuteScheduler
+#undef BTPS_ProcessScheduler
+#undef BTPS_QueryScheduleTimeout
+#undef BTPS_AllocateMemory
+#undef BTPS_FreeMemory
+#undef BTPS_QueryMemoryUsage
+#undef BTPS_QueryMemoryStatistics
+#undef BTPS_SetMemoryTraceTag
+#undef BTPS_ReadMemoryTrace
+#undef BTPS_DumpMemoryTrace
+#undef BTPS_QueryMemoryPoolUsage
+#undef BTPS_LogMessage
+#undef BTPS_ReadLog
+#undef BTPS_CreateMailbox
+#undef BTPS_AddMailbox
+#undef BTPS_WaitMailbox
+#undef BTPS_QueryMailbox
+#undef BTPS_DeleteMailbox
+#undef BTPS_AddMailboxPointer
+#undef BTPS_WaitMailboxPointer
+#undef BTPS_OutputMessage
+#undef BTPS_DumpData
+
+   /* The following constant represents the time (in Milliseconds) that */
+   /* BTPS_ExecuteScheduler() waits between passes while only functions */
+   /* with a period of zero (polled functions) are scheduled.           */
+#define SCHEDULER_POLL_INTERVAL_MS                     (1)
+
+   /* The following structure is a container structure for a Mailbox    */
+   /* that was created (and not deleted yet).  BTPS_WaitMailbox() uses  */
+   /* the list of these to fail when the Mailbox is deleted while it    */
+   /* waits.                                                            */
+typedef struct _tagMailboxEntry_t
+{
+   Mailbox_t                   Mailbox;
+   struct _tagMailboxEntry_t  *NextMailboxEntry;
+} MailboxEntry_t;
+
+   /* Kernel lock.  KernelLockCount is the number of times that the     */
+   /* calling thread holds the lock (the lock may be taken again by a   */
+   /* scheduled function or by a callback).  KernelCondition is         */
+   /* signaled whenever Mailbox data is added, a Mailbox is deleted or  */
+   /* the scheduled functions change.                                   */
+static pthread_mutex_t        KernelMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t         KernelCondition;
+static Boolean_t              KernelConditionInitialized;
+static __thread unsigned int  KernelLockCount;
+
+static struct timespec        StartTime;        /* CLOCK_MONOTONIC time of    */
+                                                /* BTPS_Init() (Tick Count    */
+                                                /* zero).                     */
+
+static MailboxEntry_t        *MailboxList;      /* Mailboxes that exist.      */
+
+   /* Internal Function Prototypes.                                     */
+static void KernelLock(void);
+static void KernelUnlock(void);
+static void KernelWait(unsigned long MilliSeconds, Boolean_t Timed);
+static void KernelSignal(void);
+static unsigned long BTPSAPI MonotonicTickCount(void);
+static Boolean_t MailboxExists(Mailbox_t Mailbox);
+
+   /* The following function takes the kernel lock for the calling      */
+   /* thread (again, if it holds the lock already).                     */
+static void KernelLock(void)
+{
+   if(!KernelLockCount)
+      pthread_mutex_lock(&KernelMutex);
+
+   KernelLockCount++;
+}
+
+   /* The following function releases the kernel lock taken by the      */
+   /* matching KernelLock() call.                                       */
+static void KernelUnlock(void)
+{
+   if(!(--KernelLockCount))
+      pthread_mutex_unlock(&KernelMutex);
+}
+
+   /* The following function waits (with the kernel lock held) until    */
+   /* KernelCondition is signaled or (if Timed is TRUE) the specified   */
+   /* time (in Milliseconds) has elapsed.  The lock is released         */
+   /* completely during the wait (however many times the calling thread */
+   /* holds it), so that the other threads can add data or delete the   */
+   /* Mailbox that is waited on.                                        */
+   /* * NOTE * The caller must check its wait condition again when this */
+   /*          function returns (wake-ups may be spurious).             */
+static void KernelWait(unsigned long MilliSeconds, Boolean_t Timed)
+{
+   unsigned int    LockCount;
+   struct timespec Deadline;
+
+   LockCount       = KernelLockCount;
+   KernelLockCount = 0;
+
+   if(Timed)
+   {
+      clock_gettime(CLOCK_MONOTONIC, &Deadline);
+
+      Deadline.tv_sec  += (time_t)(MilliSeconds / 1000);
+      Deadline.tv_nsec += (long)((MilliSeconds % 1000) * 1000000L);
+      if(Deadline.tv_nsec >= 1000000000L)
+      {
+         Deadline.tv_sec++;
+         Deadline.tv_nsec -= 1000000000L;
+      }
+
+      pthread_cond_timedwait(&KernelCondition, &KernelMutex, &Deadline);
+   }
+   else
+      pthread_cond_wait(&KernelCondition, &KernelMutex);
+
+   KernelLockCount = LockCount;
+}
+
+   /* The following function wakes all threads that wait in             */
+   /* KernelWait().  The caller must hold the kernel lock.              */
+static void KernelSignal(void)
+{
+   pthread_cond_broadcast(&KernelCondition);
+}
+
+   /* The following function is the default Tick Count of this port     */
+   /* (used if no GetTickCountCallback was given to BTPS_Init()).  This */
+   /* function returns the Milliseconds since BTPS_Init() on the        */
+   /* CLOCK_MONOTONIC clock (which is not set back with the time of     */
+   /* day).                                                             */
+static unsigned long BTPSAPI MonotonicTickCount(void)
+{
+   struct timespec Now;
+
+   clock_gettime(CLOCK_MONOTONIC, &Now);
+
+   return((unsigned long)((Now.tv_sec - StartTime.tv_sec) * 1000L + (Now.tv_nsec - StartTime.tv_nsec) / 1000000L));
+}
+
+   /* The following function returns TRUE if the specified Mailbox was  */
+   /* created and has not been deleted, or FALSE otherwise.  The caller */
+   /* must hold the kernel lock.                                        */
+static Boolean_t MailboxExists(Mailbox_t Mailbox)
+{
+   MailboxEntry_t *MailboxEntry;
+
+   MailboxEntry = MailboxList;
+   while((MailboxEntry) && (MailboxEntry->Mailbox != Mailbox))
+      MailboxEntry = MailboxEntry->NextMailboxEntry;
+
+   return((Boolean_t)(MailboxEntry != NULL));
+}
+
+   /* The following function is responsible for delaying the current    */
+   /* task for the specified duration (specified in Milliseconds).  The */
+   /* kernel lock is released while the calling thread sleeps.          */
+void BTPSAPI BTPS_Delay(unsigned long MilliSeconds)
+{
+   unsigned int    LockCount;
+   struct timespec Delay;
+
+   Delay.tv_sec  = (time_t)(MilliSeconds / 1000);
+   Delay.tv_nsec = (long)((MilliSeconds % 1000) * 1000000L);
+
+   LockCount = KernelLockCount;
+   if(LockCount)
+   {
+      KernelLockCount = 0;
+      pthread_mutex_unlock(&KernelMutex);
+   }
+
+   /* Sleep again for the remaining time if a signal interrupted the    */
+   /* sleep.                                                            */
+   while((nanosleep(&Delay, &Delay)) && (errno == EINTR))
+      ;
+
+   if(LockCount)
+   {
+      pthread_mutex_lock(&KernelMutex);
+      KernelLockCount = LockCount;
+   }
+}
+
+Boolean_t BTPSAPI BTPS_AddFunctionToScheduler(BTPS_SchedulerFunction_t SchedulerFunction, void *SchedulerParameter, unsigned int Period)
+{
+   Boolean_t ret_val;
+
+   KernelLock();
+
+   if((ret_val = NoOS_BTPS_AddFunctionToScheduler(SchedulerFunction, SchedulerParameter, Period)) != FALSE)
+      KernelSignal();
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+void BTPSAPI BTPS_DeleteFunctionFromScheduler(BTPS_SchedulerFunction_t SchedulerFunction, void *SchedulerParameter)
+{
+   KernelLock();
+
+   NoOS_BTPS_DeleteFunctionFromScheduler(SchedulerFunction, SchedulerParameter);
+
+   KernelSignal();
+
+   KernelUnlock();
+}
+
+   /* The following function begins execution of the actual Scheduler.  */
+   /* Once this function is called, it NEVER returns.  Between passes   */
+   /* this function sleeps until the next scheduled function is due (or */
+   /* for SCHEDULER_POLL_INTERVAL_MS while functions with a period of   */
+   /* zero are scheduled), or until the scheduled functions change.     */
+   /* * NOTE * The time until the next function is due is in ticks of   */
+   /*          BTPS_GetTickCount() and is converted with                */
+   /*          MSP430_TICK_RATE_MS (one Millisecond per tick in this    */
+   /*          port).  A GetTickCountCallback given to BTPS_Init() must */
+   /*          therefore count Milliseconds (as the stack timeouts      */
+   /*          assume anyway), or the scheduler sleeps too long or too  */
+   /*          short.                                                   */
+void BTPSAPI BTPS_ExecuteScheduler(void)
+{
+   unsigned long Timeout;
+
+   KernelLock();
+
+   while(TRUE)
+   {
+      NoOS_BTPS_ProcessScheduler();
+
+      if(!NoOS_BTPS_QueryScheduleTimeout(&Timeout))
+      {
+         if(NumberScheduledFunctions)
+            KernelWait(SCHEDULER_POLL_INTERVAL_MS, TRUE);
+         else
+            KernelWait(0, FALSE);
+      }
+      else
+      {
+         if(Timeout)
+            KernelWait(TICKS_TO_MILLISECONDS(Timeout), TRUE);
+      }
+   }
+}
+
+void BTPSAPI BTPS_ProcessScheduler(void)
+{
+   KernelLock();
+
+   NoOS_BTPS_ProcessScheduler();
+
+   KernelUnlock();
+}
+
+   /* * NOTE * Mailboxes of this port are waited on by blocking, so     */
+   /*          they still do not set a time.                            */
+Boolean_t BTPSAPI BTPS_QueryScheduleTimeout(unsigned long *Timeout)
+{
+   Boolean_t ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_QueryScheduleTimeout(Timeout);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+void BTPSAPI *BTPS_AllocateMemory(unsigned long MemorySize)
+{
+   void *ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_AllocateMemory(MemorySize);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+void BTPSAPI BTPS_FreeMemory(void *MemoryPointer)
+{
+   KernelLock();
+
+   NoOS_BTPS_FreeMemory(MemoryPointer);
+
+   KernelUnlock();
+}
+
+int BTPSAPI BTPS_QueryMemoryUsage(unsigned int *Used, unsigned int *Free, unsigned int *MaxFree)
+{
+   int ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_QueryMemoryUsage(Used, Free, MaxFree);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+int BTPSAPI BTPS_QueryMemoryStatistics(BTPS_MemoryStatistics_t *Statistics)
+{
+   int ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_QueryMemoryStatistics(Statistics);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+Byte_t BTPSAPI BTPS_SetMemoryTraceTag(Byte_t Tag)
+{
+   Byte_t ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_SetMemoryTraceTag(Tag);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+unsigned int BTPSAPI BTPS_ReadMemoryTrace(unsigned int MaximumEntries, BTPS_MemoryTraceEntry_t *Entries, unsigned long *Lost)
+{
+   unsigned int ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_ReadMemoryTrace(MaximumEntries, Entries, Lost);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+void BTPSAPI BTPS_DumpMemoryTrace(void)
+{
+   KernelLock();
+
+   NoOS_BTPS_DumpMemoryTrace();
+
+   KernelUnlock();
+}
+
+Boolean_t BTPSAPI BTPS_QueryMemoryPoolUsage(unsigned int PoolIndex, BTPS_MemoryPoolUsage_t *Usage)
+{
+   Boolean_t ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_QueryMemoryPoolUsage(PoolIndex, Usage);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+void BTPSAPI BTPS_LogMessage(Word_t MessageID, unsigned int NumberArguments, DWord_t Argument1, DWord_t Argument2, DWord_t Argument3)
+{
+   KernelLock();
+
+   NoOS_BTPS_LogMessage(MessageID, NumberArguments, Argument1, Argument2, Argument3);
+
+   KernelUnlock();
+}
+
+unsigned int BTPSAPI BTPS_ReadLog(unsigned int BufferSize, Byte_t *Buffer, unsigned long *Lost)
+{
+   unsigned int ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_ReadLog(BufferSize, Buffer, Lost);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+Mailbox_t BTPSAPI BTPS_CreateMailbox(unsigned int NumberSlots, unsigned int SlotSize)
+{
+   Mailbox_t       ret_val;
+   MailboxEntry_t *MailboxEntry;
+
+   KernelLock();
+
+   if((ret_val = NoOS_BTPS_CreateMailbox(NumberSlots, SlotSize)) != NULL)
+   {
+      /* Note the Mailbox in the list of Mailboxes that exist.  The     */
+      /* list entry is bookkeeping of this port only, so it is taken    */
+      /* from the host with malloc() and does not use the kernel heap   */
+      /* (which keeps the usage of the MSP430 build).                   */
+      if((MailboxEntry = (MailboxEntry_t *)malloc(sizeof(MailboxEntry_t))) != NULL)
+      {
+         MailboxEntry->Mailbox          = ret_val;
+         MailboxEntry->NextMailboxEntry = MailboxList;
+         MailboxList                    = MailboxEntry;
+      }
+      else
+      {
+         NoOS_BTPS_DeleteMailbox(ret_val, NULL);
+
+         ret_val = NULL;
+      }
+   }
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+Boolean_t BTPSAPI BTPS_AddMailbox(Mailbox_t Mailbox, void *MailboxData)
+{
+   Boolean_t ret_val;
+
+   KernelLock();
+
+   if((ret_val = NoOS_BTPS_AddMailbox(Mailbox, MailboxData)) != FALSE)
+      KernelSignal();
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+   /* The following function is provided to allow a means to retrieve   */
+   /* data from the specified Mailbox.  This function blocks until data */
+   /* is placed in the Mailbox (returning TRUE) or the Mailbox is       */
+   /* deleted (returning FALSE).                                        */
+   /* * NOTE * This function must not be called from a Mailbox Delete   */
+   /*          Callback.                                                */
+Boolean_t BTPSAPI BTPS_WaitMailbox(Mailbox_t Mailbox, void *MailboxData)
+{
+   Boolean_t ret_val;
+
+   ret_val = FALSE;
+
+   if((Mailbox) && (MailboxData))
+   {
+      KernelLock();
+
+      while((MailboxExists(Mailbox)) && ((ret_val = NoOS_BTPS_WaitMailbox(Mailbox, MailboxData)) == FALSE))
+         KernelWait(0, FALSE);
+
+      KernelUnlock();
+   }
+
+   return(ret_val);
+}
+
+Boolean_t BTPSAPI BTPS_QueryMailbox(Mailbox_t Mailbox)
+{
+   Boolean_t ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_QueryMailbox(Mailbox);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+   /* The following function is responsible for destroying a Mailbox.   */
+   /* The BTPS_WaitMailbox() calls that wait on the Mailbox return      */
+   /* FALSE.                                                            */
+void BTPSAPI BTPS_DeleteMailbox(Mailbox_t Mailbox, BTPS_MailboxDeleteCallback_t MailboxDeleteCallback)
+{
+   MailboxEntry_t **MailboxEntry;
+   MailboxEntry_t  *DeleteEntry;
+
+   KernelLock();
+
+   /* Remove the Mailbox from the list of Mailboxes that exist and wake */
+   /* the threads that wait on it.                                      */
+   MailboxEntry = &MailboxList;
+   while((*MailboxEntry) && ((*MailboxEntry)->Mailbox != Mailbox))
+      MailboxEntry = &((*MailboxEntry)->NextMailboxEntry);
+
+   if(*MailboxEntry)
+   {
+      DeleteEntry   = *MailboxEntry;
+      *MailboxEntry = DeleteEntry->NextMailboxEntry;
+
+      free(DeleteEntry);
+
+      KernelSignal();
+   }
+
+   NoOS_BTPS_DeleteMailbox(Mailbox, MailboxDeleteCallback);
+
+   KernelUnlock();
+}
+
+Boolean_t BTPSAPI BTPS_AddMailboxPointer(Mailbox_t Mailbox, void *Buffer)
+{
+   Boolean_t ret_val;
+
+   KernelLock();
+
+   if((ret_val = NoOS_BTPS_AddMailboxPointer(Mailbox, Buffer)) != FALSE)
+      KernelSignal();
+
+   KernelUnlock();
+
+   return(ret_val);
+}
+
+   /* The following function blocks (as BTPS_WaitMailbox()) until a     */
+   /* pointer is placed in the Mailbox or the Mailbox is deleted.       */
+Boolean_t BTPSAPI BTPS_WaitMailboxPointer(Mailbox_t Mailbox, void **Buffer)
+{
+   Boolean_t ret_val;
+
+   ret_val = FALSE;
+
+   if((Mailbox) && (Buffer))
+   {
+      KernelLock();
+
+      while((MailboxExists(Mailbox)) && ((ret_val = NoOS_BTPS_WaitMailboxPointer(Mailbox, Buffer)) == FALSE))
+         KernelWait(0, FALSE);
+
+      KernelUnlock();
+   }
+
+   return(ret_val);
+}
+
+   /* The following function is responsible for the initialization of   */
+   /* the kernel (see the No-OS BTPS_Init()).  If no                    */
+   /* GetTickCountCallback is specified the Tick Count is the           */
+   /* Milliseconds since this call on the CLOCK_MONOTONIC clock.        */
+void BTPSAPI BTPS_Init(void *UserParam)
+{
+   pthread_condattr_t ConditionAttributes;
+
+   /* The condition variable waits on the CLOCK_MONOTONIC clock (as the */
+   /* Tick Count), so the scheduler does not oversleep when the time of */
+   /* day is set.                                                       */
+   if(!KernelConditionInitialized)
+   {
+      pthread_condattr_init(&ConditionAttributes);
+      pthread_condattr_setclock(&ConditionAttributes, CLOCK_MONOTONIC);
+      pthread_cond_init(&KernelCondition, &ConditionAttributes);
+      pthread_condattr_destroy(&ConditionAttributes);
+
+      KernelConditionInitialized = TRUE;
+   }
+
+   KernelLock();
+
+   clock_gettime(CLOCK_MONOTONIC, &StartTime);
+
+   NoOS_BTPS_Init(UserParam);
+
+   if(!GetTickCountCallback)
+      GetTickCountCallback = MonotonicTickCount;
+
+   KernelUnlock();
+}
+
+void BTPSAPI BTPS_DeInit(void)
+{
+   KernelLock();
+
+   NoOS_BTPS_DeInit();
+
+   KernelUnlock();
+}
+
+   /* Write out the specified NULL terminated Debugging String to the   */
+   /* Debug output.                                                     */
+void BTPSAPI BTPS_OutputMessage(BTPSCONST char *DebugString, ...)
+{
+   int     ret_val;
+   va_list args;
+
+   KernelLock();
+
+   va_start(args, DebugString);
+   ret_val = vSprintF(DebugMsgBuffer, DebugString, args);
+   va_end(args);
+
+   ConsoleWrite(DebugMsgBuffer, ret_val);
+
+   KernelUnlock();
+}
+
+int BTPSAPI BTPS_DumpData(unsigned int DataLength, BTPSCONST unsigned char *DataPtr)
+{
+   int ret_val;
+
+   KernelLock();
+
+   ret_val = NoOS_BTPS_DumpData(DataLength, DataPtr);
+
+   KernelUnlock();
+
+   return(ret_val);
+}
@@ -0,0 +1,608 @@
+/*****< heapbnch.c >***********************************************************/
+/*                                                                            */
+/*  HEAPBNCH - Heap allocator benchmark for POSIX hosts.                      */
+/*                                                                            */
+/*  Replays a heap allocation trace against the heap of the No-OS kernel      */
+/*  (size class free lists, _Malloc()/_MemFree() of ../BTPSKRNL.c) and        */
+/*  against the first-fit heap walk that it replaced (a copy of it is kept    */
+/*  below), each on a heap of BTPS_MEMORY_BUFFER_SIZE bytes, and reports for  */
+/*  both the requests that fail, the peak of the used heap and the time per   */
+/*  operation.  A checked pass fills every allocation with a pattern and      */
+/*  verifies it when it is freed (and that the heap is one free fragment at   */
+/*  the end), so that an allocator that hands out overlapping fragments is    */
+/*  reported as well.                                                         */
+/*                                                                            */
+/*  The trace is either a recording of the firmware (heap_trace.mat written   */
+/*  as text by heap_trace_replay.m, one "Operation Tag Size Offset" entry     */
+/*  per line) or, without a file, a synthetic trace under memory pressure     */
+/*  (requests of mixed sizes that keep the live data near a fill level of the */
+/*  heap, freed partly in order and partly at random).                        */
+/*                                                                            */
+/*  Build (this module includes posix/BTPSKRNL.c, do not compile it too) :    */
+/*     gcc -O2 -I<btpskrnl> -I<include> -DBTPS_MEMORY_BUFFER_SIZE=<bytes>     */
+/*         '-DBTPS_ALIGNMENT_TYPE=unsigned short' posix/HEAPBNCH.c sprintf.c  */
+/*         -lpthread                                                          */
+/*  (the alignment type of the MSP430, so that the fragments are laid out as  */
+/*  on the target).  Run : HEAPBNCH [trace file], or HEAPBNCH -s [seed]       */
+/*  [fill percent] for the synthetic trace.                                   */
+/******************************************************************************/
+#include "BTPSKRNL.c"            /* POSIX Kernel (with the No-OS heap).       */
+
+#include <stdio.h>
+#include <string.h>
+
+   /* The following constants are the operations of the trace (see      */
+   /* BTPS_MEMORY_TRACE_OPERATION_xxx).  A failed request of the        */
+   /* recording is replayed as a request that is freed right away.      */
+#define TRACE_OPERATION_ALLOCATE                       1
+#define TRACE_OPERATION_FREE                           2
+#define TRACE_OPERATION_FAILURE                        5
+
+   /* The following constants represent the largest trace that is       */
+   /* replayed and the number of distinct live objects (the Offset of   */
+   /* the recording, in alignment units, is the key of an object).      */
+#define MAXIMUM_TRACE_ENTRIES                          1000000
+#define MAXIMUM_OBJECTS                                65536
+
+   /* The following constants are the defaults of the synthetic trace : */
+   /* the number of requests, the live data that is kept (percent of    */
+   /* the heap) and the share of the frees that take the oldest object  */
+   /* (the others take a random one).                                   */
+#define SYNTHETIC_REQUESTS                             200000
+#define SYNTHETIC_FILL_PERCENT                         80
+#define SYNTHETIC_IN_ORDER_PERCENT                     50
+
+   /* The following constant represents the number of timed passes of   */
+   /* the replay (the first, checked pass is not timed).                */
+#define TIMED_PASSES                                   20
+
+   /* The following structure represents an entry of the trace.         */
+typedef struct _tagTraceEntry_t
+{
+   Byte_t Operation;
+   Word_t Size;
+   Word_t Key;
+} TraceEntry_t;
+
+   /* The following structure represents an allocator that is replayed. */
+typedef struct _tagAllocator_t
+{
+   char       *Name;
+   void     *(*Allocate)(unsigned long Size);
+   void      (*Free)(void *MemoryPtr);
+   Word_t    (*UsedUnits)(void);
+   Boolean_t (*Whole)(void);
+} Allocator_t;
+
+   /* The following structure holds the result of the replay of one     */
+   /* allocator.                                                        */
+typedef struct _tagReplayResult_t
+{
+   unsigned long Requests;
+   unsigned long Failures;
+   unsigned long Bad;
+   Word_t        PeakUnits;
+   double        NanoSecondsPerOperation;
+} ReplayResult_t;
+
+   /* Internal Variables to this Module (Remember that all variables    */
+   /* declared static are initialized to 0 automatically by the         */
+   /* compiler as part of standard C/C++).                              */
+static TraceEntry_t  Trace[MAXIMUM_TRACE_ENTRIES];
+static unsigned long TraceEntries;
+
+static void         *Object[MAXIMUM_OBJECTS];   /* Live objects by key.       */
+static Word_t        ObjectSize[MAXIMUM_OBJECTS];
+
+static unsigned long RandomState;               /* State of the pseudo random */
+                                                /* number generator.          */
+
+   /* First-fit heap (the allocator of the kernel before the size       */
+   /* classes), on its own buffer of the same size.                     */
+static Alignment_t   FirstFitBuffer[(BTPS_MEMORY_BUFFER_SIZE/ALIGNMENT_SIZE) + 1];
+static HeapInfo_t   *FirstFitHead;
+static HeapInfo_t   *FirstFitTail;
+static Word_t        FirstFitUsedUnits;
+
+   /* Internal Function Prototypes.                                     */
+static unsigned long Random(unsigned long Range);
+static void FirstFitInit(void);
+static void *FirstFitMalloc(unsigned long Size);
+static void FirstFitFree(void *MemoryPtr);
+static Word_t FirstFitUsed(void);
+static Boolean_t FirstFitWhole(void);
+static void *KernelMalloc(unsigned long Size);
+static void KernelFree(void *MemoryPtr);
+static Word_t KernelUsed(void);
+static Boolean_t KernelWhole(void);
+static Boolean_t ReadTrace(char *FileName);
+static void SyntheticTrace(unsigned long Seed, unsigned int FillPercent);
+static unsigned long ReplayPass(Allocator_t *Allocator, Boolean_t Checked, ReplayResult_t *Result);
+static void Replay(Allocator_t *Allocator, ReplayResult_t *Result);
+
+   /* The following function returns a pseudo random number from 0 to   */
+   /* Range - 1 (xorshift, so that the synthetic trace is the same on   */
+   /* every host).                                                      */
+static unsigned long Random(unsigned long Range)
+{
+   RandomState ^= (RandomState << 13) & 0xFFFFFFFFUL;
+   RandomState ^= RandomState >> 17;
+   RandomState ^= (RandomState << 5) & 0xFFFFFFFFUL;
+
+   return((RandomState & 0xFFFFFFFFUL) % Range);
+}
+
+   /* The following function initializes the first-fit heap (one free   */
+   /* fragment).                                                        */
+static void FirstFitInit(void)
+{
+   Word_t HeapSize;
+
+   HeapSize                 = sizeof(FirstFitBuffer) / ALIGNMENT_SIZE;
+
+   FirstFitHead             = (HeapInfo_t *)FirstFitBuffer;
+   FirstFitHead->PrevSize   = HeapSize;
+   FirstFitHead->Size       = HeapSize;
+
+   FirstFitTail             = (HeapInfo_t *)(FirstFitBuffer + HeapSize);
+
+   FirstFitUsedUnits        = 0;
+}
+
+   /* The following function is the _Malloc() of the kernel before the  */
+   /* size classes : the fragments are walked from the start of the     */
+   /* heap for small requests and from the end of the heap for requests */
+   /* of LARGE_SIZE or more, and the first one that is large enough is  */
+   /* taken.                                                            */
+static void *FirstFitMalloc(unsigned long Size)
+{
+   HeapInfo_t *HeapInfoPtr;
+   HeapInfo_t *TmpInfoPtr;
+   Word_t      TmpSize;
+   void       *ret_val;
+
+   if(Size % ALIGNMENT_SIZE)
+      Size = (Size / ALIGNMENT_SIZE) + 1;
+   else
+      Size /= ALIGNMENT_SIZE;
+
+   Size += HEAP_INFO_DATA_SIZE(0);
+
+   ret_val = NULL;
+
+   if((Size >= HEAP_INFO_DATA_SIZE(1)) && (!(Size & SEGMENT_ALLOCATED_BITMASK)))
+   {
+      if(Size >= LARGE_SIZE)
+         HeapInfoPtr = (HeapInfo_t *)(((Alignment_t *)FirstFitTail) - FirstFitHead->PrevSize);
+      else
+         HeapInfoPtr = FirstFitHead;
+
+      while(((Size < LARGE_SIZE) || (HeapInfoPtr != FirstFitHead)) && (HeapInfoPtr != FirstFitTail))
+      {
+         if((HeapInfoPtr->Size & SEGMENT_ALLOCATED_BITMASK) || (HeapInfoPtr->Size < Size))
+         {
+            if(Size >= LARGE_SIZE)
+               HeapInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) - (HeapInfoPtr->PrevSize));
+            else
+               HeapInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) + (HeapInfoPtr->Size & SEGMENT_SIZE_BITMASK));
+         }
+         else
+            break;
+      }
+
+      if((HeapInfoPtr != FirstFitTail) && (!(HeapInfoPtr->Size & SEGMENT_ALLOCATED_BITMASK)) && (HeapInfoPtr->Size >= Size))
+      {
+         if(HeapInfoPtr->Size >= (Size + HEAP_INFO_DATA_SIZE(MINIMUM_MEMORY_SIZE)))
+         {
+            TmpSize = HeapInfoPtr->Size - Size;
+
+            if(Size >= LARGE_SIZE)
+            {
+               TmpInfoPtr           = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) + TmpSize);
+               TmpInfoPtr->PrevSize = TmpSize;
+               TmpInfoPtr->Size     = Size | SEGMENT_ALLOCATED_BITMASK;
+               HeapInfoPtr->Size    = TmpSize;
+               HeapInfoPtr          = TmpInfoPtr;
+               TmpSize              = Size;
+            }
+            else
+            {
+               TmpInfoPtr           = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) + Size);
+               TmpInfoPtr->PrevSize = Size;
+               TmpInfoPtr->Size     = TmpSize;
+               HeapInfoPtr->Size    = Size | SEGMENT_ALLOCATED_BITMASK;
+            }
+
+            TmpInfoPtr = (HeapInfo_t *)(((Alignment_t *)TmpInfoPtr) + TmpSize);
+
+            if(TmpInfoPtr == FirstFitTail)
+               FirstFitHead->PrevSize = TmpSize;
+            else
+               TmpInfoPtr->PrevSize = TmpSize;
+         }
+         else
+            HeapInfoPtr->Size |= SEGMENT_ALLOCATED_BITMASK;
+
+         FirstFitUsedUnits += HeapInfoPtr->Size & SEGMENT_SIZE_BITMASK;
+
+         ret_val = (void *)&HeapInfoPtr->Data;
+      }
+   }
+
+   return(ret_val);
+}
+
+   /* The following function is the _MemFree() of the kernel before the */
+   /* size classes (the fragment is merged with its free neighbours).   */
+static void FirstFitFree(void *MemoryPtr)
+{
+   HeapInfo_t *HeapInfoPtr;
+   HeapInfo_t *TmpInfoPtr;
+
+   HeapInfoPtr = (HeapInfo_t *)(((Alignment_t *)MemoryPtr) - HEAP_INFO_DATA_SIZE(0));
+
+   if(HeapInfoPtr->Size & SEGMENT_ALLOCATED_BITMASK)
+   {
+      HeapInfoPtr->Size &= SEGMENT_SIZE_BITMASK;
+
+      FirstFitUsedUnits -= HeapInfoPtr->Size;
+
+      if(HeapInfoPtr != FirstFitHead)
+      {
+         TmpInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) - HeapInfoPtr->PrevSize);
+
+         if(!(TmpInfoPtr->Size & SEGMENT_ALLOCATED_BITMASK))
+         {
+            TmpInfoPtr->Size += HeapInfoPtr->Size;
+            HeapInfoPtr       = TmpInfoPtr;
+         }
+      }
+
+      TmpInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) + HeapInfoPtr->Size);
+
+      if(TmpInfoPtr == FirstFitTail)
+         FirstFitHead->PrevSize = HeapInfoPtr->Size;
+      else
+      {
+         if(TmpInfoPtr->Size & SEGMENT_ALLOCATED_BITMASK)
+            TmpInfoPtr->PrevSize = HeapInfoPtr->Size;
+         else
+         {
+            HeapInfoPtr->Size += TmpInfoPtr->Size;
+
+            TmpInfoPtr = (HeapInfo_t *)(((Alignment_t *)HeapInfoPtr) + HeapInfoPtr->Size);
+
+            if(TmpInfoPtr == FirstFitTail)
+               FirstFitHead->PrevSize = HeapInfoPtr->Size;
+            else
+               TmpInfoPtr->PrevSize = HeapInfoPtr->Size;
+         }
+      }
+   }
+}
+
+   /* The following function returns the used memory of the first-fit   */
+   /* heap (alignment units).                                           */
+static Word_t FirstFitUsed(void)
+{
+   return(FirstFitUsedUnits);
+}
+
+   /* The following function returns TRUE if the first-fit heap is one  */
+   /* free fragment (as it is when every object was freed).             */
+static Boolean_t FirstFitWhole(void)
+{
+   return((Boolean_t)(FirstFitHead->Size == (Word_t)(((Alignment_t *)FirstFitTail) - ((Alignment_t *)FirstFitHead))));
+}
+
+   /* The following functions are the heap of the kernel (without the   */
+   /* kernel lock, the memory pools and the trace of                    */
+   /* BTPS_AllocateMemory(), so that only the allocators are compared). */
+static void *KernelMalloc(unsigned long Size)
+{
+   return(_Malloc(Size));
+}
+
+static void KernelFree(void *MemoryPtr)
+{
+   _MemFree(MemoryPtr);
+}
+
+static Word_t KernelUsed(void)
+{
+   return((Word_t)(((Alignment_t *)HeapTail) - ((Alignment_t *)HeapHead) - HeapFreeUnits));
+}
+
+static Boolean_t KernelWhole(void)
+{
+   return((Boolean_t)((HeapHead->Size == (Word_t)(((Alignment_t *)HeapTail) - ((Alignment_t *)HeapHead))) && (HeapFreeUnits == HeapHead->Size)));
+}
+
+   /* The following function reads a trace file (one "Operation Tag     */
+   /* Size Offset" entry per line, the other operations are skipped).   */
+   /* This function returns TRUE if the file was read.                  */
+static Boolean_t ReadTrace(char *FileName)
+{
+   FILE          *File;
+   Boolean_t      ret_val;
+   unsigned long  Operation;
+   unsigned long  Tag;
+   unsigned long  Size;
+   unsigned long  Offset;
+
+   if((File = fopen(FileName, "r")) != NULL)
+   {
+      while((TraceEntries < MAXIMUM_TRACE_ENTRIES) && (fscanf(File, "%lu %lu %lu %lu", &Operation, &Tag, &Size, &Offset) == 4))
+      {
+         if((Operation == TRACE_OPERATION_ALLOCATE) || (Operation == TRACE_OPERATION_FREE) || (Operation == TRACE_OPERATION_FAILURE))
+         {
+            Trace[TraceEntries].Operation = (Byte_t)Operation;
+            Trace[TraceEntries].Size      = (Word_t)Size;
+            Trace[TraceEntries].Key       = (Word_t)(Offset % MAXIMUM_OBJECTS);
+            TraceEntries++;
+         }
+      }
+
+      fclose(File);
+
+      ret_val = TRUE;
+   }
+   else
+      ret_val = FALSE;
+
+   return(ret_val);
+}
+
+   /* The following function builds the synthetic trace.  The requests  */
+   /* are small (up to 40 bytes, most of them), medium (up to LARGE_SIZE*/
+   /* on the MSP430) or large (up to 600 bytes).  A request is made     */
+   /* while the live data is below FillPercent of the heap, otherwise   */
+   /* an object is freed (the oldest one or a random one).              */
+static void SyntheticTrace(unsigned long Seed, unsigned int FillPercent)
+{
+   Word_t         Live[MAXIMUM_OBJECTS];
+   unsigned long  LiveNo;
+   unsigned long  LiveBytes;
+   unsigned long  Requests;
+   unsigned long  Index;
+   unsigned long  Key;
+   Word_t         Size;
+
+   RandomState = Seed | 1;
+   LiveNo      = 0;
+   LiveBytes   = 0;
+   Key         = 0;
+
+   for(Requests=0;(Requests<SYNTHETIC_REQUESTS) && (TraceEntries<(MAXIMUM_TRACE_ENTRIES - 1));)
+   {
+      if((LiveNo < MAXIMUM_OBJECTS) && ((LiveBytes * 100) < ((unsigned long)BTPS_MEMORY_BUFFER_SIZE * FillPercent)))
+      {
+         Index = Random(100);
+         if(Index < 60)
+            Size = (Word_t)(4 + Random(37));
+         else
+         {
+            if(Index < 90)
+               Size = (Word_t)(41 + Random(210));
+            else
+               Size = (Word_t)(256 + Random(345));
+         }
+
+         /* The key of the object is a free one (after the last one).   */
+         while(ObjectSize[Key])
+            Key = (Key + 1) % MAXIMUM_OBJECTS;
+
+         ObjectSize[Key]               = Size;
+         Live[LiveNo++]                = (Word_t)Key;
+         LiveBytes                    += Size;
+
+         Trace[TraceEntries].Operation = TRACE_OPERATION_ALLOCATE;
+         Trace[TraceEntries].Size      = Size;
+         Trace[TraceEntries].Key       = (Word_t)Key;
+         TraceEntries++;
+         Requests++;
+      }
+      else
+      {
+         /* Free the oldest object or a random one.                     */
+         if(Random(100) < SYNTHETIC_IN_ORDER_PERCENT)
+            Index = 0;
+         else
+            Index = Random(LiveNo);
+
+         Key = Live[Index];
+
+         memmove(&Live[Index], &Live[Index + 1], (LiveNo - Index - 1) * sizeof(Live[0]));
+         LiveNo--;
+
+         LiveBytes                    -= ObjectSize[Key];
+         ObjectSize[Key]               = 0;
+
+         Trace[TraceEntries].Operation = TRACE_OPERATION_FREE;
+         Trace[TraceEntries].Size      = 0;
+         Trace[TraceEntries].Key       = (Word_t)Key;
+         TraceEntries++;
+      }
+   }
+
+   memset(ObjectSize, 0, sizeof(ObjectSize));
+}
+
+   /* The following function replays the trace once against the         */
+   /* specified allocator and frees the objects that are left, so that  */
+   /* the heap is one free fragment again.  If Checked is TRUE, every   */
+   /* object is filled with a pattern of its key that is verified when  */
+   /* it is freed, and the failures, errors and peak are counted in the */
+   /* result.  This function returns the number of operations.          */
+static unsigned long ReplayPass(Allocator_t *Allocator, Boolean_t Checked, ReplayResult_t *Result)
+{
+   unsigned long  Index;
+   unsigned long  Operations;
+   unsigned long  Key;
+   Word_t         Used;
+   Word_t         Count;
+   unsigned char *Ptr;
+   unsigned char  Pattern;
+
+   Operations = 0;
+
+   for(Index=0;Index<=TraceEntries;Index++)
+   {
+      if(Index < TraceEntries)
+         Key = Trace[Index].Key;
+      else
+         Key = 0;
+
+      if((Index < TraceEntries) && (Trace[Index].Operation != TRACE_OPERATION_FREE))
+      {
+         /* An object of the recording that is allocated again (its     */
+         /* free was not recorded) is freed first.                      */
+         if(Object[Key])
+         {
+            Allocator->Free(Object[Key]);
+            Object[Key] = NULL;
+            Operations++;
+         }
+
+         Operations++;
+
+         if((Ptr = (unsigned char *)Allocator->Allocate(Trace[Index].Size)) != NULL)
+         {
+            if(Checked)
+            {
+               Pattern = (unsigned char)(Key * 31 + 7);
+               for(Count=0;Count<Trace[Index].Size;Count++)
+                  Ptr[Count] = (unsigned char)(Pattern + Count);
+
+               if((Used = Allocator->UsedUnits()) > Result->PeakUnits)
+                  Result->PeakUnits = Used;
+            }
+
+            if(Trace[Index].Operation == TRACE_OPERATION_ALLOCATE)
+            {
+               Object[Key]     = Ptr;
+               ObjectSize[Key] = Trace[Index].Size;
+            }
+            else
+            {
+               Allocator->Free(Ptr);
+               Operations++;
+            }
+         }
+         else
+         {
+            if(Checked)
+               Result->Failures++;
+         }
+
+         if(Checked)
+            Result->Requests++;
+      }
+      else
+      {
+         /* Free the object (or, after the trace, every object that is  */
+         /* left).                                                      */
+         do
+         {
+            if((Ptr = (unsigned char *)Object[Key]) != NULL)
+            {
+               if(Checked)
+               {
+                  Pattern = (unsigned char)(Key * 31 + 7);
+                  for(Count=0;Count<ObjectSize[Key];Count++)
+                  {
+                     if(Ptr[Count] != (unsigned char)(Pattern + Count))
+                     {
+                        Result->Bad++;
+                        break;
+                     }
+                  }
+               }
+
+               Allocator->Free(Ptr);
+               Object[Key] = NULL;
+               Operations++;
+            }
+         } while((Index == TraceEntries) && (++Key < MAXIMUM_OBJECTS));
+      }
+   }
+
+   if((Checked) && (!Allocator->Whole()))
+      Result->Bad++;
+
+   return(Operations);
+}
+
+   /* The following function replays the trace against the specified    */
+   /* allocator : a checked pass and TIMED_PASSES timed passes.         */
+static void Replay(Allocator_t *Allocator, ReplayResult_t *Result)
+{
+   unsigned long   Operations;
+   unsigned int    Pass;
+   struct timespec Start;
+   struct timespec End;
+
+   memset(Result, 0, sizeof(ReplayResult_t));
+
+   ReplayPass(Allocator, TRUE, Result);
+
+   Operations = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &Start);
+
+   for(Pass=0;Pass<TIMED_PASSES;Pass++)
+      Operations += ReplayPass(Allocator, FALSE, Result);
+
+   clock_gettime(CLOCK_MONOTONIC, &End);
+
+   if(Operations)
+      Result->NanoSecondsPerOperation = (((double)(End.tv_sec - Start.tv_sec) * 1e9) + (double)(End.tv_nsec - Start.tv_nsec)) / (double)Operations;
+}
+
+int main(int argc, char *argv[])
+{
+   int            ret_val;
+   unsigned int   Index;
+   ReplayResult_t Result;
+   Allocator_t    Allocator[2] =
+   {
+      { "first fit  ", FirstFitMalloc, FirstFitFree, FirstFitUsed, FirstFitWhole },
+      { "size class ", KernelMalloc,   KernelFree,   KernelUsed,   KernelWhole   }
+   };
+
+   if((argc > 1) && (strcmp(argv[1], "-s")))
+   {
+      if(ReadTrace(argv[1]))
+         ret_val = 0;
+      else
+      {
+         printf("HEAPBNCH: cannot read %s\n", argv[1]);
+         ret_val = 1;
+      }
+   }
+   else
+   {
+      SyntheticTrace((argc > 2)?strtoul(argv[2], NULL, 0):1, (argc > 3)?(unsigned int)strtoul(argv[3], NULL, 0):SYNTHETIC_FILL_PERCENT);
+      ret_val = 0;
+   }
+
+   if(!ret_val)
+   {
+      FirstFitInit();
+      HeapInit();
+
+      printf("Heap %u bytes, alignment %u bytes, %lu trace entries\n", (unsigned int)BTPS_MEMORY_BUFFER_SIZE, (unsigned int)ALIGNMENT_SIZE, TraceEntries);
+
+      for(Index=0;Index<(sizeof(Allocator)/sizeof(Allocator[0]));Index++)
+      {
+         Replay(&Allocator[Index], &Result);
+
+         printf("%s: requests %lu failed %lu (%.2f%%) peak %lu bytes %.1f ns/op errors %lu\n", Allocator[Index].Name, Result.Requests, Result.Failures, (Result.Requests)?((100.0 * Result.Failures) / Result.Requests):0.0, (unsigned long)Result.PeakUnits * ALIGNMENT_SIZE, Result.NanoSecondsPerOperation, Result.Bad);
+
+         if(Result.Bad)
+            ret_val = 1;
+      }
+   }
+
+   return(ret_val);
+}
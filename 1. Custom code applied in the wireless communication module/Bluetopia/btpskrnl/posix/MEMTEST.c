@@ -0,0 +1,510 @@
+/*****< memtest.c >************************************************************/
+/*                                                                            */
+/*  MEMTEST - Test of the BTPS memory functions for POSIX hosts.              */
+/*                                                                            */
+/*  Checks BTPS_MemCopy(), BTPS_MemMove(), BTPS_MemInitialize() and           */
+/*  BTPS_MemCompare() of the kernel (../BTPSKRNL.c, which moves a word at a   */
+/*  time when the blocks have the same word alignment) against the C          */
+/*  run-time, then measures their throughput against the byte loops that      */
+/*  they replaced (the C run-time of the MSP430 moves a byte at a time).      */
+/*  The correctness sweep covers :                                            */
+/*     - every source and destination alignment (0 to 7 bytes),               */
+/*     - the sizes across the word transfer threshold and the odd head and    */
+/*       tail bytes (every size up to 40 bytes, then sizes around powers of   */
+/*       two up to 1025 bytes),                                               */
+/*     - BTPS_MemMove() with overlaps in both directions (the Destination     */
+/*       from 17 bytes before to 17 bytes after the Source),                  */
+/*     - the sign of BTPS_MemCompare() for a difference at every position     */
+/*       (both signs, bytes above 0x7F, a later difference of the opposite    */
+/*       sign and a difference just past Size that must be ignored),          */
+/*  and checks that no byte around the Destination is written.  The           */
+/*  throughput is in cycles per byte (time stamp counter) on x86 hosts and    */
+/*  in Nanoseconds per byte otherwise.                                        */
+/*                                                                            */
+/*  Build (see posix/BTPSKRNL.c) :                                            */
+/*     gcc -O2 -fno-tree-loop-distribute-patterns -fno-tree-vectorize         */
+/*         -I<btpskrnl> -I<include> posix/BTPSKRNL.c sprintf.c                */
+/*         posix/MEMTEST.c -lpthread                                          */
+/*  (without the two options gcc turns the byte loops into calls of the C     */
+/*  run-time, and vectorizes the word loops, which the MSP430 compiler does   */
+/*  not).  The program returns 0 if every check passed.                       */
+/******************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "BTPSKRNL.h"            /* Bluetooth Kernel Protoypes/Constants.     */
+
+   /* The following constants represent the largest alignment that is   */
+   /* tested, the bytes around the Destination that are checked and the */
+   /* largest overlap of BTPS_MemMove() that is tested.                 */
+#define MAXIMUM_ALIGNMENT                              8
+#define GUARD_SIZE                                     16
+#define MAXIMUM_OVERLAP                                17
+
+   /* The following constant represents the size of the test buffers.   */
+#define BUFFER_SIZE                                    (1100 + (2 * (GUARD_SIZE + MAXIMUM_ALIGNMENT + MAXIMUM_OVERLAP)))
+
+   /* The following constants are the value of the bytes around the     */
+   /* Destination and the number of errors that are printed.            */
+#define GUARD_VALUE                                    0xA5
+#define MAXIMUM_PRINTED_ERRORS                         10
+
+   /* The following constant represents the bytes that are moved by     */
+   /* each function and size in the throughput measurement.             */
+#define THROUGHPUT_BYTES                               (32UL * 1024 * 1024)
+
+   /* The following structure represents the functions that are         */
+   /* measured : the kernel functions or the byte loops.                */
+typedef struct _tagMemFunctions_t
+{
+   char  *Name;
+   void (*Copy)(void *Destination, BTPSCONST void *Source, unsigned long Size);
+   void (*Move)(void *Destination, BTPSCONST void *Source, unsigned long Size);
+   void (*Initialize)(void *Destination, unsigned char Value, unsigned long Size);
+   int  (*Compare)(BTPSCONST void *Source1, BTPSCONST void *Source2, unsigned long Size);
+} MemFunctions_t;
+
+   /* Internal Variables to this Module (Remember that all variables    */
+   /* declared static are initialized to 0 automatically by the         */
+   /* compiler as part of standard C/C++).                              */
+static unsigned long Sizes[] = { 63, 64, 65, 127, 128, 129, 255, 256, 257, 511, 512, 513, 1000, 1001, 1023, 1024, 1025 };
+
+static unsigned char Source[BUFFER_SIZE];
+static unsigned char Destination[BUFFER_SIZE];
+static unsigned char Expected[BUFFER_SIZE];
+
+static unsigned long Checks;
+static unsigned long Errors;
+
+static volatile int  Sink;                      /* Results of the measured    */
+                                                /* compares (so that they are */
+                                                /* not optimized away).       */
+
+   /* Internal Function Prototypes.                                     */
+static unsigned long SizeValue(unsigned int Index);
+static void Fill(unsigned char *Buffer, unsigned long Size, unsigned int Seed);
+static void Check(Boolean_t Passed, char *Function, unsigned long SourceAlignment, unsigned long DestinationAlignment, unsigned long Size, long Position);
+static void TestCopy(void);
+static void TestMove(void);
+static void TestInitialize(void);
+static void TestCompare(void);
+static void ByteCopy(void *Destination, BTPSCONST void *Source, unsigned long Size);
+static void ByteMove(void *Destination, BTPSCONST void *Source, unsigned long Size);
+static void ByteInitialize(void *Destination, unsigned char Value, unsigned long Size);
+static int ByteCompare(BTPSCONST void *Source1, BTPSCONST void *Source2, unsigned long Size);
+static unsigned long long Now(void);
+static double Throughput(MemFunctions_t *Functions, unsigned int Function, unsigned long Size, unsigned long SourceAlignment, unsigned long DestinationAlignment);
+static void TestThroughput(void);
+
+   /* The following function returns the size of the specified index of */
+   /* the sweep : every size up to 40 bytes, then the Sizes list.  This */
+   /* function returns 0 after the last size.                           */
+static unsigned long SizeValue(unsigned int Index)
+{
+   unsigned long ret_val;
+
+   if(Index <= 40)
+      ret_val = Index;
+   else
+   {
+      if((Index - 41) < (sizeof(Sizes)/sizeof(Sizes[0])))
+         ret_val = Sizes[Index - 41];
+      else
+         ret_val = 0;
+   }
+
+   return(ret_val);
+}
+
+   /* The following function fills a buffer with a pattern (no byte of  */
+   /* it is equal to its neighbours).                                   */
+static void Fill(unsigned char *Buffer, unsigned long Size, unsigned int Seed)
+{
+   unsigned long Index;
+
+   for(Index=0;Index<Size;Index++)
+      Buffer[Index] = (unsigned char)((Index * 7) + (Index >> 8) + Seed);
+}
+
+   /* The following function counts a check and prints the first errors.*/
+static void Check(Boolean_t Passed, char *Function, unsigned long SourceAlignment, unsigned long DestinationAlignment, unsigned long Size, long Position)
+{
+   Checks++;
+
+   if(!Passed)
+   {
+      if(Errors < MAXIMUM_PRINTED_ERRORS)
+         printf("%s failed : alignments %lu/%lu, size %lu, position/distance %ld\n", Function, SourceAlignment, DestinationAlignment, Size, Position);
+
+      Errors++;
+   }
+}
+
+   /* The following function checks BTPS_MemCopy() for every alignment  */
+   /* of the Source and Destination and every size of the sweep.        */
+static void TestCopy(void)
+{
+   unsigned long SourceAlignment;
+   unsigned long DestinationAlignment;
+   unsigned long Size;
+   unsigned int  Index;
+
+   Fill(Source, sizeof(Source), 1);
+
+   for(SourceAlignment=0;SourceAlignment<MAXIMUM_ALIGNMENT;SourceAlignment++)
+   {
+      for(DestinationAlignment=0;DestinationAlignment<MAXIMUM_ALIGNMENT;DestinationAlignment++)
+      {
+         for(Index=0;(!Index) || ((Size = SizeValue(Index)) != 0);Index++)
+         {
+            if(!Index)
+               Size = 0;
+
+            memset(Destination, GUARD_VALUE, sizeof(Destination));
+            memset(Expected, GUARD_VALUE, sizeof(Expected));
+
+            memcpy(&Expected[GUARD_SIZE + DestinationAlignment], &Source[GUARD_SIZE + SourceAlignment], Size);
+            BTPS_MemCopy(&Destination[GUARD_SIZE + DestinationAlignment], &Source[GUARD_SIZE + SourceAlignment], Size);
+
+            Check((Boolean_t)(!memcmp(Destination, Expected, sizeof(Destination))), "BTPS_MemCopy", SourceAlignment, DestinationAlignment, Size, 0);
+         }
+      }
+   }
+}
+
+   /* The following function checks BTPS_MemMove() within one buffer    */
+   /* for every alignment of the Source, every size of the sweep and    */
+   /* every distance of the Destination from the Source up to           */
+   /* MAXIMUM_OVERLAP bytes (before and after, overlapping when the     */
+   /* distance is less than the size).                                  */
+static void TestMove(void)
+{
+   unsigned long SourceAlignment;
+   unsigned long Size;
+   unsigned long Start;
+   unsigned int  Index;
+   long          Distance;
+
+   for(SourceAlignment=0;SourceAlignment<MAXIMUM_ALIGNMENT;SourceAlignment++)
+   {
+      Start = GUARD_SIZE + MAXIMUM_OVERLAP + SourceAlignment;
+
+      for(Distance=-MAXIMUM_OVERLAP;Distance<=MAXIMUM_OVERLAP;Distance++)
+      {
+         for(Index=0;(!Index) || ((Size = SizeValue(Index)) != 0);Index++)
+         {
+            if(!Index)
+               Size = 0;
+
+            Fill(Destination, sizeof(Destination), 3);
+            Fill(Expected, sizeof(Expected), 3);
+
+            memmove(&Expected[Start + Distance], &Expected[Start], Size);
+            BTPS_MemMove(&Destination[Start + Distance], &Destination[Start], Size);
+
+            Check((Boolean_t)(!memcmp(Destination, Expected, sizeof(Destination))), "BTPS_MemMove", SourceAlignment, (unsigned long)((long)SourceAlignment + Distance), Size, Distance);
+         }
+      }
+   }
+}
+
+   /* The following function checks BTPS_MemInitialize() for every      */
+   /* alignment and size of the sweep, with values of which the two     */
+   /* bytes of a word differ from the fill value of the guard.          */
+static void TestInitialize(void)
+{
+   static unsigned char Values[] = { 0x00, 0x5A, 0xFF };
+
+   unsigned long DestinationAlignment;
+   unsigned long Size;
+   unsigned int  Index;
+   unsigned int  Value;
+
+   for(Value=0;Value<sizeof(Values);Value++)
+   {
+      for(DestinationAlignment=0;DestinationAlignment<MAXIMUM_ALIGNMENT;DestinationAlignment++)
+      {
+         for(Index=0;(!Index) || ((Size = SizeValue(Index)) != 0);Index++)
+         {
+            if(!Index)
+               Size = 0;
+
+            memset(Destination, GUARD_VALUE, sizeof(Destination));
+            memset(Expected, GUARD_VALUE, sizeof(Expected));
+
+            memset(&Expected[GUARD_SIZE + DestinationAlignment], Values[Value], Size);
+            BTPS_MemInitialize(&Destination[GUARD_SIZE + DestinationAlignment], Values[Value], Size);
+
+            Check((Boolean_t)(!memcmp(Destination, Expected, sizeof(Destination))), "BTPS_MemInitialize", 0, DestinationAlignment, Size, Values[Value]);
+         }
+      }
+   }
+}
+
+   /* The following function checks the sign of BTPS_MemCompare() for   */
+   /* every alignment of the two blocks, every size of the sweep and a  */
+   /* difference at every position : Source1 lower (0x10 against 0x90,  */
+   /* so that a signed compare of the bytes fails) and Source1 higher   */
+   /* (0xF0 against 0x0F), each followed by a difference of the other   */
+   /* sign.  The equal blocks (with a difference just past Size) must   */
+   /* compare equal.                                                    */
+static void TestCompare(void)
+{
+   unsigned char *Source1;
+   unsigned char *Source2;
+   unsigned long  Alignment1;
+   unsigned long  Alignment2;
+   unsigned long  Size;
+   unsigned long  Position;
+   unsigned int   Index;
+   int            Result;
+
+   for(Alignment1=0;Alignment1<MAXIMUM_ALIGNMENT;Alignment1++)
+   {
+      for(Alignment2=0;Alignment2<MAXIMUM_ALIGNMENT;Alignment2++)
+      {
+         Source1 = &Source[GUARD_SIZE + Alignment1];
+         Source2 = &Destination[GUARD_SIZE + Alignment2];
+
+         for(Index=0;(!Index) || ((Size = SizeValue(Index)) != 0);Index++)
+         {
+            if(!Index)
+               Size = 0;
+
+            Fill(Source1, Size + 1, 5);
+            Fill(Source2, Size + 1, 5);
+
+            /* Equal blocks, a difference just past the end.            */
+            Source2[Size] = (unsigned char)(Source1[Size] + 1);
+
+            Check((Boolean_t)(!BTPS_MemCompare(Source1, Source2, Size)), "BTPS_MemCompare (equal)", Alignment1, Alignment2, Size, -1);
+
+            for(Position=0;Position<Size;Position++)
+            {
+               Fill(Source2, Size + 1, 5);
+
+               Source1[Position] = 0x10;
+               Source2[Position] = 0x90;
+
+               if((Position + 1) < Size)
+                  Source2[Position + 1] = (unsigned char)(Source1[Position + 1] - 1);
+
+               Result = BTPS_MemCompare(Source1, Source2, Size);
+
+               Check((Boolean_t)(Result < 0), "BTPS_MemCompare (lower)", Alignment1, Alignment2, Size, (long)Position);
+
+               Source1[Position] = 0xF0;
+               Source2[Position] = 0x0F;
+
+               if((Position + 1) < Size)
+                  Source2[Position + 1] = (unsigned char)(Source1[Position + 1] + 1);
+
+               Result = BTPS_MemCompare(Source1, Source2, Size);
+
+               Check((Boolean_t)(Result > 0), "BTPS_MemCompare (higher)", Alignment1, Alignment2, Size, (long)Position);
+
+               Fill(Source1, Size + 1, 5);
+            }
+         }
+      }
+   }
+}
+
+   /* The following functions are the byte loops that the kernel        */
+   /* functions replaced (as the C run-time of the MSP430 does it).     */
+static void ByteCopy(void *Destination, BTPSCONST void *Source, unsigned long Size)
+{
+   unsigned char           *DestinationPtr;
+   BTPSCONST unsigned char *SourcePtr;
+
+   DestinationPtr = (unsigned char *)Destination;
+   SourcePtr      = (BTPSCONST unsigned char *)Source;
+
+   while(Size--)
+      *DestinationPtr++ = *SourcePtr++;
+}
+
+static void ByteMove(void *Destination, BTPSCONST void *Source, unsigned long Size)
+{
+   unsigned char           *DestinationPtr;
+   BTPSCONST unsigned char *SourcePtr;
+
+   DestinationPtr = (unsigned char *)Destination;
+   SourcePtr      = (BTPSCONST unsigned char *)Source;
+
+   if((DestinationPtr <= SourcePtr) || (DestinationPtr >= (SourcePtr + Size)))
+   {
+      while(Size--)
+         *DestinationPtr++ = *SourcePtr++;
+   }
+   else
+   {
+      DestinationPtr += Size;
+      SourcePtr      += Size;
+
+      while(Size--)
+         *--DestinationPtr = *--SourcePtr;
+   }
+}
+
+static void ByteInitialize(void *Destination, unsigned char Value, unsigned long Size)
+{
+   unsigned char *DestinationPtr;
+
+   DestinationPtr = (unsigned char *)Destination;
+
+   while(Size--)
+      *DestinationPtr++ = Value;
+}
+
+static int ByteCompare(BTPSCONST void *Source1, BTPSCONST void *Source2, unsigned long Size)
+{
+   BTPSCONST unsigned char *Source1Ptr;
+   BTPSCONST unsigned char *Source2Ptr;
+   int                      ret_val;
+
+   Source1Ptr = (BTPSCONST unsigned char *)Source1;
+   Source2Ptr = (BTPSCONST unsigned char *)Source2;
+   ret_val    = 0;
+
+   while((!ret_val) && (Size--))
+      ret_val = (int)*Source1Ptr++ - (int)*Source2Ptr++;
+
+   return(ret_val);
+}
+
+   /* The following function returns the time stamp counter on x86      */
+   /* hosts, or the CLOCK_MONOTONIC time in Nanoseconds.                */
+static unsigned long long Now(void)
+{
+#if (defined(__x86_64__) || defined(__i386__))
+
+   return(__builtin_ia32_rdtsc());
+
+#else
+
+   struct timespec Time;
+
+   clock_gettime(CLOCK_MONOTONIC, &Time);
+
+   return(((unsigned long long)Time.tv_sec * 1000000000ULL) + (unsigned long long)Time.tv_nsec);
+
+#endif
+}
+
+   /* The following function measures one function (0 copy, 1 move to   */
+   /* an overlapping Destination 2 bytes after the Source, or 3 bytes   */
+   /* if the alignments differ, 2 initialize, 3 compare of equal        */
+   /* blocks) for the specified size and alignments.  This function     */
+   /* returns the cycles (or Nanoseconds) per byte.                     */
+static double Throughput(MemFunctions_t *Functions, unsigned int Function, unsigned long Size, unsigned long SourceAlignment, unsigned long DestinationAlignment)
+{
+   unsigned long       Count;
+   unsigned long       Index;
+   unsigned long long  Start;
+   unsigned char      *SourcePtr;
+   unsigned char      *DestinationPtr;
+   int                 Result;
+
+   SourcePtr      = &Source[GUARD_SIZE + SourceAlignment];
+   DestinationPtr = &Destination[GUARD_SIZE + DestinationAlignment];
+   Count          = THROUGHPUT_BYTES / Size;
+   Result         = 0;
+
+   Fill(Source, sizeof(Source), 1);
+   memcpy(DestinationPtr, SourcePtr, Size);
+
+   Start = Now();
+
+   for(Index=0;Index<Count;Index++)
+   {
+      switch(Function)
+      {
+         case 0:
+            Functions->Copy(DestinationPtr, SourcePtr, Size);
+            break;
+         case 1:
+            Functions->Move(SourcePtr + 2 + DestinationAlignment - SourceAlignment, SourcePtr, Size);
+            break;
+         case 2:
+            Functions->Initialize(DestinationPtr, (unsigned char)Index, Size);
+            break;
+         default:
+            Result += Functions->Compare(SourcePtr, DestinationPtr, Size);
+            break;
+      }
+   }
+
+   Sink = Result;
+
+   return((double)(Now() - Start) / ((double)Count * (double)Size));
+}
+
+   /* The following function prints the throughput of the kernel        */
+   /* functions and of the byte loops for block sizes from 16 to 1024   */
+   /* bytes : both blocks word aligned, both at an odd address (one     */
+   /* byte before the words) and with different alignments (byte by     */
+   /* byte in both).                                                    */
+static void TestThroughput(void)
+{
+   static char          *FunctionName[] = { "MemCopy", "MemMove", "MemInitialize", "MemCompare" };
+   static unsigned long  Size[]         = { 16, 64, 256, 1024 };
+   static unsigned long  Alignment[][2] = { { 0, 0 }, { 1, 1 }, { 0, 1 } };
+   static char          *AlignmentName[] = { "aligned", "odd", "mixed" };
+
+   MemFunctions_t        Functions[2] =
+   {
+      { "kernel",     BTPS_MemCopy, BTPS_MemMove, BTPS_MemInitialize, BTPS_MemCompare },
+      { "byte loop",  ByteCopy,     ByteMove,     ByteInitialize,     ByteCompare     }
+   };
+   unsigned int          Function;
+   unsigned int          SizeIndex;
+   unsigned int          AlignmentIndex;
+   double                Kernel;
+   double                Byte;
+
+#if (defined(__x86_64__) || defined(__i386__))
+
+   printf("\nThroughput (cycles per byte, kernel / byte loop)\n");
+
+#else
+
+   printf("\nThroughput (Nanoseconds per byte, kernel / byte loop)\n");
+
+#endif
+
+   for(Function=0;Function<4;Function++)
+   {
+      for(AlignmentIndex=0;AlignmentIndex<3;AlignmentIndex++)
+      {
+         printf("%-14s %-8s", FunctionName[Function], AlignmentName[AlignmentIndex]);
+
+         for(SizeIndex=0;SizeIndex<(sizeof(Size)/sizeof(Size[0]));SizeIndex++)
+         {
+            Kernel = Throughput(&Functions[0], Function, Size[SizeIndex], Alignment[AlignmentIndex][0], Alignment[AlignmentIndex][1]);
+            Byte   = Throughput(&Functions[1], Function, Size[SizeIndex], Alignment[AlignmentIndex][0], Alignment[AlignmentIndex][1]);
+
+            printf("  %4lu: %5.2f / %5.2f", Size[SizeIndex], Kernel, Byte);
+         }
+
+         printf("\n");
+      }
+   }
+}
+
+int main(void)
+{
+   TestCopy();
+   TestMove();
+   TestInitialize();
+   TestCompare();
+
+   printf("%lu checks, %lu errors\n", Checks, Errors);
+
+   TestThroughput();
+
+   return((Errors)?1:0);
+}
@@ -0,0 +1,506 @@
+/*****< hcitap.c >*************************************************************/
+/*                                                                            */
+/*  HCITAP - HCI tap of the HCI Transport Layer (see HCITR_TapData()).        */
+/*                                                                            */
+/*  Splits the UART (H4) byte stream of both directions into packets, keeps   */
+/*  them with a Tick Count in a RAM ring and reads them out as btsnoop        */
+/*  records (Wireshark, data link 1002 : H4) or as the packets of the ring,   */
+/*  which the application carries itself.  The module does not depend on the */
+/*  UART, so every transport (see posix/HCITRANS.c) shares it.                */
+/******************************************************************************/
+#include "BTPSKRNL.h"            /* Bluetooth Kernel Protoypes/Constants.     */
+#include "HCITRANS.h"            /* HCI Transport Prototypes/Constants.       */
+
+   /* A transport for another platform (see posix/HCITRANS.c) defines   */
+   /* HCITR_TAP_PORT and the critical section MACROs itself and includes*/
+   /* this module.  It may also widen the Captured Length of the ring   */
+   /* (TAP_CAPTURED_LENGTH_SIZE) to keep longer packets.                */
+#ifndef HCITR_TAP_PORT
+
+#include "HRDWCFG.h"             /* MSP430 Exp Board Setup and Utilities      */
+
+   /* The following MACROs protect the tap from the interrupt service   */
+   /* routines, restoring the interrupt state of the caller on exit.    */
+#define TAP_ENTER_CRITICAL_SECTION(_State)                     { (_State) = __get_interrupt_state(); __disable_interrupt(); }
+
+#define TAP_EXIT_CRITICAL_SECTION(_State)                      __set_interrupt_state(_State)
+
+typedef __istate_t TapState_t;
+
+#endif
+
+   /* The following constant represents the size (in bytes) of the      */
+   /* Captured Length of a packet in the ring (1 or 2).                 */
+#ifndef TAP_CAPTURED_LENGTH_SIZE
+
+   #define TAP_CAPTURED_LENGTH_SIZE                            1
+
+#endif
+
+#if HCITR_TAP_SNAP_LENGTH < 5
+
+   #error HCITR_TAP_SNAP_LENGTH must keep the largest packet header (5 bytes)
+
+#endif
+
+#if (TAP_CAPTURED_LENGTH_SIZE == 1) && (HCITR_TAP_SNAP_LENGTH > 0xFF)
+
+   #error HCITR_TAP_SNAP_LENGTH must fit the one byte Captured Length (255 bytes)
+
+#endif
+
+#if HCITR_TAP_SNAP_LENGTH > 0xFFFF
+
+   #error HCITR_TAP_SNAP_LENGTH must fit the two byte Captured Length (65535 bytes)
+
+#endif
+
+   /* H4 packet types (first byte of every packet).                     */
+#define H4_PACKET_TYPE_COMMAND                                 0x01
+#define H4_PACKET_TYPE_ACL                                     0x02
+#define H4_PACKET_TYPE_SCO                                     0x03
+#define H4_PACKET_TYPE_EVENT                                   0x04
+
+   /* The following constants represent the packets in the ring :       */
+   /*    Captured Length (TAP_CAPTURED_LENGTH_SIZE Bytes), btsnoop Flags*/
+   /*    (1 Byte), Original Length (4 Bytes), Tick Count (4 Bytes),     */
+   /*    captured bytes                                                 */
+#define TAP_RECORD_FLAGS                                       (TAP_CAPTURED_LENGTH_SIZE)
+#define TAP_RECORD_ORIGINAL_LENGTH                             (TAP_CAPTURED_LENGTH_SIZE + 1)
+#define TAP_RECORD_TICK                                        (TAP_CAPTURED_LENGTH_SIZE + 5)
+#define TAP_RECORD_HEADER_SIZE                                 (TAP_CAPTURED_LENGTH_SIZE + 9)
+
+#define TAP_RECORD_SIZE(_x)                                    (TAP_RECORD_HEADER_SIZE + (_x))
+
+   /* btsnoop flags : bit 0 is set for received packets, bit 1 for      */
+   /* Commands and Events.                                              */
+#define BTSNOOP_FLAG_RECEIVED                                  0x01
+#define BTSNOOP_FLAG_COMMAND_EVENT                             0x02
+
+   /* btsnoop timestamps are microseconds since midnight, January 1st,  */
+   /* 0 AD.  The Tick Counts are placed at midnight, January 1st, 2000. */
+#define BTSNOOP_TIMESTAMP_BASE                                 0x00E03AB44A676000ULL
+
+#if HCITR_TAP_BUFFER_SIZE
+
+   /* The following structure holds the packet of a direction that is   */
+   /* being split off the byte stream.                                  */
+typedef struct _tagTapPacket_t
+{
+   DWord_t Count;                               /* Bytes of the packet so far.*/
+   DWord_t Total;                               /* Length of the packet (of   */
+                                                /* its header until the       */
+                                                /* header is complete).       */
+   DWord_t Tick;                                /* Tick Count of the first    */
+                                                /* byte.                      */
+   Boolean_t HeaderDone;                        /* TRUE once Total is the     */
+                                                /* length of the packet.      */
+   Byte_t  Snap[HCITR_TAP_SNAP_LENGTH];         /* Captured bytes.            */
+} TapPacket_t;
+
+static TapPacket_t   TapPacket[2];              /* Packets being split off    */
+                                                /* (by direction).            */
+
+static Byte_t        TapBuffer[HCITR_TAP_BUFFER_SIZE];
+                                                /* Ring of packet records.    */
+
+static unsigned int  TapHead;                   /* Oldest record (read next). */
+
+static unsigned int  TapCount;                  /* Bytes not read yet.        */
+
+static DWord_t       TapDropped;                /* Packets dropped (running). */
+
+   /* Internal Function Prototypes.                                     */
+static void TapPut(Byte_t Value);
+static Byte_t TapGet(unsigned int Offset);
+static void TapCopy(Byte_t *Buffer, unsigned int Offset, unsigned int Length);
+static unsigned int TapCaptured(void);
+static void TapCommit(unsigned int Direction, TapPacket_t *Packet);
+static unsigned int PutBigEndian(Byte_t *Buffer, DWord_t Value);
+
+   /* The following function appends a byte to the ring (the caller     */
+   /* makes room first).                                                */
+static void TapPut(Byte_t Value)
+{
+   TapBuffer[(TapHead + TapCount) % HCITR_TAP_BUFFER_SIZE] = Value;
+
+   TapCount++;
+}
+
+   /* The following function returns the byte at the specified offset   */
+   /* from the oldest record.                                           */
+static Byte_t TapGet(unsigned int Offset)
+{
+   return(TapBuffer[(TapHead + Offset) % HCITR_TAP_BUFFER_SIZE]);
+}
+
+   /* The following function copies the specified number of bytes at the*/
+   /* specified offset from the oldest record (at most two copies, as   */
+   /* the bytes may wrap at the end of the ring).                       */
+static void TapCopy(Byte_t *Buffer, unsigned int Offset, unsigned int Length)
+{
+   unsigned int Index;
+   unsigned int Count;
+
+   Index = (TapHead + Offset) % HCITR_TAP_BUFFER_SIZE;
+   Count = HCITR_TAP_BUFFER_SIZE - Index;
+   if(Count > Length)
+      Count = Length;
+
+   BTPS_MemCopy(Buffer, &(TapBuffer[Index]), Count);
+
+   if(Length > Count)
+      BTPS_MemCopy(&(Buffer[Count]), TapBuffer, (Length - Count));
+}
+
+   /* The following function returns the Captured Length of the oldest  */
+   /* record.                                                           */
+static unsigned int TapCaptured(void)
+{
+   unsigned int ret_val;
+   unsigned int Index;
+
+   ret_val = 0;
+   for(Index=0;Index<TAP_CAPTURED_LENGTH_SIZE;Index++)
+      ret_val = (ret_val << 8) | TapGet(Index);
+
+   return(ret_val);
+}
+
+   /* The following function stores a complete packet in the ring,      */
+   /* dropping the oldest records until it fits.                        */
+   /* * NOTE * This function MUST be called in a critical section.      */
+static void TapCommit(unsigned int Direction, TapPacket_t *Packet)
+{
+   unsigned int Index;
+   unsigned int Captured;
+   Byte_t       Flags;
+
+   Captured = (Packet->Count > HCITR_TAP_SNAP_LENGTH)?HCITR_TAP_SNAP_LENGTH:(unsigned int)Packet->Count;
+
+   if(TAP_RECORD_SIZE(Captured) <= HCITR_TAP_BUFFER_SIZE)
+   {
+      while((TapCount + TAP_RECORD_SIZE(Captured)) > HCITR_TAP_BUFFER_SIZE)
+      {
+         Index     = TAP_RECORD_SIZE(TapCaptured());
+         TapHead   = (TapHead + Index) % HCITR_TAP_BUFFER_SIZE;
+         TapCount -= Index;
+
+         TapDropped++;
+      }
+
+      Flags = (Byte_t)((Direction == HCITR_TAP_DIRECTION_RECEIVED)?BTSNOOP_FLAG_RECEIVED:0);
+      if((Packet->Snap[0] == H4_PACKET_TYPE_COMMAND) || (Packet->Snap[0] == H4_PACKET_TYPE_EVENT))
+         Flags |= BTSNOOP_FLAG_COMMAND_EVENT;
+
+      for(Index=0;Index<TAP_CAPTURED_LENGTH_SIZE;Index++)
+         TapPut((Byte_t)(Captured >> ((TAP_CAPTURED_LENGTH_SIZE - 1 - Index) * 8)));
+
+      TapPut(Flags);
+
+      for(Index=0;Index<4;Index++)
+         TapPut((Byte_t)(Packet->Count >> (24 - (Index * 8))));
+
+      for(Index=0;Index<4;Index++)
+         TapPut((Byte_t)(Packet->Tick >> (24 - (Index * 8))));
+
+      for(Index=0;Index<Captured;Index++)
+         TapPut(Packet->Snap[Index]);
+   }
+   else
+      TapDropped++;
+}
+
+   /* The following function writes a 32 bit value MSB first and returns*/
+   /* the number of bytes written.                                      */
+static unsigned int PutBigEndian(Byte_t *Buffer, DWord_t Value)
+{
+   Buffer[0] = (Byte_t)(Value >> 24);
+   Buffer[1] = (Byte_t)(Value >> 16);
+   Buffer[2] = (Byte_t)(Value >> 8);
+   Buffer[3] = (Byte_t)Value;
+
+   return(4);
+}
+
+#endif
+
+   /* The following function is used to pass data of the UART (H4) byte */
+   /* stream to the HCI tap.  The bytes are split into packets by the   */
+   /* packet type and the length in the packet header.  A byte that is  */
+   /* not a known packet type (e.g. an HCILL sleep or wake up byte) is a*/
+   /* packet of its own.                                                */
+void BTPSAPI HCITR_TapData(unsigned int Direction, unsigned int Length, unsigned char *Buffer)
+{
+#if HCITR_TAP_BUFFER_SIZE
+
+   DWord_t      Count;
+   TapState_t   State;
+   TapPacket_t *Packet;
+
+   if((Direction <= HCITR_TAP_DIRECTION_RECEIVED) && (Buffer))
+   {
+      Packet = &TapPacket[Direction];
+
+      TAP_ENTER_CRITICAL_SECTION(State);
+
+      while(Length)
+      {
+         /* The first byte of a packet is its type, which gives the     */
+         /* length of the packet header.                                */
+         if(!Packet->Count)
+         {
+            Packet->Tick       = (DWord_t)BTPS_GetTickCount();
+            Packet->HeaderDone = FALSE;
+
+            switch(*Buffer)
+            {
+               case H4_PACKET_TYPE_COMMAND:
+               case H4_PACKET_TYPE_SCO:
+                  Packet->Total = 4;
+                  break;
+               case H4_PACKET_TYPE_ACL:
+                  Packet->Total = 5;
+                  break;
+               case H4_PACKET_TYPE_EVENT:
+                  Packet->Total = 3;
+                  break;
+               default:
+                  Packet->Total      = 1;
+                  Packet->HeaderDone = TRUE;
+                  break;
+            }
+         }
+
+         /* Take the bytes up to the end of the header or packet, and   */
+         /* keep the first HCITR_TAP_SNAP_LENGTH of them.               */
+         Count = Packet->Total - Packet->Count;
+         if(Count > Length)
+            Count = Length;
+
+         if(Packet->Count < HCITR_TAP_SNAP_LENGTH)
+            BTPS_MemCopy(&(Packet->Snap[Packet->Count]), Buffer, ((Packet->Count + Count) > HCITR_TAP_SNAP_LENGTH)?(HCITR_TAP_SNAP_LENGTH - Packet->Count):Count);
+
+         Packet->Count += Count;
+         Buffer        += Count;
+         Length        -= (unsigned int)Count;
+
+         /* The complete header gives the length of the packet.         */
+         if((!Packet->HeaderDone) && (Packet->Count == Packet->Total))
+         {
+            switch(Packet->Snap[0])
+            {
+               case H4_PACKET_TYPE_COMMAND:
+               case H4_PACKET_TYPE_SCO:
+                  Packet->Total += Packet->Snap[3];
+                  break;
+               case H4_PACKET_TYPE_ACL:
+                  Packet->Total += (DWord_t)Packet->Snap[3] | ((DWord_t)Packet->Snap[4] << 8);
+                  break;
+               default:
+                  Packet->Total += Packet->Snap[2];
+                  break;
+            }
+
+            Packet->HeaderDone = TRUE;
+         }
+
+         if((Packet->HeaderDone) && (Packet->Count == Packet->Total))
+         {
+            TapCommit(Direction, Packet);
+
+            Packet->Count = 0;
+         }
+      }
+
+      TAP_EXIT_CRITICAL_SECTION(State);
+   }
+
+#endif
+}
+
+   /* The following function is used to write the btsnoop file header   */
+   /* of a capture of the HCI tap to the specified buffer.              */
+unsigned int BTPSAPI HCITR_TapHeader(unsigned char *Buffer)
+{
+   unsigned int ret_val;
+
+   if(Buffer)
+   {
+      /* Identification pattern, version 1 and data link 1002 (H4).     */
+      BTPS_MemCopy(Buffer, "btsnoop", 8);
+
+      Buffer[8]  = 0;
+      Buffer[9]  = 0;
+      Buffer[10] = 0;
+      Buffer[11] = 1;
+      Buffer[12] = 0;
+      Buffer[13] = 0;
+      Buffer[14] = 0x03;
+      Buffer[15] = 0xEA;
+
+      ret_val    = HCITR_BTSNOOP_HEADER_SIZE;
+   }
+   else
+      ret_val = 0;
+
+   return(ret_val);
+}
+
+   /* The following function is used to read the packets of the HCI tap */
+   /* as btsnoop packet records : Original Length, Included Length,     */
+   /* Flags, Cumulative Drops (4 Bytes each) and Timestamp (8 Bytes),   */
+   /* MSB first, followed by the captured bytes.                        */
+unsigned int BTPSAPI HCITR_TapRead(unsigned int BufferSize, unsigned char *Buffer, unsigned long TickRate)
+{
+   unsigned int       ret_val;
+
+#if HCITR_TAP_BUFFER_SIZE
+
+   unsigned int       Index;
+   unsigned int       Captured;
+   unsigned long long Timestamp;
+   DWord_t            Tick;
+   Boolean_t          Done;
+   TapState_t         State;
+
+#endif
+
+   ret_val = 0;
+
+#if HCITR_TAP_BUFFER_SIZE
+
+   if((Buffer) && (TickRate))
+   {
+      Done = FALSE;
+
+      while(!Done)
+      {
+         /* The record is copied in one critical section, as the oldest */
+         /* records may be dropped by a writer.                         */
+         TAP_ENTER_CRITICAL_SECTION(State);
+
+         if(TapCount)
+         {
+            Captured = TapCaptured();
+
+            if((ret_val + HCITR_BTSNOOP_RECORD_HEADER_SIZE + Captured) <= BufferSize)
+            {
+               Tick = 0;
+               for(Index=TAP_RECORD_TICK;Index<TAP_RECORD_HEADER_SIZE;Index++)
+                  Tick = (Tick << 8) | TapGet(Index);
+
+               /* Original and Included Length, Flags, Cumulative Drops.*/
+               for(Index=TAP_RECORD_ORIGINAL_LENGTH;Index<TAP_RECORD_TICK;Index++)
+                  Buffer[ret_val++] = TapGet(Index);
+
+               ret_val += PutBigEndian(&(Buffer[ret_val]), (DWord_t)Captured);
+               ret_val += PutBigEndian(&(Buffer[ret_val]), (DWord_t)TapGet(TAP_RECORD_FLAGS));
+               ret_val += PutBigEndian(&(Buffer[ret_val]), TapDropped);
+
+               Timestamp = BTSNOOP_TIMESTAMP_BASE + (((unsigned long long)Tick * 1000000ULL) / TickRate);
+
+               ret_val += PutBigEndian(&(Buffer[ret_val]), (DWord_t)(Timestamp >> 32));
+               ret_val += PutBigEndian(&(Buffer[ret_val]), (DWord_t)Timestamp);
+
+               for(Index=0;Index<Captured;Index++)
+                  Buffer[ret_val++] = TapGet(TAP_RECORD_HEADER_SIZE + Index);
+
+               TapHead   = (TapHead + TAP_RECORD_SIZE(Captured)) % HCITR_TAP_BUFFER_SIZE;
+               TapCount -= TAP_RECORD_SIZE(Captured);
+            }
+            else
+               Done = TRUE;
+         }
+         else
+            Done = TRUE;
+
+         TAP_EXIT_CRITICAL_SECTION(State);
+      }
+   }
+
+#endif
+
+   return(ret_val);
+}
+
+   /* The following function is used to read the packets of the HCI tap */
+   /* as they are kept in the ring, for a transport that carries them   */
+   /* itself (e.g. in the records of a data stream).  The Included      */
+   /* Length is one byte, so a longer packet (a port with a wider       */
+   /* Captured Length) is cut to 255 bytes.                             */
+unsigned int BTPSAPI HCITR_TapReadPackets(unsigned int BufferSize, unsigned char *Buffer, unsigned long *Dropped)
+{
+   unsigned int ret_val;
+
+#if HCITR_TAP_BUFFER_SIZE
+
+   unsigned int Captured;
+   unsigned int Included;
+   unsigned int Length;
+   Boolean_t    Done;
+   TapState_t   State;
+
+#endif
+
+   ret_val = 0;
+
+   if(Dropped)
+      *Dropped = 0;
+
+#if HCITR_TAP_BUFFER_SIZE
+
+   if((Buffer) && (Dropped))
+   {
+      Done = FALSE;
+
+      while(!Done)
+      {
+         /* The packet is copied in one critical section, as the oldest */
+         /* records may be dropped by a writer.                         */
+         TAP_ENTER_CRITICAL_SECTION(State);
+
+         Length = 0;
+
+         if(TapCount)
+         {
+            Captured = TapCaptured();
+            Included = (Captured > 0xFF)?0xFF:Captured;
+
+            /* Whole packets only, except for the first one, which is   */
+            /* cut to the buffer.                                       */
+            if((ret_val + HCITR_TAP_PACKET_HEADER_SIZE + Included) <= BufferSize)
+               Length = HCITR_TAP_PACKET_HEADER_SIZE + Included;
+            else
+            {
+               if((!ret_val) && (BufferSize >= HCITR_TAP_PACKET_HEADER_SIZE))
+                  Length = BufferSize;
+
+               Done = TRUE;
+            }
+
+            if(Length)
+            {
+               TapCopy(&(Buffer[ret_val + 1]), TAP_RECORD_FLAGS, (Length - 1));
+
+               Buffer[ret_val] = (Byte_t)(Length - HCITR_TAP_PACKET_HEADER_SIZE);
+               ret_val        += Length;
+
+               TapHead         = (TapHead + TAP_RECORD_SIZE(Captured)) % HCITR_TAP_BUFFER_SIZE;
+               TapCount       -= TAP_RECORD_SIZE(Captured);
+            }
+         }
+         else
+            Done = TRUE;
+
+         if(Done)
+            *Dropped = TapDropped;
+
+         TAP_EXIT_CRITICAL_SECTION(State);
+      }
+   }
+
+#endif
+
+   return(ret_val);
+}
@@ -53,6 +53,34 @@
    __enable_interrupt();     \
 }
 
+   /* The following MACRO is used to enable the transmit interrupt      */
+   /* before the transmitter is primed.  A DMA transmit (see            */
+   /* BT_UART_DMA_TX_TRIGGER in HRDWCFG.h) is triggered by the transmit */
+   /* flag itself, so the transmit interrupt stays disabled.            */
+#ifdef BT_UART_DMA_TX_TRIGGER
+
+   #define TX_INTERRUPT_ENABLE()
+
+#else
+
+   #define TX_INTERRUPT_ENABLE()                               UARTIntEnableTransmit(UartContext.UartBase)
+
+#endif
+
+   /* The following MACRO is used to enable the receive interrupt.  A   */
+   /* DMA receive (see BT_UART_DMA_RX_TRIGGER in HRDWCFG.h) is triggered*/
+   /* by the receive flag itself, so the receive interrupt stays        */
+   /* disabled.                                                         */
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+   #define RX_INTERRUPT_ENABLE()
+
+#else
+
+   #define RX_INTERRUPT_ENABLE()                               UARTIntEnableReceive(UartContext.UartBase)
+
+#endif
+
    /* TI Chip Defaults.                                                 */
 
    /* The following defines the TI Bluetooth chips startup baud rate.   */
@@ -61,11 +89,37 @@
    /* be the TI CC256x will always come up at 115200 baud.              */
 #define BLUETOOTH_STARTUP_BAUD_RATE                              115200L
 
-#define DEFAULT_INPUT_BUFFER_SIZE                                128//1042 //128
+#define DEFAULT_INPUT_BUFFER_SIZE                                HCITR_INPUT_BUFFER_SIZE
 #define DEFAULT_OUTPUT_BUFFER_SIZE                               384 //384//64
 #define XOFF_LIMIT                                               8
 #define XON_LIMIT                                                16
 
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+   /* The DMA channel fills the Rx Buffer one half at a time (the size  */
+   /* and destination are reloaded when a half is full).  The Rx Buffer */
+   /* Counts are updated when a half is full, when the transport is     */
+   /* processed and when the line goes idle, so the free space that the */
+   /* counts show may be up to a half larger than the real free space.  */
+   /* The flow limits are moved up by a half to cover this.             */
+#define RX_DMA_HALF_SIZE                                         (DEFAULT_INPUT_BUFFER_SIZE / 2)
+
+#if ((DEFAULT_INPUT_BUFFER_SIZE % 2) || (DEFAULT_INPUT_BUFFER_SIZE < 64))
+
+   #error HCITR_INPUT_BUFFER_SIZE must be even and at least 64 for the DMA receive.
+
+#endif
+
+#define RX_XOFF_LIMIT                                            (RX_DMA_HALF_SIZE + XOFF_LIMIT)
+#define RX_XON_LIMIT                                             (RX_DMA_HALF_SIZE + XON_LIMIT)
+
+#else
+
+#define RX_XOFF_LIMIT                                            XOFF_LIMIT
+#define RX_XON_LIMIT                                             XON_LIMIT
+
+#endif
+
 #define UART_CONTEXT_FLAG_OPEN_STATE                             0x0001
 #define UART_CONTEXT_FLAG_FLOW_ENABLED                           0x0002
 #define UART_CONTEXT_FLAG_RX_OVERRUN                             0x0004
@@ -101,6 +155,14 @@ typedef struct _tagUartContext_t
    volatile int    TxBytesFree;
    int             TxInIndex;
    int             TxOutIndex;
+#ifdef BT_UART_DMA_TX_TRIGGER
+   int             TxDmaCount;
+#endif
+#ifdef BT_UART_DMA_RX_TRIGGER
+   int             RxDmaHalf;
+   int             RxIdleIndex;
+#endif
+   HCITR_Statistics_t Statistics;
    unsigned char   Flags;
 } UartContext_t;
 
@@ -117,6 +179,14 @@ static unsigned long           _COMCallbackParameter;
    /* Local Function Prototypes.                                        */
 static void FlushRxFIFO(unsigned char *Base);
 static void TxTransmit(void);
+#ifdef BT_UART_DMA_TX_TRIGGER
+static void TxDmaCredit(int Count);
+static void TxDmaPause(void);
+#endif
+#ifdef BT_UART_DMA_RX_TRIGGER
+static int RxDmaIndex(void);
+static void RxDmaUpdate(void);
+#endif
 static void RxProcess(void);
 static void DisableTransmitter(void);
 static void EnableTransmitter(void);
@@ -138,6 +208,95 @@ static void FlushRxFIFO(unsigned char *Base)
    }
 }
 
+#ifdef BT_UART_DMA_TX_TRIGGER
+
+   /* The following function, which should be called with interrupts    */
+   /* disabled, exists to hand the bytes of the Tx Buffer from          */
+   /* TxOutIndex up to the end of the data (or of the buffer) to the DMA*/
+   /* channel.  The Tx Buffer Counts are updated when the channel is    */
+   /* done (see UartDmaInterrupt()) or paused (see TxDmaPause()), so    */
+   /* the CPU works once per block instead of once per character.       */
+static void TxTransmit(void)
+{
+   int Count;
+
+   /* if Transmit and Tx Flow are Enabled (CTS is low), no block is     */
+   /* being sent and the Tx Buffer is not empty start the next block.   */
+   if(((UartContext.Flags & (UART_CONTEXT_FLAG_TRANSMIT_ENABLED | UART_CONTEXT_FLAG_TX_FLOW_ENABLED)) == (UART_CONTEXT_FLAG_TRANSMIT_ENABLED | UART_CONTEXT_FLAG_TX_FLOW_ENABLED)) && (!UartContext.TxDmaCount) && (UartContext.TxBytesFree != UartContext.TxBufferSize))
+   {
+      /* The block may not wrap the buffer.                             */
+      Count = UartContext.TxBufferSize - UartContext.TxBytesFree;
+      if(Count > (UartContext.TxBufferSize - UartContext.TxOutIndex))
+         Count = UartContext.TxBufferSize - UartContext.TxOutIndex;
+
+      UartContext.TxDmaCount = Count;
+
+      /* Single transfers, one per transmit flag, from the Tx Buffer to */
+      /* the UART Transmit Buffer (set in HCITR_COMOpen()).             */
+      __data16_write_addr((unsigned short)&BT_UART_DMA_TX_SA, (unsigned long)&(UartContext.TxBuffer[UartContext.TxOutIndex]));
+      BT_UART_DMA_TX_SZ  = Count;
+      BT_UART_DMA_TX_CTL = DMASRCINCR_3 | DMASBDB | DMALEVEL | DMAIE | DMAEN;
+
+      /* The UART Tx side is now primed.                                */
+      UartContext.Flags |= UART_CONTEXT_FLAG_TX_PRIMED;
+   }
+   else
+   {
+      /* The Tx Transmitter is primed while a block is being sent.      */
+      if(!UartContext.TxDmaCount)
+         UartContext.Flags &= ~UART_CONTEXT_FLAG_TX_PRIMED;
+   }
+}
+
+   /* The following function, which should be called with interrupts    */
+   /* disabled, exists to credit the characters of the block that the   */
+   /* DMA channel has sent to the Tx Buffer Counts.                     */
+static void TxDmaCredit(int Count)
+{
+   /* Update the circular buffer counts.                                */
+   UartContext.TxBytesFree += Count;
+   UartContext.TxOutIndex  += Count;
+
+   /* Check if we need to wrap the buffer.                              */
+   if(UartContext.TxOutIndex >= UartContext.TxBufferSize)
+      UartContext.TxOutIndex -= UartContext.TxBufferSize;
+
+   /* No block is being sent.                                           */
+   UartContext.TxDmaCount  = 0;
+   UartContext.Flags      &= ~UART_CONTEXT_FLAG_TX_PRIMED;
+}
+
+   /* The following function, which should be called with interrupts    */
+   /* disabled, exists to stop the block that is being sent (CTS high or*/
+   /* Transmit disabled).  The characters that were sent are credited   */
+   /* and TxTransmit() sends the rest later.                            */
+static void TxDmaPause(void)
+{
+   int Count;
+
+   if(UartContext.TxDmaCount)
+   {
+      BT_UART_DMA_TX_CTL &= ~DMAEN;
+
+      /* A block that was done before the channel was stopped has its   */
+      /* size reloaded and its flag set (the flag is cleared here so the*/
+      /* block is not credited twice).  Otherwise the size register     */
+      /* counts the characters that were not sent.                      */
+      if(BT_UART_DMA_TX_CTL & DMAIFG)
+      {
+         BT_UART_DMA_TX_CTL &= ~DMAIFG;
+
+         Count = UartContext.TxDmaCount;
+      }
+      else
+         Count = UartContext.TxDmaCount - (int)BT_UART_DMA_TX_SZ;
+
+      TxDmaCredit(Count);
+   }
+}
+
+#else
+
    /* The following function, which should be called with interrupts    */
    /* disabled, exists to transmit a character and update the Tx Buffer */
    /* Counts.                                                           */
@@ -171,6 +330,164 @@ static void TxTransmit(void)
    }
 }
 
+#endif
+
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+   /* The following function, which should be called with interrupts    */
+   /* disabled, exists to return the index of the Rx Buffer that the DMA*/
+   /* channel writes next, or -1 if a half is full and its interrupt is */
+   /* pending (UartDmaInterrupt() then moves the channel on).           */
+static int RxDmaIndex(void)
+{
+   int Size;
+
+   /* The size is read before the flag, so a half that becomes full     */
+   /* between the two reads is not taken for an empty one.              */
+   Size = (int)BT_UART_DMA_RX_SZ;
+   if(BT_UART_DMA_RX_CTL & DMAIFG)
+      return(-1);
+
+   return((UartContext.RxDmaHalf?RX_DMA_HALF_SIZE:0) + ((RX_DMA_HALF_SIZE - Size) % RX_DMA_HALF_SIZE));
+}
+
+   /* The following function, which should be called with interrupts    */
+   /* disabled, exists to credit the characters that the DMA channel has*/
+   /* written to the Rx Buffer since the last update and to raise RTS   */
+   /* if the Rx Buffer is nearly full.                                  */
+static void RxDmaUpdate(void)
+{
+   int Index;
+   int Count;
+
+   Index = RxDmaIndex();
+   if((Index >= 0) && (Index != UartContext.RxInIndex))
+   {
+      Count = Index - UartContext.RxInIndex;
+      if(Count < 0)
+         Count += UartContext.RxBufferSize;
+
+      UartContext.Statistics.RxBytes += Count;
+
+      /* Check to see if the channel wrote over characters that were    */
+      /* not delivered yet.                                             */
+      if(Count > UartContext.RxBytesFree)
+      {
+         /* Flag that we have encountered an RX Overrun.                */
+         UartContext.Statistics.RxOverruns += (Count - UartContext.RxBytesFree);
+         UartContext.Flags                 |= UART_CONTEXT_FLAG_RX_OVERRUN;
+         UartContext.RxBytesFree            = 0;
+      }
+      else
+         UartContext.RxBytesFree -= Count;
+
+      UartContext.RxInIndex = Index;
+
+      /* If the UART is in the process of shutting down flag that this  */
+      /* has been interrupted due to the arrival of UART data.          */
+      if(UartContext.SuspendState == hssSuspendWait)
+         UartContext.SuspendState = hssSuspendWaitInterrupted;
+   }
+
+   /* Check to see if we need to Disable Rx Flow.                       */
+   if((UartContext.Flags & UART_CONTEXT_FLAG_FLOW_ENABLED) && (UartContext.RxBytesFree <= UartContext.XOffLimit))
+   {
+      UartContext.Flags &= (~UART_CONTEXT_FLAG_FLOW_ENABLED);
+      FLOW_OFF();
+
+      UartContext.Statistics.RxFlowStops++;
+   }
+}
+
+   /* The following function is the line idle check of the DMA receive. */
+   /* It is called from the Tick Interrupt (which belongs to the        */
+   /* application).  The UART has no idle line interrupt, so the line   */
+   /* is taken to be idle when the DMA channel has not moved for a      */
+   /* tick.  This function returns non-zero (LPM3 should be exited, so  */
+   /* that HCITR_COMProcess() delivers the data) while the line is idle */
+   /* and the Rx Buffer holds data that was not delivered.              */
+int UartDmaIdleCheck(void)
+{
+   int ret_val = 0;
+   int Index;
+
+   if(HCITransportOpen)
+   {
+      Index = RxDmaIndex();
+      if(Index != UartContext.RxIdleIndex)
+      {
+         /* The channel has moved, check again on the next tick.        */
+         UartContext.RxIdleIndex = Index;
+      }
+      else
+      {
+         /* The line is idle, check for data that was received since    */
+         /* the last update or that was not delivered.                  */
+         if((Index >= 0) && ((Index != UartContext.RxInIndex) || (UartContext.RxBytesFree != UartContext.RxBufferSize)))
+            ret_val = 1;
+      }
+   }
+
+   return(ret_val);
+}
+
+#endif
+
+#if (defined(BT_UART_DMA_TX_TRIGGER)) || (defined(BT_UART_DMA_RX_TRIGGER))
+
+   /* The following function is the DMA Interrupt of the transport.  It */
+   /* is called from the DMA Interrupt Service Routine (which belongs   */
+   /* to the application, as DMA0 does) with the value that was read    */
+   /* from the DMA Interrupt Vector Register.  This function returns    */
+   /* non-zero if LPM3 should be exited.                                */
+int UartDmaInterrupt(Word_t VectorRegister)
+{
+   int ret_val = 0;
+
+#ifdef BT_UART_DMA_TX_TRIGGER
+
+   if(VectorRegister == BT_UART_DMA_TX_IV)
+   {
+      /* The block was sent, credit it and start the next one.          */
+      if(UartContext.TxDmaCount)
+      {
+         TxDmaCredit(UartContext.TxDmaCount);
+
+         TxTransmit();
+      }
+
+      /* Flag that LPM3 should be exited on return (HCITR_COMWrite() may*/
+      /* be waiting for space in the Tx Buffer).                        */
+      ret_val = 1;
+   }
+
+#endif
+
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+   if(VectorRegister == BT_UART_DMA_RX_IV)
+   {
+      /* A half is full and the channel is writing the other half.  The */
+      /* half that is full is the destination of the next reload.       */
+      UartContext.RxDmaHalf = !UartContext.RxDmaHalf;
+
+      __data16_write_addr((unsigned short)&BT_UART_DMA_RX_DA, (unsigned long)&(UartContext.RxBuffer[UartContext.RxDmaHalf?0:RX_DMA_HALF_SIZE]));
+
+      /* Credit the half that is full.                                  */
+      RxDmaUpdate();
+
+      /* Flag that LPM3 should be exited on return, so that the data is */
+      /* delivered.                                                     */
+      ret_val = 1;
+   }
+
+#endif
+
+   return(ret_val);
+}
+
+#endif
+
    /* The following function is the Interrupt Service Routine for the   */
    /* UART RX interrupt.                                                */
 #pragma vector=BT_UART_IV
@@ -195,6 +512,7 @@ __interrupt void UartInterrupt(void)
 
          /* Read the character from the UART Receive Buf.               */
          UartContext.RxBuffer[UartContext.RxInIndex++] = UARTReceiveBufferReg(UartContext.UartBase);
+         UartContext.Statistics.RxBytes++;
 
          /* Credit the received character.                              */
          --(UartContext.RxBytesFree);
@@ -211,6 +529,8 @@ __interrupt void UartInterrupt(void)
             /* if Flow is Enabled then disable it                       */
             UartContext.Flags &= (~UART_CONTEXT_FLAG_FLOW_ENABLED);
             FLOW_OFF();
+
+            UartContext.Statistics.RxFlowStops++;
          }
       }
       else
@@ -218,6 +538,8 @@ __interrupt void UartInterrupt(void)
          /* We have data in the FIFO, but no place to put the data,     */
          /* so will will have to flush the FIFO and discard the data.   */
          Dummy = UARTReceiveBufferReg(UartContext.UartBase);
+         UartContext.Statistics.RxBytes++;
+         UartContext.Statistics.RxOverruns++;
 
          /* Flag that we have encountered an RX Overrun.                */
          /* Also Disable Rx Flow.                                       */
@@ -275,7 +597,7 @@ int CtsInterrupt(void)
       if((UartContext.Flags & UART_CONTEXT_FLAG_TRANSMIT_ENABLED) && (UartContext.TxBytesFree != UartContext.TxBufferSize))
       {
          /* Re-enable the transmit interrupt.                           */
-         UARTIntEnableTransmit(UartContext.UartBase);
+         TX_INTERRUPT_ENABLE();
 
          /* Reprime the transmitter.                                    */
          TxTransmit();
@@ -302,6 +624,13 @@ int CtsInterrupt(void)
       /* Flag that we are no longer primed.                             */
       UartContext.Flags &= (~UART_CONTEXT_FLAG_TX_PRIMED);
 
+#ifdef BT_UART_DMA_TX_TRIGGER
+
+      /* Stop the block that is being sent.                             */
+      TxDmaPause();
+
+#endif
+
       /* Check to see what the current UART State is.  If the UART is   */
       /* currently suspended we will re-start the UART here as this must*/
       /* mean that we are in HCILL sleep mode and the Bluetooth         */
@@ -349,6 +678,16 @@ static void RxProcess(void)
    unsigned int MaxWrite;
    unsigned int Count;
 
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+   /* Credit the characters that the DMA channel has written to the     */
+   /* half that is not full yet.                                        */
+   DISABLE_INTERRUPTS();
+   RxDmaUpdate();
+   ENABLE_INTERRUPTS();
+
+#endif
+
    /* Determine the number of characters that can be delivered.         */
    Count = (UartContext.RxBufferSize - UartContext.RxBytesFree);
    if(Count)
@@ -360,10 +699,21 @@ static void RxProcess(void)
       MaxWrite = (UartContext.RxBufferSize-UartContext.RxOutIndex);
       Count    = (MaxWrite < Count)?MaxWrite:Count;
 
+#if HCITR_TAP_BUFFER_SIZE
+
+      /* Pass the data to the HCI tap before the upper layer sees it.   */
+      HCITR_TapData(HCITR_TAP_DIRECTION_RECEIVED, Count, &UartContext.RxBuffer[UartContext.RxOutIndex]);
+
+#endif
+
       /* Call the upper layer back with the data.                       */
       if((Count) && (_COMDataCallback))
+      {
          (*_COMDataCallback)(TRANSPORT_ID, Count, &UartContext.RxBuffer[UartContext.RxOutIndex], _COMCallbackParameter);
 
+         UartContext.Statistics.RxDeliveries++;
+      }
+
       /* Adjust the Out Index and handle any looping.                   */
       UartContext.RxOutIndex += Count;
       if(UartContext.RxOutIndex >= UartContext.RxBufferSize)
@@ -402,6 +752,13 @@ static void DisableTransmitter(void)
 
    /* Disable the Transmit Interrupt.                                   */
    UARTIntDisableTransmit(UartContext.UartBase);
+
+#ifdef BT_UART_DMA_TX_TRIGGER
+
+   /* Stop the block that is being sent.                                */
+   TxDmaPause();
+
+#endif
 }
 
    /* The following function is used to re-enable Transmit Operation.   */
@@ -416,7 +773,7 @@ static void EnableTransmitter(void)
    if(UartContext.Flags & UART_CONTEXT_FLAG_TX_FLOW_ENABLED)
    {
       /* Re-enable the transmit interrupt.                              */
-      UARTIntEnableTransmit(UartContext.UartBase);
+      TX_INTERRUPT_ENABLE();
 
       /* Reprime the transmitter.                                       */
       TxTransmit();
@@ -503,7 +860,7 @@ static void LoadTransmitBuffer(unsigned int Length, unsigned char *Buffer)
          DISABLE_INTERRUPTS();
 
          /* Enable the transmit interrupt.                              */
-         UARTIntEnableTransmit(UartContext.UartBase);
+         TX_INTERRUPT_ENABLE();
 
          /* Prime the transmitter.                                      */
          TxTransmit();
@@ -548,8 +905,8 @@ int BTPSAPI HCITR_COMOpen(HCI_COMMDriverInformation_t *COMMDriverInformation, HC
       UartContext.ID           = 1;
       UartContext.RxBufferSize = DEFAULT_INPUT_BUFFER_SIZE;
       UartContext.RxBytesFree  = DEFAULT_INPUT_BUFFER_SIZE;
-      UartContext.XOffLimit    = XOFF_LIMIT;
-      UartContext.XOnLimit     = XON_LIMIT;
+      UartContext.XOffLimit    = RX_XOFF_LIMIT;
+      UartContext.XOnLimit     = RX_XON_LIMIT;
       UartContext.TxBufferSize = DEFAULT_OUTPUT_BUFFER_SIZE;
       UartContext.TxBytesFree  = DEFAULT_OUTPUT_BUFFER_SIZE;
       UartContext.SuspendState = hssNormal;
@@ -616,12 +973,46 @@ int BTPSAPI HCITR_COMOpen(HCI_COMMDriverInformation_t *COMMDriverInformation, HC
          /* Clear any data that is in the Buffer.                       */
          FlushRxFIFO(UartContext.UartBase);
 
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+         /* Start the receive DMA channel : repeated single transfers,  */
+         /* one per receive flag, from the UART Receive Buffer to the   */
+         /* first half of the Rx Buffer.  The destination is written    */
+         /* again once the channel is enabled, so the second half is    */
+         /* reloaded when the first is full.                            */
+         DISABLE_INTERRUPTS();
+         BT_UART_DMA_RX_CTL       = 0;
+         BT_UART_DMA_RX_TSEL_REG  = (BT_UART_DMA_RX_TSEL_REG & ~(BT_UART_DMA_RX_TSEL_MASK)) | BT_UART_DMA_RX_TRIGGER;
+         ENABLE_INTERRUPTS();
+
+         __data16_write_addr((unsigned short)&BT_UART_DMA_RX_SA, (unsigned long)(UartContext.UartBase + MSP430_UART_RXBUF_OFFSET));
+         __data16_write_addr((unsigned short)&BT_UART_DMA_RX_DA, (unsigned long)&(UartContext.RxBuffer[0]));
+         BT_UART_DMA_RX_SZ  = RX_DMA_HALF_SIZE;
+         BT_UART_DMA_RX_CTL = DMADT_4 | DMADSTINCR_3 | DMASBDB | DMALEVEL | DMAIE | DMAEN;
+
+         __data16_write_addr((unsigned short)&BT_UART_DMA_RX_DA, (unsigned long)&(UartContext.RxBuffer[RX_DMA_HALF_SIZE]));
+
+#endif
+
          /* Enable Receive interrupt.                                   */
-         UARTIntEnableReceive(UartContext.UartBase);
+         RX_INTERRUPT_ENABLE();
 
          /* Disable Transmit Interrupt.                                  */
          UARTIntDisableTransmit(UartContext.UartBase);
 
+#ifdef BT_UART_DMA_TX_TRIGGER
+
+         /* Select the trigger of the transmit DMA channel and point    */
+         /* the channel at the UART Transmit Buffer.                    */
+         DISABLE_INTERRUPTS();
+         BT_UART_DMA_TX_CTL       = 0;
+         BT_UART_DMA_TX_TSEL_REG  = (BT_UART_DMA_TX_TSEL_REG & ~(BT_UART_DMA_TX_TSEL_MASK)) | BT_UART_DMA_TX_TRIGGER;
+         ENABLE_INTERRUPTS();
+
+         __data16_write_addr((unsigned short)&BT_UART_DMA_TX_DA, (unsigned long)(UartContext.UartBase + MSP430_UART_TXBUF_OFFSET));
+
+#endif
+
          DISABLE_INTERRUPTS();
 
          /* Flag that the UART Tx Buffer will need to be primed.        */
@@ -679,6 +1070,21 @@ void BTPSAPI HCITR_COMClose(unsigned int HCITransportID)
 
       /* Clear the UartContext Flags.                                   */
       DISABLE_INTERRUPTS();
+
+#ifdef BT_UART_DMA_TX_TRIGGER
+
+      /* Stop the block that is being sent.                             */
+      TxDmaPause();
+
+#endif
+
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+      /* Stop the receive DMA channel.                                  */
+      BT_UART_DMA_RX_CTL = 0;
+
+#endif
+
       UartContext.Flags = 0;
       ENABLE_INTERRUPTS();
 
@@ -735,7 +1141,7 @@ void BTPSAPI HCITR_COMReconfigure(unsigned int HCITransportID, HCI_Driver_Reconf
 
       UARTIntDisableReceive(UartContext.UartBase);
       HAL_CommConfigure(UartContext.UartBase, BaudRate, (UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE | UART_CONFIG_PAR_NONE));
-      UARTIntEnableReceive(UartContext.UartBase);
+      RX_INTERRUPT_ENABLE();
 
       /* Small delay to let the COM Port reconfigure itself.            */
       BTPS_Delay(1);
@@ -831,6 +1237,13 @@ int BTPSAPI HCITR_COMWrite(unsigned int HCITransportID, unsigned int Length, uns
    /* the output buffer appears to be valid as well.                    */
    if((HCITransportID == TRANSPORT_ID) && (HCITransportOpen) && (Length) && (Buffer))
    {
+#if HCITR_TAP_BUFFER_SIZE
+
+      /* Pass the data to the HCI tap.                                  */
+      HCITR_TapData(HCITR_TAP_DIRECTION_SENT, Length, Buffer);
+
+#endif
+
       /* Load the Transmit Buffer with the selected characters.         */
       LoadTransmitBuffer(Length, Buffer);
 
@@ -894,6 +1307,13 @@ int BTPSAPI HCITR_COMSuspend(unsigned int HCITransportID)
          /* the UART.                                                   */
          DISABLE_INTERRUPTS();
 
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+         /* Credit the characters that the DMA channel has written.     */
+         RxDmaUpdate();
+
+#endif
+
          if(UartContext.SuspendState == hssSuspendWait)
          {
             /* Flag that the UART is current suspended.                 */
@@ -955,3 +1375,36 @@ Boolean_t BTPSAPI HCITR_UartSuspended(unsigned int HCITransportID)
 {
    return((Boolean_t)(UartContext.SuspendState == hssSuspended));
 }
+
+   /* The following function is used to read the receive statistics of  */
+   /* the specified HCI Transport.  This function returns zero if       */
+   /* successful, or a negative value if there was an error.            */
+int BTPSAPI HCITR_QueryStatistics(unsigned int HCITransportID, HCITR_Statistics_t *Statistics)
+{
+   int ret_val;
+
+   /* Check to make sure that the specified Transport ID is valid.      */
+   if((HCITransportID == TRANSPORT_ID) && (HCITransportOpen) && (Statistics))
+   {
+      /* The counts are updated in the interrupts, so copy them with    */
+      /* interrupts disabled.                                           */
+      DISABLE_INTERRUPTS();
+
+#ifdef BT_UART_DMA_RX_TRIGGER
+
+      /* Credit the characters that the DMA channel has written.        */
+      RxDmaUpdate();
+
+#endif
+
+      BTPS_MemCopy(Statistics, &(UartContext.Statistics), HCITR_STATISTICS_SIZE);
+
+      ENABLE_INTERRUPTS();
+
+      ret_val = 0;
+   }
+   else
+      ret_val = HCITR_ERROR_INVALID_PARAMETER;
+
+   return(ret_val);
+}
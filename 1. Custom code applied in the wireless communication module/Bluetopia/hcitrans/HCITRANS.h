@@ -55,6 +55,32 @@
    /* enable flow, and a NULL pointer to disable flow.                  */
 #define HCI_COMM_DRIVER_DISABLE_UART_TX_RX   (HCI_COMM_DRIVER_RECONFIGURE_DATA_COMMAND_CHANGE_PARAMETERS + 1)
 
+   /* The following constant represents the size (in bytes) of the      */
+   /* receive buffer of the transport.  The transport raises RTS when   */
+   /* the buffer is nearly full.                                        */
+#ifndef HCITR_INPUT_BUFFER_SIZE
+
+   #define HCITR_INPUT_BUFFER_SIZE               (128)
+
+#endif
+
+   /* The following structure represents the statistics of the receive  */
+   /* side of the transport (see HCITR_QueryStatistics()).  RxBytes     */
+   /* counts the bytes that were received and RxDeliveries the calls of */
+   /* the COM Data Callback.  RxFlowStops counts the times RTS was      */
+   /* raised because the receive buffer was nearly full.  RxOverruns    */
+   /* counts the bytes that were lost because the receive buffer was    */
+   /* full.                                                             */
+typedef struct _tagHCITR_Statistics_t
+{
+   unsigned long RxBytes;
+   unsigned long RxDeliveries;
+   unsigned long RxFlowStops;
+   unsigned long RxOverruns;
+} HCITR_Statistics_t;
+
+#define HCITR_STATISTICS_SIZE                    (sizeof(HCITR_Statistics_t))
+
    /* The following declared type represents the Prototype Function for */
    /* an HCI Transport Driver Data Callback for COM data.  This function*/
    /* will be called whenever HCI Packet Information has been received  */
@@ -173,4 +199,99 @@ int BTPSAPI HCITR_COMSuspend(unsigned int HCITransportID);
    /* suspended or FALSE otherwise.                                     */
 Boolean_t BTPSAPI HCITR_UartSuspended(unsigned int HCITransportID);
 
+   /* The following function is used to read the receive statistics of  */
+   /* the specified HCI Transport.  This function accepts as its        */
+   /* parameters the HCI Transport ID and a pointer to a buffer that    */
+   /* will receive the statistics.  The statistics are counted from     */
+   /* HCITR_COMOpen().  This function returns zero if successful, or a  */
+   /* negative value if there was an error.                             */
+int BTPSAPI HCITR_QueryStatistics(unsigned int HCITransportID, HCITR_Statistics_t *Statistics);
+
+   /* The following constant represents the size (in bytes) of the RAM  */
+   /* ring of the HCI tap (see HCITR_TapData()).  0 leaves the tap out. */
+#ifndef HCITR_TAP_BUFFER_SIZE
+
+   #define HCITR_TAP_BUFFER_SIZE                 (0)
+
+#endif
+
+   /* The following constant represents the number of bytes of a packet */
+   /* (packet type included) that the HCI tap keeps.  The rest of a     */
+   /* longer packet is counted in its original length only.  At most    */
+   /* 255 (the Captured Length in the ring is one byte), except on a    */
+   /* port with a wider one (the host port keeps whole packets).        */
+#ifndef HCITR_TAP_SNAP_LENGTH
+
+   #define HCITR_TAP_SNAP_LENGTH                 (64)
+
+#endif
+
+   /* The following constants are used with HCITR_TapData() to specify  */
+   /* the direction of the data.                                        */
+#define HCITR_TAP_DIRECTION_SENT                 0
+#define HCITR_TAP_DIRECTION_RECEIVED             1
+
+   /* The following constants represent the size of the btsnoop file    */
+   /* header (see HCITR_TapHeader()) and of the header of a btsnoop     */
+   /* packet record (see HCITR_TapRead()).                              */
+#define HCITR_BTSNOOP_HEADER_SIZE                16
+#define HCITR_BTSNOOP_RECORD_HEADER_SIZE         24
+
+   /* The following constant represents the size of the header of a     */
+   /* packet that is read with HCITR_TapReadPackets().                  */
+#define HCITR_TAP_PACKET_HEADER_SIZE             10
+
+   /* The following function is used to pass data of the UART (H4) byte */
+   /* stream to the HCI tap.  This function accepts as its parameters   */
+   /* the direction (HCITR_TAP_DIRECTION_xxx), the number of bytes and  */
+   /* a pointer to the data.  The bytes of every direction are split    */
+   /* into packets (Command, ACL, SCO, Event, and the single byte       */
+   /* packets of the HCILL protocol) and every packet is stored with    */
+   /* the Tick Count of its first byte in the RAM ring.  When the ring  */
+   /* is full the oldest packets are dropped.  The transport taps the   */
+   /* data that passes HCITR_COMWrite() and the COM Data Callback       */
+   /* itself.                                                           */
+   /* * NOTE * Data that is written to the UART without                 */
+   /*          HCITR_COMWrite() (e.g. by DMA) should be passed to this  */
+   /*          function in the order that it is sent.                   */
+   /* * NOTE * This function may be called from an interrupt service    */
+   /*          routine.  It does nothing if HCITR_TAP_BUFFER_SIZE is    */
+   /*          zero.                                                    */
+void BTPSAPI HCITR_TapData(unsigned int Direction, unsigned int Length, unsigned char *Buffer);
+
+   /* The following function is used to write the btsnoop file header   */
+   /* (version 1, H4 data link) of a capture of the HCI tap to the      */
+   /* specified buffer (HCITR_BTSNOOP_HEADER_SIZE bytes).  This function*/
+   /* returns the number of bytes that were written.                    */
+unsigned int BTPSAPI HCITR_TapHeader(unsigned char *Buffer);
+
+   /* The following function is used to read the packets of the HCI tap */
+   /* as btsnoop packet records (whole records only, oldest first).     */
+   /* This function accepts as its parameters the size of the buffer, a */
+   /* pointer to the buffer and the number of Ticks (BTPS_GetTickCount) */
+   /* per second, which converts the Tick Counts to the btsnoop         */
+   /* timestamps.  This function returns the number of bytes that were  */
+   /* read.  The packets that are read are removed from the ring.  The  */
+   /* cumulative drops field of a record counts the packets that were   */
+   /* dropped before it.                                                */
+unsigned int BTPSAPI HCITR_TapRead(unsigned int BufferSize, unsigned char *Buffer, unsigned long TickRate);
+
+   /* The following function is used to read the packets of the HCI tap */
+   /* in the form they are kept in the ring (whole packets, oldest      */
+   /* first) : Included Length (1 Byte), btsnoop Flags (1 Byte),        */
+   /* Original Length (4 Bytes) and Tick Count (4 Bytes), MSB first,    */
+   /* followed by the included bytes.  This function accepts as its     */
+   /* parameters the size of the buffer, a pointer to the buffer and a  */
+   /* pointer to receive the running count of the packets that were     */
+   /* dropped.  This function returns the number of bytes that were     */
+   /* read.  The packets that are read are removed from the ring.       */
+   /* * NOTE * When the oldest packet does not fit the buffer whole, it */
+   /*          is cut to the buffer (the Original Length is kept), so   */
+   /*          a buffer that holds HCITR_TAP_PACKET_HEADER_SIZE Bytes   */
+   /*          and more always reads a packet that is waiting.          */
+   /* * NOTE * This function may be called from an interrupt service    */
+   /*          routine.  It copies every packet with interrupts         */
+   /*          disabled.                                                */
+unsigned int BTPSAPI HCITR_TapReadPackets(unsigned int BufferSize, unsigned char *Buffer, unsigned long *Dropped);
+
 #endif
@@ -0,0 +1,499 @@
+/*****< hcitrans.c >***********************************************************/
+/*                                                                            */
+/*  HCITRANS - HCI Transport Layer for POSIX hosts (see                       */
+/*  btpskrnl/posix/BTPSKRNL.c).                                               */
+/*                                                                            */
+/*  Stands in for the UART of the CC256x.  If no COMDeviceName is given to    */
+/*  HCITR_COMOpen() the transport opens a pseudo terminal (virtual radio) and */
+/*  prints the name of its slave side, where a controller emulator, a test    */
+/*  script or a bridge to a real controller (e.g. socat to a USB UART) is     */
+/*  attached.  Otherwise the named serial device is opened.  Received data is */
+/*  delivered from HCITR_COMProcess() (polled, as on the MSP430).             */
+/*                                                                            */
+/*  All HCI traffic passes the HCI tap (hcitrans/HCITAP.c).  If the           */
+/*  environment variable HCITR_BTSNOOP_FILE names a file, the traffic is      */
+/*  written to it as a btsnoop capture (Wireshark) while the port is open.    */
+/******************************************************************************/
+#define _XOPEN_SOURCE 600
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+   /* The host keeps whole packets in the HCI tap (the MSP430 keeps the */
+   /* first 64 bytes), with a two byte Captured Length in the ring.     */
+#ifndef HCITR_TAP_SNAP_LENGTH
+
+   #define HCITR_TAP_SNAP_LENGTH                                 (0xFFFF)
+
+#endif
+
+#define TAP_CAPTURED_LENGTH_SIZE                                 2
+
+#include "BTPSKRNL.h"            /* Bluetooth Kernel Protoypes/Constants.     */
+#include "HCITRANS.h"            /* HCI Transport Prototypes/Constants.       */
+
+   /* The HCI tap is always part of the host transport.                 */
+#if !HCITR_TAP_BUFFER_SIZE
+
+   #undef  HCITR_TAP_BUFFER_SIZE
+   #define HCITR_TAP_BUFFER_SIZE                                 (16384)
+
+#endif
+
+   /* The following constant represents the number of Ticks per second  */
+   /* of BTPS_GetTickCount() (Milliseconds, unless the application gives*/
+   /* BTPS_Init() a GetTickCountCallback of another rate).              */
+#ifndef HCITR_TAP_TICK_RATE
+
+   #define HCITR_TAP_TICK_RATE                                   1000
+
+#endif
+
+   /* The tap is serialized with a mutex, as the port may be written and*/
+   /* processed by different threads.                                   */
+#define HCITR_TAP_PORT
+
+#define TAP_ENTER_CRITICAL_SECTION(_State)                     { (_State) = 0; pthread_mutex_lock(&TapMutex); }
+
+#define TAP_EXIT_CRITICAL_SECTION(_State)                      { (void)(_State); pthread_mutex_unlock(&TapMutex); }
+
+typedef int TapState_t;
+
+static pthread_mutex_t TapMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#include "../HCITAP.c"           /* HCI tap (shared with the MSP430).         */
+
+#define TRANSPORT_ID                                           1
+
+   /* The following defines the baud rate that the port is opened with  */
+   /* (the startup baud rate of the TI CC256x).                         */
+#define BLUETOOTH_STARTUP_BAUD_RATE                              115200L
+
+   /* The following defines the largest number of bytes that are passed */
+   /* to the COM Data Callback at a time (the receive buffer of the     */
+   /* MSP430 transport).                                                */
+#define DEFAULT_INPUT_BUFFER_SIZE                                HCITR_INPUT_BUFFER_SIZE
+
+   /* The following defines the length of the device name that is built */
+   /* from COMDeviceName and COMPortNumber.                             */
+#define MAXIMUM_DEVICE_NAME_LENGTH                               64
+
+   /* The following defines the size of the buffer that the btsnoop     */
+   /* records are read into (one record at least).                      */
+#define BTSNOOP_BUFFER_SIZE                                      (HCITR_BTSNOOP_RECORD_HEADER_SIZE + HCITR_TAP_SNAP_LENGTH)
+
+   /* Internal Variables to this Module (Remember that all variables    */
+   /* declared static are initialized to 0 automatically by the compiler*/
+   /* as part of standard C/C++).                                       */
+static int                     PortDescriptor;
+static unsigned int            HCITransportOpen;
+static Boolean_t               TransportSuspended;
+static unsigned char           RxBuffer[DEFAULT_INPUT_BUFFER_SIZE];
+static HCITR_Statistics_t      RxStatistics;
+static FILE                   *BtsnoopFile;
+
+   /* COM Data Callback Function and Callback Parameter information.    */
+static HCITR_COMDataCallback_t _COMDataCallback;
+static unsigned long           _COMCallbackParameter;
+
+   /* Local Function Prototypes.                                        */
+static speed_t BaudRateToSpeed(unsigned long BaudRate);
+static void ConfigurePort(unsigned long BaudRate);
+static void RxProcess(void);
+static void BtsnoopFlush(void);
+
+   /* The following function maps a baud rate to the termios speed.     */
+   /* This function returns B0 if the baud rate is not supported.       */
+static speed_t BaudRateToSpeed(unsigned long BaudRate)
+{
+   speed_t ret_val;
+
+   switch(BaudRate)
+   {
+      case 9600L:
+         ret_val = B9600;
+         break;
+      case 19200L:
+         ret_val = B19200;
+         break;
+      case 38400L:
+         ret_val = B38400;
+         break;
+      case 57600L:
+         ret_val = B57600;
+         break;
+      case 115200L:
+         ret_val = B115200;
+         break;
+      case 230400L:
+         ret_val = B230400;
+         break;
+#ifdef B460800
+      case 460800L:
+         ret_val = B460800;
+         break;
+#endif
+#ifdef B921600
+      case 921600L:
+         ret_val = B921600;
+         break;
+#endif
+      default:
+         ret_val = B0;
+         break;
+   }
+
+   return(ret_val);
+}
+
+   /* The following function configures the opened port for raw 8 bit   */
+   /* data (no echo, no character translation) at the specified baud    */
+   /* rate (the baud rate is left unchanged if it is not supported, and */
+   /* has no effect on a pseudo terminal).                              */
+static void ConfigurePort(unsigned long BaudRate)
+{
+   speed_t        Speed;
+   struct termios Attributes;
+
+   if(!tcgetattr(PortDescriptor, &Attributes))
+   {
+      Attributes.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+      Attributes.c_oflag &= ~OPOST;
+      Attributes.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+      Attributes.c_cflag &= ~(CSIZE | PARENB | CSTOPB);
+      Attributes.c_cflag |= (CS8 | CLOCAL | CREAD);
+
+      Attributes.c_cc[VMIN]  = 0;
+      Attributes.c_cc[VTIME] = 0;
+
+      if((Speed = BaudRateToSpeed(BaudRate)) != B0)
+      {
+         cfsetispeed(&Attributes, Speed);
+         cfsetospeed(&Attributes, Speed);
+      }
+
+      tcsetattr(PortDescriptor, TCSANOW, &Attributes);
+   }
+}
+
+   /* The following function reads all data that the port has received  */
+   /* and passes it to the COM Data Callback (DEFAULT_INPUT_BUFFER_SIZE */
+   /* bytes at most per callback).                                      */
+static void RxProcess(void)
+{
+   ssize_t Length;
+
+   while((HCITransportOpen) && ((Length = read(PortDescriptor, RxBuffer, sizeof(RxBuffer))) > 0))
+   {
+      /* Received data ends the suspended state (as the CTS interrupt   */
+      /* of the MSP430 transport).                                      */
+      TransportSuspended = FALSE;
+
+      HCITR_TapData(HCITR_TAP_DIRECTION_RECEIVED, (unsigned int)Length, RxBuffer);
+
+      BtsnoopFlush();
+
+      RxStatistics.RxBytes += (unsigned long)Length;
+
+      if(_COMDataCallback)
+      {
+         (*_COMDataCallback)(TRANSPORT_ID, (unsigned int)Length, RxBuffer, _COMCallbackParameter);
+
+         RxStatistics.RxDeliveries++;
+      }
+   }
+}
+
+   /* The following function writes the packets of the HCI tap to the   */
+   /* btsnoop file (if one is open).                                    */
+static void BtsnoopFlush(void)
+{
+   unsigned int  Length;
+   unsigned char Buffer[BTSNOOP_BUFFER_SIZE];
+
+   if(BtsnoopFile)
+   {
+      while((Length = HCITR_TapRead(sizeof(Buffer), Buffer, HCITR_TAP_TICK_RATE)) != 0)
+         fwrite(Buffer, 1, Length, BtsnoopFile);
+
+      fflush(BtsnoopFile);
+   }
+}
+
+   /* The following function is responsible for opening the HCI         */
+   /* Transport layer that will be used by Bluetopia to send and receive*/
+   /* COM (Serial) data.  If the COMDeviceName member of the COMM Driver*/
+   /* Information is NULL a pseudo terminal is opened, otherwise the    */
+   /* device COMDeviceName (with COMPortNumber appended, unless         */
+   /* COMPortNumber is -1).  A successful call to this function will    */
+   /* return a non-zero, positive value which specifies the             */
+   /* HCITransportID that is used with the remaining transport functions*/
+   /* in this module.  This function returns a negative return value to */
+   /* signify an error.                                                 */
+int BTPSAPI HCITR_COMOpen(HCI_COMMDriverInformation_t *COMMDriverInformation, HCITR_COMDataCallback_t COMDataCallback, unsigned long CallbackParameter)
+{
+   int            ret_val;
+   char           DeviceName[MAXIMUM_DEVICE_NAME_LENGTH];
+   char          *FileName;
+   unsigned char  Header[HCITR_BTSNOOP_HEADER_SIZE];
+
+   /* First, make sure that the port is not already open and make sure  */
+   /* that valid COMM Driver Information was specified.                 */
+   if((!HCITransportOpen) && (COMMDriverInformation) && (COMDataCallback))
+   {
+      if(COMMDriverInformation->COMDeviceName)
+      {
+         if(COMMDriverInformation->COMPortNumber == (unsigned int)-1)
+            PortDescriptor = open(COMMDriverInformation->COMDeviceName, O_RDWR | O_NOCTTY | O_NONBLOCK);
+         else
+         {
+            if(BTPS_StringLength(COMMDriverInformation->COMDeviceName) < (MAXIMUM_DEVICE_NAME_LENGTH - 11))
+            {
+               SprintF(DeviceName, "%s%u", COMMDriverInformation->COMDeviceName, COMMDriverInformation->COMPortNumber);
+
+               PortDescriptor = open(DeviceName, O_RDWR | O_NOCTTY | O_NONBLOCK);
+            }
+            else
+               PortDescriptor = -1;
+         }
+      }
+      else
+      {
+         /* No device, open the virtual radio.                          */
+         if((PortDescriptor = posix_openpt(O_RDWR | O_NOCTTY)) >= 0)
+         {
+            if((grantpt(PortDescriptor)) || (unlockpt(PortDescriptor)) || (fcntl(PortDescriptor, F_SETFL, O_NONBLOCK)))
+            {
+               close(PortDescriptor);
+
+               PortDescriptor = -1;
+            }
+            else
+               BTPS_OutputMessage("HCITR: virtual radio on %s\r\n", ptsname(PortDescriptor));
+         }
+      }
+
+      if(PortDescriptor >= 0)
+      {
+         ConfigurePort(BLUETOOTH_STARTUP_BAUD_RATE);
+
+         /* Note the COM Callback information.                          */
+         _COMDataCallback      = COMDataCallback;
+         _COMCallbackParameter = CallbackParameter;
+
+         TransportSuspended    = FALSE;
+         HCITransportOpen      = 1;
+
+         BTPS_MemInitialize(&RxStatistics, 0, HCITR_STATISTICS_SIZE);
+
+         /* Start the btsnoop capture if a file is named.               */
+         if(((FileName = getenv("HCITR_BTSNOOP_FILE")) != NULL) && (*FileName))
+         {
+            if((BtsnoopFile = fopen(FileName, "wb")) != NULL)
+               fwrite(Header, 1, HCITR_TapHeader(Header), BtsnoopFile);
+            else
+               BTPS_OutputMessage("HCITR: unable to open %s\r\n", FileName);
+         }
+
+         ret_val               = TRANSPORT_ID;
+      }
+      else
+         ret_val = HCITR_ERROR_UNABLE_TO_OPEN_TRANSPORT;
+   }
+   else
+      ret_val = HCITR_ERROR_UNABLE_TO_OPEN_TRANSPORT;
+
+   return(ret_val);
+}
+
+   /* The following function is responsible for closing the the specific*/
+   /* HCI Transport layer that was opened via a successful call to the  */
+   /* HCITR_COMOpen() function (specified by the first parameter).      */
+   /* * NOTE * The very last data callback that is issued from this     */
+   /*          module specifies zero and NULL for the data length and   */
+   /*          data buffer (respectively).                              */
+void BTPSAPI HCITR_COMClose(unsigned int HCITransportID)
+{
+   HCITR_COMDataCallback_t COMDataCallback;
+   unsigned long           CallbackParameter;
+
+   /* Check to make sure that the specified Transport ID is valid.      */
+   if((HCITransportID == TRANSPORT_ID) && (HCITransportOpen))
+   {
+      close(PortDescriptor);
+
+      PortDescriptor = -1;
+
+      /* End the btsnoop capture.                                       */
+      if(BtsnoopFile)
+      {
+         BtsnoopFlush();
+
+         fclose(BtsnoopFile);
+
+         BtsnoopFile = NULL;
+      }
+
+      /* Note the Callback information.                                 */
+      COMDataCallback   = _COMDataCallback;
+      CallbackParameter = _COMCallbackParameter;
+
+      /* Flag that the HCI Transport is no longer open.                 */
+      HCITransportOpen = 0;
+
+      /* Flag that there is no callback information present.            */
+      _COMDataCallback      = NULL;
+      _COMCallbackParameter = 0;
+
+      /* All finished, perform the callback to let the upper layer know */
+      /* that this module will no longer issue data callbacks and is    */
+      /* completely cleaned up.                                         */
+      if(COMDataCallback)
+         (*COMDataCallback)(HCITransportID, 0, NULL, CallbackParameter);
+   }
+}
+
+   /* The following function is responsible for instructing the         */
+   /* specified HCI Transport layer (first parameter) that was opened   */
+   /* via a successful call to the HCITR_COMOpen() function to          */
+   /* reconfigure itself with the specified information.  The baud rate */
+   /* change is applied to the port.  Disabling Transmit and Receive    */
+   /* waits until the written data has been sent.                       */
+void BTPSAPI HCITR_COMReconfigure(unsigned int HCITransportID, HCI_Driver_Reconfigure_Data_t *DriverReconfigureData)
+{
+   /* Check to make sure that the specified Transport ID is valid.      */
+   if((HCITransportID == TRANSPORT_ID) && (HCITransportOpen) && (DriverReconfigureData) && (DriverReconfigureData->ReconfigureCommand == HCI_COMM_DRIVER_RECONFIGURE_DATA_COMMAND_CHANGE_PARAMETERS))
+   {
+      tcdrain(PortDescriptor);
+
+      ConfigurePort(*((unsigned long *)DriverReconfigureData->ReconfigureData));
+   }
+
+   /* Check to see if there is a global reconfigure parameter.          */
+   if((DriverReconfigureData) && (!HCITransportID) && (HCITransportOpen))
+   {
+      if((DriverReconfigureData->ReconfigureCommand == HCI_COMM_DRIVER_DISABLE_UART_TX_RX) && (!DriverReconfigureData->ReconfigureData))
+         tcdrain(PortDescriptor);
+   }
+}
+
+   /* The following function is provided to allow a mechanism for       */
+   /* modules to force the processing of incoming COM Data.             */
+void BTPSAPI HCITR_COMProcess(unsigned int HCITransportID)
+{
+   /* Check to make sure that the specified Transport ID is valid.      */
+   if((HCITransportID == TRANSPORT_ID) && (HCITransportOpen))
+      RxProcess();
+}
+
+   /* The following function is responsible for actually sending data   */
+   /* through the opened HCI Transport layer (specified by the first    */
+   /* parameter).  This function returns zero if all of the data was    */
+   /* written or a negative value if an error occurred.  This function  */
+   /* blocks while the port cannot take more data.                      */
+int BTPSAPI HCITR_COMWrite(unsigned int HCITransportID, unsigned int Length, unsigned char *Buffer)
+{
+   int           ret_val;
+   ssize_t       Written;
+   struct pollfd PollDescriptor;
+
+   /* Check to make sure that the specified Transport ID is valid and   */
+   /* the output buffer appears to be valid as well.                    */
+   if((HCITransportID == TRANSPORT_ID) && (HCITransportOpen) && (Length) && (Buffer))
+   {
+      TransportSuspended = FALSE;
+
+      HCITR_TapData(HCITR_TAP_DIRECTION_SENT, Length, Buffer);
+
+      BtsnoopFlush();
+
+      ret_val = 0;
+
+      while((Length) && (!ret_val))
+      {
+         if((Written = write(PortDescriptor, Buffer, Length)) > 0)
+         {
+            Buffer += Written;
+            Length -= (unsigned int)Written;
+         }
+         else
+         {
+            if((Written < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+            {
+               /* The port is full, wait until it can take more data.   */
+               PollDescriptor.fd      = PortDescriptor;
+               PollDescriptor.events  = POLLOUT;
+               PollDescriptor.revents = 0;
+
+               poll(&PollDescriptor, 1, -1);
+            }
+            else
+               ret_val = HCITR_ERROR_WRITING_TO_PORT;
+         }
+      }
+   }
+   else
+      ret_val = HCITR_ERROR_WRITING_TO_PORT;
+
+   return(ret_val);
+}
+
+   /* The following function is responsible for suspending the HCI COM  */
+   /* transport.  It will block until all written data has been sent    */
+   /* then put the transport in a suspended state (until data is        */
+   /* written or received).  This function will return a value of 0 if  */
+   /* the suspend was successful or a negative value if there is an     */
+   /* error.                                                            */
+int BTPSAPI HCITR_COMSuspend(unsigned int HCITransportID)
+{
+   int ret_val;
+
+   if((HCITransportID == TRANSPORT_ID) && (HCITransportOpen))
+   {
+      tcdrain(PortDescriptor);
+
+      TransportSuspended = TRUE;
+
+      ret_val            = 0;
+   }
+   else
+      ret_val = HCITR_ERROR_INVALID_PARAMETER;
+
+   /* Finally return the result to the caller.                          */
+   return(ret_val);
+}
+
+   /* The following function is used to determine if the UART is        */
+   /* currently suspended.  This function returns TRUE if the UART is   */
+   /* suspended or FALSE otherwise.                                     */
+Boolean_t BTPSAPI HCITR_UartSuspended(unsigned int HCITransportID)
+{
+   return(TransportSuspended);
+}
+
+   /* The following function is used to read the receive statistics of  */
+   /* the specified HCI Transport.  The pseudo terminal has its own flow*/
+   /* control, so RxFlowStops and RxOverruns stay 0.  This function     */
+   /* returns zero if successful, or a negative value if there was an   */
+   /* error.                                                            */
+int BTPSAPI HCITR_QueryStatistics(unsigned int HCITransportID, HCITR_Statistics_t *Statistics)
+{
+   int ret_val;
+
+   /* Check to make sure that the specified Transport ID is valid.      */
+   if((HCITransportID == TRANSPORT_ID) && (HCITransportOpen) && (Statistics))
+   {
+      BTPS_MemCopy(Statistics, &RxStatistics, HCITR_STATISTICS_SIZE);
+      ret_val = 0;
+   }
+   else
+      ret_val = HCITR_ERROR_INVALID_PARAMETER;
+
+   return(ret_val);
+}
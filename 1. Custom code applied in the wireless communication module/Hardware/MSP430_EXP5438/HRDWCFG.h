@@ -116,6 +116,51 @@ typedef enum
    /* The UART Module's Rx Pin Mask.                                    */
 #define BT_UART_PIN_RX                 (BIT5)
 
+/******************************************************************************/
+/** The following group of defines control the DMA channels used to transmit **/
+/** and receive on the Bluetooth UART.                                       **/
+/******************************************************************************/
+
+   /* The HCI Transport (HCITRANS.c) transmits with the DMA channel     */
+   /* below if BT_UART_DMA_TX_TRIGGER is defined as the DMA trigger of  */
+   /* the UART's transmit flag (in the DMAxTSEL field of the channel).  */
+   /* USCI_A2 has no DMA trigger on the MSP430F5438(A) (triggers 16 to  */
+   /* 23 are USCI_A0, B0, A1 and B1), so it is not defined for this     */
+   /* board and the transport transmits from the UART interrupt.  DMA0  */
+   /* belongs to the application (SPPLEDemo, USCI_A0).                  */
+/* #define BT_UART_DMA_TX_TRIGGER      (DMA1TSEL_21) */
+
+   /* The DMA Trigger Select register and field of the channel.         */
+#define BT_UART_DMA_TX_TSEL_REG        (DMACTL0)
+#define BT_UART_DMA_TX_TSEL_MASK       (DMA1TSEL0 | DMA1TSEL1 | DMA1TSEL2 | DMA1TSEL3 | DMA1TSEL4)
+
+   /* The registers of the channel.                                     */
+#define BT_UART_DMA_TX_CTL             (DMA1CTL)
+#define BT_UART_DMA_TX_SA              (DMA1SA)
+#define BT_UART_DMA_TX_DA              (DMA1DA)
+#define BT_UART_DMA_TX_SZ              (DMA1SZ)
+
+   /* The DMA Interrupt Vector Register value of the channel.           */
+#define BT_UART_DMA_TX_IV              (DMAIV_DMA1IFG)
+
+   /* The HCI Transport receives with the DMA channel below if          */
+   /* BT_UART_DMA_RX_TRIGGER is defined as the DMA trigger of the       */
+   /* UART's receive flag (not defined for this board, see above).      */
+/* #define BT_UART_DMA_RX_TRIGGER      (DMA2TSEL_20) */
+
+   /* The DMA Trigger Select register and field of the channel.         */
+#define BT_UART_DMA_RX_TSEL_REG        (DMACTL1)
+#define BT_UART_DMA_RX_TSEL_MASK       (DMA2TSEL0 | DMA2TSEL1 | DMA2TSEL2 | DMA2TSEL3 | DMA2TSEL4)
+
+   /* The registers of the channel.                                     */
+#define BT_UART_DMA_RX_CTL             (DMA2CTL)
+#define BT_UART_DMA_RX_SA              (DMA2SA)
+#define BT_UART_DMA_RX_DA              (DMA2DA)
+#define BT_UART_DMA_RX_SZ              (DMA2SZ)
+
+   /* The DMA Interrupt Vector Register value of the channel.           */
+#define BT_UART_DMA_RX_IV              (DMAIV_DMA2IFG)
+
 /******************************************************************************/
 /** The following control the frequency of the processor.                    **/
 /******************************************************************************/
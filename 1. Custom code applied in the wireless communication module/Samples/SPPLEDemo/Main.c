@@ -16,17 +16,37 @@
 #include "Main.h"                /* Main application header.                  */
 #include "HCITRANS.h"            /* HCI Transport Prototypes/Constants.       */
 
-#define LED_TOGGLE_RATE_SUCCESS                    (8*500) /* The LED Toggle    */
+#define LED_TOGGLE_RATE_SUCCESS                    (500)   /* The LED Toggle    */
                                                          /* rate when the demo*/
                                                          /* successfully      */
                                                          /* starts up.        */
 
+#define IDLE_NO_TIMEOUT                            (0xFFFFFFFF) /* No deadline  */
+                                                         /* to wake up for,   */
+                                                         /* see IdleSleep().  */
+
+   /* The following define the fixed-block memory pools of the kernel   */
+   /* (see BTPS_MemoryPool_t).  The large blocks hold an ACL packet of  */
+   /* a full SPP frame (329 Bytes, see AUTOMODE_SetConfigParams) with   */
+   /* the RFCOMM, L2CAP and HCI headers, the small blocks the short-    */
+   /* lived control objects of the stack.                               */
+#define MEMORY_POOL_LARGE_BLOCK_SIZE               (352)
+#define MEMORY_POOL_LARGE_NUMBER_BLOCKS            (4)
+#define MEMORY_POOL_SMALL_BLOCK_SIZE               (32)
+#define MEMORY_POOL_SMALL_NUMBER_BLOCKS            (12)
+
    /* Internal Variables to this Module (Remember that all variables    */
    /* declared static are initialized to 0 automatically by the         */
    /* compiler as part of standard C/C++).                              */
 static unsigned int BluetoothStackID;
 static Boolean_t    SleepEnabled;
 
+static BTPS_MemoryPool_t MemoryPools[] =
+{
+   { MEMORY_POOL_SMALL_BLOCK_SIZE, MEMORY_POOL_SMALL_NUMBER_BLOCKS },
+   { MEMORY_POOL_LARGE_BLOCK_SIZE, MEMORY_POOL_LARGE_NUMBER_BLOCKS }
+};
+
 
    /* HCI Sleep Mode Callback.                                          */
 static void BTPSAPI HCI_Sleep_Callback(Boolean_t SleepAllowed, unsigned long CallbackParameter);
@@ -35,6 +55,7 @@ static void BTPSAPI HCI_Sleep_Callback(Boolean_t SleepAllowed, unsigned long Cal
 static void DisplayCallback(char Character);
 static unsigned long GetTickCallback(void);
 static void ProcessCharacters(void);
+static void IdleSleep(Boolean_t DeepSleep, unsigned long Timeout);
 static void IdleFunction(void *UserParameter);
 static void MainThread(void);
 
@@ -69,8 +90,46 @@ static void ProcessCharacters(void)
       //ProcessCommandLine(Input);
 }
 
+   /* The following function is responsible for sleeping until the next */
+   /* scheduler deadline, or the specified Timeout (in ticks) if it is  */
+   /* earlier.  The wakeup is a one-shot taken by the tick ISR          */
+   /* (HAL_SetWakeup()), so the TA1 acquisition timer is not changed.   */
+   /* Any interrupt that exits low power mode also ends the sleep.      */
+   /* * NOTE * LPM3 keeps only ACLK.  It is used when requested and TA1 */
+   /*          runs off ACLK, otherwise LPM0 is used (LPM1 would stop   */
+   /*          the FLL and let the SMCLK sampling clock drift).         */
+static void IdleSleep(Boolean_t DeepSleep, unsigned long Timeout)
+{
+   unsigned long ScheduleTimeout;
+
+   /* Interrupts are disabled from the deadline check until the low     */
+   /* power mode is entered (which enables them) so that a wakeup is    */
+   /* not lost in between.                                              */
+   __disable_interrupt();
+
+   if((BTPS_QueryScheduleTimeout(&ScheduleTimeout)) && (ScheduleTimeout < Timeout))
+      Timeout = ScheduleTimeout;
+
+   if(Timeout)
+   {
+      HAL_SetWakeup((Timeout != IDLE_NO_TIMEOUT)?Timeout:0);
+
+      if((DeepSleep) && ((TA1CTL & TASSEL_3) == TASSEL_1))
+         LPM3;
+      else
+         LPM0;
+
+      /* Cancel the wakeup if another interrupt ended the sleep.        */
+      __disable_interrupt();
+      HAL_SetWakeup(0);
+   }
+
+   __enable_interrupt();
+}
+
    /* The following function is responsible for checking the idle state */
-   /* and possibly entering LPM3 mode.                                  */
+   /* and sleeping until there is something to do (possibly in LPM3     */
+   /* mode).                                                            */
 static void IdleFunction(void *UserParameter)
 {
    unsigned long        CurrentTickCount;
@@ -84,9 +143,10 @@ static void IdleFunction(void *UserParameter)
       /* Attempt to suspend the UART.                                   */
       if(!HCITR_COMSuspend(0))
       {
-         /* Enter MSP430 LPM3 with Timer Interrupts disabled (we will   */
-         /* require an interrupt to wake us up from this state).        */
+         /* Enter MSP430 LPM3 until the next scheduler deadline (or     */
+         /* an interrupt, e.g. the Controller waking us up).            */
          //HAL_LowPowerMode((unsigned char)TRUE);
+         IdleSleep(TRUE, IDLE_NO_TIMEOUT);
 
          /* Check to see if a wakeup is in progress (by the Controller).*/
          /* If so we will disable sleep mode so that we complete the    */
@@ -122,13 +182,15 @@ static void IdleFunction(void *UserParameter)
 
          /* Set the tick count for the next toggle.                     */
          PreviousTickCount = CurrentTickCount;
+         ElapsedTicks      = 0;
       }
 
       /* Process any console characters that we may have.               */
       ProcessCharacters();
 
-      /* Enter LPM0 while we wait for something to happen.              */
-      LPM0;
+      /* Enter LPM0 while we wait for something to happen (at the       */
+      /* latest the next LED toggle).                                   */
+      IdleSleep(FALSE, LED_TOGGLE_RATE_SUCCESS - ElapsedTicks);
    }
 }
 
@@ -154,6 +216,10 @@ static void MainThread(void)
    BTPS_Initialization.GetTickCountCallback  = GetTickCallback;
    BTPS_Initialization.MessageOutputCallback = DisplayCallback;
 
+   /* Set up the fixed-block memory pools.                              */
+   BTPS_Initialization.NumberMemoryPools     = sizeof(MemoryPools)/BTPS_MEMORY_POOL_SIZE;
+   BTPS_Initialization.MemoryPools           = MemoryPools;
+
    /* Initialize the application.                                       */
    if((Result = InitializeApplication(&HCI_DriverInformation, &BTPS_Initialization)) > 0)
    {
@@ -47,6 +47,16 @@ void Buffer_Reset(void);
 void SPI_RHD_Init(unsigned char send, unsigned char send2);
 void RHD_Init(void);
 void RHD_SPI_Buffer_Save(void);
+void SDA_Set_Channel(unsigned char Channel, unsigned char Mode, signed int Threshold, long NEO_Threshold);
+int SDA_Set_Window(unsigned char Pre, unsigned char Post, unsigned char Align);
+int LFP_Set_Stream(unsigned int Mask);
+int BT_Set_Compression(unsigned char Compress);
+int BT_Set_Batching(unsigned int Frame_Limit, unsigned int Deadline);
+int SDA_Set_Quota(unsigned char Percent);
+int SDA_Set_Sampling_Rate(unsigned char Rate);
+int SDA_Get_Drops(unsigned char Channel, unsigned int *Drops, unsigned int *Quota_Drops);
+int CL_Set_Rule(unsigned char Rule, unsigned char Channel, unsigned int Rate, unsigned int Window, unsigned char Output, unsigned int Duration);
+int CL_Clear_Rule(unsigned char Rule);
 void BL_Periodinc_write(void *Userparameter);
 void SPI_BL_Periodinc_write(void *Userparameter);
 void AUTOMODE_Start_Automode(void);
@@ -61,3 +71,8 @@ static volatile unsigned long MSP430Ticks;
    /* This function is called to get the system Tick Count.             */
 unsigned long HAL_GetTickCount(void);
 
+   /* This function is called to wake the main loop from low power mode */
+   /* the specified number of ticks from now (0 cancels the wakeup).    */
+   /* * NOTE * This function should be called with interrupts disabled. */
+void HAL_SetWakeup(unsigned long Ticks);
+
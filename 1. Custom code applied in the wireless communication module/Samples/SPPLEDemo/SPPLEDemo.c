@@ -21,9 +21,22 @@
 #include "SS1BTGAT.h"            /* Main SS1 GATT Header.                     */
 #include "SS1BTGAP.h"            /* Main SS1 GAP Service Header.              */
 #include "BTPSKRNL.h"            /* BTPS Kernel Header.                       */
+#include "SPPLELog.h"            /* Binary Log Message Table.                 */
 
 #include "HAL.h"                 /* Function for Hardware Abstraction.        */
 #include "HCITRANS.h"            /* HCI Transport Prototypes/Constants.       */
+#include "HRDWCFG.h"             /* MSP430 Exp Board Setup and Utilities      */
+
+   /* DMA Interrupt of the HCI Transport (HCITRANS.c), called by        */
+   /* DMA_INTERRUPT for its channels (see BT_UART_DMA_TX_TRIGGER and    */
+   /* BT_UART_DMA_RX_TRIGGER), and the line idle check of its DMA       */
+   /* receive, called by TIMER_INTERRUPT.                               */
+#if (defined(BT_UART_DMA_TX_TRIGGER)) || (defined(BT_UART_DMA_RX_TRIGGER))
+extern int UartDmaInterrupt(Word_t VectorRegister);
+#endif
+#ifdef BT_UART_DMA_RX_TRIGGER
+extern int UartDmaIdleCheck(void);
+#endif
 
 #define MAX_SUPPORTED_COMMANDS                     (64)  /* Denotes the       */
                                                          /* maximum number of */
@@ -680,8 +693,8 @@ static void BTPSAPI HCI_Event_Callback(unsigned int BluetoothStackID, HCI_Event_
 ////////////////  /*User defined Functions*/ /////////////////////////////////////////////////////////////
 
 
-unsigned char BL_Write_from_SPI(unsigned char order);
 void SPI_BL_Periodic_write(void *Userparameter);
+void BT_Snippet_Encoder(void *UserParameter);
 void BL_UART_Bulk_Transmission_Mode(void);
 
 void AUTOMODE_Display(void);
@@ -690,25 +703,199 @@ void AUTOMODE_SetConfigParams(void *Userparameter);
 void AUTOMODE_OpenServer(void *Userparameter);
 void AUTOMODE_CountBeforeWrite(void *Userparameter);
 
+static void SDA_Update_Bounds(unsigned char Channel);
+static void BT_Tx_Geometry_Update(void);
+static void BT_Tx_Batch_Update(void);
+static void SDA_Quota_Update(void);
+static void CL_Reset(void);
+static void SDA_Rate_Apply(unsigned char Rate);
+static void CL_Mask_Update(void);
+static void CL_Fire(unsigned char Index);
+void TM_Heap_Sample(void *UserParameter);
+void SDA_Rate_Process(void *UserParameter);
+static unsigned char BT_Event_Post(unsigned char Type, const Byte_t *Body);
+static unsigned char TM_Record(Byte_t *p);
+static unsigned char BT_Log_Record(Byte_t *p);
+static unsigned char BT_Trace_Record(Byte_t *p);
+static unsigned char BT_Tap_Record(Byte_t *p, unsigned int Room);
+static void BT_Command_Input(const Byte_t *Data, unsigned int Length);
+static unsigned char BL_Set_Frame_Length(unsigned int Payload);
+static unsigned int BT_Frame_Info(void);
+static void BL_Tx_Start(unsigned char Packets);
+static void BT_Frame_Publish(void);
+static unsigned int BT_Encode_Size(const Byte_t *Packet);
+static unsigned int BT_Encode_Snippet(const Byte_t *Packet, Byte_t *Record, unsigned int Size);
+
 
 /////////////////////  /* User defined definition*/       //////////////////////////////////////////////
 
-#define SAMPLING_RATE           8 // 8kHz
+#define SAMPLING_RATE           8 // 8kHz (default, see SDA_Set_Sampling_Rate)
 #define HS_BAUD_RATE            2000000
 
 //More than 620 Bytes can be used.
 #define CHANNEL_NUMBER          16
 
-#define SPI_PRE_SAVE_BUF_SIZE   ((SAMPLING_RATE * 2) + 2) //16-bit resolution and 1 ms data + 4Bytes
+//// Snippet window ////////////////////////////
+//A snippet is Snippet_Pre samples, the trigger sample and Snippet_Post
+//samples (default 8 + 1 + 15 = 24 samples, 3 ms).
+//With Snippet_Align > 0 the trigger sample is the local minimum (maximum
+//for SDA_MODE_POS) within Snippet_Align samples after the crossing, and
+//the packet header time is the tick of that sample.
+//The window can be changed by SDA_Set_Window up to the _MAX values, which
+//size the pre-save ring. The _MAX values keep 1 ms before and 3 ms after
+//the trigger sample at SAMPLING_RATE_MAX.
+#define SNIPPET_PRE             SAMPLING_RATE // 1 ms
+#define SNIPPET_POST            ((BT_DATA_SIZE / 2) - SNIPPET_PRE - 1)
+#define SNIPPET_ALIGN           0 // off
+#define SNIPPET_PRE_MAX         SAMPLING_RATE_MAX
+#define SNIPPET_POST_MAX        (SAMPLING_RATE_MAX * 3)
+#define SNIPPET_ALIGN_MAX       SAMPLING_RATE
+#define SNIPPET_LENGTH_MIN      8
+
+#define SPI_PRE_SAVE_BUF_SIZE   ((SNIPPET_PRE_MAX + SNIPPET_ALIGN_MAX + 1) * 2) //16-bit resolution, 50 Bytes
 #define SPI_PRE_SAVE_BUF_NO     CHANNEL_NUMBER
 
-#define BT_HEADER_SIZE          4 // ŸӰ ä  
+#define BT_HEADER_SIZE          6 // 타임과 채널 정보, pre-trigger count, intra-tick offset
 #define BT_DATA_SIZE            (SAMPLING_RATE * 3 * 2) // 16-bit resolution and 3 ms data
 #define BT_TRANS_SIZE           (BT_HEADER_SIZE + BT_DATA_SIZE)
 #define BT_TX_PACKET_BUF_NO     (CHANNEL_NUMBER +24)
+#define BT_TX_PACKET_POOL_SIZE  (BT_TRANS_SIZE * BT_TX_PACKET_BUF_NO) // 2160 Bytes
+#define BT_TX_PACKET_BUF_MAX    64 // packet count limit for short snippets
 
 #define BT_TRANS_STEP_SIZE      4
 
+//// Sampling rate ////////////////////////////
+//TIMER1_A0 counts SMCLK / 8 (3.125 MHz) and every tick samples all the
+//channels. SDA_Set_Sampling_Rate (or BT_CMD_SET_RATE from the host)
+//selects a rate of the TA1CCR0 chart in BL_UART_Bulk_Transmission_Mode,
+//also while streaming. The snippet window keeps its length in time (up
+//to the _MAX sample counts), and the deadline of BT_Set_Batching stays
+//in ms. The LFP rate, the LFP low-pass and the RHD DSP high-pass cut-off
+//follow the sampling rate. Every frame info record carries the rate and
+//the window, so the host does not assume 8 kHz.
+//The same TIMER1_A0 tick drives the BTPS kernel, divided by the rate to
+//stay in ms (Kernel_Ticks, see HAL_GetTickCount). The periods kept in
+//sample ticks (telemetry, closed loop windows, batching deadline) are
+//rescaled by Buffer_Reset when the rate changes.
+//The unrolled ISR has 3125 cycles per tick at 8 kHz and half of that at
+//16 kHz, which is why the chart stops there.
+#define SAMPLING_RATE_MIN       8 // kHz
+#define SAMPLING_RATE_MAX       16 // kHz
+#define SAMPLING_TIMER_HZ       3125000UL
+
+//// Frame batching ////////////////////////////
+//A frame carries as many complete packets (or coded records) as fit in
+//the frame limit, and is sent early when the oldest one has waited for
+//the deadline. Both can be changed at run time by BT_Set_Batching.
+//BT_TX_FRAME_MAX keeps the RFCOMM frame with the largest frame info
+//and event records under the maximum frame size set by
+//AUTOMODE_SetConfigParams (BT_TX_PAYLOAD_MAX).
+#define BT_TX_PAYLOAD_MAX       329 // Bytes
+#define BT_TX_FRAME_MAX         252 // Bytes
+#define BT_TX_FRAME_LIMIT       (BT_TRANS_SIZE * BT_TRANS_STEP_SIZE) // 216 Bytes, 4 packets
+#define BT_TX_DEADLINE_MS       10
+#define BT_TX_DEADLINE_MAX_MS   1000
+
+//// Fair admission ////////////////////////////
+//Once more than SDA_SATURATION_PERCENT of the pool packets are in use, a
+//channel that already holds its quota (SDA_QUOTA_PERCENT of the packets,
+//see SDA_Set_Quota) gets no new packet. The spike is dropped and counted
+//in SDA_Quota_Drop as well as SDA_Drop. Below the saturation level any
+//channel takes a free packet as before.
+#define SDA_QUOTA_PERCENT       10 // 4 of 40 packets
+#define SDA_SATURATION_PERCENT  50
+
+//// Snippet records ////////////////////////////
+//Header   Byte0 = Ch (bit 0-3), time LSB0-3 (bit 4-7)
+//         Byte1 = time LSB4-11, Byte2 = time LSB12-19
+//         Byte3 = time LSB20-25 (bit 0-5), record class (bit 6-7)
+//         Byte4 = pre-trigger sample count (index of the trigger sample)
+//         Byte5 = intra-tick offset of the trigger sample, in
+//                 BT_OFFSET_UNIT timer counts after the start of the
+//                 tick in the header (see SDA_Header)
+//Raw      header + snippet samples (MSB first), BT_Tx_Stride Bytes
+//LFP      header (Byte4, Byte5 = 0) + decimated samples of one channel,
+//         BT_Tx_Stride Bytes
+//         (the time is the tick of the first sample, see LFP_Decimate)
+//Control  header (Ch = 0, Byte4 = type, Byte5 = record length in Bytes)
+//         + body, even length
+//Delta    header + first sample + 4-bit width per BT_DELTA_GROUP deltas
+//         (high nibble first) + zigzag deltas packed MSB first with the
+//         width of their group, padded to an even length
+//With BT_SNIPPET_COMPRESSION the main loop codes the complete packets
+//into frame buffers (see BT_Snippet_Encoder). A snippet is sent raw if
+//a delta does not fit 15 bits or the record would not be shorter.
+#define BT_SNIPPET_COMPRESSION  0 // 1 : delta coded records
+
+//TIMER1_A0 counts (SMCLK / 8) per unit of the intra-tick offset
+#define BT_OFFSET_SHIFT         1
+#define BT_OFFSET_UNIT          (1 << BT_OFFSET_SHIFT) // 0.64 us
+
+//The RHD2132 returns the result of a CONVERT command two commands later,
+//so the sample saved for channel n was converted by the command of
+//channel n - RHD_PIPELINE_DELAY (in the previous tick for the first ones).
+#define RHD_PIPELINE_DELAY      2
+
+#define BT_REC_RAW              0x00
+#define BT_REC_DELTA            0x40
+#define BT_REC_LFP              0x80
+#define BT_REC_CTRL             0xC0
+#define BT_REC_CLASS_MASK       0xC0
+
+#define BT_DELTA_GROUP          4
+#define BT_DELTA_GROUP_MAX      ((SNIPPET_PRE_MAX + SNIPPET_POST_MAX + BT_DELTA_GROUP - 1) / BT_DELTA_GROUP)
+#define BT_DELTA_LIMIT          16383 // zigzag code < 2^15
+
+#define BT_TX_FRAME_BUF_NO      2
+
+//Control record types
+#define BT_CTRL_FRAME_INFO      0x01
+#define BT_CTRL_TRIGGER         0x02
+#define BT_CTRL_ECHO            0x03
+#define BT_CTRL_TELEMETRY       0x04
+#define BT_CTRL_LOG             0x05
+#define BT_CTRL_HEAP_TRACE      0x06
+#define BT_CTRL_HCI_TAP         0x07
+
+//Every frame starts with a frame info record (see BT_Frame_Info) :
+//  frame sequence number (2 Bytes), mask of the channels with new drops
+//  (2 Bytes), sampling rate (Hz, 2 Bytes), Snippet_Pre and Snippet_Post
+//  (1 Byte each), running drop count of the channels in the mask
+//  (2 Bytes each)
+#define BT_FRAME_INFO_SIZE      14
+#define BT_FRAME_INFO_MAX       (BT_FRAME_INFO_SIZE + (CHANNEL_NUMBER * 2))
+
+//Event records follow the frame info (see BT_Event_Post). The header has
+//the tick of the event and a body of BT_EVENT_BODY Bytes :
+//  BT_CTRL_TRIGGER : rule index, its output (1 Byte each) and its running
+//                    trigger count (2 Bytes), see CL_Fire
+//  BT_CTRL_ECHO    : probe token of a BT_CMD_ECHO command (4 Bytes), the
+//                    tick is the one the command was received in
+//When events are pending and no packets are ready, a frame of the frame
+//info and the event records is sent at once.
+#define BT_EVENT_NO             3
+#define BT_EVENT_BODY           4
+#define BT_EVENT_SIZE           (BT_HEADER_SIZE + BT_EVENT_BODY)
+
+#define BT_TX_PRE_DATA_SIZE     14
+
+#define BT_TX_SEGMENT_NO        3 // pre-data, packets, post-data
+
+//DMA0 trigger field of DMACTL0 (DMA1 may be used by the HCI transport)
+#define BT_DMA0_TSEL_MASK       (DMA0TSEL0 | DMA0TSEL1 | DMA0TSEL2 | DMA0TSEL3 | DMA0TSEL4)
+
+//// Host commands ////////////////////////////
+//The host writes commands to the SPP port :
+//  BT_CMD_SYNC, opcode, argument length, arguments
+//Bytes before BT_CMD_SYNC are skipped (see BT_Command_Input).
+#define BT_CMD_SYNC             0xA5
+#define BT_CMD_ARG_MAX          10
+#define BT_CMD_SET_RATE         0x01 // rate (kHz, 1 Byte)
+#define BT_CMD_SET_RULE         0x02 // rule, channel, output (1 Byte each),
+                                     // rate (Hz), window, duration (ms, 2 Bytes each, MSB first)
+#define BT_CMD_CLEAR_RULE       0x03 // rule (1 Byte, CL_RULE_NO : all)
+#define BT_CMD_ECHO             0x04 // probe token (4 Bytes), answered by a BT_CTRL_ECHO record
+
 
 
 //// SPI channel selection protocol ////////////////////////////
@@ -732,34 +919,183 @@ void AUTOMODE_CountBeforeWrite(void *Userparameter);
 
 #define SPI_2   0x00
 
-//// Negative threshold selection ////////////////////////////
-
-#define NVTH_50UV       254 //spike amplitude
-#define NVTH_100UV      254
-
-#define NVTH_CH_01      NVTH_50UV
-#define NVTH_CH_02      NVTH_50UV
-#define NVTH_CH_03      NVTH_50UV
-#define NVTH_CH_04      NVTH_50UV
-#define NVTH_CH_05      NVTH_50UV
-#define NVTH_CH_06      NVTH_50UV
-#define NVTH_CH_07      NVTH_50UV
-#define NVTH_CH_08      NVTH_50UV
-#define NVTH_CH_09      NVTH_50UV
-#define NVTH_CH_10      NVTH_50UV
-#define NVTH_CH_11      NVTH_50UV
-#define NVTH_CH_12      NVTH_50UV
-#define NVTH_CH_13      NVTH_50UV
-#define NVTH_CH_14      NVTH_50UV
-#define NVTH_CH_15      NVTH_50UV
-#define NVTH_CH_16      NVTH_50UV
+//// Spike detection (SDA) selection ////////////////////////////
+//
+// Detection compares the full 16-bit sample (twos complement, 0.195 uV/LSB)
+// against a per-channel threshold magnitude (VTH, in LSB).
+//
+//    Mode            Crossing condition
+//    SDA_MODE_NEG    x[n] < -VTH
+//    SDA_MODE_POS    x[n] > +VTH
+//    SDA_MODE_ABS    |x[n]| > VTH
+//    SDA_MODE_NEO    x[n-1]^2 - x[n]*x[n-2] > NEOTH  (nonlinear energy operator)
+//
+// NEG/POS/ABS are folded into one lower/upper bound pair per channel,
+// so the ISR does two compares whatever the mode is.
+
+#define SDA_MODE_NEG    0
+#define SDA_MODE_POS    1
+#define SDA_MODE_ABS    2
+#define SDA_MODE_NEO    3
+
+#define SDA_SAMPLE(_p)  ((signed int)(SWord_t)(((Word_t)*(_p) << 8) | *((_p) + 1)))
+
+#define UV_TO_LSB(_uv)  ((signed int)(((long)(_uv) * 1000L) / 195))
+
+#define VTH_50UV        UV_TO_LSB(50)   //spike amplitude
+#define VTH_100UV       UV_TO_LSB(100)  //same as the former high-byte check (< 254)
+
+#define NEOTH_DEFAULT   ((long)VTH_100UV * VTH_100UV)
+
+#define SDA_MODE_CH_01  SDA_MODE_NEG
+#define SDA_MODE_CH_02  SDA_MODE_NEG
+#define SDA_MODE_CH_03  SDA_MODE_NEG
+#define SDA_MODE_CH_04  SDA_MODE_NEG
+#define SDA_MODE_CH_05  SDA_MODE_NEG
+#define SDA_MODE_CH_06  SDA_MODE_NEG
+#define SDA_MODE_CH_07  SDA_MODE_NEG
+#define SDA_MODE_CH_08  SDA_MODE_NEG
+#define SDA_MODE_CH_09  SDA_MODE_NEG
+#define SDA_MODE_CH_10  SDA_MODE_NEG
+#define SDA_MODE_CH_11  SDA_MODE_NEG
+#define SDA_MODE_CH_12  SDA_MODE_NEG
+#define SDA_MODE_CH_13  SDA_MODE_NEG
+#define SDA_MODE_CH_14  SDA_MODE_NEG
+#define SDA_MODE_CH_15  SDA_MODE_NEG
+#define SDA_MODE_CH_16  SDA_MODE_NEG
+
+#define VTH_CH_01       VTH_100UV
+#define VTH_CH_02       VTH_100UV
+#define VTH_CH_03       VTH_100UV
+#define VTH_CH_04       VTH_100UV
+#define VTH_CH_05       VTH_100UV
+#define VTH_CH_06       VTH_100UV
+#define VTH_CH_07       VTH_100UV
+#define VTH_CH_08       VTH_100UV
+#define VTH_CH_09       VTH_100UV
+#define VTH_CH_10       VTH_100UV
+#define VTH_CH_11       VTH_100UV
+#define VTH_CH_12       VTH_100UV
+#define VTH_CH_13       VTH_100UV
+#define VTH_CH_14       VTH_100UV
+#define VTH_CH_15       VTH_100UV
+#define VTH_CH_16       VTH_100UV
+
+//// LFP stream ////////////////////////////
+//With channels selected in LFP_STREAM_MASK (or by LFP_Set_Stream) the
+//amplifier band is opened to 0.1 Hz - 5 kHz and the DSP high-pass is set
+//to 1.2 Hz (see RHD_Init). The ISR then splits every sample :
+//    low  += (x - low) >> LFP_SHIFT       (170 Hz low-pass at 8 kHz)
+//    x     = x - low                      (spike band for SDA and snippets)
+//and sums LFP_DECIMATION low-pass samples of each selected channel into
+//one LFP sample (500 Hz). The LFP samples are collected in a staging
+//packet and handed to the BT buffer when the packet is full. A full
+//staging packet is dropped when the BT buffer is full and counted in
+//LFP_Drop (sent in the telemetry record).
+#define LFP_STREAM_MASK         0x0000 // bit n : channel n+1
+#define LFP_CHANNEL_MAX         4
+#define LFP_SHIFT               3
+#define LFP_DECIMATION_SHIFT    4
+#define LFP_DECIMATION          (1 << LFP_DECIMATION_SHIFT) // 8 kHz / 16 = 500 Hz
+
+//// Closed loop outputs ////////////////////////////
+//A rule (see CL_Set_Rule) fires when its channel detects more spikes in
+//its window than its rate allows, i.e. CL_Rule[].Count crossings within
+//Window ticks. The ISR checks the rule at every crossing of the channel,
+//dropped spikes included, so the output (pump driver input) is raised
+//in the tick of the crossing that completes the count. It is cleared
+//after the rule duration; the rule does not fire again meanwhile.
+//Every trigger is logged by a trigger record sent after the frame info
+//of the next frame. Up to BT_EVENT_NO events wait for a frame; the
+//running trigger count in the record shows the triggers lost beyond that.
+#define CL_RULE_NO              4
+#define CL_COUNT_MAX            16 // spikes per window
+#define CL_WINDOW_MAX_MS        4000 // 16-bit ticks at SAMPLING_RATE_MAX
+#define CL_DURATION_MAX_MS      4000
+
+//Outputs on P4.0 ~ P4.2 (unused, driven low by ConfigureBoardDefaults)
+#define CL_OUTPUT_NO            3
+#define CL_OUTPUT_MASK          ((1 << CL_OUTPUT_NO) - 1)
+#define CL_OUTPUT_SEL           P4SEL
+#define CL_OUTPUT_DIR           P4DIR
+#define CL_OUTPUT_OUT           P4OUT
+
+//// Telemetry ////////////////////////////
+//Every TM_PERIOD_MS (counted in sample ticks by TM_Tick, the heap
+//counters are read by the main loop on request, see TM_Heap_Sample)
+//a telemetry record is sent in a frame of its own
+//(frame info, event records and the telemetry record, see BL_Tx_Start) :
+//  pool packets (1 Byte), pool high-water mark (1 Byte),
+//  running count of timer ISR overruns (2 Bytes), longest timer ISR
+//  (TIMER1_A0 counts, 2 Bytes), heap used, free and largest free block
+//  (BTPS_QueryMemoryStatistics, 2 Bytes each), running count of events lost
+//  for a full queue (2 Bytes), crossings per channel, dropped spikes
+//  included (2 Bytes each), mask of the LFP channels (2 Bytes), running
+//  count of dropped LFP packets per LFP channel, in channel order
+//  (2 Bytes each, LFP_CHANNEL_MAX)
+//The high-water mark, the longest ISR and the crossings cover the period.
+#define TM_PERIOD_MS            1000
+#define TM_RECORD_SIZE          (BT_HEADER_SIZE + 16 + (CHANNEL_NUMBER * 2) + (LFP_CHANNEL_MAX * 2))
+
+//// Binary log ////////////////////////////
+//BTPS_LOGx (see SPPLELog.h) writes a message ID, the tick and the raw
+//arguments into the kernel log instead of formatting a string. The log
+//is drained lazily : every frame without packets (events only or
+//telemetry, see BL_Tx_Start) ends with a log record of the oldest
+//entries that fit BT_LOG_RECORD_MAX Bytes :
+//  entries lost for a full log since the last record (2 Bytes), log
+//  entries (BTPS_LOG_ENTRY_SIZE Bytes each, see BTPS_LogMessage)
+//The host decodes the entries against the table of SPPLELog.h. The log
+//is built in when BTPS_LOG_BUFFER_SIZE is set (project options).
+#define BT_LOG_RECORD_MAX       (BT_HEADER_SIZE + 2 + 64)
+
+//// Heap trace ////////////////////////////
+//When the kernel keeps the allocation trace (BTPS_MEMORY_TRACE_SIZE,
+//project options), a frame without packets also carries a heap trace
+//record of the oldest entries after the log record :
+//  entries lost for a full trace since the last record (2 Bytes), trace
+//  entries : operation, tag (1 Byte each), size, offset (2 Bytes each,
+//  see BTPS_MemoryTraceEntry_t)
+//data_extraction.m saves them for heap_trace_replay.m. Frames without
+//packets go out about once per TM_PERIOD_MS while streaming, so the
+//trace must hold the allocations in between or entries are lost.
+#if BTPS_MEMORY_TRACE_SIZE
+#define BT_TRACE_ENTRY_NO       8
+#define BT_TRACE_ENTRY_SIZE     6
+#define BT_TRACE_RECORD_MAX     (BT_HEADER_SIZE + 2 + (BT_TRACE_ENTRY_NO * BT_TRACE_ENTRY_SIZE))
+#else
+#define BT_TRACE_RECORD_MAX     0
+#endif
+
+//// HCI tap ////////////////////////////
+//When the transport keeps the HCI tap (HCITR_TAP_BUFFER_SIZE, project
+//options), a frame without packets ends with an HCI tap record of the
+//oldest tapped packets that fit the room left under BT_TX_PAYLOAD_MAX
+//(at least BT_TAP_RECORD_MAX Bytes) :
+//  running counts (4 Bytes each) of the packets dropped for a full tap,
+//  of the spike frames sent and of their Bytes, tap packets : included
+//  length, btsnoop flags (1 Byte each), original length, tick count
+//  (ms, 4 Bytes each), included bytes (see HCITR_TapReadPackets),
+//  padded to an even number of Bytes
+//hci_tap_btsnoop.m writes the packets saved by data_extraction.m to a
+//btsnoop file. A frame with a tap record is not tapped itself, or every
+//record would come back in the next one. While streaming, only about
+//one frame per TM_PERIOD_MS has no packets, so the frames with packets
+//(spike frames) are not tapped either : they would only push the setup
+//and control traffic out of the tap, and tapping them costs the ISR.
+//They are counted instead (the spike data itself is in the stream).
+#if HCITR_TAP_BUFFER_SIZE
+#define BT_TAP_RECORD_MAX       ((BT_TX_PAYLOAD_MAX - (BT_FRAME_INFO_MAX + (BT_EVENT_NO * BT_EVENT_SIZE) + TM_RECORD_SIZE + BT_LOG_RECORD_MAX + BT_TRACE_RECORD_MAX)) & ~1)
+#else
+#define BT_TAP_RECORD_MAX       0
+#endif
 
 
 ////////////// User defined constant variables /////////////////////////////////////////////////
 static const unsigned char ucSPSBS = SPI_PRE_SAVE_BUF_SIZE;
-static const unsigned char ucBTS = BT_TRANS_SIZE;
-static const unsigned char ucBTS4 = BT_TRANS_SIZE*4;
-static const unsigned char ucBTPBN = BT_TX_PACKET_BUF_NO;
+
+//TA1CCR0 from SAMPLING_RATE_MIN to SAMPLING_RATE_MAX in 2 kHz steps
+static const unsigned int Sampling_Divider[] = {390, 312, 259, 222, 193};
 
 
 ////////////////  /*User defined Variables*/  ////////////////////////////////////////////////////////////
@@ -767,20 +1103,202 @@ static const unsigned char ucBTPBN = BT_TX_PACKET_BUF_NO;
 //static int TWP_NOP;
 
 static Byte_t SPI_Pre_Buf[SPI_PRE_SAVE_BUF_NO][SPI_PRE_SAVE_BUF_SIZE];
-static Byte_t BT_Tx_Packet_Buf[BT_TX_PACKET_BUF_NO][BT_TRANS_SIZE];
+static Byte_t BT_Tx_Packet_Pool[BT_TX_PACKET_POOL_SIZE];
 static unsigned char SPI_Rx_Addr;
-static unsigned char BT_Tx_Rest[BT_TX_PACKET_BUF_NO];
+static unsigned char BT_Tx_Rest[BT_TX_PACKET_BUF_MAX];
+
+//Packet geometry in BT_Tx_Packet_Pool (see BT_Tx_Geometry_Update)
+static unsigned char BT_Tx_Stride;//Bytes per packet (header + snippet)
+static unsigned char BT_Tx_Slots;//Packets in the pool
+
+//Frame batching (see BT_Set_Batching)
+static unsigned int BT_Tx_Frame_Limit = BT_TX_FRAME_LIMIT;//Bytes
+static unsigned int BT_Tx_Deadline_ms = BT_TX_DEADLINE_MS;
+static unsigned int BT_Tx_Deadline;//ticks
+static unsigned char BT_Tx_Batch;//packets per frame (raw mode)
+static unsigned int BT_Tx_Wait;//ticks the oldest complete packet has waited (raw mode)
+static unsigned char BT_Tx_Packets;//packets in the frame being sent (compressed : 1 frame buffer, 0 : events only)
+static unsigned char BT_Tap_Carried;//size of the HCI tap record in the frame being sent (such a frame is not tapped)
+static unsigned long BT_Tap_Frames;//spike frames sent (running, not tapped, see BT_Tap_Record)
+static unsigned long BT_Tap_Bytes;//Bytes of the spike frames sent (running)
 
 static unsigned char BT_Tx_Packet_Ass_From=0;//Assigned packet address in order unit (start point)
 static unsigned char BT_Tx_Packet_Ass_To=0;//Assigned packet address in order unit (end point)
 
 static unsigned char Cycle_start=0;
 
+//Sampling rate (see SDA_Set_Sampling_Rate)
+static unsigned char Sampling_Rate = SAMPLING_RATE;//kHz, ticks per ms
+static unsigned int Sampling_Rate_Hz;//actual rate sent in the frame info
+static volatile unsigned char Sampling_Rate_Pending;//kHz, 0 : none (see SDA_Rate_Process)
+
 static unsigned char Spike[CHANNEL_NUMBER];
 
+static unsigned char BT_Write_ok=1;
+
+//Frame sequence and spikes dropped for lack of BT buffer space
+static unsigned int BT_Frame_Seq;
+static unsigned int SDA_Drop[CHANNEL_NUMBER];//running count
+static unsigned int SDA_Drop_Mask;//channels with new drops since the last frame
+static unsigned char SDA_Hold[CHANNEL_NUMBER];//samples left of a dropped spike
+
+//Fair admission (see SDA_Set_Quota)
+static unsigned char SDA_Quota_Percent = SDA_QUOTA_PERCENT;
+static unsigned char SDA_Quota;//packets per channel under saturation
+static unsigned char SDA_Saturation;//packets in use from which the quota applies
+static unsigned char SDA_Held[CHANNEL_NUMBER];//snippet packets in the pool
+static unsigned int SDA_Quota_Drop[CHANNEL_NUMBER];//running count of quota drops
+
+//Delta coding state (see BT_Snippet_Encoder)
+static unsigned char BT_Compress = BT_SNIPPET_COMPRESSION;
+static unsigned char BT_Delta_Width[BT_DELTA_GROUP_MAX];
+static unsigned char BT_Delta_Groups;
+
+//Frame buffers at the end of BT_Tx_Packet_Pool (compressed mode only)
+static Byte_t *BT_Frame_Buf[BT_TX_FRAME_BUF_NO];
+static volatile unsigned int BT_Frame_Len[BT_TX_FRAME_BUF_NO];//Bytes ready to send (0 : free)
+static unsigned int BT_Frame_In_Len;//Bytes coded into BT_Frame_Buf[BT_Frame_In]
+static unsigned int BT_Frame_In_Tick;//tick of the first record in BT_Frame_Buf[BT_Frame_In]
+static unsigned char BT_Frame_In;
+static unsigned char BT_Frame_Out;
+
+//Transmit engine : segments of the frame being sent (see BL_Tx_Start)
+typedef struct _tagBT_Tx_Segment_t
+{
+  const Byte_t *Ptr;
+  unsigned int Length;
+} BT_Tx_Segment_t;
+
+static BT_Tx_Segment_t BT_Tx_Segment[BT_TX_SEGMENT_NO];
+static unsigned char BT_Tx_Segment_Index;
+static volatile unsigned char BT_Tx_Busy;
+
+//Control records waiting for the next frame (see BT_Event_Post)
+typedef struct _tagBT_Event_t
+{
+  unsigned long Ticks;
+  unsigned char Type;
+  Byte_t Body[BT_EVENT_BODY];
+} BT_Event_t;
+
+static BT_Event_t BT_Event[BT_EVENT_NO];
+static unsigned char BT_Event_Out;
+static unsigned char BT_Event_Count;
+
+//Host command being received (see BT_Command_Input)
+static Byte_t BT_Cmd_Buf[2 + BT_CMD_ARG_MAX];//opcode, argument length, arguments
+static unsigned char BT_Cmd_Fill;
+static unsigned char BT_Cmd_Sync;
+
+//Snippet window (see SDA_Set_Window)
+static unsigned char Snippet_Pre = SNIPPET_PRE;
+static unsigned char Snippet_Post = SNIPPET_POST;
+static unsigned char Snippet_Align = SNIPPET_ALIGN;
+
+//Snippet capture state per channel
+static Byte_t *Spike_Write_Ptr[CHANNEL_NUMBER];//next write position in the packet
+static unsigned char Spike_Delay[CHANNEL_NUMBER];//ring distance (Bytes) of the sample to copy
+static unsigned char Align_Count[CHANNEL_NUMBER];//samples left in the alignment search
+static unsigned char Align_Lag[CHANNEL_NUMBER];//samples since the peak
+static signed int Align_Peak[CHANNEL_NUMBER];
+
+//TA1R at the CONVERT command of every channel in the last tick
+//(channel order of the commands, see RHD_SPI_Read)
+static unsigned int SPI_Convert_Time[CHANNEL_NUMBER];
+
+//Offsets from the newest sample to older ones in the pre-save ring.
+//They are common to all channels and are updated once per tick.
+static signed char SPI_Prev1_Offset;
+static signed char SPI_Prev2_Offset;
+
+//Spike detection configuration per channel (see SDA_Set_Channel)
+static unsigned char SDA_Mode[CHANNEL_NUMBER] =
+{
+  SDA_MODE_CH_01, SDA_MODE_CH_02, SDA_MODE_CH_03, SDA_MODE_CH_04,
+  SDA_MODE_CH_05, SDA_MODE_CH_06, SDA_MODE_CH_07, SDA_MODE_CH_08,
+  SDA_MODE_CH_09, SDA_MODE_CH_10, SDA_MODE_CH_11, SDA_MODE_CH_12,
+  SDA_MODE_CH_13, SDA_MODE_CH_14, SDA_MODE_CH_15, SDA_MODE_CH_16
+};
+
+static signed int SDA_Threshold[CHANNEL_NUMBER] =
+{
+  VTH_CH_01, VTH_CH_02, VTH_CH_03, VTH_CH_04,
+  VTH_CH_05, VTH_CH_06, VTH_CH_07, VTH_CH_08,
+  VTH_CH_09, VTH_CH_10, VTH_CH_11, VTH_CH_12,
+  VTH_CH_13, VTH_CH_14, VTH_CH_15, VTH_CH_16
+};
 
+static long SDA_NEO_Threshold[CHANNEL_NUMBER] =
+{
+  NEOTH_DEFAULT, NEOTH_DEFAULT, NEOTH_DEFAULT, NEOTH_DEFAULT,
+  NEOTH_DEFAULT, NEOTH_DEFAULT, NEOTH_DEFAULT, NEOTH_DEFAULT,
+  NEOTH_DEFAULT, NEOTH_DEFAULT, NEOTH_DEFAULT, NEOTH_DEFAULT,
+  NEOTH_DEFAULT, NEOTH_DEFAULT, NEOTH_DEFAULT, NEOTH_DEFAULT
+};
 
-static unsigned char BT_Tx_Protocol[16] = 
+//Crossing bounds derived from SDA_Mode/SDA_Threshold (see SDA_Update_Bounds)
+static signed int SDA_Lower[CHANNEL_NUMBER];
+static signed int SDA_Upper[CHANNEL_NUMBER];
+
+//LFP stream state (see LFP_Set_Stream)
+static unsigned int LFP_Mask = LFP_STREAM_MASK;
+static unsigned char LFP_Count;//selected channels
+static unsigned char LFP_Channel[LFP_CHANNEL_MAX];
+static unsigned char LFP_Phase;
+static signed int LFP_Low[CHANNEL_NUMBER];//low-pass state
+static signed long LFP_Acc[LFP_CHANNEL_MAX];//decimation sum
+static Byte_t *LFP_Buf[LFP_CHANNEL_MAX];//staging packet (end of the pool)
+static unsigned char LFP_Fill[LFP_CHANNEL_MAX];//Bytes in the staging packet
+static unsigned int LFP_Drop[LFP_CHANNEL_MAX];//running count of dropped packets
+
+//Closed loop rules (see CL_Set_Rule)
+typedef struct _tagCL_Rule_t
+{
+  unsigned char Channel;
+  unsigned char Output;
+  unsigned char Count;//crossings that fire the rule (0 : rule cleared)
+  unsigned char Seen;//crossings in Time[], up to Count
+  unsigned char Head;//oldest crossing in Time[] once Seen == Count
+  unsigned int Window_ms;
+  unsigned int Duration_ms;
+  unsigned int Window;//ticks
+  unsigned int Fired;//running trigger count
+  unsigned int Time[CL_COUNT_MAX];//ticks (low 16 bits) of the last crossings
+} CL_Rule_t;
+
+static CL_Rule_t CL_Rule[CL_RULE_NO];
+static unsigned int CL_Mask;//channels with a rule
+static unsigned char CL_Active;//outputs on
+static unsigned int CL_Remain[CL_OUTPUT_NO];//ticks left of every output
+
+//Telemetry (see TM_Tick)
+static unsigned int TM_Period;//ticks
+static unsigned int TM_Countdown;
+static unsigned char TM_Due;
+static volatile unsigned char TM_Sample_Due;//heap sample requested by TM_Tick
+static unsigned char TM_Pool_Max;
+static unsigned int TM_Overrun;
+static unsigned int TM_ISR_Max;
+static unsigned int TM_Event_Lost;
+static unsigned int TM_Crossing[CHANNEL_NUMBER];
+static unsigned int TM_Heap[3];//used, free, largest free block (see TM_Heap_Sample)
+
+//Kernel clock (see HAL_GetTickCount) : one tick per ms whatever the
+//TIMER1_A0 rate (1 kHz on ACLK before streaming, Sampling_Rate while
+//streaming). MSP430Ticks stays the sample clock of the records.
+static volatile unsigned long Kernel_Ticks;
+static unsigned char Kernel_Tick_Div = 1;//TIMER1_A0 ticks per kernel tick
+static unsigned char Kernel_Tick_Phase;
+
+//One-shot wakeup of the idle main loop (see HAL_SetWakeup)
+static volatile unsigned long Wakeup_Tick;
+static volatile unsigned char Wakeup_Armed;
+
+
+
+//pre-data, followed by the frame info, event, telemetry, log, heap
+//trace and HCI tap records
+static unsigned char BT_Tx_Protocol[BT_TX_PRE_DATA_SIZE + BT_FRAME_INFO_MAX + (BT_EVENT_NO * BT_EVENT_SIZE) + TM_RECORD_SIZE + BT_LOG_RECORD_MAX + BT_TRACE_RECORD_MAX + BT_TAP_RECORD_MAX] = 
 { 
   0x32,//pre-data
   0x02,
@@ -798,8 +1316,11 @@ static unsigned char BT_Tx_Protocol[16] =
   0xEF,
   
   160,//72,
-  0x1,
-  
+  0x1
+};
+
+static const unsigned char BT_Tx_Post_Data[2] = 
+{
   0x40,//post-data
   0x31
 };
@@ -1625,8 +2146,7 @@ static void SPPLESendProcess(LE_Context_Info_t *LEContextInfo, DeviceInfo_t *Dev
    /* Verify that the input parameter is semi-valid.                    */
    if((LEContextInfo) && (DeviceInfo))
    {
-//xxx
-//xxx      Display(("Transmit Credits: %u.\r\n", DeviceInfo->TransmitCredits));
+      BTPS_LOG1(LOG_SEND_CREDITS, LEContextInfo->SPPLEBufferInfo.TransmitCredits);
 
       /* Loop while we have data to send and we have not used up all    */
       /* Transmit Credits.                                              */
@@ -1701,8 +2221,7 @@ static void SPPLESendProcess(LE_Context_Info_t *LEContextInfo, DeviceInfo_t *Dev
             /* Check to see if the data was written successfully.       */
             if(Result >= 0)
             {
-//xxx Debug Statement
-//xxx               Display(("Actually sent %u of Maximum %u.\r\n", (unsigned int)Result, MaxLength));
+               BTPS_LOG2(LOG_SEND_ACTUAL, Result, MaxLength);
 
                /* Adjust the counters.                                  */
                LEContextInfo->SPPLEBufferInfo.SendInfo.BytesToSend -= (unsigned int)Result;
@@ -1736,8 +2255,7 @@ static void SPPLESendProcess(LE_Context_Info_t *LEContextInfo, DeviceInfo_t *Dev
 
                   /* Flag that the LE buffer is full                    */
                   LEContextInfo->BufferFull = TRUE;
-//xxx
-//xxx                     Display(("xxx Buffer Full for device %s.\r\n", __FUNCTION__));
+                  BTPS_LOG0(LOG_SEND_BUFFER_FULL);
                }
                else
                {
@@ -1775,8 +2293,7 @@ static void SPPLESendCredits(LE_Context_Info_t *LEContextInfo, DeviceInfo_t *Dev
    /* Verify that the input parameters are semi-valid.                  */
    if((LEContextInfo) && (DeviceInfo) && ((DataLength) || (LEContextInfo->SPPLEBufferInfo.QueuedCredits)))
    {
-//xxx Debug statement
-//xxx      Display(("\r\nSending %u Credits.\r\n", DataLength));
+      BTPS_LOG1(LOG_CREDITS_SEND, DataLength);
 
       /* Only attempt to send the credits if the LE buffer is not full. */
       if(LEContextInfo->BufferFull == FALSE)
@@ -1823,8 +2340,7 @@ static void SPPLESendCredits(LE_Context_Info_t *LEContextInfo, DeviceInfo_t *Dev
             {
                /* Flag that the buffer is full.                         */
                LEContextInfo->BufferFull = TRUE;
-//xxx
-//xxx                  Display(("xxx Buffer Full for device %s.\r\n", __FUNCTION__));
+               BTPS_LOG0(LOG_CREDITS_BUFFER_FULL);
             }
 
             LEContextInfo->SPPLEBufferInfo.QueuedCredits += DataLength;
@@ -1842,8 +2358,7 @@ static void SPPLEReceiveCreditEvent(LE_Context_Info_t *LEContextInfo, DeviceInfo
    /* Verify that the input parameters are semi-valid.                  */
    if((LEContextInfo) && (DeviceInfo))
    {
-//xxx Debug statement
-//xxx      Display(("\r\nReceived %u Credits, Credit Count %u.\r\n", Credits, Credits+LEContextInfo->SPPLEBufferInfo.TransmitCredits));
+      BTPS_LOG2(LOG_CREDITS_RECEIVED, Credits, Credits+LEContextInfo->SPPLEBufferInfo.TransmitCredits);
 
       /* If this is a real credit event store the number of credits.    */
       LEContextInfo->SPPLEBufferInfo.TransmitCredits += Credits;
@@ -1940,8 +2455,7 @@ static unsigned int SPPLESendData(LE_Context_Info_t *LEContextInfo, DeviceInfo_t
             /* Try to write data if not exiting the loop.               */
             if(!Done)
             {
-//xxx Debug statement
-//xxx               Display(("\r\nTrying to send %u bytes.\r\n", DataCount));
+               BTPS_LOG1(LOG_DATA_TRY, DataCount);
 
                /* Use the correct API based on device role for SPPLE.   */
                if(DeviceInfo->Flags & DEVICE_INFO_FLAGS_SPPLE_SERVER)
@@ -1982,8 +2496,7 @@ static unsigned int SPPLESendData(LE_Context_Info_t *LEContextInfo, DeviceInfo_t
                      SPPLEBufferLength                              -= (unsigned int)Result;
                      LEContextInfo->SPPLEBufferInfo.TransmitCredits -= (unsigned int)Result;
 
-//xxx Debug statement
-//xxx                     Display(("\r\nSent %u, Remaining Credits %u.\r\n", (unsigned int)Result, DeviceInfo->TransmitCredits));
+                     BTPS_LOG2(LOG_DATA_SENT, Result, LEContextInfo->SPPLEBufferInfo.TransmitCredits);
 
                      /* Flag that data was sent.                        */
                      TotalBytesTransmitted                          += Result;
@@ -2020,8 +2533,7 @@ static unsigned int SPPLESendData(LE_Context_Info_t *LEContextInfo, DeviceInfo_t
                         /* Flag that the LE buffer is full.             */
                         LEContextInfo->BufferFull = TRUE;
 
-//xxx
-//xxx                           Display(("xxx Buffer Full for device %s.\r\n", __FUNCTION__));
+                        BTPS_LOG0(LOG_DATA_BUFFER_FULL);
                      }
                      else
                         Display(("SEND failed with error %d\r\n", Result));
@@ -2057,8 +2569,7 @@ static void SPPLEDataIndicationEvent(LE_Context_Info_t *LEContextInfo, DeviceInf
    /* Verify that the input parameters are semi-valid.                  */
    if((LEContextInfo) && (DeviceInfo))
    {
-//xxx Debug statement
-//xxx      Display(("\r\nData Indication Event: %u bytes.\r\n", (unsigned int)DataLength));
+      BTPS_LOG1(LOG_DATA_INDICATION, DataLength);
 
       /* If we are automatically reading the data, go ahead and credit  */
       /* what we just received, as well as reading everying in the      */
@@ -2627,7 +3138,10 @@ static int Write(ParameterList_t *TempParam)
    Buffer_Reset();
    RHD_Init();
    BL_UART_Bulk_Transmission_Mode();
-   NumberScheduledFunctions=0;
+   
+   if(BT_Compress) BTPS_AddFunctionToScheduler(BT_Snippet_Encoder, NULL, 0);
+   BTPS_AddFunctionToScheduler(SDA_Rate_Process, NULL, 0);
+   BTPS_AddFunctionToScheduler(TM_Heap_Sample, NULL, 0);
    
    MSP430Ticks=0;
    Cycle_start=1;
@@ -3671,8 +4185,7 @@ static void BTPSAPI GATT_Connection_Event_Callback(unsigned int BluetoothStackID
                   /* device.                                            */
                   if((DeviceInfo = SearchDeviceInfoEntryByBD_ADDR(&DeviceInfoList, LEContextInfo[LEConnectionIndex].ConnectionBD_ADDR)) != NULL)
                   {
-   //xxx
-   //xxx                  Display(("xxx Buffer Empty for device.\r\n"));
+                     BTPS_LOG0(LOG_BUFFER_EMPTY);
 
                      /* Flag that the buffer is no longer empty.        */
                      LEContextInfo[LEConnectionIndex].BufferFull = FALSE;
@@ -4394,10 +4907,22 @@ static void BTPSAPI SPP_Event_Callback(unsigned int BluetoothStackID, SPP_Event_
                   }
                   else
                   {
-                     /* Simply inform the user that data has arrived.   */
-                     Display(("\r\n"));
-                     Display(("SPP Data Indication, ID: 0x%04X, Length: 0x%04X.\r\n", SPP_Event_Data->Event_Data.SPP_Data_Indication_Data->SerialPortID,
-                                                                                      SPP_Event_Data->Event_Data.SPP_Data_Indication_Data->DataLength));
+                     /* Read the commands from the host (see            */
+                     /* BT_Command_Input).                              */
+                     Done = FALSE;
+
+                     while(!Done)
+                     {
+                        if((TempLength = SPP_Data_Read(BluetoothStackID, LocalSerialPortID, (Word_t)sizeof(SPPContextInfo[SerialPortIndex].Buffer), (Byte_t *)SPPContextInfo[SerialPortIndex].Buffer)) > 0)
+                           BT_Command_Input((Byte_t *)SPPContextInfo[SerialPortIndex].Buffer, (unsigned int)TempLength);
+                        else
+                        {
+                           if(TempLength < 0)
+                              Display(("SPP_Data_Read(): Error %d.\r\n", TempLength));
+
+                           Done = TRUE;
+                        }
+                     }
                   }
                }
 
@@ -4798,7 +5323,7 @@ void SPI_Init(void)
 
 void DMA_Init(unsigned char *From_Addr, unsigned int length)
 {
-  DMACTL0 = DMA0TSEL_17;  // USCI_A0 TXIFG trigger
+  DMACTL0 = (DMACTL0 & ~BT_DMA0_TSEL_MASK) | DMA0TSEL_17;  // USCI_A0 TXIFG trigger
   __data16_write_addr((unsigned short) &DMA0SA,(unsigned long) From_Addr);
                                             // Source block address
   __data16_write_addr((unsigned short) &DMA0DA,(unsigned long) &UCA0TXBUF);
@@ -4815,17 +5340,587 @@ void Buffer_Reset(void)
   for(i=0;i<CHANNEL_NUMBER;i++)
   {
     Spike[i]=0;
+    Align_Count[i]=0;
+    SDA_Hold[i]=0;
+    SDA_Drop[i]=0;
+    SDA_Held[i]=0;
+    SDA_Quota_Drop[i]=0;
+  }
+  SDA_Drop_Mask=0;
+  BT_Frame_Seq=0;
+  BT_Write_ok=1;
+  
+  Sampling_Rate_Hz = (unsigned int)(SAMPLING_TIMER_HZ / (Sampling_Divider[(Sampling_Rate - SAMPLING_RATE_MIN) >> 1] + 1));
+  
+  //LFP channel list from the mask
+  LFP_Count=0;
+  for(i=0;i<CHANNEL_NUMBER;i++)
+  {
+    if((LFP_Mask & (1u << i)) && (LFP_Count < LFP_CHANNEL_MAX)) LFP_Channel[LFP_Count++] = i;
+    LFP_Low[i]=0;
+  }
+  for(i=0;i<LFP_CHANNEL_MAX;i++)
+  {
+    LFP_Acc[i]=0;
+    LFP_Fill[i]=0;
+    LFP_Drop[i]=0;
+  }
+  LFP_Phase=0;
+  
+  CL_Reset();
+  
+  BT_Tx_Geometry_Update();
+  BT_Tx_Packet_Ass_From=0;
+  BT_Tx_Packet_Ass_To=0;
+  
+  for(i=0;i<BT_TX_FRAME_BUF_NO;i++)
+  {
+    BT_Frame_Len[i]=0;
+  }
+  BT_Frame_In_Len=0;
+  BT_Frame_In=0;
+  BT_Frame_Out=0;
+  BT_Tx_Busy=0;
+  BT_Tx_Wait=0;
+  BT_Event_Out=0;
+  BT_Event_Count=0;
+  
+  TM_Period = TM_PERIOD_MS * Sampling_Rate;
+  TM_Countdown = TM_Period;
+  TM_Due=0;
+  TM_Sample_Due=0;
+  TM_Pool_Max=0;
+  TM_Overrun=0;
+  TM_ISR_Max=0;
+  TM_Event_Lost=0;
+  for(i=0;i<CHANNEL_NUMBER;i++)
+  {
+    TM_Crossing[i]=0;
   }
   
   SPI_Rx_Addr = ucSPSBS-2;
   
-  for(i=0;i<ucBTPBN;i++)
+  for(i=0;i<CHANNEL_NUMBER;i++)
+  {
+    SDA_Update_Bounds(i);
+  }
+  
+  for(i=0;i<BT_TX_PACKET_BUF_MAX;i++)
   {
     BT_Tx_Rest[i]=0;
   }
   
 }
 
+///////////////////////////////////////////////////////////////////
+//      Function        CL_Reset
+//      Description     Turn the closed loop outputs off, forget the
+//                      crossings of the rules and convert their
+//                      windows to ticks at the current sampling rate.
+//      Input value     NONE
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void CL_Reset(void)
+{
+  unsigned char i;
+  
+  CL_OUTPUT_SEL &= ~CL_OUTPUT_MASK;
+  CL_OUTPUT_OUT &= ~CL_OUTPUT_MASK;
+  CL_OUTPUT_DIR |= CL_OUTPUT_MASK;
+  CL_Active=0;
+  
+  for(i=0;i<CL_OUTPUT_NO;i++)
+  {
+    CL_Remain[i]=0;
+  }
+  
+  for(i=0;i<CL_RULE_NO;i++)
+  {
+    CL_Rule[i].Seen=0;
+    CL_Rule[i].Head=0;
+    CL_Rule[i].Fired=0;
+    CL_Rule[i].Window = CL_Rule[i].Window_ms * Sampling_Rate;
+  }
+  CL_Mask_Update();
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Tx_Geometry_Update
+//      Description     Derive the packet size and the number of
+//                      packets in BT_Tx_Packet_Pool from the snippet
+//                      window. Shorter snippets give more packets.
+//                      In compressed mode two frame buffers of
+//                      BT_TX_FRAME_MAX Bytes are taken from the end
+//                      of the pool.
+//                      The LFP staging packets are taken after them.
+//      Input value     NONE
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void BT_Tx_Geometry_Update(void)
+{
+  unsigned int Slots;
+  unsigned int Pool_Size;
+  unsigned char i;
+  
+  BT_Tx_Stride = BT_HEADER_SIZE + ((Snippet_Pre + 1 + Snippet_Post) << 1);
+  BT_Tx_Batch_Update();
+  
+  Pool_Size = BT_TX_PACKET_POOL_SIZE;
+  if(BT_Compress) Pool_Size -= BT_TX_FRAME_MAX * BT_TX_FRAME_BUF_NO;
+  
+  BT_Frame_Buf[0] = BT_Tx_Packet_Pool + Pool_Size;
+  BT_Frame_Buf[1] = BT_Frame_Buf[0] + BT_TX_FRAME_MAX;
+  
+  for(i=0;i<LFP_Count;i++)
+  {
+    Pool_Size -= BT_Tx_Stride;
+    LFP_Buf[i] = BT_Tx_Packet_Pool + Pool_Size;
+  }
+  
+  //A frame of packets ends at the end of the pool (see BL_Frame_Ready).
+  Slots = Pool_Size / BT_Tx_Stride;
+  if(Slots > BT_TX_PACKET_BUF_MAX) Slots = BT_TX_PACKET_BUF_MAX;
+  
+  BT_Tx_Slots = Slots;
+  SDA_Quota_Update();
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Quota_Update
+//      Description     Packet counts of the fair admission policy
+//                      from the pool size (quota at least one).
+//      Input value     NONE
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void SDA_Quota_Update(void)
+{
+  SDA_Quota = ((unsigned int)BT_Tx_Slots * SDA_Quota_Percent) / 100;
+  if(!SDA_Quota) SDA_Quota = 1;
+  
+  SDA_Saturation = ((unsigned int)BT_Tx_Slots * SDA_SATURATION_PERCENT) / 100;
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Set_Quota
+//      Description     Change the share of the pool one channel can
+//                      hold once the pool is saturated.
+//                      Accepted while streaming.
+//      Input value     Percent         1 ~ 100 (100 : no quota)
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int SDA_Set_Quota(unsigned char Percent)
+{
+  if((!Percent) || (Percent > 100))
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  //The acquisition ISR reads the quota every tick.
+  __disable_interrupt();
+  
+  SDA_Quota_Percent = Percent;
+  SDA_Quota_Update();
+  
+  __enable_interrupt();
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Get_Drops
+//      Description     Read the drop counters of one channel since
+//                      the start of the stream.
+//      Input value     Channel         0 ~ CHANNEL_NUMBER-1
+//                      Drops           all dropped spikes
+//                      Quota_Drops     spikes refused by the quota
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int SDA_Get_Drops(unsigned char Channel, unsigned int *Drops, unsigned int *Quota_Drops)
+{
+  if((Channel >= CHANNEL_NUMBER) || (!Drops) || (!Quota_Drops))
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  __disable_interrupt();
+  
+  *Drops = SDA_Drop[Channel];
+  *Quota_Drops = SDA_Quota_Drop[Channel];
+  
+  __enable_interrupt();
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Tx_Batch_Update
+//      Description     Packets per frame from the frame limit
+//                      (at least one) and the deadline in ticks.
+//      Input value     NONE
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void BT_Tx_Batch_Update(void)
+{
+  BT_Tx_Batch = BT_Tx_Frame_Limit / BT_Tx_Stride;
+  if(!BT_Tx_Batch) BT_Tx_Batch = 1;
+  
+  BT_Tx_Deadline = BT_Tx_Deadline_ms * Sampling_Rate;
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Set_Batching
+//      Description     Change the frame limit and the latency
+//                      deadline. Accepted while streaming.
+//      Input value     Frame_Limit     Bytes of packets (or coded
+//                                      records) per frame
+//                      Deadline        ms the oldest packet may
+//                                      wait (0 : send at once)
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int BT_Set_Batching(unsigned int Frame_Limit, unsigned int Deadline)
+{
+  if((!Frame_Limit) || (Frame_Limit > BT_TX_FRAME_MAX) || (Deadline > BT_TX_DEADLINE_MAX_MS))
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  //The transmit engine reads these in the ISRs.
+  __disable_interrupt();
+  
+  BT_Tx_Frame_Limit = Frame_Limit;
+  BT_Tx_Deadline_ms = Deadline;
+  BT_Tx_Batch_Update();
+  
+  __enable_interrupt();
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Set_Window
+//      Description     Change the snippet window. The packet size
+//                      changes with it, so this is only accepted
+//                      before continuous mode starts (Write).
+//      Input value     Pre     samples before the trigger sample
+//                      Post    samples after the trigger sample
+//                      Align   peak search length (0 : off)
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int SDA_Set_Window(unsigned char Pre, unsigned char Post, unsigned char Align)
+{
+  if((Cycle_start) || (Pre > SNIPPET_PRE_MAX) || (Post > SNIPPET_POST_MAX) || (Align > SNIPPET_ALIGN_MAX) || ((Pre + 1 + Post) < SNIPPET_LENGTH_MIN))
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  Snippet_Pre = Pre;
+  Snippet_Post = Post;
+  Snippet_Align = Align;
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        LFP_Set_Stream
+//      Description     Select the channels of the LFP stream. The
+//                      amplifier band and the pool layout change
+//                      with it, so this is only accepted before
+//                      continuous mode starts.
+//      Input value     Mask (bit n : channel n+1, 0 : snippets only)
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int LFP_Set_Stream(unsigned int Mask)
+{
+  unsigned char i, Count;
+  
+  for(i=0,Count=0;i<CHANNEL_NUMBER;i++)
+  {
+    if(Mask & (1u << i)) ++Count;
+  }
+  
+  if((Cycle_start) || (Count > LFP_CHANNEL_MAX))
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  LFP_Mask = Mask;
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Set_Compression
+//      Description     Select raw or delta coded snippet records.
+//                      The pool layout changes with it, so this is
+//                      only accepted before continuous mode starts.
+//      Input value     Compress (0 : raw, 1 : delta coded)
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int BT_Set_Compression(unsigned char Compress)
+{
+  if(Cycle_start)
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  BT_Compress = !!Compress;
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Set_Sampling_Rate
+//      Description     Change the sampling rate. The snippet window
+//                      is scaled to keep its length in time.
+//                      While streaming, the change is only recorded
+//                      here (this runs in the SPP data indication)
+//                      : sampling stops at the next tick and
+//                      SDA_Rate_Process applies the rate once the
+//                      frame in flight is sent.
+//      Input value     Rate            SAMPLING_RATE_MIN ~
+//                                      SAMPLING_RATE_MAX (kHz, even)
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int SDA_Set_Sampling_Rate(unsigned char Rate)
+{
+  if((Rate < SAMPLING_RATE_MIN) || (Rate > SAMPLING_RATE_MAX) || (Rate & 0x01))
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  if(Cycle_start)
+  {
+    Sampling_Rate_Pending = (Rate != Sampling_Rate)?Rate:0;
+    return(0);
+  }
+  
+  SDA_Rate_Apply(Rate);
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Rate_Apply
+//      Description     Set the sampling rate and scale the snippet
+//                      window to keep its length in time. While
+//                      streaming, the packets of the old rate are
+//                      discarded, the periods kept in sample ticks
+//                      are rescaled (Buffer_Reset) and TIMER1_A0
+//                      and the kernel clock divider follow the new
+//                      rate. The frame sequence number goes on.
+//                      Called with sampling stopped and no frame
+//                      in flight.
+//      Input value     Rate            checked by SDA_Set_Sampling_Rate
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void SDA_Rate_Apply(unsigned char Rate)
+{
+  unsigned int Pre, Post, Align;
+  unsigned int Seq;
+  
+  if(Rate == Sampling_Rate) return;
+  
+  //Same window in time at the new rate
+  Pre = ((unsigned int)Snippet_Pre * Rate) / Sampling_Rate;
+  Post = ((unsigned int)Snippet_Post * Rate) / Sampling_Rate;
+  Align = ((unsigned int)Snippet_Align * Rate) / Sampling_Rate;
+  
+  if(Pre > SNIPPET_PRE_MAX) Pre = SNIPPET_PRE_MAX;
+  if(Post > SNIPPET_POST_MAX) Post = SNIPPET_POST_MAX;
+  if(Align > SNIPPET_ALIGN_MAX) Align = SNIPPET_ALIGN_MAX;
+  if((Pre + 1 + Post) < SNIPPET_LENGTH_MIN) Post = SNIPPET_LENGTH_MIN - 1 - Pre;
+  
+  Sampling_Rate = Rate;
+  Snippet_Pre = Pre;
+  Snippet_Post = Post;
+  Snippet_Align = Align;
+  
+  if(Cycle_start)
+  {
+    Seq = BT_Frame_Seq;
+    Buffer_Reset();
+    BT_Frame_Seq = Seq;
+    
+    __disable_interrupt();
+    TA1CCR0 = Sampling_Divider[(Sampling_Rate - SAMPLING_RATE_MIN) >> 1];
+    TA1CTL |= TACLR;
+    Kernel_Tick_Div = Sampling_Rate;
+    Kernel_Tick_Phase = 0;
+    __enable_interrupt();
+  }
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Rate_Process
+//      Description     Scheduled on every pass of the main loop :
+//                      apply the rate recorded by
+//                      SDA_Set_Sampling_Rate once TIMER_INTERRUPT
+//                      has stopped sampling and DMA_INTERRUPT has
+//                      sent the frame in flight (TIMER_INTERRUPT
+//                      wakes the main loop then). The kernel clock
+//                      keeps running meanwhile.
+//      Input value     NONE
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+void SDA_Rate_Process(void *UserParameter)
+{
+  if((!Sampling_Rate_Pending) || (BT_Tx_Busy)) return;
+  
+  SDA_Rate_Apply(Sampling_Rate_Pending);
+  
+  //Sampling restarts at the next tick.
+  Sampling_Rate_Pending = 0;
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        CL_Set_Rule
+//      Description     Load a closed loop rule : fire Output for
+//                      Duration ms when the spike rate of Channel
+//                      over Window ms exceeds Rate. Accepted while
+//                      streaming; the rule starts with no crossings.
+//      Input value     Rule            0 ~ CL_RULE_NO-1
+//                      Channel         channel of the record header
+//                      Rate            Hz
+//                      Window          ms (1 ~ CL_WINDOW_MAX_MS)
+//                      Output          0 ~ CL_OUTPUT_NO-1
+//                      Duration        ms (1 ~ CL_DURATION_MAX_MS)
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int CL_Set_Rule(unsigned char Rule, unsigned char Channel, unsigned int Rate, unsigned int Window, unsigned char Output, unsigned int Duration)
+{
+  unsigned long Count;
+  
+  //More than Rate * Window spikes in the window
+  Count = (((unsigned long)Rate * Window) / 1000) + 1;
+  
+  if((Rule >= CL_RULE_NO) || (Channel >= CHANNEL_NUMBER) || (Output >= CL_OUTPUT_NO) || (Count > CL_COUNT_MAX) ||
+     (!Window) || (Window > CL_WINDOW_MAX_MS) || (!Duration) || (Duration > CL_DURATION_MAX_MS))
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  //The ISR reads the rules at every crossing.
+  __disable_interrupt();
+  
+  CL_Rule[Rule].Channel = Channel;
+  CL_Rule[Rule].Output = Output;
+  CL_Rule[Rule].Count = (unsigned char)Count;
+  CL_Rule[Rule].Seen = 0;
+  CL_Rule[Rule].Head = 0;
+  CL_Rule[Rule].Window_ms = Window;
+  CL_Rule[Rule].Duration_ms = Duration;
+  CL_Rule[Rule].Window = Window * Sampling_Rate;
+  CL_Mask_Update();
+  
+  __enable_interrupt();
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        CL_Clear_Rule
+//      Description     Remove a closed loop rule. An output already
+//                      fired is still cleared after its duration.
+//      Input value     Rule            0 ~ CL_RULE_NO-1, CL_RULE_NO : all
+//      Return value    0 or APPLICATION_ERROR_INVALID_PARAMETERS
+//////////////////////////////////////////////////////////////////
+int CL_Clear_Rule(unsigned char Rule)
+{
+  unsigned char i;
+  
+  if(Rule > CL_RULE_NO)
+    return(APPLICATION_ERROR_INVALID_PARAMETERS);
+  
+  __disable_interrupt();
+  
+  for(i=0;i<CL_RULE_NO;i++)
+  {
+    if((Rule == CL_RULE_NO) || (Rule == i)) CL_Rule[i].Count = 0;
+  }
+  CL_Mask_Update();
+  
+  __enable_interrupt();
+  
+  return(0);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        CL_Mask_Update
+//      Description     Mark the channels with a rule.
+//      Input value     NONE
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void CL_Mask_Update(void)
+{
+  unsigned char i;
+  
+  CL_Mask=0;
+  for(i=0;i<CL_RULE_NO;i++)
+  {
+    if(CL_Rule[i].Count) CL_Mask |= (1u << CL_Rule[i].Channel);
+  }
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Command_Execute
+//      Description     Run one host command
+//      Input value     Opcode          BT_CMD_xx
+//                      Arg, Length     arguments
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void BT_Command_Execute(unsigned char Opcode, const Byte_t *Arg, unsigned char Length)
+{
+  int Result = APPLICATION_ERROR_INVALID_PARAMETERS;
+  
+  switch(Opcode)
+  {
+    case BT_CMD_SET_RATE:
+      if(Length == 1) Result = SDA_Set_Sampling_Rate(Arg[0]);
+      break;
+    case BT_CMD_SET_RULE:
+      if(Length == 9)
+        Result = CL_Set_Rule(Arg[0], Arg[1], ((unsigned int)Arg[3] << 8) | Arg[4], ((unsigned int)Arg[5] << 8) | Arg[6],
+                             Arg[2], ((unsigned int)Arg[7] << 8) | Arg[8]);
+      break;
+    case BT_CMD_CLEAR_RULE:
+      if(Length == 1) Result = CL_Clear_Rule(Arg[0]);
+      break;
+    case BT_CMD_ECHO:
+      if(Length == BT_EVENT_BODY)
+      {
+        //The ISRs post events too.
+        __disable_interrupt();
+        if(BT_Event_Post(BT_CTRL_ECHO, Arg)) Result = 0;
+        __enable_interrupt();
+      }
+      break;
+    default:
+      break;
+  }
+  
+  if(Result) Display(("Command 0x%02X Failed: %d.\r\n", Opcode, Result));
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Command_Input
+//      Description     Collect the host commands from the data read
+//                      from the SPP port. A command may be split
+//                      over several reads.
+//      Input value     Data, Length
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void BT_Command_Input(const Byte_t *Data, unsigned int Length)
+{
+  for(;Length;Length--,Data++)
+  {
+    if(!BT_Cmd_Sync)
+    {
+      BT_Cmd_Sync = (*Data == BT_CMD_SYNC);
+      BT_Cmd_Fill = 0;
+      continue;
+    }
+    
+    BT_Cmd_Buf[BT_Cmd_Fill++] = *Data;
+    if(BT_Cmd_Fill < 2) continue;
+    
+    //Resynchronize on a bad argument length.
+    if(BT_Cmd_Buf[1] > BT_CMD_ARG_MAX)
+    {
+      BT_Cmd_Sync = 0;
+      continue;
+    }
+    
+    if(BT_Cmd_Fill < 2 + BT_Cmd_Buf[1]) continue;
+    
+    BT_Cmd_Sync = 0;
+    BT_Command_Execute(BT_Cmd_Buf[0], BT_Cmd_Buf + 2, BT_Cmd_Buf[1]);
+  }
+}
+
 
 ///////////////////////////////////////////////////////////////////
 //      Function        SPI_RHD_Init
@@ -4958,7 +6053,9 @@ void RHD_Init(void)
   //    *DSP off mode
   //            0x84 0100 0000 = 0x84 0x40
   //////////////////////////////////////////////////////////
-  SPI_RHD_Init(0x84,0x53);
+  //LFP stream : 1.244 Hz (DC offset removal only)
+  if(LFP_Count) SPI_RHD_Init(0x84,0x5A);
+  else SPI_RHD_Init(0x84,0x53);
   SPI_RHD_Init(0x85,0x00);
   //FH = 20 kHz
   //RH1 DAC1 = 8
@@ -4998,12 +6095,24 @@ void RHD_Init(void)
   //0x8C 0000 1111 = 0x8C 0x0F
   //0x8D 0000 0000 = 0x8D 0x00
   
+  //Setting3 : FH = 5 kHz, FL = 0.1 Hz (LFP stream)
+  //0x8C 0001 0000 = 0x8C 0x10
+  //0x8D 0111 1100 = 0x8D 0x7C
+  
   SPI_RHD_Init(0x88,0x21);//0x08);
   SPI_RHD_Init(0x89,0x00);//0x00);
   SPI_RHD_Init(0x8A,0x25);//0x04);
   SPI_RHD_Init(0x8B,0x00);//0x00);
-  SPI_RHD_Init(0x8C,0x0F);//0x10);
-  SPI_RHD_Init(0x8D,0x00);//0x7C);
+  if(LFP_Count)
+  {
+    SPI_RHD_Init(0x8C,0x10);
+    SPI_RHD_Init(0x8D,0x7C);
+  }
+  else
+  {
+    SPI_RHD_Init(0x8C,0x0F);//0x10);
+    SPI_RHD_Init(0x8D,0x00);//0x7C);
+  }
   /*Integrated Tx board design 1 (blue) */
   //Channel 23 to 26 Off, 27 to 30 on
   //Register 14 --> 0000 0000 = 0x0, 0x0
@@ -5027,65 +6136,90 @@ void RHD_Init(void)
   SPI_RHD_Init(0x00,0x00);
 }
 
-void RHD_SPI_Buffer_Save(void)
-{
-  // UCB1STE (P10.4)
-  // UCB1CLK (P10.3)
-  // UCB1SIMO (P10.1)
-  // UCB1SOMI (P10.2)
-  
-  //Define a pointer variable that is the address to write as a result of SPI
-  //Variable    SPI_save_ptr
-  //Operation 
-  //            #CH-01
-  //            SPI_save_ptr = SPI_initial_addr;
-  //            *SPI_save_ptr <= SPI received data
-  //            *(SPI_save_ptr+1) <= SPI 2nd received data
-  //            SDA condition check...
-  //            
-  //            SPI_save_ptr+=18; (pre-save data (18B))
-  //
-  //            #CH-02
-  //            *SPI_save_ptr <= SPI_received data
-  //            *(SPI_save_ptr+1) <= SPI 2nd received data
-  //            SDA condition check...
-  //
-  //            SPI_save_ptr+=18; ...
-  //
-  /////////////////////////////////////////////////////////////////////
-  static unsigned char *SPI_initial_ptr = SPI_Pre_Buf[0];
-  static unsigned char *SPI_save_ptr;
-  static unsigned char BT_Write_ok=1;
-  static unsigned char Packet_addr;
-  static Byte_t *stt_addr;
-  static unsigned char Current_CH;
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Update_Bounds
+//      Description     Convert the detection mode and threshold of
+//                      a channel into the lower/upper bounds checked
+//                      by the ISR. A side that must not trigger gets
+//                      a bound no 16-bit sample can cross.
+//      Input value     Channel
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void SDA_Update_Bounds(unsigned char Channel)
+{
+  SDA_Lower[Channel] = (-32767 - 1);
+  SDA_Upper[Channel] = 32767;
   
-  //Add two Bytes of SPI buffer address to save
-  SPI_Rx_Addr+=2;
-  if(SPI_Rx_Addr == ucSPSBS) SPI_Rx_Addr=0;
+  switch(SDA_Mode[Channel])
+  {
+  case SDA_MODE_NEG:
+    SDA_Lower[Channel] = -SDA_Threshold[Channel];
+    break;
+  case SDA_MODE_POS:
+    SDA_Upper[Channel] = SDA_Threshold[Channel];
+    break;
+  case SDA_MODE_ABS:
+    SDA_Lower[Channel] = -SDA_Threshold[Channel];
+    SDA_Upper[Channel] = SDA_Threshold[Channel];
+    break;
+  default:
+    //SDA_MODE_NEO does not use the amplitude bounds.
+    break;
+  }
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Set_Channel
+//      Description     Change the spike detection setting of one
+//                      channel at run time.
+//      Input value     Channel         0 ~ CHANNEL_NUMBER-1
+//                      Mode            SDA_MODE_xx
+//                      Threshold       amplitude threshold (LSB)
+//                      NEO_Threshold   energy threshold (LSB^2)
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+void SDA_Set_Channel(unsigned char Channel, unsigned char Mode, signed int Threshold, long NEO_Threshold)
+{
+  if((Channel >= CHANNEL_NUMBER) || (Mode > SDA_MODE_NEO)) return;
   
-  //Set SPI_save_ptr as the address to save
-  SPI_save_ptr = SPI_initial_ptr + SPI_Rx_Addr;
+  if(Threshold < 0) Threshold = -Threshold;
   
-  //Check if there is any rest space in BT Buf
-  if(!BT_Write_ok) 
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
+  //The acquisition ISR reads these tables every tick.
+  __disable_interrupt();
   
-  //Set current channel
-  Current_CH=0;
+  SDA_Mode[Channel] = Mode;
+  SDA_Threshold[Channel] = Threshold;
+  SDA_NEO_Threshold[Channel] = NEO_Threshold;
+  SDA_Update_Bounds(Channel);
   
-  //111111111111111111111111111111//////////
+  __enable_interrupt();
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        RHD_SPI_Read
+//      Description     Send one 16-bit CONVERT command and save the
+//                      16-bit result (MSB first) at Save_ptr.
+//                      The timer count at the command is kept for the
+//                      intra-tick offset (see SDA_Header).
+//                      Forced inline to keep the unrolled ISR cost.
+//      Input value     Command (CH_xx), Save_ptr
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static void RHD_SPI_Read(unsigned char Command, Byte_t *Save_ptr)
+{
   /*         First 8-bit data of 16-bit send                 */
   //Turn off SPI_CS pin (: SPI selection)
   P10OUT &= ~0x10;              //Start SPI data send
+  SPI_Convert_Time[Command - CH_01] = TA1R;
   //wait for SPI transmit ready
   while(!(UCB3IFG & UCTXIFG));
   //Data write in Tx buffer register
-  UCB3TXBUF = CH_01;
+  UCB3TXBUF = Command;
   //Wait for input(to SOMI) completion
   while(!(UCB3IFG & UCRXIFG));
   //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
+  *Save_ptr = UCB3RXBUF;
   //Wait for end SPI operation
   while(UCB3STAT & UCBUSY);
   
@@ -5097,1584 +6231,1413 @@ void RHD_SPI_Buffer_Save(void)
   //Wait for input(to SOMI) completion
   while(!(UCB3IFG & UCRXIFG));
   //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
+  *(Save_ptr+1) = UCB3RXBUF;
   //Wait for end SPI operation
   while(UCB3STAT & UCBUSY);
   //Turn on CS pin (: SPI transmit end notification)
   P10OUT |= 0x10;       //End SPI data send
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Crossing
+//      Description     Check the newest sample of a channel against
+//                      its detection setting.
+//      Input value     Current_CH, SPI_save_ptr (newest sample)
+//      Return value    1 if the threshold is crossed, otherwise 0
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static unsigned char SDA_Crossing(unsigned char Current_CH, Byte_t *SPI_save_ptr)
+{
+  signed int Sample;
+  signed int Prev1;
+  signed int Prev2;
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
-  {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full 24x2=48 (2byte) , 3ms / 8kHz / 16bit resolution
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
-  }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  //else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < 246) && BT_Write_ok)
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_01) && BT_Write_ok)
+  Sample = SDA_SAMPLE(SPI_save_ptr);
+  
+  if(SDA_Mode[Current_CH] != SDA_MODE_NEO)
+    return((Sample < SDA_Lower[Current_CH]) || (Sample > SDA_Upper[Current_CH]));
+  
+  //Nonlinear energy operator : x[n-1]^2 - x[n]*x[n-2]
+  Prev1 = SDA_SAMPLE(SPI_save_ptr + SPI_Prev1_Offset);
+  Prev2 = SDA_SAMPLE(SPI_save_ptr + SPI_Prev2_Offset);
+  
+  return((((long)Prev1 * Prev1) - ((long)Sample * Prev2)) > SDA_NEO_Threshold[Current_CH]);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Write_Check
+//      Description     Check if the next packet of the pool is free.
+//                      One packet is always left between the write
+//                      and the send positions.
+//      Input value     NONE
+//      Return value    1 : free
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static unsigned char BT_Write_Check(void)
+{
+  if(BT_Tx_Packet_Ass_From == BT_Tx_Slots-1) return(!!BT_Tx_Packet_Ass_To);
+  
+  return(BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Pool_Used
+//      Description     Packets of the pool in use (assigned and not
+//                      yet sent)
+//      Input value     NONE
+//      Return value    packets
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static unsigned char BT_Pool_Used(void)
+{
+  unsigned char Used;
+  
+  Used = BT_Tx_Packet_Ass_From - BT_Tx_Packet_Ass_To;
+  if(BT_Tx_Packet_Ass_From < BT_Tx_Packet_Ass_To) Used += BT_Tx_Slots;
+  
+  return(Used);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Admit
+//      Description     Fair admission : check if a channel may take
+//                      a new packet. The quota applies only while
+//                      more than SDA_Saturation packets are in use.
+//      Input value     Current_CH
+//      Return value    1 : admitted
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static unsigned char SDA_Admit(unsigned char Current_CH)
+{
+  if(SDA_Held[Current_CH] < SDA_Quota) return(1);
+  
+  return(BT_Pool_Used() <= SDA_Saturation);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Release
+//      Description     Update the packet count of the channel of a
+//                      packet leaving the pool (snippets only).
+//      Input value     Packet (header)
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static void SDA_Release(const Byte_t *Packet)
+{
+  if((Packet[3] & BT_REC_CLASS_MASK) == BT_REC_RAW) --SDA_Held[Packet[0] & 0x0F];
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        BT_Packet_Assign
+//      Description     Take the next packet of the pool and update
+//                      the buffer filling state. Only called while
+//                      BT_Write_ok is set.
+//      Input value     NONE
+//      Return value    packet address (slot)
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static unsigned char BT_Packet_Assign(void)
+{
+  unsigned char Packet_addr;
+  
+  Packet_addr = BT_Tx_Packet_Ass_From;
+  if(++BT_Tx_Packet_Ass_From == BT_Tx_Slots) BT_Tx_Packet_Ass_From=0;
+  
+  BT_Write_ok = BT_Write_Check();
+  if(BT_Pool_Used() > TM_Pool_Max) TM_Pool_Max = BT_Pool_Used();
+  
+  return Packet_addr;
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Header
+//      Description     Save the packet header of a snippet.
+//                      The intra-tick offset is the timer count at
+//                      the command that converted the sample of the
+//                      channel, taken from the current tick (the
+//                      command order is the same every tick).
+//      Input value     Current_CH, Ticks (tick of the trigger sample)
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static void SDA_Header(unsigned char Current_CH, unsigned long Ticks)
+{
+  Byte_t *stt_addr;
+  unsigned char Slot;
+  
+  //Command that converted the sample of this channel
+  if(Current_CH >= RHD_PIPELINE_DELAY) Slot = Current_CH - RHD_PIPELINE_DELAY;
+  else
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    Slot = Current_CH + CHANNEL_NUMBER - RHD_PIPELINE_DELAY;
+    --Ticks;
   }
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
+  stt_addr = Spike_Write_Ptr[Current_CH];
   
+  *stt_addr++ = Current_CH + ((Ticks&0x0F)<<4);
+  *stt_addr++ = ((Ticks>>4)&0xFF);
+  *stt_addr++ = ((Ticks>>12)&0xFF);
+  *stt_addr++ = ((Ticks>>20)&0x3F) | BT_REC_RAW;
+  *stt_addr++ = Snippet_Pre;
+  *stt_addr++ = (Byte_t)(SPI_Convert_Time[Slot] >> BT_OFFSET_SHIFT);
   
-  //2222222222222222222222222222222222222222222222222//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_02;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  Spike_Write_Ptr[Current_CH] = stt_addr;
+  BT_Tx_Rest[Spike[Current_CH] - 1] = BT_HEADER_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        SDA_Copy
+//      Description     Move the pre-save sample Spike_Delay Bytes
+//                      behind the newest one into the packet, and
+//                      release the channel when the packet is full.
+//      Input value     Current_CH, SPI_save_ptr (newest sample)
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static void SDA_Copy(unsigned char Current_CH, Byte_t *SPI_save_ptr)
+{
+  unsigned char Packet_addr;
+  signed char Offset;
+  Byte_t *stt_addr;
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  Offset = -(signed char)Spike_Delay[Current_CH];
+  if(SPI_Rx_Addr < Spike_Delay[Current_CH]) Offset += ucSPSBS;
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  stt_addr = Spike_Write_Ptr[Current_CH];
+  *stt_addr++ = *(SPI_save_ptr + Offset);
+  *stt_addr++ = *(SPI_save_ptr + Offset + 1);
+  Spike_Write_Ptr[Current_CH] = stt_addr;
+  
+  Packet_addr = Spike[Current_CH] - 1;
+  BT_Tx_Rest[Packet_addr] += 2;
+  
+  //Check if the BT buffer is full (header + Snippet_Pre + 1 + Snippet_Post samples)
+  if(BT_Tx_Rest[Packet_addr] >= BT_Tx_Stride)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
+    Spike[Current_CH] = 0;
   }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_02) && BT_Write_ok)
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        CL_Crossing
+//      Description     Add a crossing to the rules of the channel
+//                      and fire the ones that see Count crossings
+//                      within their window.
+//      Input value     Current_CH
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void CL_Crossing(unsigned char Current_CH)
+{
+  CL_Rule_t *Rule;
+  unsigned int Now;
+  unsigned char i;
+  
+  Now = (unsigned int)MSP430Ticks;
+  
+  for(i=0,Rule=CL_Rule;i<CL_RULE_NO;i++,Rule++)
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
+    if((!Rule->Count) || (Rule->Channel != Current_CH)) continue;
     
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
+    //Time[] keeps the last Count crossings; Head is the oldest.
+    Rule->Time[Rule->Head] = Now;
+    if(++Rule->Head >= Rule->Count) Rule->Head = 0;
+    if((Rule->Seen < Rule->Count) && (++Rule->Seen < Rule->Count)) continue;
     
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
+    if((unsigned int)(Now - Rule->Time[Rule->Head]) >= Rule->Window) continue;
+    if(CL_Active & (1 << Rule->Output)) continue;
     
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
+    CL_Fire(i);
+  }
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        CL_Fire
+//      Description     Raise the output of a rule for its duration
+//                      and log the trigger for the next frame.
+//      Input value     Index           rule
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void CL_Fire(unsigned char Index)
+{
+  CL_Rule_t *Rule = CL_Rule + Index;
+  Byte_t Body[BT_EVENT_BODY];
+  
+  CL_OUTPUT_OUT |= (1 << Rule->Output);
+  CL_Active |= (1 << Rule->Output);
+  CL_Remain[Rule->Output] = Rule->Duration_ms * Sampling_Rate;
+  
+  //The rule needs Count new crossings to fire again.
+  Rule->Seen = 0;
+  Rule->Head = 0;
+  ++Rule->Fired;
+  
+  Body[0] = Index;
+  Body[1] = Rule->Output;
+  Body[2] = Rule->Fired >> 8;
+  Body[3] = Rule->Fired & 0xFF;
+  BT_Event_Post(BT_CTRL_TRIGGER, Body);
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        CL_Tick
+//      Description     Clear the outputs whose duration ran out.
+//                      Called every tick while an output is on.
+//      Input value     NONE
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+static void CL_Tick(void)
+{
+  unsigned char i;
+  
+  for(i=0;i<CL_OUTPUT_NO;i++)
+  {
+    if((CL_Active & (1 << i)) && (!--CL_Remain[i]))
     {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
+      CL_OUTPUT_OUT &= ~(1 << i);
+      CL_Active &= ~(1 << i);
     }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
   }
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        RHD_SDA
+//      Description     Spike detection and snippet saving for one
+//                      channel.
+//                      step 1. a spike is in progress : search the
+//                              alignment peak, then move one delayed
+//                              pre-save sample into its packet.
+//                      step 2. otherwise check a new crossing and
+//                              assign a packet to it. Without a free
+//                              packet, or over the channel quota
+//                              (see SDA_Admit), the spike is counted
+//                              as dropped and the channel is held for
+//                              a snippet.
+//      Input value     Current_CH, SPI_save_ptr (newest sample)
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static void RHD_SDA(unsigned char Current_CH, Byte_t *SPI_save_ptr)
+{
+  unsigned char Packet_addr;
+  signed int Sample;
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
-  
-  
-  //33333333333333333333333333333333333333333333333333//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_03;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
-  
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
+  //SDA step 1. Check if the spike is already detected on this channel
   if(Spike[Current_CH])
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
+    if(Align_Count[Current_CH])
     {
-      Spike[Current_CH] = 0;
+      //Alignment search : follow the peak for Snippet_Align samples
+      Sample = SDA_SAMPLE(SPI_save_ptr);
+      ++Align_Lag[Current_CH];
+      
+      if((SDA_Mode[Current_CH] == SDA_MODE_POS) ? (Sample > Align_Peak[Current_CH]) : (Sample < Align_Peak[Current_CH]))
+      {
+        Align_Peak[Current_CH] = Sample;
+        Align_Lag[Current_CH] = 0;
+      }
+      
+      if(--Align_Count[Current_CH]) return;
+      
+      //The peak becomes the trigger sample.
+      Spike_Delay[Current_CH] = (Align_Lag[Current_CH] + Snippet_Pre) << 1;
+      SDA_Header(Current_CH, MSP430Ticks - Align_Lag[Current_CH]);
     }
     
+    //Save the delayed SPI_data into BT data buffer.
+    SDA_Copy(Current_CH, SPI_save_ptr);
   }
   //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_03) && BT_Write_ok)
+  else if(SDA_Hold[Current_CH])
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
+    //A dropped spike is still in progress.
+    --SDA_Hold[Current_CH];
+  }
+  else if(SDA_Crossing(Current_CH, SPI_save_ptr))
+  {
+    ++TM_Crossing[Current_CH];
+    if(CL_Mask & (1u << Current_CH)) CL_Crossing(Current_CH);
     
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
+    if((!BT_Write_ok) || (!SDA_Admit(Current_CH)))
+    {
+      if(BT_Write_ok) ++SDA_Quota_Drop[Current_CH];
+      ++SDA_Drop[Current_CH];
+      SDA_Drop_Mask |= (1u << Current_CH);
+      SDA_Hold[Current_CH] = Snippet_Align + Snippet_Post;
+      return;
+    }
     
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
+    //Assign BT buffer space and update current buffer filling state
+    Packet_addr = BT_Packet_Assign();
+    ++SDA_Held[Current_CH];
+    Spike_Write_Ptr[Current_CH] = BT_Tx_Packet_Pool + (unsigned int)Packet_addr * BT_Tx_Stride;
+    Spike[Current_CH] = Packet_addr + 1;
     
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
+    if(Snippet_Align)
     {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
+      //Header and samples are saved once the peak is found.
+      Align_Count[Current_CH] = Snippet_Align;
+      Align_Lag[Current_CH] = 0;
+      Align_Peak[Current_CH] = SDA_SAMPLE(SPI_save_ptr);
     }
     else
     {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
+      //The crossing sample is the trigger sample.
+      Spike_Delay[Current_CH] = Snippet_Pre << 1;
+      SDA_Header(Current_CH, MSP430Ticks);
+      SDA_Copy(Current_CH, SPI_save_ptr);
     }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
   }
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        LFP_Filter
+//      Description     Split the newest sample of a channel into the
+//                      low-pass state and the spike band sample,
+//                      which replaces it in the pre-save ring.
+//      Input value     Current_CH, SPI_save_ptr (newest sample)
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static void LFP_Filter(unsigned char Current_CH, Byte_t *SPI_save_ptr)
+{
+  signed int Sample;
+  signed long High;
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
+  if(!LFP_Count) return;
   
+  Sample = SDA_SAMPLE(SPI_save_ptr);
+  LFP_Low[Current_CH] += (signed int)(((signed long)Sample - LFP_Low[Current_CH]) >> LFP_SHIFT);
   
-  //44444444444444444444444444444444444444444444444444//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_04;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
-  
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
-  {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
-  }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_04) && BT_Write_ok)
-  {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
-  }
-  
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
-  
-  
-  //5555555555555555555555555555555555555555555555555//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_05;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
-  
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
-  {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
-  }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_05) && BT_Write_ok)
-  {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
-  }
+  High = (signed long)Sample - LFP_Low[Current_CH];
+  if(High > 32767) High = 32767;
+  else if(High < -32768L) High = -32768L;
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
-  
-  
-  //6666666666666666666666666666666666666666666666666//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_06;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  *SPI_save_ptr = (Byte_t)((Word_t)High >> 8);
+  *(SPI_save_ptr + 1) = (Byte_t)High;
+}
+
+///////////////////////////////////////////////////////////////////
+//      Function        LFP_Decimate
+//      Description     Sum the low-pass samples of the selected
+//                      channels and store one LFP sample every
+//                      LFP_DECIMATION ticks. Each channel has its
+//                      own phase so at most one staging packet is
+//                      stored or handed over per tick.
+//                      A full staging packet is dropped when the BT
+//                      buffer is full and counted in LFP_Drop.
+//      Input value     NONE
+//      Return value    NONE
+//////////////////////////////////////////////////////////////////
+#pragma inline=forced
+static void LFP_Decimate(void)
+{
+  unsigned char j, Packet_addr;
+  Byte_t *stt_addr;
+  signed int Sample;
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  for(j=0;j<LFP_Count;j++)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
-  }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_06) && BT_Write_ok)
-  {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    LFP_Acc[j] += LFP_Low[LFP_Channel[j]];
   }
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
+  if(++LFP_Phase == LFP_DECIMATION) LFP_Phase=0;
   
+  j = LFP_Phase >> 2;
+  if((j >= LFP_Count) || (LFP_Phase & 0x03)) return;
   
-  //7777777777777777777777777777777777777777777777777//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_07;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  Sample = (signed int)(LFP_Acc[j] >> LFP_DECIMATION_SHIFT);
+  LFP_Acc[j] = 0;
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
-  {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
-  }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_07) && BT_Write_ok)
+  //Header with the tick of the first sample
+  if(!LFP_Fill[j])
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
+    stt_addr = LFP_Buf[j];
+    *stt_addr++ = LFP_Channel[j] + ((MSP430Ticks&0x0F)<<4);
     *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
     *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    *stt_addr++ = ((MSP430Ticks>>20)&0x3F) | BT_REC_LFP;
+    *stt_addr++ = 0;
+    *stt_addr = 0;
+    LFP_Fill[j] = BT_HEADER_SIZE;
   }
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
+  stt_addr = LFP_Buf[j] + LFP_Fill[j];
+  *stt_addr++ = (Byte_t)((Word_t)Sample >> 8);
+  *stt_addr = (Byte_t)Sample;
+  LFP_Fill[j] += 2;
   
+  if(LFP_Fill[j] < BT_Tx_Stride) return;
   
-  //8888888888888888888888888888888888888888888888888//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_08;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  LFP_Fill[j] = 0;
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
-  
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  //Hand the staging packet over to the BT buffer.
+  if(BT_Write_ok)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
-  }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_08) && BT_Write_ok)
-  {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    Packet_addr = BT_Packet_Assign();
+    BTPS_MemCopy(BT_Tx_Packet_Pool + (unsigned int)Packet_addr * BT_Tx_Stride, LFP_Buf[j], BT_Tx_Stride);
+    BT_Tx_Rest[Packet_addr] = BT_Tx_Stride;
   }
+  else ++LFP_Drop[j];
+}
+
+void RHD_SPI_Buffer_Save(void)
+{
+  // UCB1STE (P10.4)
+  // UCB1CLK (P10.3)
+  // UCB1SIMO (P10.1)
+  // UCB1SOMI (P10.2)
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
-  
+  //Define a pointer variable that is the address to write as a result of SPI
+  //Variable    SPI_save_ptr
+  //Operation 
+  //            #CH-01
+  //            SPI_save_ptr = SPI_initial_addr;
+  //            RHD_SPI_Read  : *SPI_save_ptr, *(SPI_save_ptr+1) <= SPI received data
+  //            LFP_Filter    : spike band / low-pass split (LFP stream only)
+  //            RHD_SDA       : SDA condition check...
+  //            
+  //            SPI_save_ptr+=ucSPSBS; (pre-save ring of the channel)
+  //
+  //            #CH-02
+  //            RHD_SPI_Read, RHD_SDA ...
+  //
+  //            SPI_save_ptr+=ucSPSBS; ...
+  //
+  //The channel sequence is kept unrolled; the helpers are forced inline
+  //so every channel index is a constant.
+  /////////////////////////////////////////////////////////////////////
+  Byte_t *SPI_save_ptr;
   
-  //9999999999999999999999999999999999999999999999999//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_09;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  //Add two Bytes of SPI buffer address to save
+  SPI_Rx_Addr+=2;
+  if(SPI_Rx_Addr == ucSPSBS) SPI_Rx_Addr=0;
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  //Offsets of the two previous samples
+  SPI_Prev1_Offset = (SPI_Rx_Addr >= 2) ? -2 : (ucSPSBS - 2);
+  SPI_Prev2_Offset = (SPI_Rx_Addr >= 4) ? -4 : (ucSPSBS - 4);
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
-  {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
-  }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_09) && BT_Write_ok)
-  {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
-  }
+  //Set SPI_save_ptr as the address to save
+  SPI_save_ptr = SPI_Pre_Buf[0] + SPI_Rx_Addr;
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
+  //Check if there is any rest space in BT Buf
+  if(!BT_Write_ok) 
+    BT_Write_ok = BT_Write_Check();
+  
+  //CH_01
+  RHD_SPI_Read(CH_01, SPI_save_ptr);
+  LFP_Filter(0, SPI_save_ptr);
+  RHD_SDA(0, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_02
+  RHD_SPI_Read(CH_02, SPI_save_ptr);
+  LFP_Filter(1, SPI_save_ptr);
+  RHD_SDA(1, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_03
+  RHD_SPI_Read(CH_03, SPI_save_ptr);
+  LFP_Filter(2, SPI_save_ptr);
+  RHD_SDA(2, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_04
+  RHD_SPI_Read(CH_04, SPI_save_ptr);
+  LFP_Filter(3, SPI_save_ptr);
+  RHD_SDA(3, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_05
+  RHD_SPI_Read(CH_05, SPI_save_ptr);
+  LFP_Filter(4, SPI_save_ptr);
+  RHD_SDA(4, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_06
+  RHD_SPI_Read(CH_06, SPI_save_ptr);
+  LFP_Filter(5, SPI_save_ptr);
+  RHD_SDA(5, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_07
+  RHD_SPI_Read(CH_07, SPI_save_ptr);
+  LFP_Filter(6, SPI_save_ptr);
+  RHD_SDA(6, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_08
+  RHD_SPI_Read(CH_08, SPI_save_ptr);
+  LFP_Filter(7, SPI_save_ptr);
+  RHD_SDA(7, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_09
+  RHD_SPI_Read(CH_09, SPI_save_ptr);
+  LFP_Filter(8, SPI_save_ptr);
+  RHD_SDA(8, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_10
+  RHD_SPI_Read(CH_10, SPI_save_ptr);
+  LFP_Filter(9, SPI_save_ptr);
+  RHD_SDA(9, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_11
+  RHD_SPI_Read(CH_11, SPI_save_ptr);
+  LFP_Filter(10, SPI_save_ptr);
+  RHD_SDA(10, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_12
+  RHD_SPI_Read(CH_12, SPI_save_ptr);
+  LFP_Filter(11, SPI_save_ptr);
+  RHD_SDA(11, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_13
+  RHD_SPI_Read(CH_13, SPI_save_ptr);
+  LFP_Filter(12, SPI_save_ptr);
+  RHD_SDA(12, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_14
+  RHD_SPI_Read(CH_14, SPI_save_ptr);
+  LFP_Filter(13, SPI_save_ptr);
+  RHD_SDA(13, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_15
+  RHD_SPI_Read(CH_15, SPI_save_ptr);
+  LFP_Filter(14, SPI_save_ptr);
+  RHD_SDA(14, SPI_save_ptr);
+  SPI_save_ptr += ucSPSBS;
+  
+  //CH_16
+  RHD_SPI_Read(CH_16, SPI_save_ptr);
+  LFP_Filter(15, SPI_save_ptr);
+  RHD_SDA(15, SPI_save_ptr);
+  
+  //LFP stream
+  if(LFP_Count) LFP_Decimate();
+}
+
+///////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////
+//      Fn      BL_Tx_Segment
+//      Des     Send the current segment of the frame
+//              by DMA0. DMA_INTERRUPT is called when
+//              the segment was sent.
+//      Inp     NONE
+//      Ret     NONE
+///////////////////////////////////////////////
+#pragma inline=forced
+static void BL_Tx_Segment(void)
+{
+  BT_Tx_Segment_t *Segment;
   
+  Segment = BT_Tx_Segment + BT_Tx_Segment_Index;
   
-  //AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_10;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  //Set the DMA option.
+  DMACTL0 = (DMACTL0 & ~BT_DMA0_TSEL_MASK) | DMA0TSEL_17;
+  __data16_write_addr((unsigned short) & DMA0SA, (unsigned long) Segment->Ptr);
+  __data16_write_addr((unsigned short) & DMA0DA, (unsigned long) &UCA0TXBUF);
+  DMA0SZ = Segment->Length;
+  DMA0CTL = DMASRCINCR_3 + DMASBDB + DMALEVEL + DMAIE;
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  //Start to send.
+  DMA0CTL |= DMAEN;
+}
+
+///////////////////////////////////////////////
+//      Fn      BL_Tx_Start
+//      Des     Queue one frame as a segment list
+//              (pre-data with the frame info record,
+//              packets or a coded frame buffer,
+//              post-data) and start to send it.
+//              A frame of event records only has no
+//              packet segment. The telemetry and log
+//              records are sent in such a frame.
+//              The frame bypasses HCITR_COMWrite, so it
+//              is passed to the HCI tap here when the
+//              transport keeps one (HCITR_TAP_BUFFER_SIZE),
+//              unless it carries an HCI tap record. A
+//              spike frame is only counted.
+//              Only called from the ISRs while the
+//              engine is idle.
+//      Inp     Packets (from BL_Frame_Ready, 0 : events only)
+//      Ret     NONE
+///////////////////////////////////////////////
+static void BL_Tx_Start(unsigned char Packets)
+{
+  BT_Tx_Segment_t *Segment;
+  unsigned char start;
+  unsigned int info;
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  Segment = BT_Tx_Segment + 1;
+  if(TM_Due) Packets = 0;
+  BT_Tx_Packets = Packets;
+  
+  //Select the frame : a coded frame buffer or complete packets.
+  if(!Packets)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
+    Segment->Length = 0;
   }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_10) && BT_Write_ok)
+  else if(BT_Compress)
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    Segment->Ptr = BT_Frame_Buf[BT_Frame_Out];
+    Segment->Length = BT_Frame_Len[BT_Frame_Out];
+  }
+  else
+  {
+    Segment->Ptr = BT_Tx_Packet_Pool + (unsigned int)BT_Tx_Packet_Ass_To * BT_Tx_Stride;
+    Segment->Length = (unsigned int)BT_Tx_Stride * Packets;
   }
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
-  
+  //Set the frame info record and the length fields.
+  info = BT_Frame_Info();
+  start = BL_Set_Frame_Length(Segment->Length + info);
   
-  //BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_11;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  BT_Tx_Segment[0].Ptr = BT_Tx_Protocol + start;
+  BT_Tx_Segment[0].Length = BT_TX_PRE_DATA_SIZE - start + info;
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  BT_Tx_Segment[2].Ptr = BT_Tx_Post_Data;
+  BT_Tx_Segment[2].Length = sizeof(BT_Tx_Post_Data);
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+#if HCITR_TAP_BUFFER_SIZE
+  if(Packets)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
+    BT_Tap_Frames++;
+    BT_Tap_Bytes += BT_Tx_Segment[0].Length + Segment->Length + BT_Tx_Segment[2].Length;
   }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_11) && BT_Write_ok)  //-50uV ۳ // 0x80 - ǹ//& ! ٲָ +ǹ 
+  else if(!BT_Tap_Carried)
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    HCITR_TapData(HCITR_TAP_DIRECTION_SENT, BT_Tx_Segment[0].Length, (unsigned char *)BT_Tx_Segment[0].Ptr);
+    HCITR_TapData(HCITR_TAP_DIRECTION_SENT, BT_Tx_Segment[2].Length, (unsigned char *)BT_Tx_Segment[2].Ptr);
   }
+#endif
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
-  
+  BT_Tx_Segment_Index = 0;
+  if(!Packets)
+  {
+    //DMA0 does not send empty segments.
+    BT_Tx_Segment[1] = BT_Tx_Segment[0];
+    BT_Tx_Segment_Index = 1;
+  }
+  BT_Tx_Busy = 1;
   
-  //CCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCCC//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_12;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  BL_Tx_Segment();
+}
+
+///////////////////////////////////////////////
+//      Fn      BL_Tx_Release
+//      Des     Pass away the transmitted frame
+//      Inp     NONE
+//      Ret     NONE
+///////////////////////////////////////////////
+#pragma inline=forced
+static void BL_Tx_Release(void)
+{
+  unsigned char i;
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  if(!BT_Tx_Packets) return;
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  if(BT_Compress)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
+    //Give the frame buffer back to BT_Snippet_Encoder.
+    BT_Frame_Len[BT_Frame_Out]=0;
+    BT_Frame_Out ^= 1;
+  }
+  else
+  {
+    for(i=0;i<BT_Tx_Packets;i++)
     {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
+      SDA_Release(BT_Tx_Packet_Pool + (unsigned int)BT_Tx_Packet_Ass_To * BT_Tx_Stride);
+      BT_Tx_Rest[BT_Tx_Packet_Ass_To]=0;
+      if(++BT_Tx_Packet_Ass_To == BT_Tx_Slots) BT_Tx_Packet_Ass_To=0;
     }
     
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
+    //The deadline of the next packet starts now.
+    BT_Tx_Wait=0;
+  }
+}
     
+///////////////////////////////////////////////
+//      Fn      BL_Set_Frame_Length
+//      Des     Write the ACL, L2CAP and RFCOMM length
+//              fields of the pre-data for a payload
+//              (frame info record included).
+//              RFCOMM uses a 1-byte length field up to
+//              127 Bytes, then the pre-data is one Byte
+//              shorter and starts at BT_Tx_Protocol[1].
+//      Inp     Payload (RFCOMM information Bytes)
+//      Ret     pre-data start index in BT_Tx_Protocol
+///////////////////////////////////////////////
+static unsigned char BL_Set_Frame_Length(unsigned int Payload)
+{
+  unsigned int L2CAP_Length;
+  unsigned char start;
+  Byte_t *p;
+  
+  //RFCOMM address + control + length (1 or 2) + FCS
+  if(Payload > 127)
+  {
+    start = 0;
+    L2CAP_Length = Payload + 5;
   }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_12) && BT_Write_ok)
+  else
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    start = 1;
+    L2CAP_Length = Payload + 4;
   }
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
+  p = BT_Tx_Protocol + start;
+  
+  *p++ = 0x32;
+  *p++ = 0x02;                          //HCI ACL data
+  *p++ = 0x01;                          //Handle, PB/BC flags
+  *p++ = 0x20;
+  *p++ = (L2CAP_Length + 4) & 0xFF;     //ACL length
+  *p++ = (L2CAP_Length + 4) >> 8;
+  *p++ = L2CAP_Length & 0xFF;           //L2CAP length
+  *p++ = L2CAP_Length >> 8;
+  *p++ = 0x40;                          //L2CAP CID
+  *p++ = 0x00;
+  *p++ = 0x09;                          //RFCOMM address
+  *p++ = 0xEF;                          //UIH
+  
+  if(start)
+  {
+    *p = (Payload << 1) | 0x01;
+  }
+  else
+  {
+    *p++ = (Payload << 1) & 0xFF;
+    *p = Payload >> 7;
+  }
   
+  return start;
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Event_Post
+//      Des     Queue an event record for the next frame
+//              (see BT_Frame_Info). Called from the ISRs,
+//              or with the interrupts disabled.
+//      Inp     Type    BT_CTRL_xx
+//              Body    BT_EVENT_BODY Bytes
+//      Ret     1 : queued, 0 : queue full
+///////////////////////////////////////////////
+static unsigned char BT_Event_Post(unsigned char Type, const Byte_t *Body)
+{
+  BT_Event_t *Event;
   
-  //DDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDD//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_13;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  if(BT_Event_Count >= BT_EVENT_NO)
+  {
+    ++TM_Event_Lost;
+    return(0);
+  }
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  Event = BT_Event + ((BT_Event_Out + BT_Event_Count) % BT_EVENT_NO);
+  Event->Ticks = MSP430Ticks;
+  Event->Type = Type;
+  BTPS_MemCopy(Event->Body, Body, BT_EVENT_BODY);
+  ++BT_Event_Count;
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  return(1);
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Frame_Info
+//      Des     Write the frame info record after the
+//              pre-data : frame sequence number and the
+//              running drop count of every channel that
+//              dropped spikes since the last frame.
+//              The event records posted since the last
+//              frame follow, the telemetry record when
+//              it is due and, in a frame without
+//              packets, the log, heap trace and HCI tap
+//              records.
+//              Called once per frame from
+//              BL_Tx_Start.
+//      Inp     NONE
+//      Ret     size of the records
+///////////////////////////////////////////////
+static unsigned int BT_Frame_Info(void)
+{
+  Byte_t *p;
+  BT_Event_t *Event;
+  unsigned int Mask, Size;
+  unsigned char i;
+  
+  p = BT_Tx_Protocol + BT_TX_PRE_DATA_SIZE;
+  Mask = SDA_Drop_Mask;
+  SDA_Drop_Mask = 0;
+  
+  *p++ = ((MSP430Ticks&0x0F)<<4);
+  *p++ = ((MSP430Ticks>>4)&0xFF);
+  *p++ = ((MSP430Ticks>>12)&0xFF);
+  *p++ = ((MSP430Ticks>>20)&0x3F) | BT_REC_CTRL;
+  *p++ = BT_CTRL_FRAME_INFO;
+  ++p;//record size
+  *p++ = BT_Frame_Seq >> 8;
+  *p++ = BT_Frame_Seq & 0xFF;
+  *p++ = Mask >> 8;
+  *p++ = Mask & 0xFF;
+  *p++ = Sampling_Rate_Hz >> 8;
+  *p++ = Sampling_Rate_Hz & 0xFF;
+  *p++ = Snippet_Pre;
+  *p++ = Snippet_Post;
+  Size = BT_FRAME_INFO_SIZE;
+  
+  ++BT_Frame_Seq;
+  
+  for(i=0;Mask;i++,Mask>>=1)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
+    if(Mask & 0x01)
     {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
+      *p++ = SDA_Drop[i] >> 8;
+      *p++ = SDA_Drop[i] & 0xFF;
+      Size += 2;
     }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
   }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_13) && BT_Write_ok)
+  
+  BT_Tx_Protocol[BT_TX_PRE_DATA_SIZE + 5] = Size;
+  
+  //Events since the last frame
+  for(;BT_Event_Count;BT_Event_Count--)
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
+    Event = BT_Event + BT_Event_Out;
+    if(++BT_Event_Out == BT_EVENT_NO) BT_Event_Out = 0;
     
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    *p++ = ((Event->Ticks&0x0F)<<4);
+    *p++ = ((Event->Ticks>>4)&0xFF);
+    *p++ = ((Event->Ticks>>12)&0xFF);
+    *p++ = ((Event->Ticks>>20)&0x3F) | BT_REC_CTRL;
+    *p++ = Event->Type;
+    *p++ = BT_EVENT_SIZE;
+    BTPS_MemCopy(p, Event->Body, BT_EVENT_BODY);
+    p += BT_EVENT_BODY;
+    Size += BT_EVENT_SIZE;
   }
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
-  
-  
-  //EEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEEE//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_14;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  if(TM_Due)
+  {
+    Size += TM_Record(p);
+    p += TM_RECORD_SIZE;
+  }
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  BT_Tap_Carried = 0;
+  if(!BT_Tx_Packets)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
-    
+    i = BT_Log_Record(p);
+    p += i;
+    Size += i;
+    i = BT_Trace_Record(p);
+    p += i;
+    Size += i;
+    BT_Tap_Carried = BT_Tap_Record(p, BT_TX_PAYLOAD_MAX - Size);
+    Size += BT_Tap_Carried;
+  }
+  
+  return Size;
+}
+
+///////////////////////////////////////////////
+//      Fn      TM_Record
+//      Des     Write the telemetry record and start
+//              the next period
+//      Inp     p (record position)
+//      Ret     record size
+///////////////////////////////////////////////
+static unsigned char TM_Record(Byte_t *p)
+{
+  unsigned char i;
+  unsigned int Mask;
+  
+  *p++ = ((MSP430Ticks&0x0F)<<4);
+  *p++ = ((MSP430Ticks>>4)&0xFF);
+  *p++ = ((MSP430Ticks>>12)&0xFF);
+  *p++ = ((MSP430Ticks>>20)&0x3F) | BT_REC_CTRL;
+  *p++ = BT_CTRL_TELEMETRY;
+  *p++ = TM_RECORD_SIZE;
+  *p++ = BT_Tx_Slots;
+  *p++ = TM_Pool_Max;
+  *p++ = TM_Overrun >> 8;
+  *p++ = TM_Overrun & 0xFF;
+  *p++ = TM_ISR_Max >> 8;
+  *p++ = TM_ISR_Max & 0xFF;
+  for(i=0;i<3;i++)
+  {
+    *p++ = TM_Heap[i] >> 8;
+    *p++ = TM_Heap[i] & 0xFF;
   }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_14) && BT_Write_ok)
+  *p++ = TM_Event_Lost >> 8;
+  *p++ = TM_Event_Lost & 0xFF;
+  for(i=0;i<CHANNEL_NUMBER;i++)
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
-    
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
-    
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
-    
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    *p++ = TM_Crossing[i] >> 8;
+    *p++ = TM_Crossing[i] & 0xFF;
+    TM_Crossing[i] = 0;
+  }
+  Mask = 0;
+  for(i=0;i<LFP_Count;i++) Mask |= (1u << LFP_Channel[i]);
+  *p++ = Mask >> 8;
+  *p++ = Mask & 0xFF;
+  for(i=0;i<LFP_CHANNEL_MAX;i++)
+  {
+    *p++ = LFP_Drop[i] >> 8;
+    *p++ = LFP_Drop[i] & 0xFF;
   }
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
+  TM_Pool_Max = BT_Pool_Used();
+  TM_ISR_Max = 0;
+  TM_Due = 0;
   
+  return(TM_RECORD_SIZE);
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Log_Record
+//      Des     Move the oldest entries of the kernel
+//              log into a log record (see
+//              BT_LOG_RECORD_MAX)
+//      Inp     p (record position)
+//      Ret     record size (0 : the log is empty)
+///////////////////////////////////////////////
+static unsigned char BT_Log_Record(Byte_t *p)
+{
+  unsigned long Lost;
+  unsigned char Size;
   
-  //FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_15;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  Size = BTPS_ReadLog(BT_LOG_RECORD_MAX - BT_HEADER_SIZE - 2, p + BT_HEADER_SIZE + 2, &Lost);
+  if((!Size) && (!Lost)) return(0);
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  if(Lost > 0xFFFF) Lost = 0xFFFF;
+  Size += BT_HEADER_SIZE + 2;
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  *p++ = ((MSP430Ticks&0x0F)<<4);
+  *p++ = ((MSP430Ticks>>4)&0xFF);
+  *p++ = ((MSP430Ticks>>12)&0xFF);
+  *p++ = ((MSP430Ticks>>20)&0x3F) | BT_REC_CTRL;
+  *p++ = BT_CTRL_LOG;
+  *p++ = Size;
+  *p++ = Lost >> 8;
+  *p = Lost & 0xFF;
+  
+  return(Size);
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Trace_Record
+//      Des     Move the oldest entries of the kernel
+//              heap trace into a heap trace record
+//              (see BT_TRACE_RECORD_MAX)
+//      Inp     p (record position)
+//      Ret     record size (0 : the trace is empty)
+///////////////////////////////////////////////
+static unsigned char BT_Trace_Record(Byte_t *p)
+{
+#if BTPS_MEMORY_TRACE_SIZE
+  BTPS_MemoryTraceEntry_t Entry[BT_TRACE_ENTRY_NO];
+  unsigned long Lost;
+  unsigned char i, Count, Size;
+  
+  Count = BTPS_ReadMemoryTrace(BT_TRACE_ENTRY_NO, Entry, &Lost);
+  if((!Count) && (!Lost)) return(0);
+  
+  if(Lost > 0xFFFF) Lost = 0xFFFF;
+  Size = BT_HEADER_SIZE + 2 + (Count * BT_TRACE_ENTRY_SIZE);
+  
+  *p++ = ((MSP430Ticks&0x0F)<<4);
+  *p++ = ((MSP430Ticks>>4)&0xFF);
+  *p++ = ((MSP430Ticks>>12)&0xFF);
+  *p++ = ((MSP430Ticks>>20)&0x3F) | BT_REC_CTRL;
+  *p++ = BT_CTRL_HEAP_TRACE;
+  *p++ = Size;
+  *p++ = Lost >> 8;
+  *p++ = Lost & 0xFF;
+  for(i=0;i<Count;i++)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
-    
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
-    {
-      Spike[Current_CH] = 0;
-    }
+    *p++ = Entry[i].Operation;
+    *p++ = Entry[i].Tag;
+    *p++ = Entry[i].Size >> 8;
+    *p++ = Entry[i].Size & 0xFF;
+    *p++ = Entry[i].Offset >> 8;
+    *p++ = Entry[i].Offset & 0xFF;
+  }
+  
+  return(Size);
+#else
+  return(0);
+#endif
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Tap_Record
+//      Des     Move the oldest packets of the HCI tap
+//              into an HCI tap record (see
+//              BT_TAP_RECORD_MAX)
+//      Inp     p (record position), Room (Bytes left
+//              in the frame)
+//      Ret     record size (0 : the tap is empty)
+///////////////////////////////////////////////
+static unsigned char BT_Tap_Record(Byte_t *p, unsigned int Room)
+{
+#if HCITR_TAP_BUFFER_SIZE
+  unsigned long Dropped;
+  unsigned int Size;
+  
+  //The record size field is one Byte, and the size is even.
+  if(Room > 0xFE) Room = 0xFE;
+  Room &= ~1;
+  if(Room < (BT_HEADER_SIZE + 12 + HCITR_TAP_PACKET_HEADER_SIZE)) return(0);
+  
+  Size = HCITR_TapReadPackets(Room - BT_HEADER_SIZE - 12, p + BT_HEADER_SIZE + 12, &Dropped);
+  if(!Size) return(0);
+  
+  Size += BT_HEADER_SIZE + 12;
+  if(Size & 1) p[Size++] = 0;
+  
+  *p++ = ((MSP430Ticks&0x0F)<<4);
+  *p++ = ((MSP430Ticks>>4)&0xFF);
+  *p++ = ((MSP430Ticks>>12)&0xFF);
+  *p++ = ((MSP430Ticks>>20)&0x3F) | BT_REC_CTRL;
+  *p++ = BT_CTRL_HCI_TAP;
+  *p++ = Size;
+  *p++ = Dropped >> 24;
+  *p++ = (Dropped >> 16) & 0xFF;
+  *p++ = (Dropped >> 8) & 0xFF;
+  *p++ = Dropped & 0xFF;
+  *p++ = BT_Tap_Frames >> 24;
+  *p++ = (BT_Tap_Frames >> 16) & 0xFF;
+  *p++ = (BT_Tap_Frames >> 8) & 0xFF;
+  *p++ = BT_Tap_Frames & 0xFF;
+  *p++ = BT_Tap_Bytes >> 24;
+  *p++ = (BT_Tap_Bytes >> 16) & 0xFF;
+  *p++ = (BT_Tap_Bytes >> 8) & 0xFF;
+  *p = BT_Tap_Bytes & 0xFF;
+  
+  return(Size);
+#else
+  return(0);
+#endif
+}
+
+///////////////////////////////////////////////
+//      Fn      BL_Frame_Ready
+//      Des     Check if a frame is ready to send.
+//              Compressed mode : a coded frame buffer
+//              was handed over by BT_Snippet_Encoder.
+//              Raw mode : BT_Tx_Batch complete packets,
+//              or fewer when they reach the end of the
+//              pool or the oldest one has waited for
+//              the deadline.
+//      Inp     NONE
+//      Ret     packets to send (compressed : 1), 0 : not ready
+///////////////////////////////////////////////
+#pragma inline=forced
+static unsigned char BL_Frame_Ready(void)
+{
+  unsigned char Packets, Packet_addr;
+  
+  if(BT_Compress) return(!!BT_Frame_Len[BT_Frame_Out]);
+  
+  Packet_addr = BT_Tx_Packet_Ass_To;
+  for(Packets=0;Packets<BT_Tx_Batch;)
+  {
+    if(BT_Tx_Rest[Packet_addr] != BT_Tx_Stride) break;
     
+    ++Packets;
+    if(++Packet_addr == BT_Tx_Slots) return(Packets);
   }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_15) && BT_Write_ok)
+  
+  if((Packets == BT_Tx_Batch) || ((Packets) && (BT_Tx_Wait >= BT_Tx_Deadline))) return(Packets);
+  
+  return(0);
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Delta_Zigzag
+//      Des     Zigzag code of the difference between
+//              a sample and the previous one
+//              (0, -1, 1, -2, 2 ... => 0, 1, 2, 3, 4 ...)
+//      Inp     Delta (|Delta| <= BT_DELTA_LIMIT)
+//      Ret     code
+///////////////////////////////////////////////
+#pragma inline=forced
+static unsigned int BT_Delta_Zigzag(signed long Delta)
+{
+  if(Delta >= 0) return((unsigned int)Delta << 1);
+  
+  return(((unsigned int)(-Delta) << 1) - 1);
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Encode_Size
+//      Des     Find the bit width of every delta group
+//              (BT_Delta_Width) and the coded record size
+//      Inp     Packet (complete packet in the pool)
+//      Ret     record size, 0 : send raw
+///////////////////////////////////////////////
+static unsigned int BT_Encode_Size(const Byte_t *Packet)
+{
+  const Byte_t *p;
+  signed int Prev, Sample;
+  signed long Delta;
+  unsigned int Code, Bits, Size;
+  unsigned char k, n, Width, Samples;
+  
+  p = Packet + BT_HEADER_SIZE;
+  Samples = Snippet_Pre + 1 + Snippet_Post;
+  
+  Prev = SDA_SAMPLE(p);
+  Bits = 0;
+  Width = 0;
+  n = 0;
+  BT_Delta_Groups = 0;
+  
+  for(k=1;k<Samples;k++)
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
+    p += 2;
+    Sample = SDA_SAMPLE(p);
+    Delta = (signed long)Sample - Prev;
+    Prev = Sample;
     
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
+    if((Delta > BT_DELTA_LIMIT) || (Delta < -BT_DELTA_LIMIT)) return(0);
     
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
+    Code = BT_Delta_Zigzag(Delta);
+    while(Code >> Width) ++Width;
     
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
+    //Close the group
+    if((++n == BT_DELTA_GROUP) || (k == Samples - 1))
     {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
+      BT_Delta_Width[BT_Delta_Groups++] = Width;
+      Bits += Width * n;
+      Width = 0;
+      n = 0;
     }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
   }
   
-  //Set Buf address as next channel
-  SPI_save_ptr += 18;
-  ++Current_CH;
+  //header + first sample + width nibbles + deltas
+  Size = BT_HEADER_SIZE + 2 + ((BT_Delta_Groups + 1) >> 1) + ((Bits + 7) >> 3);
+  Size += Size & 1;
   
+  if(Size >= BT_Tx_Stride) return(0);
   
-  //GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG//////////
-  /*         First 8-bit data of 16-bit send                 */
-  //Turn off SPI_CS pin (: SPI selection)
-  P10OUT &= ~0x10;              //Start SPI data send
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = CH_16;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save received SPI data
-  *SPI_save_ptr = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
+  return(Size);
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Encode_Snippet
+//      Des     Write a packet as a delta coded record
+//              (or raw when Size is 0)
+//      Inp     Packet, Record (destination),
+//              Size (from BT_Encode_Size)
+//      Ret     record size
+///////////////////////////////////////////////
+static unsigned int BT_Encode_Snippet(const Byte_t *Packet, Byte_t *Record, unsigned int Size)
+{
+  const Byte_t *p;
+  Byte_t *q;
+  signed int Prev, Sample;
+  unsigned long Acc;
+  unsigned char k, n, g, Width, Fill, Samples;
   
-  /*         Second 8-bit data send                 */
-  //wait for SPI transmit ready
-  while(!(UCB3IFG & UCTXIFG));
-  //Data write in Tx buffer register
-  UCB3TXBUF = SPI_2;
-  //Wait for input(to SOMI) completion
-  while(!(UCB3IFG & UCRXIFG));
-  //Save 2nd received SPI data
-  *(SPI_save_ptr+1) = UCB3RXBUF;
-  //Wait for end SPI operation
-  while(UCB3STAT & UCBUSY);
-  //Turn on CS pin (: SPI transmit end notification)
-  P10OUT |= 0x10;       //End SPI data send
+  if(!Size)
+  {
+    BTPS_MemCopy(Record, Packet, BT_Tx_Stride);
+    return(BT_Tx_Stride);
+  }
   
-  //Run SDA
-  //SDA step 1. Check if the spike is already detected on CH01
-  if(Spike[Current_CH])
+  //Header with the delta class, and the first sample
+  BTPS_MemCopy(Record, Packet, BT_HEADER_SIZE + 2);
+  Record[3] = (Packet[3] & ~BT_REC_CLASS_MASK) | BT_REC_DELTA;
+  q = Record + BT_HEADER_SIZE + 2;
+  
+  //Width nibbles
+  for(g=0;g<BT_Delta_Groups;g+=2)
+  {
+    *q = BT_Delta_Width[g] << 4;
+    if(g + 1 < BT_Delta_Groups) *q |= BT_Delta_Width[g + 1];
+    ++q;
+  }
+  
+  //Deltas
+  p = Packet + BT_HEADER_SIZE;
+  Samples = Snippet_Pre + 1 + Snippet_Post;
+  Prev = SDA_SAMPLE(p);
+  Acc = 0;
+  Fill = 0;
+  n = 0;
+  g = 0;
+  
+  for(k=1;k<Samples;k++)
   {
-    //Save the oldest SPI_data into BT data buffer.
-    Packet_addr = Spike[Current_CH] - 1;
-    stt_addr = &(BT_Tx_Packet_Buf[Packet_addr][BT_Tx_Rest[Packet_addr]]);
+    p += 2;
+    Sample = SDA_SAMPLE(p);
+    Width = BT_Delta_Width[g];
     
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
+    Acc = (Acc << Width) | BT_Delta_Zigzag((signed long)Sample - Prev);
+    Prev = Sample;
+    
+    Fill += Width;
+    while(Fill >= 8)
     {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
+      Fill -= 8;
+      *q++ = (Byte_t)(Acc >> Fill);
     }
     
-    BT_Tx_Rest[Packet_addr] += 2;
-    
-    //Check if the BT buffer is full
-    if(BT_Tx_Rest[Packet_addr] >= ucBTS)
+    if(++n == BT_DELTA_GROUP)
     {
-      Spike[Current_CH] = 0;
+      n = 0;
+      ++g;
     }
-    
   }
-  //SDA step 2. Check if recently read data is enough to set as spike
-  else if((*SPI_save_ptr & 0x80) && (*SPI_save_ptr < NVTH_CH_16) && BT_Write_ok)
+  
+  if(Fill) *q++ = (Byte_t)(Acc << (8 - Fill));
+  if((q - Record) & 1) *q = 0;
+  
+  return(Size);
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Frame_Expired
+//      Des     Check if the first record of the input
+//              frame buffer has waited for the deadline
+//      Inp     NONE
+//      Ret     1 : expired
+///////////////////////////////////////////////
+#pragma inline=forced
+static unsigned char BT_Frame_Expired(void)
+{
+  return(((Word_t)MSP430Ticks - BT_Frame_In_Tick) >= BT_Tx_Deadline);
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Frame_Publish
+//      Des     Hand the input frame buffer to the
+//              transmit engine
+//      Inp     NONE
+//      Ret     NONE
+///////////////////////////////////////////////
+static void BT_Frame_Publish(void)
+{
+  BT_Frame_Len[BT_Frame_In] = BT_Frame_In_Len;
+  BT_Frame_In ^= 1;
+  BT_Frame_In_Len = 0;
+}
+
+///////////////////////////////////////////////
+//      Fn      BT_Snippet_Encoder
+//      Des     Scheduled in the main loop in compressed
+//              mode. Codes the complete packets in order
+//              into the input frame buffer, and hands the
+//              buffer to the transmit engine when another
+//              raw packet would pass the frame limit, or
+//              when its first record has waited for the
+//              deadline.
+//              The ISR wakes the main loop (LPM0) when a
+//              packet is complete or the deadline passed.
+//      Inp     NONE
+//      Ret     NONE
+///////////////////////////////////////////////
+void BT_Snippet_Encoder(void *UserParameter)
+{
+  Byte_t *Packet;
+  unsigned int Size;
+  
+  while(BT_Tx_Rest[BT_Tx_Packet_Ass_To] >= BT_Tx_Stride)
   {
-    //Assign BT buffer space and update current buffer filling state
-    stt_addr = BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_From];
-    Spike[Current_CH] = ++BT_Tx_Packet_Ass_From;
-    if(BT_Tx_Packet_Ass_From == ucBTPBN) BT_Tx_Packet_Ass_From=0;
+    //Wait until the frame buffer was sent.
+    if(BT_Frame_Len[BT_Frame_In]) return;
     
-    BT_Write_ok = (BT_Tx_Packet_Ass_To != BT_Tx_Packet_Ass_From + 1) || ((!!BT_Tx_Packet_Ass_To) || (BT_Tx_Packet_Ass_From != ucBTPBN-1));
+    if(!BT_Frame_In_Len) BT_Frame_In_Tick = (Word_t)MSP430Ticks;
     
-    //Save the header information.
-    *stt_addr++ = Current_CH + ((MSP430Ticks&0x0F)<<4);
-    *stt_addr++ = ((MSP430Ticks>>4)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>12)&0xFF);
-    *stt_addr++ = ((MSP430Ticks>>20)&0xFF);
+    Packet = BT_Tx_Packet_Pool + (unsigned int)BT_Tx_Packet_Ass_To * BT_Tx_Stride;
+    //LFP packets are sent raw.
+    Size = ((Packet[3] & BT_REC_CLASS_MASK) == BT_REC_RAW) ? BT_Encode_Size(Packet) : 0;
+    BT_Frame_In_Len += BT_Encode_Snippet(Packet, BT_Frame_Buf[BT_Frame_In] + BT_Frame_In_Len, Size);
     
-    //Save the oldest SPI data into BT data buffer.
-    if(SPI_Rx_Addr != ucSPSBS - 2)
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2);
-      *stt_addr = *(SPI_save_ptr +3);
-    }
-    else
-    {
-      *stt_addr++ = *(SPI_save_ptr + 2 - ucSPSBS);
-      *stt_addr = *(SPI_save_ptr + 3 - ucSPSBS);
-    }
-    //Update currently saved data size in the assigned BT buf.
-    BT_Tx_Rest[Spike[Current_CH] - 1] = 6;
+    //Release the packet
+    __disable_interrupt();
+    SDA_Release(Packet);
+    __enable_interrupt();
+    BT_Tx_Rest[BT_Tx_Packet_Ass_To]=0;
+    if(++BT_Tx_Packet_Ass_To == BT_Tx_Slots) BT_Tx_Packet_Ass_To=0;
+    
+    if(BT_Frame_In_Len + BT_Tx_Stride > BT_Tx_Frame_Limit) BT_Frame_Publish();
   }
   
+  if((BT_Frame_In_Len) && (!BT_Frame_Len[BT_Frame_In]) && (BT_Frame_Expired())) BT_Frame_Publish();
+}
+
+///////////////////////////////////////////////
+//      Fn      TM_Tick
+//      Des     Track the timer ISR time and overruns,
+//              and request the heap sample of the
+//              telemetry record every TM_PERIOD_MS
+//              (TM_Heap_Sample then flags the record).
+//              Called at the end of the tick (TA1R
+//              counts from the start of the ISR).
+//      Inp     NONE
+//      Ret     NONE
+///////////////////////////////////////////////
+#pragma inline=forced
+static void TM_Tick(void)
+{
+  unsigned int Elapsed;
   
+  Elapsed = TA1R;
+  if(Elapsed > TM_ISR_Max) TM_ISR_Max = Elapsed;
   
+  //The next tick is already due.
+  if(TA1CCTL0 & CCIFG) ++TM_Overrun;
   
+  if(!--TM_Countdown)
+  {
+    TM_Countdown = TM_Period;
+    TM_Sample_Due = 1;
+  }
 }
 
-///////////////////////////////////////////////////////////////
-
-
 ///////////////////////////////////////////////
-//      Fn      BL_Write_from_SPI
-//      Des     1 cycle SPI result data transmitting
-//              to BL module in UART protocol
-//      Inp     order
-//      Ret     (next step) order
+//      Fn      TM_Heap_Sample
+//      Des     Scheduled on every pass of the main
+//              loop, runs when TM_Tick requests the
+//              sample (TIMER_INTERRUPT wakes the main
+//              loop then) : heap usage for the telemetry
+//              record from the kernel counters (the heap
+//              is not walked), then the record is
+//              flagged, so the period has the one clock
+//              of TM_Tick
+//      Inp     NONE
+//      Ret     NONE
 ///////////////////////////////////////////////
-unsigned char BL_Write_from_SPI(unsigned char order)
+void TM_Heap_Sample(void *UserParameter)
 {
-  static unsigned char *remove_addr;
+  BTPS_MemoryStatistics_t Statistics;
+  int Result;
   
-  ++order; // Initial input must be 0 value.
+  if(!TM_Sample_Due) return;
   
+  Result = BTPS_QueryMemoryStatistics(&Statistics);
   
-  switch(order)
+  __disable_interrupt();
+  if(!Result)
   {
-  case 1:
-    //pre-data send
-    
-    if(!!(DMA0CTL & DMAEN)) --order; //DMA is in operation
-    else
-    {
-      //DMA is not in operation
-      
-      //Set the DMA option.
-      DMACTL0 = DMA0TSEL_17;
-      __data16_write_addr((unsigned short) & DMA0SA, (unsigned long) BT_Tx_Protocol);
-      __data16_write_addr((unsigned short) & DMA0DA, (unsigned long) &UCA0TXBUF);
-      DMA0SZ = 14;
-      DMA0CTL = DMASRCINCR_3 + DMASBDB + DMALEVEL;
-      
-      //Start to send pre-data.
-      DMA0CTL |= DMAEN;
-    }
-
-    break;
-  case 2:
-    //wait until pre-data will be sent.
-    if(!!(DMA0CTL & DMAIFG))
-    {
-      //pre-data sending was finished.
-      
-      //reset interrupt flag.
-      DMA0CTL &= ~ DMAIFG;
-      //setting to send data
-      DMACTL0 = DMA0TSEL_17;
-      __data16_write_addr((unsigned short) & DMA0SA, (unsigned long) &BT_Tx_Packet_Buf[BT_Tx_Packet_Ass_To]);
-      __data16_write_addr((unsigned short) & DMA0DA, (unsigned long) &UCA0TXBUF);
-      DMA0SZ = ucBTS4;
-      DMA0CTL = DMASRCINCR_3 + DMASBDB + DMALEVEL;
-      
-      //start data sending.
-      DMA0CTL |= DMAEN;
-      
-      return order;
-    }
-    else return --order; //pre-data sending was not finished.
-    break;
-  case 3:
-    //Check if the data sending was finished.
-    if(!!(DMA0CTL & DMAIFG))
-    {
-      //data transmission was finished.
-      
-      //Reset DMA mode.
-      DMA0CTL &= ~ DMAIFG;
-      
-      
-      //Start to send post-data.
-      
-      //Set the DMA option.
-      DMACTL0 = DMA0TSEL_17;
-      __data16_write_addr((unsigned short) & DMA0SA, (unsigned long) &BT_Tx_Protocol[14]);
-      __data16_write_addr((unsigned short) & DMA0DA, (unsigned long) &UCA0TXBUF);
-      DMA0SZ = 2;
-      DMA0CTL = DMASRCINCR_3 + DMASBDB + DMALEVEL;
-      
-      //Start to send pre-data.
-      DMA0CTL |= DMAEN;
-      
-      
-      //Pass away transmitted data.
-      remove_addr = BT_Tx_Rest + BT_Tx_Packet_Ass_To;
-      
-      *remove_addr=0;
-      *(remove_addr+1)=0;
-      *(remove_addr+2)=0;
-      *(remove_addr+3)=0;
-      
-      BT_Tx_Packet_Ass_To += 4;
-      
-      if(BT_Tx_Packet_Ass_To == ucBTPBN) BT_Tx_Packet_Ass_To=0;
-      
-      return order;
-    }
-    else return --order; //data sending was not finished.
-    break;
-  case 4:
-    if(!!(DMA0CTL & DMAIFG)) DMA0CTL &= ~ DMAIFG; //post-data transmission was finished.
-                                                  //Reset DMA flag.
-    else return --order;
-    break;
-  default:
-    break;
+    TM_Heap[0] = Statistics.Used;
+    TM_Heap[1] = Statistics.Free;
+    TM_Heap[2] = Statistics.MaxFree;
   }
-  
-  return order;
+  TM_Sample_Due = 0;
+  TM_Due = 1;
+  __enable_interrupt();
 }
-    
+
 ///////////////////////////////////////////////
 //      Fn      SPI_BL_Periodic_write
 //      Des     Periodically SPI data comm. and
@@ -6686,9 +7649,8 @@ unsigned char BL_Write_from_SPI(unsigned char order)
 
 void SPI_BL_Periodic_write(void *Userparameter)
 {
-  static unsigned char order=0;
   static unsigned char work1=0;
-  static unsigned char work2=0;
+  unsigned char Packets;
   
   //Periodically ADC sensing must be implemented by SPI communication every cycle
   //Read and save ADC data on no.1 to no 4 channel (no.0 was false operated)
@@ -6697,25 +7659,21 @@ void SPI_BL_Periodic_write(void *Userparameter)
     work1=1;
     RHD_SPI_Buffer_Save();
     work1=0;
+    
+    if(CL_Active) CL_Tick();
   
-    //If the size of data in buffer is bigger than BL_TRANS_SIZE, 
-    //transmit the data to BT module in the way of direct UART control
-    if((!work2) && ((BT_Tx_Rest[BT_Tx_Packet_Ass_To+3]==ucBTS) || (order) ) )
+    //Age of the oldest complete packet (raw mode deadline)
+    if((BT_Tx_Rest[BT_Tx_Packet_Ass_To] == BT_Tx_Stride) && (BT_Tx_Wait < BT_Tx_Deadline)) ++BT_Tx_Wait;
+    
+    //If a frame is ready and the transmit engine is idle, start it.
+    //DMA_INTERRUPT chains the following frames back-to-back.
+    if(!BT_Tx_Busy)
     {
-      work2=1;
-      //Yes. ready to transmit
-      
-      //Transmit UART data to BT module
-      order=BL_Write_from_SPI(order);
-      if(order>BT_TRANS_STEP_SIZE)
-      {
-        //End transmission mode.
-        //Reset all the transmission information.
-        order=0;
-      }
-      work2=0;
+      Packets = BL_Frame_Ready();
+      if((Packets) || (BT_Event_Count) || (TM_Due)) BL_Tx_Start(Packets);
     }
     
+    TM_Tick();
   }
 }
          
@@ -6749,7 +7707,11 @@ void BL_UART_Bulk_Transmission_Mode(void)
    16 kHz (16.108 kHz)          (25,000 / 8 / 16) - 1 = 193
    18 kHz (17.960 kHz)          (25,000 / 8 / 18) - 1 = 173
    */
-   TA1CCR0 = 390; // 25MHz / 8 / (313 + 1) = 9.95 kHz
+   TA1CCR0 = Sampling_Divider[(Sampling_Rate - SAMPLING_RATE_MIN) >> 1]; // 25MHz / 8 / (390 + 1) = 7.992 kHz (default)
+   
+   //The kernel clock keeps counting ms (see HAL_GetTickCount).
+   Kernel_Tick_Div = Sampling_Rate;
+   Kernel_Tick_Phase = 0;
 
    //two division
 //   TA1CCR0 = 2;
@@ -6775,10 +7737,22 @@ void BL_UART_Bulk_Transmission_Mode(void)
 ////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////Timer////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////
-   /* This function is called to get the system Tick Count.             */
+   /* This function is called to get the system Tick Count.  The count  */
+   /* is in milliseconds whatever the TIMER1_A0 rate (the kernel        */
+   /* scheduler, the stack timeouts and BTPS_Delay() rely on it), see   */
+   /* Kernel_Ticks.                                                     */
 unsigned long HAL_GetTickCount(void)
 {
-   return(MSP430Ticks);
+   return(Kernel_Ticks);
+}
+
+   /* This function is called to wake the main loop from low power mode */
+   /* the specified number of ticks from now (0 cancels the wakeup).    */
+   /* The wakeup is taken by TIMER_INTERRUPT, TA1 itself is unchanged.  */
+void HAL_SetWakeup(unsigned long Ticks)
+{
+   Wakeup_Tick  = Kernel_Ticks + Ticks;
+   Wakeup_Armed = (Ticks != 0);
 }
 
    /* Timer A Get Tick Count Function for BTPSKRNL Timer A Interrupt.   */
@@ -6787,16 +7761,80 @@ unsigned long HAL_GetTickCount(void)
 __interrupt void TIMER_INTERRUPT(void)
 {
    ++MSP430Ticks;
+   if(++Kernel_Tick_Phase >= Kernel_Tick_Div)
+   {
+      Kernel_Tick_Phase = 0;
+      ++Kernel_Ticks;
+   }
    /* Start up clean.                                                   */
    TA1CTL |= TACLR;
    
    //if(Cycle_start) RHD_SPI_Buffer_Save(NULL);
-   if(Cycle_start) SPI_BL_Periodic_write(NULL);
+   //Sampling stops while a rate change is pending (SDA_Rate_Process).
+   if(Cycle_start)
+   {
+      if(!Sampling_Rate_Pending) SPI_BL_Periodic_write(NULL);
+      else if(!BT_Tx_Busy) LPM3_EXIT;
+   }
+   
+   //Wake the main loop to code the complete packets or to flush the
+   //input frame buffer (BT_Snippet_Encoder).
+   if((BT_Compress) && ((BT_Tx_Rest[BT_Tx_Packet_Ass_To] >= BT_Tx_Stride) || ((BT_Frame_In_Len) && (BT_Frame_Expired())))) LPM0_EXIT;
+   
+   //Wake the main loop to sample the heap for the telemetry record
+   //(TM_Heap_Sample).
+   if(TM_Sample_Due) LPM3_EXIT;
+
+#ifdef BT_UART_DMA_RX_TRIGGER
+   //Wake the main loop to deliver the HCI data that the DMA channel
+   //received before the line went idle.
+   if(UartDmaIdleCheck()) LPM3_EXIT;
+#endif
 
    /* Exit from LPM if necessary (this statement will have no effect if */
    /* we are not currently in low power mode).                          */
    //LPM3_EXIT;
+   if((Wakeup_Armed) && ((signed long)(Kernel_Ticks - Wakeup_Tick) >= 0))
+   {
+      Wakeup_Armed = 0;
+      LPM3_EXIT;
+   }
+   
+}
+
+   /* DMA0 segment done : send the next segment of the frame, or        */
+   /* release the frame and chain the next one (see BL_Tx_Start).       */
+#pragma vector=DMA_VECTOR
+__interrupt void DMA_INTERRUPT(void)
+{
+   unsigned char Packets;
+   Word_t Vector;
+   
+   //Reading DMAIV clears the flag. The other channels belong to
+   //the HCI transport.
+   Vector = DMAIV;
+   if(Vector != DMAIV_DMA0IFG)
+   {
+#if (defined(BT_UART_DMA_TX_TRIGGER)) || (defined(BT_UART_DMA_RX_TRIGGER))
+     if(UartDmaInterrupt(Vector)) LPM3_EXIT;
+#endif
+     return;
+   }
+   
+   if(++BT_Tx_Segment_Index < BT_TX_SEGMENT_NO)
+   {
+      BL_Tx_Segment();
+      return;
+   }
+   
+   BL_Tx_Release();
+   BT_Tx_Busy = 0;
+   
+   //The frames left are discarded by a pending rate change.
+   if(Sampling_Rate_Pending) return;
    
+   Packets = BL_Frame_Ready();
+   if((Packets) || (BT_Event_Count) || (TM_Due)) BL_Tx_Start(Packets);
 }
 
 
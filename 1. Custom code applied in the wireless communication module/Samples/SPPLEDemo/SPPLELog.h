@@ -0,0 +1,44 @@
+/*****< spplelog.h >***********************************************************/
+/*                                                                            */
+/*  SPPLELOG - Message table of the binary log (see BTPS_LogMessage) of the   */
+/*             SPPLEDemo application.                                         */
+/*                                                                            */
+/******************************************************************************/
+#ifndef __SPPLELOG_H__
+#define __SPPLELOG_H__
+
+   /* The following table lists the messages of the binary log, one     */
+   /* LOG_MESSAGE(Name, Format) per message.  The Message ID of a       */
+   /* message is its position in the table (from 1).  The firmware only */
+   /* writes the Message ID and the raw arguments (see BTPS_LOGx()) and */
+   /* the host (data_extraction.m) reads this file to print the         */
+   /* messages with their Format.  The arguments are 32 bit unsigned    */
+   /* values, so the Format should only use %u and %x.                  */
+   /* * NOTE * New messages must be added at the end of the table, so   */
+   /*          that the logs recorded before can still be decoded.      */
+#define SPPLE_LOG_MESSAGE_TABLE                                                               \
+   LOG_MESSAGE(LOG_SEND_CREDITS,           "Transmit Credits: %u")                           \
+   LOG_MESSAGE(LOG_SEND_ACTUAL,            "Actually sent %u of Maximum %u")                 \
+   LOG_MESSAGE(LOG_SEND_BUFFER_FULL,       "Buffer Full (SPPLESendProcess)")                 \
+   LOG_MESSAGE(LOG_CREDITS_SEND,           "Sending %u Credits")                             \
+   LOG_MESSAGE(LOG_CREDITS_BUFFER_FULL,    "Buffer Full (SPPLESendCredits)")                 \
+   LOG_MESSAGE(LOG_CREDITS_RECEIVED,       "Received %u Credits, Credit Count %u")           \
+   LOG_MESSAGE(LOG_DATA_TRY,               "Trying to send %u bytes")                        \
+   LOG_MESSAGE(LOG_DATA_SENT,              "Sent %u, Remaining Credits %u")                  \
+   LOG_MESSAGE(LOG_DATA_BUFFER_FULL,       "Buffer Full (SPPLESendData)")                    \
+   LOG_MESSAGE(LOG_DATA_INDICATION,        "Data Indication Event: %u bytes")                \
+   LOG_MESSAGE(LOG_BUFFER_EMPTY,           "Buffer Empty")
+
+   /* Message IDs (LOG_NONE is not a message).                          */
+#define LOG_MESSAGE(_Name, _Format)        _Name,
+
+typedef enum
+{
+   LOG_NONE,
+   SPPLE_LOG_MESSAGE_TABLE
+   LOG_MESSAGE_NO
+} SPPLE_Log_Message_t;
+
+#undef LOG_MESSAGE
+
+#endif
@@ -0,0 +1,353 @@
+/*****< spplehost.c >**********************************************************/
+/*                                                                            */
+/*  SPPLEHOST - Host stand-in of the SPPLEDemo data stream for POSIX hosts.   */
+/*                                                                            */
+/*  Opens a pseudo terminal in place of the SPP serial port and sends the     */
+/*  records of SPPLEDemo.c on it : a frame info record at the start of        */
+/*  every frame, raw snippet records of synthetic spikes (at the rate given   */
+/*  on the command line, random times and channels) and a BT_CTRL_ECHO        */
+/*  record for every BT_CMD_ECHO command that is received, so                 */
+/*  latency_probe.m can be run without the wireless system.  Frames are sent  */
+/*  by the rules of BL_Frame_Ready (frame limit, deadline, events at once)    */
+/*  from a function of the BTPS scheduler that runs every Millisecond (one    */
+/*  tick of the POSIX kernel).  The acquisition itself (RHD2132, detection,   */
+/*  DMA) is not part of the host build, so the residence of a probe is the    */
+/*  one of the frame rules only.                                              */
+/*                                                                            */
+/*  Build (see btpskrnl/posix/BTPSKRNL.c) :                                   */
+/*     gcc -I<btpskrnl> -I<include> <btpskrnl>/posix/BTPSKRNL.c               */
+/*         <btpskrnl>/sprintf.c SPPLEHost.c -lpthread                         */
+/*  Run : SPPLEHost [spikes per second], then set the printed pseudo          */
+/*  terminal as the Port of latency_probe.m.                                  */
+/******************************************************************************/
+#define _XOPEN_SOURCE 600
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "BTPSKRNL.h"            /* Bluetooth Kernel Protoypes/Constants.     */
+
+   /* The following constants are the ones of the record stream of      */
+   /* SPPLEDemo.c (see the Snippet records, Control record types and    */
+   /* Host commands there).                                             */
+#define CHANNEL_NUMBER                             16
+#define SAMPLING_RATE_HZ                           8000
+#define SNIPPET_PRE                                8
+#define SNIPPET_POST                               15
+#define SNIPPET_LENGTH                             (SNIPPET_PRE + 1 + SNIPPET_POST)
+
+#define BT_HEADER_SIZE                             6
+#define BT_TRANS_SIZE                              (BT_HEADER_SIZE + (SNIPPET_LENGTH * 2))
+#define BT_REC_RAW                                 0x00
+#define BT_REC_CTRL                                0xC0
+
+#define BT_CTRL_FRAME_INFO                         0x01
+#define BT_CTRL_ECHO                               0x03
+#define BT_FRAME_INFO_SIZE                         14
+
+#define BT_EVENT_NO                                3
+#define BT_EVENT_BODY                              4
+#define BT_EVENT_SIZE                              (BT_HEADER_SIZE + BT_EVENT_BODY)
+
+#define BT_TX_FRAME_LIMIT                          (BT_TRANS_SIZE * 4)
+#define BT_TX_DEADLINE_MS                          10
+
+#define BT_CMD_SYNC                                0xA5
+#define BT_CMD_ARG_MAX                             10
+#define BT_CMD_ECHO                                0x04
+
+   /* The sampling ticks of the record headers are 26 bits wide.        */
+#define TICK_MASK                                  0x03FFFFFFUL
+
+   /* The following constant represents the spike rate (spikes per      */
+   /* second, all channels) if none is given on the command line.       */
+#define DEFAULT_SPIKE_RATE                         100
+
+   /* The following structure holds an event record that waits for the  */
+   /* next frame.                                                       */
+typedef struct _tagHostEvent_t
+{
+   unsigned long Ticks;
+   Byte_t        Body[BT_EVENT_BODY];
+} HostEvent_t;
+
+   /* Internal Variables to this Module (Remember that all variables    */
+   /* declared static are initialized to 0 automatically by the         */
+   /* compiler as part of standard C/C++).                              */
+static int           PortDescriptor;            /* Master side of the pseudo  */
+                                                /* terminal.                  */
+
+static unsigned long Ticks;                     /* Sampling ticks (26 bits).  */
+
+static unsigned long SpikeRate;                 /* Spikes per second.         */
+
+static unsigned int  FrameSeq;                  /* Frame sequence number.     */
+
+static unsigned int  FrameWait;                 /* Milliseconds the oldest    */
+                                                /* snippet has waited.        */
+
+static unsigned int  PacketLength;              /* Bytes of snippet records   */
+static Byte_t        Packet[BT_TX_FRAME_LIMIT]; /* waiting for a frame.       */
+
+static unsigned int  EventCount;                /* Events waiting for a frame.*/
+static HostEvent_t   Event[BT_EVENT_NO];
+
+static Boolean_t     CmdSync;                   /* Host command being         */
+static unsigned int  CmdFill;                   /* collected (opcode, argument*/
+static Byte_t        CmdBuf[2 + BT_CMD_ARG_MAX];/* length, arguments).        */
+
+static unsigned long FramesSent;                /* Frames written and frames  */
+static unsigned long FramesLost;                /* that the port did not take.*/
+
+static Byte_t        Frame[BT_FRAME_INFO_SIZE + (BT_EVENT_NO * BT_EVENT_SIZE) + BT_TX_FRAME_LIMIT];
+
+   /* Internal Function Prototypes.                                     */
+static int OpenPort(void);
+static Byte_t *PutTicks(Byte_t *Buffer, unsigned long Value, Byte_t Class);
+static void CommandInput(const Byte_t *Data, unsigned int Length);
+static void AddSnippet(void);
+static void SendFrame(void);
+static void BTPSAPI HostTick(void *UserParameter);
+
+   /* The following function opens the pseudo terminal, sets its slave  */
+   /* side to raw 8 bit data and keeps the slave open, so the master    */
+   /* side can be written before (and after) latency_probe.m attaches.  */
+   /* This function returns zero if successful, or a negative value if  */
+   /* there was an error.                                               */
+static int OpenPort(void)
+{
+   int            ret_val;
+   int            Slave;
+   struct termios Attributes;
+
+   ret_val = -1;
+
+   if((PortDescriptor = posix_openpt(O_RDWR | O_NOCTTY)) >= 0)
+   {
+      if((!grantpt(PortDescriptor)) && (!unlockpt(PortDescriptor)) && (!fcntl(PortDescriptor, F_SETFL, O_NONBLOCK)))
+      {
+         if((Slave = open(ptsname(PortDescriptor), O_RDWR | O_NOCTTY)) >= 0)
+         {
+            if(!tcgetattr(Slave, &Attributes))
+            {
+               Attributes.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+               Attributes.c_oflag &= ~OPOST;
+               Attributes.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+               Attributes.c_cflag &= ~(CSIZE | PARENB | CSTOPB);
+               Attributes.c_cflag |= (CS8 | CLOCAL | CREAD);
+
+               tcsetattr(Slave, TCSANOW, &Attributes);
+            }
+
+            printf("SPPLEHost: data stream on %s\n", ptsname(PortDescriptor));
+
+            ret_val = 0;
+         }
+      }
+
+      if(ret_val)
+         close(PortDescriptor);
+   }
+
+   return(ret_val);
+}
+
+   /* The following function writes the first 4 Bytes of a record       */
+   /* header (channel 0, the specified tick and record class) and       */
+   /* returns the position after them.                                  */
+static Byte_t *PutTicks(Byte_t *Buffer, unsigned long Value, Byte_t Class)
+{
+   *Buffer++ = (Byte_t)((Value & 0x0F) << 4);
+   *Buffer++ = (Byte_t)((Value >> 4) & 0xFF);
+   *Buffer++ = (Byte_t)((Value >> 12) & 0xFF);
+   *Buffer++ = (Byte_t)(((Value >> 20) & 0x3F) | Class);
+
+   return(Buffer);
+}
+
+   /* The following function collects the host commands (as             */
+   /* BT_Command_Input of SPPLEDemo.c) and queues an echo record for    */
+   /* every BT_CMD_ECHO command.  The other commands are ignored.       */
+static void CommandInput(const Byte_t *Data, unsigned int Length)
+{
+   for(;Length;Length--,Data++)
+   {
+      if(!CmdSync)
+      {
+         CmdSync = (Boolean_t)(*Data == BT_CMD_SYNC);
+         CmdFill = 0;
+         continue;
+      }
+
+      CmdBuf[CmdFill++] = *Data;
+      if(CmdFill < 2)
+         continue;
+
+      /* Resynchronize on a bad argument length.                        */
+      if(CmdBuf[1] > BT_CMD_ARG_MAX)
+      {
+         CmdSync = FALSE;
+         continue;
+      }
+
+      if(CmdFill < (2U + CmdBuf[1]))
+         continue;
+
+      CmdSync = FALSE;
+
+      if((CmdBuf[0] == BT_CMD_ECHO) && (CmdBuf[1] == BT_EVENT_BODY) && (EventCount < BT_EVENT_NO))
+      {
+         Event[EventCount].Ticks = Ticks;
+         BTPS_MemCopy(Event[EventCount].Body, &(CmdBuf[2]), BT_EVENT_BODY);
+
+         EventCount++;
+      }
+   }
+}
+
+   /* The following function adds the raw snippet record of a spike on  */
+   /* a random channel, whose trigger sample is SNIPPET_POST ticks old. */
+   /* The spike is dropped if the frame is full.                        */
+static void AddSnippet(void)
+{
+   Byte_t       *Record;
+   int           Sample;
+   unsigned int  Index;
+
+   if((PacketLength + BT_TRANS_SIZE) <= sizeof(Packet))
+   {
+      Record    = &(Packet[PacketLength]);
+      PutTicks(Record, (Ticks - SNIPPET_POST) & TICK_MASK, BT_REC_RAW);
+      Record[0] |= (Byte_t)(rand() % CHANNEL_NUMBER);
+      Record[4]  = SNIPPET_PRE;
+      Record[5]  = 0;
+
+      for(Index=0;Index<SNIPPET_LENGTH;Index++)
+      {
+         if(Index == SNIPPET_PRE)
+            Sample = -1500;
+         else
+         {
+            if(Index == (SNIPPET_PRE + 1))
+               Sample = 400;
+            else
+               Sample = (rand() % 41) - 20;
+         }
+
+         Record[BT_HEADER_SIZE + (Index * 2)]     = (Byte_t)((Sample >> 8) & 0xFF);
+         Record[BT_HEADER_SIZE + (Index * 2) + 1] = (Byte_t)(Sample & 0xFF);
+      }
+
+      PacketLength += BT_TRANS_SIZE;
+   }
+}
+
+   /* The following function sends a frame : the frame info record, the */
+   /* waiting event records and snippet records.  A frame that the port */
+   /* does not take (no reader, buffer full) is counted and dropped.    */
+static void SendFrame(void)
+{
+   Byte_t       *p;
+   unsigned int  Index;
+
+   p    = PutTicks(Frame, Ticks, BT_REC_CTRL);
+   *p++ = BT_CTRL_FRAME_INFO;
+   *p++ = BT_FRAME_INFO_SIZE;
+   *p++ = (Byte_t)(FrameSeq >> 8);
+   *p++ = (Byte_t)(FrameSeq & 0xFF);
+   *p++ = 0;
+   *p++ = 0;
+   *p++ = (Byte_t)(SAMPLING_RATE_HZ >> 8);
+   *p++ = (Byte_t)(SAMPLING_RATE_HZ & 0xFF);
+   *p++ = SNIPPET_PRE;
+   *p++ = SNIPPET_POST;
+
+   FrameSeq++;
+
+   for(Index=0;Index<EventCount;Index++)
+   {
+      p    = PutTicks(p, Event[Index].Ticks, BT_REC_CTRL);
+      *p++ = BT_CTRL_ECHO;
+      *p++ = BT_EVENT_SIZE;
+      BTPS_MemCopy(p, Event[Index].Body, BT_EVENT_BODY);
+      p   += BT_EVENT_BODY;
+   }
+
+   BTPS_MemCopy(p, Packet, PacketLength);
+   p += PacketLength;
+
+   if(write(PortDescriptor, Frame, (size_t)(p - Frame)) == (ssize_t)(p - Frame))
+      FramesSent++;
+   else
+      FramesLost++;
+
+   EventCount   = 0;
+   PacketLength = 0;
+   FrameWait    = 0;
+}
+
+   /* The following function is scheduled every Millisecond : it        */
+   /* advances the sampling ticks, reads the host commands, adds the    */
+   /* spikes of the Millisecond and sends a frame when one is ready.    */
+static void BTPSAPI HostTick(void *UserParameter)
+{
+   Byte_t       Buffer[64];
+   ssize_t      Length;
+   unsigned int Count;
+
+   (void)UserParameter;
+
+   Ticks = (Ticks + (SAMPLING_RATE_HZ / 1000)) & TICK_MASK;
+
+   while((Length = read(PortDescriptor, Buffer, sizeof(Buffer))) > 0)
+      CommandInput(Buffer, (unsigned int)Length);
+
+   /* SpikeRate/1000 spikes per Millisecond : the whole ones, and one  */
+   /* more with the probability of the fraction (Poisson arrivals at    */
+   /* low rates).                                                       */
+   for(Count=(unsigned int)(SpikeRate / 1000);Count;Count--)
+      AddSnippet();
+
+   if((unsigned long)(rand() % 1000) < (SpikeRate % 1000))
+      AddSnippet();
+
+   if(PacketLength)
+      FrameWait++;
+
+   /* The frame rules of BL_Frame_Ready : events at once, snippets when */
+   /* the frame is full or the oldest one has waited for the deadline.  */
+   if((EventCount) || ((PacketLength + BT_TRANS_SIZE) > sizeof(Packet)) || (FrameWait >= BT_TX_DEADLINE_MS))
+      SendFrame();
+
+   if(!(Ticks % (SAMPLING_RATE_HZ * 10)))
+      printf("SPPLEHost: %lu frames sent, %lu not taken by the port\n", FramesSent, FramesLost);
+}
+
+int main(int argc, char *argv[])
+{
+   int ret_val;
+
+   SpikeRate = (argc > 1)?strtoul(argv[1], NULL, 10):DEFAULT_SPIKE_RATE;
+
+   BTPS_Init(NULL);
+
+   if((!OpenPort()) && (BTPS_AddFunctionToScheduler(HostTick, NULL, 1)))
+   {
+      /* Does not return.                                               */
+      BTPS_ExecuteScheduler();
+
+      ret_val = 0;
+   }
+   else
+   {
+      printf("SPPLEHost: unable to start (%d)\n", errno);
+
+      ret_val = 1;
+   }
+
+   return(ret_val);
+}
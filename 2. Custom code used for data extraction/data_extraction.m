@@ -24,7 +24,20 @@ FrameRate=5;% UpdatedFrame/sec
 global NextFrameRate;
 NextFrameRate=0.001;% NewPage/sec                 
 global SamplingFrequency;
-SamplingFrequency=8000;% Samples/sec
+SamplingFrequency=8000;% Samples/sec (replaced by the rate in the frame info records)
+global SnippetPre;
+SnippetPre=8;% Samples before the trigger sample (firmware Snippet_Pre)
+global SnippetPost;
+SnippetPost=15;% Samples after the trigger sample (firmware Snippet_Post)
+SnippetLength=SnippetPre+1+SnippetPost;% Samples/packet
+PacketWords=3+SnippetLength;% 6-byte header + samples, in 16-bit words
+global LfpDecimation;
+LfpDecimation=16;% Samples/LFP sample (firmware LFP_DECIMATION, 500 Hz)
+global LfpChannelMax;
+LfpChannelMax=4;% LFP channels per telemetry record (firmware LFP_CHANNEL_MAX)
+global OffsetUnit;
+OffsetUnit=2/3125000;% sec per intra-tick offset unit (firmware BT_OFFSET_UNIT, SMCLK/8)
+LogTableFile='../1. Custom code applied in the wireless communication module/Samples/SPPLEDemo/SPPLELog.h';% Message table of the binary log
 global Timelap;
 Timelap=Xsize/2; %sec                        
 global StartFrom;
@@ -47,53 +60,125 @@ uint32 Current_time=0; % Current time
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 
-%Data separation by packet size
-%Packet length = 200 bytes (100 data x 2 byte resolution)
+%Data separation by record
+%Every record starts with a 6-byte header (3 words)
+%   Byte0 = Ch info (bit 0-3), time LSB0-3 (bit 4-7)
+%   Byte1 = time LSB4-11
+%   Byte2 = time LSB12-19
+%   Byte3 = time LSB20-25 (bit 0-5), record class (bit 6-7)
+%   Byte4 = pre-trigger sample count (index of the trigger sample)
+%   Byte5 = intra-tick offset of the trigger sample (OffsetUnit)
+%   The trigger sample was taken at time + offset, and sample k of the
+%   snippet (k = 0 first) at (k - pre) sampling periods from there.
+%Record class 0 : raw snippet, SnippetLength words
+%Record class 1 : delta coded snippet
+%                 first sample (1 word), 4-bit width per group of
+%                 DeltaGroup deltas, zigzag deltas packed MSB first,
+%                 padded to an even number of bytes
+%Record class 2 : LFP stream, SnippetLength decimated samples of one
+%                 channel, time = first sample (LfpDecimation apart)
+%Record class 3 : control, Byte4 = type, Byte5 = record length, body
+%                 type 1 = frame info (first record of every frame)
+%                   sequence number (1 word), mask of channels with
+%                   new drops (1 word), sampling rate in Hz (1 word),
+%                   Snippet_Pre and Snippet_Post (1 byte each), running
+%                   drop count per channel in the mask (1 word each)
+%                   The snippet length and the rate of the following
+%                   records come from the last frame info.
+%                 type 2 = trigger of a closed loop rule (after the frame
+%                   info), time = tick of the trigger, rule and output
+%                   (1 byte each), running trigger count of the rule
+%                   (1 word)
+%                 type 3 = echo of a probe (see latency_probe.m), time =
+%                   tick the probe was received, probe token (2 words)
+%                 type 4 = telemetry (about once per second, in a frame
+%                   of frame info and type 2/3 records only), pool
+%                   packets and high-water mark (1 byte each), timer ISR
+%                   overruns (1 word, running), longest timer ISR in
+%                   OffsetUnit/2 (1 word), heap used, free and largest
+%                   free block (1 word each), events lost (1 word,
+%                   running), crossings per channel in the period
+%                   (1 word each), mask of the LFP channels (1 word),
+%                   dropped LFP packets per LFP channel (1 word each,
+%                   running, LfpChannelMax in channel order)
+%                 type 5 = binary log (last record of a frame of frame
+%                   info and type 2/3/4 records), log entries lost
+%                   (1 word), log entries : message ID * 4 + number of
+%                   arguments (1 word), tick of the message (2 words),
+%                   arguments (2 words each). The message IDs are the
+%                   positions in the message table (LogTableFile).
+%                 type 6 = heap allocation trace (after the log record),
+%                   entries lost (1 word), entries : operation and tag
+%                   (1 byte each), size and offset (1 word each), saved
+%                   to heap_trace.mat for heap_trace_replay.m
+%                 type 7 = HCI tap (after the heap trace record), packets
+%                   dropped by the tap, spike frames sent and their
+%                   bytes (not tapped, 2 words each, running), packets :
+%                   included length, btsnoop flags (1 byte each),
+%                   original length, tick count in ms (2 words each),
+%                   included bytes, padded to an even length, saved to
+%                   hci_tap.mat for hci_tap_btsnoop.m
+%                 Frames of frame info and type 2/3/4/5/6/7 records only
+%                 are sent when no snippets are waiting.
 fscanfData = fscanf(fid, '%d', [1 inf]);
 Ch08 = fscanfData(1,:);
 
 %Close file
 fclose(fid);
 
-%Used for initializing first iteration of data compilation loop below
-%Creates a temporary data related to a packet information
-if Ch08(1)>=0
-    Header1=Ch08(1);
-else
-    Header1=Ch08(1)+65536; 
-end
-if Ch08(2)>=0
-    Header2=Ch08(2);
-else
-    Header2=Ch08(2)+65536;
-end
-Header1_1=(Header1-mod(Header1,256))/256;
-Header1_2=mod(Header1,256);
-Header2_1=(Header2-mod(Header2,256))/256;
-Header2_2=mod(Header2,256);
-%Summary
-%Header1_1 = LSB0-3, Ch info
-%Header1_2 = LSB4-11
-%Header2_1 = LSB12-19
-%Header2_2 = LSB20-27
-Ch_No=mod(Header1_1,16)+1; %Channel information
-if(CHANNEL>2)
-    if(Ch_No<=CHANNEL)
-        Ch_No=mod((Ch_No+CHANNEL-3),CHANNEL)+1;
+%Byte stream (MSB first)
+Ch08(Ch08<0) = Ch08(Ch08<0)+65536;
+Bytes = zeros(1, 2*length(Ch08));
+Bytes(1:2:end) = floor(Ch08/256);
+Bytes(2:2:end) = mod(Ch08,256);
+data_size = length(Bytes);
+
+DeltaGroup = 4;% Deltas per width nibble (firmware BT_DELTA_GROUP)
+DeltaGroups = ceil((SnippetLength-1)/DeltaGroup);
+DeltaCount = [DeltaGroup*ones(1,DeltaGroups-1), SnippetLength-1-DeltaGroup*(DeltaGroups-1)];
+
+%Find the start and the snippet length of every record
+Rec_pos = zeros(1, floor(data_size/8));
+Rec_snippet = zeros(1, floor(data_size/8));
+Snippet_max = SnippetLength;
+Rec_no = 0;
+pos = 1;
+while pos+3 <= data_size
+    Rec_class = floor(Bytes(pos+3)/64);
+    if Rec_class == 3
+        if pos+5 > data_size
+            break;
+        end
+        Rec_len = max(Bytes(pos+5), 6);
+        if (Bytes(pos+4) == 1) && (Rec_len >= 14) && (pos+13 <= data_size)
+            SnippetLength = Bytes(pos+12)+1+Bytes(pos+13);
+            Snippet_max = max(Snippet_max, SnippetLength);
+            DeltaGroups = ceil((SnippetLength-1)/DeltaGroup);
+            DeltaCount = [DeltaGroup*ones(1,DeltaGroups-1), SnippetLength-1-DeltaGroup*(DeltaGroups-1)];
+        end
+    elseif Rec_class ~= 1
+        Rec_len = 6 + 2*SnippetLength;
+    else
+        if pos+7+ceil(DeltaGroups/2) > data_size
+            break;
+        end
+        Width = zeros(1, DeltaGroups);
+        Width(1:2:end) = floor(Bytes(pos+8+floor((0:2:DeltaGroups-1)/2))/16);
+        Width(2:2:end) = mod(Bytes(pos+8+floor((1:2:DeltaGroups-1)/2)),16);
+        Rec_len = 8 + ceil(DeltaGroups/2) + ceil(sum(Width.*DeltaCount)/8);
+        Rec_len = Rec_len + mod(Rec_len,2);
     end
+    if pos+Rec_len-1 > data_size
+        break;
+    end
+    Rec_no = Rec_no+1;
+    Rec_pos(Rec_no) = pos;
+    Rec_snippet(Rec_no) = SnippetLength;
+    pos = pos+Rec_len;
 end
-Start_time = (Header1_1-mod(Header1_1,16))/16;
-Start_time = Start_time + 16*Header1_2;
-Start_time = Start_time + (2^12)*Header2_1;
-Start_time = Start_time + (2^20)*Header2_2;
-Current_time=Start_time; %Time information
-data_size = size(Ch08,2);
-Temp_time=zeros(1,48/2);
-Temp_data=zeros(1,48/2);
-for i=0:48/2-1
-    Temp_time(i+1)=i./SamplingFrequency;
-    Temp_data(i+1)=Ch08(i+3).*0.195./1000;
-end
+Rec_pos = Rec_pos(1:Rec_no);
+Rec_snippet = Rec_snippet(1:Rec_no);
+SnippetLength = 0;
 
 hold off
 
@@ -103,9 +188,52 @@ Before_time=0;
 Inter_time=zeros(1,8000);
 Packets=0;
 Past_spike=1;
+Time_wrap=0;
+Last_time=0;
+Time_base=0;% sec at Tick_base (the rate can change during the stream)
+Tick_base=0;
+lfp_time = cell(1, CHANNEL);
+lfp_data = cell(1, CHANNEL);
+
+% Frame info : [time, sequence number, lost frames, dropped spikes per channel]
+frame_info = zeros(Rec_no, 3+CHANNEL);
+Info_no = 0;
+Last_seq = 0;
+Lost_frames = 0;
+Drop_count = zeros(1, CHANNEL);
+Drop_total = zeros(1, CHANNEL);
+
+% Closed loop triggers : [time, rule, output, trigger count of the rule]
+trigger_info = zeros(Rec_no, 4);
+Trigger_no = 0;
+
+% Telemetry : [time, pool packets, pool high-water mark, ISR overruns,
+% longest ISR [us], heap used, heap free, largest free block, events lost,
+% crossings per channel, dropped LFP packets per channel (running)]
+telemetry_info = zeros(Rec_no, 9+2*CHANNEL);
+Telemetry_no = 0;
+
+% Binary log : [time, message ID, number of arguments, arguments (3)]
+log_info = zeros(0, 6);
+Log_no = 0;
+Log_lost = 0;
+
+% Heap allocation trace : [operation, tag, size, offset]
+heap_trace = zeros(0, 4);
+Heap_trace_no = 0;
+Heap_trace_lost = 0;
+
+% HCI tap : [tick [ms], btsnoop flags, original length, packets dropped
+% before it (running)] and the included bytes of every packet
+hci_tap_info = zeros(0, 4);
+hci_tap_data = {};
+% HCI tap : spike frames sent and their bytes (running, not tapped)
+hci_tap_spikes = [0 0];
+Hci_tap_no = 0;
 
 % Pre-allocates arrays for faster processing
-wf_pre = zeros((data_size/(52/2)-1), 24);
+% (shorter snippets are padded with NaN)
+wf_pre = zeros(Rec_no, Snippet_max);
 
 ch1_time_point = wf_pre; ch1_data_point = wf_pre;
 ch2_time_point = wf_pre; ch2_data_point = wf_pre;
@@ -129,104 +257,265 @@ ch16_data_point = wf_pre; ch16_time_point = wf_pre;
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 % Compiles time and voltage data into pre-allocated arrays
-for i=1:(data_size/(52/2)-1)
-
+for i=1:Rec_no
+    
+    pos = Rec_pos(i);
+    if Rec_snippet(i) ~= SnippetLength
+        SnippetLength = Rec_snippet(i);
+        DeltaGroups = ceil((SnippetLength-1)/DeltaGroup);
+        DeltaCount = [DeltaGroup*ones(1,DeltaGroups-1), SnippetLength-1-DeltaGroup*(DeltaGroups-1)];
+        Snippet = zeros(1, SnippetLength);
+        Pad = nan(1, Snippet_max-SnippetLength);
+    end
+    Header1_1=Bytes(pos);
+    Header1_2=Bytes(pos+1);
+    Header2_1=Bytes(pos+2);
+    Header2_2=Bytes(pos+3);
+    
+    % Determines current channel
+        Ch_No=mod(Header1_1,16)+1;
+        
+    if(CHANNEL>2)
+        if(Ch_No<=CHANNEL)
+            Ch_No=mod((Ch_No+CHANNEL-3),CHANNEL)+1;
+        end
+    end
+    
+    % 26-bit time, unwrapped
+    Current_time = (Header1_1-mod(Header1_1,16))/16 + 16*Header1_2 + (2^12)*Header2_1 + (2^20)*mod(Header2_2,64) + Time_wrap;
+    if Current_time < Last_time - 2^25
+        Time_wrap = Time_wrap + 2^26;
+        Current_time = Current_time + 2^26;
+    end
+    if i == 1
+        Start_time = Current_time;
+        Last_time = Current_time;
+        Tick_base = Current_time;
+    end
+    
+    % New sampling rate : later ticks count at the new rate
+    if (floor(Header2_2/64) == 3) && (Bytes(pos+4) == 1) && (Bytes(pos+5) >= 14)
+        Rate = Bytes(pos+10)*256 + Bytes(pos+11);
+        if (Rate > 0) && (Rate ~= SamplingFrequency)
+            Time_base = Time_base + (Last_time-Tick_base)/SamplingFrequency;
+            Tick_base = Last_time;
+            SamplingFrequency = Rate;
+        end
+    end
+    Last_time = Current_time;
+    Rec_sec = Time_base + (Current_time-Tick_base)/SamplingFrequency;
+    Temp_time = ((0:SnippetLength-1) - Bytes(pos+4))./SamplingFrequency + Bytes(pos+5)*OffsetUnit;
+    
+    % Control records
+    if floor(Header2_2/64) == 3
+        if Bytes(pos+4) == 1
+            % Frame info : sequence number and running drop counts
+            Info_no = Info_no+1;
+            Seq = Bytes(pos+6)*256 + Bytes(pos+7);
+            if Info_no > 1
+                Lost_frames = Lost_frames + mod(Seq-Last_seq-1, 65536);
+            end
+            Last_seq = Seq;
+            Mask = Bytes(pos+8)*256 + Bytes(pos+9);
+            q = pos+14;
+            for k=0:15
+                if bitand(Mask, 2^k)
+                    Ch_drop = k+1;
+                    if(CHANNEL>2)
+                        if(Ch_drop<=CHANNEL)
+                            Ch_drop=mod((Ch_drop+CHANNEL-3),CHANNEL)+1;
+                        end
+                    end
+                    Drop_total(Ch_drop) = Drop_total(Ch_drop) + mod(Bytes(q)*256 + Bytes(q+1) - Drop_count(Ch_drop), 65536);
+                    Drop_count(Ch_drop) = Bytes(q)*256 + Bytes(q+1);
+                    q = q+2;
+                end
+            end
+            frame_info(Info_no, :) = [Rec_sec, Seq, Lost_frames, Drop_total];
+        elseif Bytes(pos+4) == 2
+            % Trigger : rule, output and running trigger count
+            Trigger_no = Trigger_no+1;
+            trigger_info(Trigger_no, :) = [Rec_sec, Bytes(pos+6), Bytes(pos+7), Bytes(pos+8)*256 + Bytes(pos+9)];
+        elseif (Bytes(pos+4) == 4) && (Bytes(pos+5) >= 20+2*CHANNEL)
+            % Telemetry : words from Byte8, crossings in firmware channel order
+            Words = Bytes(pos+8:2:pos+19+2*CHANNEL)*256 + Bytes(pos+9:2:pos+20+2*CHANNEL);
+            Crossing = zeros(1, CHANNEL);
+            for k=1:CHANNEL
+                Ch_tm = k;
+                if(CHANNEL>2)
+                    Ch_tm = mod((Ch_tm+CHANNEL-3),CHANNEL)+1;
+                end
+                Crossing(Ch_tm) = Words(6+k);
+            end
+            % LFP drops : one word per channel of the LFP mask, in
+            % firmware channel order
+            Lfp_drop = zeros(1, CHANNEL);
+            if Bytes(pos+5) >= 22+2*CHANNEL+2*LfpChannelMax
+                q = pos+20+2*CHANNEL;
+                Lfp_mask = Bytes(q)*256 + Bytes(q+1);
+                q = q+2;
+                for k=1:CHANNEL
+                    if bitand(Lfp_mask, 2^(k-1)) && (q < pos+22+2*CHANNEL+2*LfpChannelMax)
+                        Ch_tm = k;
+                        if(CHANNEL>2)
+                            Ch_tm = mod((Ch_tm+CHANNEL-3),CHANNEL)+1;
+                        end
+                        Lfp_drop(Ch_tm) = Bytes(q)*256 + Bytes(q+1);
+                        q = q+2;
+                    end
+                end
+            end
+            Telemetry_no = Telemetry_no+1;
+            telemetry_info(Telemetry_no, :) = [Rec_sec, Bytes(pos+6), Bytes(pos+7), Words(1), Words(2)*OffsetUnit/2*1e6, Words(3:6), Crossing, Lfp_drop];
+        elseif (Bytes(pos+4) == 5) && (Bytes(pos+5) >= 8)
+            % Log : entries lost and log entries (32-bit values, MSB first)
+            Log_lost = Log_lost + Bytes(pos+6)*256 + Bytes(pos+7);
+            q = pos+8;
+            while q+5 <= pos+Bytes(pos+5)-1
+                Arg_no = mod(Bytes(q+1), 4);
+                Arg = zeros(1, 3);
+                for k=1:Arg_no
+                    Arg(k) = Bytes(q+2+4*k:q+5+4*k)*[2^24; 2^16; 2^8; 1];
+                end
+                % The message was written this many ticks before the record
+                Age = mod(mod(Current_time, 2^26) - mod(Bytes(q+2:q+5)*[2^24; 2^16; 2^8; 1], 2^26), 2^26);
+                Log_no = Log_no+1;
+                log_info(Log_no, :) = [Rec_sec - Age/SamplingFrequency, floor((Bytes(q)*256 + Bytes(q+1))/4), Arg_no, Arg];
+                q = q+6+4*Arg_no;
+            end
+        elseif (Bytes(pos+4) == 6) && (Bytes(pos+5) >= 8)
+            % Heap trace : entries lost and 6-byte entries
+            Heap_trace_lost = Heap_trace_lost + Bytes(pos+6)*256 + Bytes(pos+7);
+            for q = pos+8:6:pos+Bytes(pos+5)-6
+                Heap_trace_no = Heap_trace_no+1;
+                heap_trace(Heap_trace_no, :) = [Bytes(q), Bytes(q+1), Bytes(q+2)*256 + Bytes(q+3), Bytes(q+4)*256 + Bytes(q+5)];
+            end
+        elseif (Bytes(pos+4) == 7) && (Bytes(pos+5) >= 18)
+            % HCI tap : packets dropped, spike frames and their bytes,
+            % packets (10-byte header)
+            Hci_tap_drops = Bytes(pos+6:pos+9)*[2^24; 2^16; 2^8; 1];
+            hci_tap_spikes = [Bytes(pos+10:pos+13)*[2^24; 2^16; 2^8; 1], Bytes(pos+14:pos+17)*[2^24; 2^16; 2^8; 1]];
+            q = pos+18;
+            while q+9 <= pos+Bytes(pos+5)-1
+                Included = Bytes(q);
+                Hci_tap_no = Hci_tap_no+1;
+                hci_tap_info(Hci_tap_no, :) = [Bytes(q+6:q+9)*[2^24; 2^16; 2^8; 1], Bytes(q+1), Bytes(q+2:q+5)*[2^24; 2^16; 2^8; 1], Hci_tap_drops];
+                hci_tap_data{Hci_tap_no} = Bytes(q+10:q+9+Included);
+                q = q+10+Included;
+            end
+        end
+        continue;
+    end
+    
+    % Snippet samples
+    if floor(Header2_2/64) ~= 1
+        Snippet = Bytes(pos+6:2:pos+5+2*SnippetLength)*256 + Bytes(pos+7:2:pos+6+2*SnippetLength);
+        Snippet(Snippet>=32768) = Snippet(Snippet>=32768)-65536;
+    else
+        Snippet(1) = Bytes(pos+6)*256 + Bytes(pos+7);
+        if Snippet(1) >= 32768
+            Snippet(1) = Snippet(1)-65536;
+        end
+        Width = zeros(1, DeltaGroups);
+        Width(1:2:end) = floor(Bytes(pos+8+floor((0:2:DeltaGroups-1)/2))/16);
+        Width(2:2:end) = mod(Bytes(pos+8+floor((1:2:DeltaGroups-1)/2)),16);
+        q = pos+8+ceil(DeltaGroups/2);
+        Bits = dec2bin(Bytes(q:q+ceil(sum(Width.*DeltaCount)/8)-1),8)';
+        Bits = Bits(:)'-'0';
+        bp = 1;
+        for k=2:SnippetLength
+            w = Width(ceil((k-1)/DeltaGroup));
+            z = sum(Bits(bp:bp+w-1).*2.^(w-1:-1:0));
+            bp = bp+w;
+            if mod(z,2)==1
+                Snippet(k) = Snippet(k-1) - (z+1)/2;
+            else
+                Snippet(k) = Snippet(k-1) + z/2;
+            end
+        end
+    end
+    
+    % LFP stream is kept apart from the spikes
+    if floor(Header2_2/64) == 2
+        lfp_time{Ch_No} = [lfp_time{Ch_No}, Rec_sec + (0:SnippetLength-1).*LfpDecimation/SamplingFrequency];
+        lfp_data{Ch_No} = [lfp_data{Ch_No}, Snippet.*0.195./1000];
+        continue;
+    end
+    
     if ( (Ch_No == 1 ) )
-        ch1_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch1_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch1_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch1_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 2 ) )
-        ch2_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch2_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch2_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch2_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 3 ) )
-        ch3_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch3_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch3_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch3_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 4 ) )
-        ch4_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch4_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch4_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch4_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 5 ) )
-        ch5_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch5_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch5_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch5_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 6 ) )
-        ch6_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch6_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch6_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch6_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 7 ) )
-        ch7_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch7_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch7_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch7_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 8 ) )
-        ch8_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch8_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch8_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch8_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     
     if ( (Ch_No == 9 ) )
-        ch9_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch9_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch9_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch9_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 10 ) )
-        ch10_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch10_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch10_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch10_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 11 ) )
-        ch11_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch11_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch11_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch11_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 12 ) )
-        ch12_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch12_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch12_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch12_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 13 ) )
-        ch13_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch13_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch13_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch13_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 14 ) )
-        ch14_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch14_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch14_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch14_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 15 ) )
-        ch15_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch15_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
+        ch15_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch15_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
     if ( (Ch_No == 16 ) )
-        ch16_time_point(i, :) = Temp_time + (Current_time-Start_time)/SamplingFrequency;
-        ch16_data_point(i, :) = Ch08( 3+i*52/2 : 3+i*52/2+23 ).*0.195./1000;   
-    end
-    
-    % Determines current channel
-        Ch_No=mod(Header1_1,16)+1;
-        
-    if(CHANNEL>2)
-        if(Ch_No<=CHANNEL)
-            Ch_No=mod((Ch_No+CHANNEL-3),CHANNEL)+1;
-        end
+        ch16_time_point(i, :) = [Temp_time + Rec_sec, Pad];
+        ch16_data_point(i, :) = [Snippet.*0.195./1000, Pad];
     end
-    
-    if Ch08(1+i*52/2)>=0
-        Header1=Ch08(1+i*52/2);
-    else
-        Header1=Ch08(1+i*52/2)+65536;
-    end
-    if Ch08(2+i*52/2)>=0
-        Header2=Ch08(2+i*52/2);
-    else
-        Header2=Ch08(2+i*52/2)+65536;
-    end
-    Header1_1=(Header1-mod(Header1,256))/256;
-    Header1_2=mod(Header1,256);
-    Header2_1=(Header2-mod(Header2,256))/256;
-    Header2_2=mod(Header2,256);
-    Current_time = (Header1_1-mod(Header1_1,16))/16 + 16*Header1_2 + (2^12)*Header2_1 + (2^20)*Header2_2;
 end
 
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 % Raster Plotting                              %
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
+% Snippet rows are Snippet_max samples long from here on
+SnippetLength = Snippet_max;
+
 % Assigns time data to a cell array for simplicity
 time = {ch1_time_point, ch2_time_point, ch3_time_point, ch4_time_point ...
     ch5_time_point, ch6_time_point, ch7_time_point, ch8_time_point ...
@@ -240,6 +529,32 @@ data = {ch1_data_point, ch2_data_point, ch3_data_point, ch4_data_point ...
 
 save('time_points.mat', 'time');
 save('data_points.mat', 'data');
+save('lfp_points.mat', 'lfp_time', 'lfp_data');
+frame_info = frame_info(1:Info_no, :);
+save('frame_info.mat', 'frame_info');
+trigger_info = trigger_info(1:Trigger_no, :);
+save('trigger_info.mat', 'trigger_info');
+telemetry_info = telemetry_info(1:Telemetry_no, :);
+save('telemetry_info.mat', 'telemetry_info');
+save('log_info.mat', 'log_info', 'Log_lost');
+save('heap_trace.mat', 'heap_trace', 'Heap_trace_lost');
+save('hci_tap.mat', 'hci_tap_info', 'hci_tap_data', 'hci_tap_spikes');
+
+% Print the binary log with the formats of the message table
+if Log_no > 0
+    LogTable = regexp(fileread(LogTableFile), 'LOG_MESSAGE\((\w+),\s*"([^"]*)"\)', 'tokens');
+    for k=1:Log_no
+        if (log_info(k, 2) >= 1) && (log_info(k, 2) <= length(LogTable))
+            LogText = sprintf(LogTable{log_info(k, 2)}{2}, log_info(k, 4:3+log_info(k, 3)));
+        else
+            LogText = ['Unknown message ' num2str(log_info(k, 2)) ' ' num2str(log_info(k, 4:3+log_info(k, 3)))];
+        end
+        fprintf('%10.4f  %s\n', log_info(k, 1), LogText);
+    end
+end
+if Log_lost > 0
+    disp(['Log entries lost: ' num2str(Log_lost)]);
+end
 
 xMax = max(max(time{1}));
 for i = 2:length(time)
@@ -277,11 +592,11 @@ for i = 1:length(time)
     Temp_time = time{i};
     Temp_data = data{i};
     ind = find(Temp_time(:, 1) > 0); 
-    x = zeros(1, length(ind).*24);
-    y = zeros(1, length(ind).*24);
+    x = zeros(1, length(ind).*SnippetLength);
+    y = zeros(1, length(ind).*SnippetLength);
     for i2 = 1:length(ind)
-        x( (24*i2 - 23):(24*i2) ) = Temp_time(ind(i2), :);
-        y( (24*i2 - 23):(24*i2) ) = Temp_data(ind(i2), :); 
+        x( (SnippetLength*(i2-1)+1):(SnippetLength*i2) ) = Temp_time(ind(i2), :);
+        y( (SnippetLength*(i2-1)+1):(SnippetLength*i2) ) = Temp_data(ind(i2), :); 
     end
     data2.x = x;
     data2.y = y;
@@ -293,6 +608,69 @@ disp('Saved time and voltage data for channels');
 
 title('Raster Plot');
 
+% Plots the LFP stream, one trace per channel
+if any(~cellfun(@isempty, lfp_time))
+    figure(5); cla reset; hold on
+    for i = 1:CHANNEL
+        if ~isempty(lfp_time{i})
+            plot(lfp_time{i}, lfp_data{i} + i*(Ymax-Ymin));
+        end
+    end
+    hold off
+    xlim([0, xMax]);
+    title('LFP');
+    disp('Plotted LFP stream');
+end
+
+% Link report : lost frames and spikes dropped for lack of buffer space
+if Info_no > 0
+    disp(['Frames: ' num2str(Info_no) ', lost frames: ' num2str(Lost_frames)]);
+    for i = 1:CHANNEL
+        Sent = sum(time{i}(:, 1) > 0);
+        if Sent + Drop_total(i) > 0
+            disp(['Ch ' num2str(i) ' dropped spikes: ' num2str(Drop_total(i)) ...
+                ' (' num2str(100*Drop_total(i)/(Sent + Drop_total(i))) ' %)']);
+        end
+    end
+    
+    % Dropped spikes per second over time (link saturation)
+    figure(6); cla reset;
+    Drop_rate = diff(sum(frame_info(:, 4:end), 2)) ./ max(diff(frame_info(:, 1)), 1/SamplingFrequency);
+    subplot(2,1,1); plot(frame_info(:, 1), frame_info(:, 4:end));
+    ylabel('Dropped spikes'); title('Link saturation');
+    subplot(2,1,2); plot(frame_info(2:end, 1), Drop_rate);
+    ylabel('Dropped spikes/s'); xlabel('Time [sec]');
+end
+
+% Device health over time (telemetry)
+if Telemetry_no > 0
+    figure(7); cla reset;
+    subplot(4,1,1); plot(telemetry_info(:, 1), telemetry_info(:, 2:3));
+    ylabel('Packets'); legend('Pool', 'High-water mark'); title('Device health');
+    subplot(4,1,2); plot(telemetry_info(:, 1), telemetry_info(:, 5));
+    ylabel('Longest ISR [us]');
+    subplot(4,1,3); plot(telemetry_info(:, 1), telemetry_info(:, [4 9]));
+    ylabel('Count'); legend('ISR overruns', 'Events lost');
+    subplot(4,1,4); plot(telemetry_info(:, 1), telemetry_info(:, 6:8));
+    ylabel('Heap [Bytes]'); legend('Used', 'Free', 'Largest free'); xlabel('Time [sec]');
+    disp(['Telemetry records: ' num2str(Telemetry_no) ', ISR overruns: ' num2str(telemetry_info(end, 4)) ...
+        ', longest ISR: ' num2str(max(telemetry_info(:, 5))) ' us, pool high-water mark: ' ...
+        num2str(max(telemetry_info(:, 3))) '/' num2str(telemetry_info(end, 2))]);
+    for i=1:CHANNEL
+        if telemetry_info(end, 9+CHANNEL+i) > 0
+            disp(['Ch ' num2str(i) ' dropped LFP packets: ' num2str(telemetry_info(end, 9+CHANNEL+i))]);
+        end
+    end
+end
+
+% Closed loop report : triggers per rule (records lost when the rule
+% fired more often than frames were sent show as gaps in the count)
+for r = unique(trigger_info(:, 2))'
+    Fired = trigger_info(trigger_info(:, 2) == r, :);
+    disp(['Rule ' num2str(r) ' (output ' num2str(Fired(end, 3)) ') triggers: ' num2str(size(Fired, 1)) ...
+        ', fired: ' num2str(Fired(end, 4)) ', first at ' num2str(Fired(1, 1)) ' sec']);
+end
+
 toc
 
 
@@ -327,9 +705,9 @@ for j = 1
     Temp_data = data2.y;
     
     hold on
-    for i = 0:24:length(Temp_time)-24
-        x = Temp_time( (i+1):(i+24) );
-        y = Temp_data( (i+1):(i+24) );
+    for i = 0:SnippetLength:length(Temp_time)-SnippetLength
+        x = Temp_time( (i+1):(i+SnippetLength) );
+        y = Temp_data( (i+1):(i+SnippetLength) );
         plot(x, y, 'b');
     end
     
@@ -344,9 +722,9 @@ disp('Plotted');
 
 f3 = figure(3); cla reset;
 hold on
-for i = 0:24:length(Temp_time)-24
-    x = Temp_time( (i+1):(i+24) ) - Temp_time(i+1);
-    y = Temp_data( (i+1):(i+24) );
+for i = 0:SnippetLength:length(Temp_time)-SnippetLength
+    x = Temp_time( (i+1):(i+SnippetLength) ) - Temp_time(i+1);
+    y = Temp_data( (i+1):(i+SnippetLength) );
     if max(max(abs(y))) < 2
         plot(x, y, 'b');
     end
@@ -388,7 +766,8 @@ for j = j
         y = temp_data( ind(i), : );
 
         % For fourier transform
-        fs = 8000;
+        fs = SamplingFrequency;
+        y = y(~isnan(y));
         N = length(y);
         X_mags = abs(fft(y));
         bin_vals = 0:N-1;
@@ -410,11 +789,11 @@ for j = j
     
     scatter(temp_time(spikeInds), j.*ones(1, length(spikeInds)), '.');
     
-    f_x = zeros(1, length(spikeInds).*24);
+    f_x = zeros(1, length(spikeInds).*SnippetLength);
     f_y = f_x;
     for i = 1:length(spikeInds)
-        f_x( (24*i)-23:(24*i) ) = temp_time(spikeInds(i), :);
-        f_y( (24*i)-23:(24*i) ) = temp_data(spikeInds(i), :);
+        f_x( (SnippetLength*(i-1)+1):(SnippetLength*i) ) = temp_time(spikeInds(i), :);
+        f_y( (SnippetLength*(i-1)+1):(SnippetLength*i) ) = temp_data(spikeInds(i), :);
     end
     
     % Saves channel time and data under variable: dataFourier %
@@ -453,8 +832,8 @@ for j = j
     x = dataFourier.x;
     y = dataFourier.y;
     
-   for i = 0:24:length(x)-24      
-       plot(x(i+1:i+24), y(i+1:i+24), 'r'); 
+   for i = 0:SnippetLength:length(x)-SnippetLength      
+       plot(x(i+1:i+SnippetLength), y(i+1:i+SnippetLength), 'r'); 
     end
     
 end
@@ -467,8 +846,8 @@ for j = j
     x = dataFourier.x;
     y = dataFourier.y;
     
-    for i = 0:24:length(x)-24
-       plot(x(i+1:i+24) - x(i+1), y(i+1:i+24), 'r'); 
+    for i = 0:SnippetLength:length(x)-SnippetLength
+       plot(x(i+1:i+SnippetLength) - x(i+1), y(i+1:i+SnippetLength), 'r'); 
     end
     
 end
@@ -0,0 +1,67 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% HCI tap to btsnoop
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+% Writes the HCI traffic that the firmware captured with the HCI tap
+% (transport built with HCITR_TAP_BUFFER_SIZE > 0, sent in the HCI tap
+% records of the data stream and saved to hci_tap.mat by
+% data_extraction.m) to a btsnoop file that Wireshark opens (File > Open,
+% data link H4). The timestamps count the tick counts of the packets (ms)
+% from midnight, January 1st, 2000, and the cumulative drops field of a
+% record counts the packets that the tap dropped (ring full) before it.
+% A packet longer than HCITR_TAP_SNAP_LENGTH bytes, or longer than the
+% room left in its record, is kept in part, which Wireshark shows as a
+% truncated packet. The spike frames are not tapped (they would push the
+% setup and control traffic out of the ring), only counted.
+%
+% TapFile is the hci_tap.mat of data_extraction.m.
+
+% BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB %
+
+clear
+clc
+
+TapFile='hci_tap.mat';% HCI tap packets (data_extraction.m)
+OutFile='hci_tap.btsnoop';% btsnoop capture
+
+TickRate=1000;% Tick counts per second (BTPS_GetTickCount)
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Read the packets                             %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+load(TapFile, 'hci_tap_info', 'hci_tap_data', 'hci_tap_spikes');
+
+% btsnoop timestamps are microseconds since midnight, January 1st, 0 AD
+% (uint64, beyond the integers a double keeps exactly)
+TimeBase = bitshift(uint64(hex2dec('00E03AB4')), 32) + uint64(hex2dec('4A676000'));
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Write the capture                            %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+fid = fopen(OutFile, 'w');
+% btsnoop file header : identification, version 1, data link 1002 (H4)
+fwrite(fid, ['btsnoop' 0], 'uint8');
+fwrite(fid, [1 1002], 'uint32', 0, 'ieee-be');
+
+Packets = size(hci_tap_info, 1);
+Drops = 0;
+for i = 1:Packets
+    Data = hci_tap_data{i};
+    Timestamp = TimeBase + uint64(hci_tap_info(i, 1))*uint64(1e6/TickRate);
+    % Original and included length, flags, cumulative drops, timestamp
+    fwrite(fid, [hci_tap_info(i, 3) length(Data) hci_tap_info(i, 2) hci_tap_info(i, 4)], 'uint32', 0, 'ieee-be');
+    fwrite(fid, double([bitshift(Timestamp, -32) bitand(Timestamp, uint64(4294967295))]), 'uint32', 0, 'ieee-be');
+    fwrite(fid, Data, 'uint8');
+    Drops = hci_tap_info(i, 4);
+end
+fclose(fid);
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Report                                       %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+disp(['Packets: ' num2str(Packets) ', dropped by the tap: ' num2str(Drops)]);
+disp(['Spike frames (not tapped): ' num2str(hci_tap_spikes(1)) ', bytes: ' num2str(hci_tap_spikes(2))]);
+disp(['Written to ' OutFile]);
@@ -0,0 +1,243 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Heap trace replay
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+% Replays the heap allocation trace of the firmware (kernel built with
+% BTPS_MEMORY_TRACE_SIZE > 0, sent in heap trace records of the data stream
+% and saved by data_extraction.m to heap_trace.mat) on a model of the
+% kernel heap, and
+% searches the smallest BTPS_MEMORY_BUFFER_SIZE with which every request
+% of the trace is served. Whether a trace fits is not monotonic in the heap
+% size (the fragments are laid out differently), so the result is the
+% smallest size from which the next CheckNo sizes (Step bytes apart) fit
+% as well. The footprint (live fragments, headers included, without any
+% fragmentation) is a lower bound.
+% The model follows the kernel allocator : 2-byte alignment units, 2-unit
+% fragment header, 4-unit minimum fragment, free lists by size class (the
+% lowest-addressed fragment of the class of the request that is large
+% enough, else of the next class that has any; the highest-addressed one for
+% requests of LARGE_SIZE or more), requests of LARGE_SIZE or more from the
+% end of the fragment, neighbours merged on free.
+% The fixed-block pool operations are not replayed (the pool memory itself
+% is the first heap allocation of the trace). A failed request is replayed
+% as a request that is freed right away.
+%
+% TraceFile is the heap_trace.mat of the recording. The trace must hold
+% the allocations from the reset of the firmware until the stream starts
+% (BTPS_MEMORY_TRACE_SIZE large enough) and must not have lost entries :
+% otherwise the result is a lower bound.
+% The trace is also written to ExportFile as text, for the allocator
+% benchmark of the kernel (btpskrnl/posix/HEAPBNCH.c, which compares the
+% failures and the speed of the size classes with the first-fit walk).
+
+% BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB %
+
+clear
+clc
+
+TraceFile='heap_trace.mat';% Saved by data_extraction.m
+TraceBufferSize=9600;% BTPS_MEMORY_BUFFER_SIZE of the traced firmware
+Step=16;% bytes between the heap sizes tried
+CheckNo=8;% larger sizes that must fit too (the fit is not monotonic)
+ExportFile='heap_trace.txt';% trace for HEAPBNCH ('' : not written)
+
+HeaderUnits=2;% HEAP_INFO_DATA_SIZE(0)
+MinimumUnits=4;% MINIMUM_FRAGMENT_SIZE (and FREE_INFO_SIZE)
+LargeUnits=128;% LARGE_SIZE
+ClassNo=15;% HEAP_CLASS_NO
+% Free list (size class) of a fragment of u units (see HeapClass)
+HeapClass = @(u) (u < 32)*(floor(u/4)+1) + ...
+    (u >= 32)*min(ClassNo, 9 + (u >= 64)*(floor(log2(max(floor(u/64), 1)))+1));
+
+Op_allocate=1;% BTPS_MEMORY_TRACE_OPERATION_ALLOCATE
+Op_free=2;% BTPS_MEMORY_TRACE_OPERATION_FREE
+Op_failure=5;% BTPS_MEMORY_TRACE_OPERATION_FAILURE
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Read the trace                               %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+load(TraceFile, 'heap_trace', 'Heap_trace_lost');
+trace = heap_trace;% [Operation, Tag, Size, Offset]
+Lost = Heap_trace_lost;
+trace = trace(ismember(trace(:, 1), [Op_allocate, Op_free, Op_failure]), :);
+
+disp(['Trace entries: ' num2str(size(trace, 1)) ', lost: ' num2str(Lost)]);
+if ~isempty(ExportFile)
+    fid = fopen(ExportFile, 'w');
+    fprintf(fid, '%d %d %d %d\n', trace');
+    fclose(fid);
+end
+if Lost > 0
+    disp('Warning: entries were lost, the result is a lower bound');
+end
+
+% Live requested bytes per tag (peak) and footprint of the live
+% fragments (alignment units, peak)
+Tags = unique(trace(:, 2))';
+LiveUnits = 0;
+Footprint = 0;
+ObjUnits = zeros(1, 65536);
+Live = zeros(1, 256);
+Peak = zeros(1, 256);
+ObjSize = zeros(1, 65536);
+ObjTag = zeros(1, 65536);
+for i = 1:size(trace, 1)
+    Off = trace(i, 4)+1;
+    u = max(ceil(trace(i, 3)/2) + HeaderUnits, MinimumUnits);
+    if trace(i, 1) == Op_failure
+        Footprint = max(Footprint, LiveUnits+u);
+    elseif trace(i, 1) == Op_allocate
+        ObjUnits(Off) = u;
+        LiveUnits = LiveUnits + u;
+        Footprint = max(Footprint, LiveUnits);
+        ObjSize(Off) = trace(i, 3);
+        ObjTag(Off) = trace(i, 2)+1;
+        Live(ObjTag(Off)) = Live(ObjTag(Off)) + ObjSize(Off);
+        Peak(ObjTag(Off)) = max(Peak(ObjTag(Off)), Live(ObjTag(Off)));
+    elseif (trace(i, 1) == Op_free) && (ObjTag(Off) > 0)
+        LiveUnits = LiveUnits - ObjUnits(Off);
+        Live(ObjTag(Off)) = Live(ObjTag(Off)) - ObjSize(Off);
+        ObjTag(Off) = 0;
+    end
+end
+for t = Tags
+    disp(['Tag ' num2str(t) ' peak live: ' num2str(Peak(t+1)) ' bytes']);
+end
+Footprint = 2*Footprint;
+disp(['Footprint: ' num2str(Footprint) ' bytes']);
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Search the smallest heap                     %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+% Sizes from the footprint up, Step bytes apart : Size is the candidate,
+% Fit_no the larger sizes that fitted after it.
+Size = Step*ceil(Footprint/Step);
+Fit_no = 0;
+while (Fit_no <= CheckNo) && (Size+Fit_no*Step <= 2*(32767-1))
+    %---- Replay the trace with a heap of Size+Fit_no*Step bytes ----%
+    Units = (Size+Fit_no*Step)/2+1;% sizeof(MemoryBuffer) in alignment units
+    FragSize = zeros(1, Units);% fragment size (units) at its start
+    FragPrev = zeros(1, Units);% start of the previous fragment
+    FragUsed = false(1, Units);
+    Lists = cell(1, ClassNo);% free fragment starts, head first
+    FragSize(1) = Units;
+    Lists{HeapClass(Units)} = 1;
+    Obj = zeros(1, 65536);% trace offset -> model fragment start
+    Fit = true;
+
+    for i = 1:size(trace, 1)
+        Op = trace(i, 1);
+        if Op == Op_free
+            a = Obj(trace(i, 4)+1);
+            Obj(trace(i, 4)+1) = 0;
+            if a == 0
+                continue;% allocated before the trace started
+            end
+        else
+            %---- Allocate ----%
+            u = ceil(trace(i, 3)/2) + HeaderUnits;
+            u = max(u, MinimumUnits);
+            c = HeapClass(u);
+            Fits = Lists{c}(FragSize(Lists{c}) >= u);
+            if isempty(Fits)
+                k = find(~cellfun(@isempty, Lists(c+1:end)), 1);
+                if ~isempty(k)
+                    Fits = Lists{c+k};
+                end
+            end
+            s = 0;
+            if ~isempty(Fits)
+                if u >= LargeUnits
+                    s = max(Fits);
+                else
+                    s = min(Fits);
+                end
+            end
+            if s == 0
+                Fit = false;
+                break;
+            end
+            % Remove from its list
+            fs = FragSize(s);
+            c = HeapClass(fs);
+            Lists{c}(Lists{c} == s) = [];
+            % Split
+            if fs >= u + MinimumUnits
+                if u >= LargeUnits
+                    a = s+fs-u; f = s; fsz = fs-u;
+                    FragPrev(a) = s;
+                    n = a+u;
+                else
+                    a = s; f = s+u; fsz = fs-u;
+                    FragPrev(f) = s;
+                    n = f+fsz;
+                end
+                FragSize(a) = u;
+                FragSize(f) = fsz;
+                if n <= Units
+                    FragPrev(n) = max(a, f);% the later of the two
+                end
+                c = HeapClass(fsz);
+                Lists{c} = [f, Lists{c}];
+            else
+                a = s;
+            end
+            FragUsed(a) = true;
+            if Op == Op_allocate
+                Obj(trace(i, 4)+1) = a;
+                continue;
+            end
+            % A failed request is freed right away
+        end
+
+        %---- Free fragment a, merge with the neighbours ----%
+        FragUsed(a) = false;
+        if a ~= 1
+            p = FragPrev(a);
+            if ~FragUsed(p)
+                fs = FragSize(p);
+                c = HeapClass(fs);
+                Lists{c}(Lists{c} == p) = [];
+                FragSize(p) = FragSize(p) + FragSize(a);
+                a = p;
+            end
+        end
+        n = a+FragSize(a);
+        if n <= Units
+            if ~FragUsed(n)
+                fs = FragSize(n);
+                c = HeapClass(fs);
+                Lists{c}(Lists{c} == n) = [];
+                FragSize(a) = FragSize(a) + fs;
+                n = a+FragSize(a);
+            end
+            if n <= Units
+                FragPrev(n) = a;
+            end
+        end
+        fs = FragSize(a);
+        c = HeapClass(fs);
+        Lists{c} = [a, Lists{c}];
+    end
+    %---- End of the replay ----%
+
+    if Fit
+        Fit_no = Fit_no+1;
+    else
+        Size = Size+(Fit_no+1)*Step;
+        Fit_no = 0;
+    end
+end
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Report                                       %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+if Fit_no <= CheckNo
+    disp('The trace does not fit the largest heap');
+else
+    disp(['Smallest BTPS_MEMORY_BUFFER_SIZE: ' num2str(Size) ' bytes (traced firmware: ' ...
+        num2str(TraceBufferSize) ' bytes)']);
+end
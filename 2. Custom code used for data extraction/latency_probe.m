@@ -0,0 +1,218 @@
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Latency probe
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+% Sends echo probes (firmware BT_CMD_ECHO) to the wireless system while it
+% streams, and measures from the record stream
+%   - probe round trip : probe sent -> echo record received
+%   - device residence : command received -> frame sent (echo record tick
+%                        -> frame info tick of its frame)
+%   - command path     : (round trip - residence)/2, host -> firmware
+%                        command handler (rules and outputs act from there)
+%   - spike path       : trigger sample of a snippet -> record received,
+%                        with the device clock mapped to the host clock by
+%                        the last probe
+% The distributions (p50/p99/max) are reported overall and per spike load
+% (spikes/s received around each probe).
+%
+% Port is the serial port of the SPP link (e.g. 'COM5'), or the pseudo
+% terminal of the host stand-in Samples/SPPLEDemo/posix/SPPLEHost.c (e.g.
+% '/dev/pts/3'), which streams synthetic spikes and answers the probes by
+% the frame rules of the firmware (no acquisition, so the residence and
+% the spike path do not include it).
+% Close the recording software first : the port carries the stream.
+% Keep the sampling rate fixed while probing : ticks are mapped to seconds
+% at the rate of the last frame info.
+
+% BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB %
+
+clear
+clc
+
+Port='COM5';% SPP serial port or pseudo terminal
+BaudRate=115200;
+ProbeNo=500;% Probes to send
+ProbePeriod=0.1;% sec between probes
+Settle=1;% sec to wait for the last echoes
+LoadBins=4;% Spike load classes in the report
+
+SnippetLength=24;% replaced by the frame info records
+SamplingFrequency=8000;% replaced by the frame info records
+DeltaGroup=4;% Deltas per width nibble (firmware BT_DELTA_GROUP)
+
+Sync=165;% BT_CMD_SYNC (0xA5)
+Echo_opcode=4;% BT_CMD_ECHO
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Open Port, Pre-Allocation and Initialization %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+s = serial(Port, 'BaudRate', BaudRate, 'InputBufferSize', 262144);
+fopen(s);
+
+Probe_sent = nan(1, ProbeNo);% host time [sec]
+% Echo : [probe, round trip, residence, command path, host time] [sec]
+echo_info = nan(ProbeNo, 5);
+Echo_no = 0;
+% Spike : [host time received, spike path latency] [sec]
+spike_info = zeros(100000, 2);
+Spike_no = 0;
+
+Rx = zeros(1, 0);
+pos = 1;
+Time_wrap = 0;
+Last_tick = 0;
+Frame_tick = 0;
+Offset = nan;% host time - device time [sec]
+Probe_no = 0;
+Next_probe = 0;
+
+DeltaGroups = ceil((SnippetLength-1)/DeltaGroup);
+DeltaCount = [DeltaGroup*ones(1,DeltaGroups-1), SnippetLength-1-DeltaGroup*(DeltaGroups-1)];
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Send probes and read the stream              %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+Start = tic;
+while (Probe_no < ProbeNo) || (toc(Start) < Next_probe + Settle)
+
+    % Probe : BT_CMD_SYNC, opcode, 4-byte token (probe number)
+    if (Probe_no < ProbeNo) && (toc(Start) >= Next_probe)
+        Token = [floor(Probe_no/2^24), mod(floor(Probe_no/2^16),256), mod(floor(Probe_no/256),256), mod(Probe_no,256)];
+        fwrite(s, [Sync, Echo_opcode, 4, Token], 'uint8');
+        Probe_no = Probe_no+1;
+        Probe_sent(Probe_no) = toc(Start);
+        Next_probe = Next_probe + ProbePeriod;
+    end
+
+    n = s.BytesAvailable;
+    if n == 0
+        pause(0.001);
+        continue;
+    end
+    Rx = [Rx(pos:end), fread(s, n, 'uint8')'];
+    Rx_time = toc(Start);
+    pos = 1;
+
+    % Records (see data_extraction.m)
+    while pos+5 <= length(Rx)
+        Rec_class = floor(Rx(pos+3)/64);
+        if Rec_class == 3
+            Rec_len = max(Rx(pos+5), 6);
+        elseif Rec_class ~= 1
+            Rec_len = 6 + 2*SnippetLength;
+        else
+            if pos+7+ceil(DeltaGroups/2) > length(Rx)
+                break;
+            end
+            Width = zeros(1, DeltaGroups);
+            Width(1:2:end) = floor(Rx(pos+8+floor((0:2:DeltaGroups-1)/2))/16);
+            Width(2:2:end) = mod(Rx(pos+8+floor((1:2:DeltaGroups-1)/2)),16);
+            Rec_len = 8 + ceil(DeltaGroups/2) + ceil(sum(Width.*DeltaCount)/8);
+            Rec_len = Rec_len + mod(Rec_len,2);
+        end
+        if pos+Rec_len-1 > length(Rx)
+            break;
+        end
+
+        % 26-bit tick, unwrapped
+        Tick = floor(Rx(pos)/16) + 16*Rx(pos+1) + (2^12)*Rx(pos+2) + (2^20)*mod(Rx(pos+3),64) + Time_wrap;
+        if Tick < Last_tick - 2^25
+            Time_wrap = Time_wrap + 2^26;
+            Tick = Tick + 2^26;
+        end
+        Last_tick = Tick;
+
+        if Rec_class == 3
+            if (Rx(pos+4) == 1) && (Rec_len >= 14)
+                % Frame info : tick the frame was sent, rate and window
+                Frame_tick = Tick;
+                Rate = Rx(pos+10)*256 + Rx(pos+11);
+                if Rate > 0
+                    SamplingFrequency = Rate;
+                end
+                SnippetLength = Rx(pos+12)+1+Rx(pos+13);
+                DeltaGroups = ceil((SnippetLength-1)/DeltaGroup);
+                DeltaCount = [DeltaGroup*ones(1,DeltaGroups-1), SnippetLength-1-DeltaGroup*(DeltaGroups-1)];
+            elseif (Rx(pos+4) == 3) && (Rec_len >= 10)
+                % Echo : tick the probe was received
+                Id = ((Rx(pos+6)*256 + Rx(pos+7))*256 + Rx(pos+8))*256 + Rx(pos+9);
+                if (Id < ProbeNo) && ~isnan(Probe_sent(Id+1))
+                    Round_trip = Rx_time - Probe_sent(Id+1);
+                    Residence = (Frame_tick - Tick)/SamplingFrequency;
+                    Command_path = (Round_trip - Residence)/2;
+                    Offset = Probe_sent(Id+1) + Command_path - Tick/SamplingFrequency;
+                    Echo_no = Echo_no+1;
+                    echo_info(Echo_no, :) = [Id, Round_trip, Residence, Command_path, Rx_time];
+                end
+            end
+        elseif (Rec_class ~= 2) && ~isnan(Offset) && (Spike_no < size(spike_info, 1))
+            % Snippet : trigger sample time on the host clock
+            Spike_time = Tick/SamplingFrequency + Offset;
+            Spike_no = Spike_no+1;
+            spike_info(Spike_no, :) = [Rx_time, Rx_time - Spike_time];
+        end
+
+        pos = pos+Rec_len;
+    end
+end
+
+fclose(s);
+delete(s);
+
+echo_info = echo_info(1:Echo_no, :);
+spike_info = spike_info(1:Spike_no, :);
+save('latency_info.mat', 'echo_info', 'spike_info');
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% Report                                       %
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+disp(['Probes: ' num2str(Probe_no) ', echoes: ' num2str(Echo_no) ...
+    ' (lost ' num2str(Probe_no-Echo_no) '), spikes: ' num2str(Spike_no)]);
+
+Names = {'Round trip', 'Residence', 'Command path'};
+for k = 1:3
+    v = sort(echo_info(:, k+1));
+    if ~isempty(v)
+        disp([Names{k} ' [ms] p50: ' num2str(1000*v(ceil(0.5*end))) ...
+            ', p99: ' num2str(1000*v(ceil(0.99*end))) ', max: ' num2str(1000*v(end))]);
+    end
+end
+v = sort(spike_info(:, 2));
+if ~isempty(v)
+    disp(['Spike path [ms] p50: ' num2str(1000*v(ceil(0.5*end))) ...
+        ', p99: ' num2str(1000*v(ceil(0.99*end))) ', max: ' num2str(1000*v(end))]);
+end
+
+% Spike load around every echo (spikes/s received within +-ProbePeriod/2)
+Load = zeros(Echo_no, 1);
+for i = 1:Echo_no
+    Load(i) = sum(abs(spike_info(:, 1) - echo_info(i, 5)) <= ProbePeriod/2)/ProbePeriod;
+end
+
+if Echo_no >= LoadBins
+    Edges = sort(Load);
+    Edges = unique([-inf; Edges(ceil((1:LoadBins-1)'/LoadBins*Echo_no)); inf]);
+    for b = 1:length(Edges)-1
+        In = (Load > Edges(b)) & (Load <= Edges(b+1));
+        if ~any(In)
+            continue;
+        end
+        v = sort(echo_info(In, 2));
+        disp(['Load ' num2str(min(Load(In))) '~' num2str(max(Load(In))) ' spikes/s, ' num2str(sum(In)) ...
+            ' probes, round trip [ms] p50: ' num2str(1000*v(ceil(0.5*end))) ...
+            ', p99: ' num2str(1000*v(ceil(0.99*end))) ', max: ' num2str(1000*v(end))]);
+    end
+end
+
+figure(1); cla reset;
+subplot(2,1,1); histogram(1000*echo_info(:, 2), 50);
+xlabel('Round trip [ms]'); ylabel('Probes'); title('Command path');
+subplot(2,1,2); histogram(1000*spike_info(:, 2), 50);
+xlabel('Spike to host [ms]'); ylabel('Spikes'); title('Spike path');
+
+figure(2); cla reset;
+plot(Load, 1000*echo_info(:, 2), '.');
+xlabel('Spike load [spikes/s]'); ylabel('Round trip [ms]');